@@ -24,6 +24,15 @@
 #include <string.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <sys/time.h>
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #include <twolame.h>
 #include <sndfile.h>
@@ -42,6 +51,40 @@ int stdin_input = FALSE;        /* we're going to read from stdin */
 char inputfilename[MAX_NAME_SIZE] = "\0";
 char outputfilename[MAX_NAME_SIZE] = "\0";
 
+int num_jobs = 0;               // threads encoding a batch of files, 0 for a single file
+char listfilename[MAX_NAME_SIZE] = "\0";
+char **batch_files = NULL;      // input files of a batch
+int num_batch_files = 0;
+
+
+/*
+  An encoder option from the command line, set again on
+  the encoder of each file of a batch
+*/
+typedef struct {
+    int ch;
+    char *arg;
+} encoder_option;
+
+encoder_option *encoder_options = NULL;
+int num_encoder_options = 0;
+
+
+/*
+  A file of a batch and the outcome of its encoding
+*/
+typedef struct {
+    char *inputfilename;
+    char outputfilename[MAX_NAME_SIZE];
+    double seconds;             // duration of the encoded audio
+    int result;
+} batch_file;
+
+#ifdef HAVE_PTHREAD_H
+/* libsndfile keeps the error of a failed sf_open() in a global, which
+   sf_strerror(NULL) reads, so the files of a batch are opened one at a time */
+static pthread_mutex_t sndfile_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 
 
@@ -152,6 +195,7 @@ static void usage_long()
     fprintf(stderr, "Usage: \n");
 
     fprintf(stderr, "\ttwolame [options] <infile> [outfile]\n");
+    fprintf(stderr, "\ttwolame [options] --jobs num <infile> [<infile>...]\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "Both input and output filenames can be set to - to use stdin/stdout.\n");
     fprintf(stderr, "  <infile>       input sound file (any format supported by libsndfile)\n");
@@ -198,6 +242,10 @@ static void usage_long()
     fprintf(stderr, "\t-e, --deemphasis emp     de-emphasis n/5/c (default: (n)one)\n");
     fprintf(stderr, "\t-E, --energy             turn on energy level extensions\n");
 
+    fprintf(stderr, "\nBatch Options\n");
+    fprintf(stderr, "\t-j, --jobs num           encode each input file to <infile>.mp2, num at a time\n");
+    fprintf(stderr, "\t    --file-list file     also encode the files listed in file, one per line\n");
+
     fprintf(stderr, "\nVerbosity Options\n");
     fprintf(stderr, "\t-t, --talkativity num    talkativity 0-10 (default is 2)\n");
     fprintf(stderr, "\t    --quiet              same as --talkativity=0\n");
@@ -261,6 +309,226 @@ static char *build_shortopt_string(char *shortstr, struct option *opts)
 
 
 
+/*
+  set_encoder_option()
+  Set an option from the command line on the encoder
+
+  Returns FALSE if it isn't an encoder option
+*/
+static int set_encoder_option(twolame_options * encopts, int ch, const char *optarg)
+{
+    switch (ch) {
+
+    // Input
+    case 's':
+        twolame_set_out_samplerate(encopts, atoi(optarg));
+        break;
+
+    case 1001:             // --scale
+        twolame_set_scale(encopts, atof(optarg));
+        break;
+
+    case 1002:             // --scale-l
+        twolame_set_scale_left(encopts, atof(optarg));
+        break;
+
+    case 1003:             // --scale-r
+        twolame_set_scale_right(encopts, atof(optarg));
+        break;
+
+
+
+    // Output
+    case 'm':
+        if (*optarg == 's') {
+            twolame_set_mode(encopts, TWOLAME_STEREO);
+        } else if (*optarg == 'd') {
+            twolame_set_mode(encopts, TWOLAME_DUAL_CHANNEL);
+        } else if (*optarg == 'j') {
+            twolame_set_mode(encopts, TWOLAME_JOINT_STEREO);
+        } else if (*optarg == 'm') {
+            twolame_set_mode(encopts, TWOLAME_MONO);
+        } else if (*optarg == 'a') {
+            twolame_set_mode(encopts, TWOLAME_AUTO_MODE);
+        } else {
+            fprintf(stderr, "Error: mode must be a/s/d/j/m not '%s'\n\n", optarg);
+            usage_long();
+        }
+        break;
+
+    case 'a':              // downmix
+        twolame_set_mode(encopts, TWOLAME_MONO);
+        break;
+
+    case 'b':
+        twolame_set_bitrate(encopts, atoi(optarg));
+        break;
+
+    case 'P':
+        twolame_set_psymodel(encopts, atoi(optarg));
+        break;
+
+    case 'v':
+        twolame_set_VBR(encopts, TRUE);
+        break;
+
+    case 'V':
+        twolame_set_VBR(encopts, TRUE);
+        twolame_set_VBR_level(encopts, atof(optarg));
+        break;
+
+    case 'B':
+        twolame_set_VBR_max_bitrate_kbps(encopts, atoi(optarg));
+        break;
+
+    case 'l':
+        twolame_set_ATH_level(encopts, atof(optarg));
+        break;
+
+    case 'q':
+        twolame_set_quick_mode(encopts, TRUE);
+        twolame_set_quick_count(encopts, atoi(optarg));
+        break;
+
+    case 1009:
+        twolame_set_freeformat(encopts, TRUE);
+        break;
+
+    // Miscellaneous
+    case 'c':
+        twolame_set_copyright(encopts, TRUE);
+        break;
+    case 1004:              // --non-copyright
+        twolame_set_copyright(encopts, FALSE);
+        break;
+    case 'o':              // --non-original
+        twolame_set_original(encopts, FALSE);
+        break;
+    case 1005:             // --original
+        twolame_set_original(encopts, TRUE);
+        break;
+    case 1011:             // --private-ext
+        twolame_set_extension(encopts, TRUE);
+        break;
+    case 'p':
+        twolame_set_error_protection(encopts, TRUE);
+        break;
+    case 'd':
+        twolame_set_padding(encopts, TWOLAME_PAD_ALL);
+        break;
+    case 'R':
+        twolame_set_num_ancillary_bits(encopts, atoi(optarg));
+        break;
+    case 'e':
+        if (*optarg == 'n')
+            twolame_set_emphasis(encopts, TWOLAME_EMPHASIS_N);
+        else if (*optarg == '5')
+            twolame_set_emphasis(encopts, TWOLAME_EMPHASIS_5);
+        else if (*optarg == 'c')
+            twolame_set_emphasis(encopts, TWOLAME_EMPHASIS_C);
+        else {
+            fprintf(stderr, "Error: emphasis must be n/5/c not '%s'\n\n", optarg);
+            usage_long();
+        }
+        break;
+    case 'E':
+        twolame_set_energy_levels(encopts, TRUE);
+        break;
+
+
+    // Verbosity
+    case 't':
+        twolame_set_verbosity(encopts, atoi(optarg));
+        break;
+
+    case 1006:             // --quiet
+        twolame_set_verbosity(encopts, 0);
+        break;
+
+    case 1007:             // --brief
+        twolame_set_verbosity(encopts, 1);
+        break;
+
+    case 1008:             // --verbose
+        twolame_set_verbosity(encopts, 4);
+        break;
+
+    default:
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/*
+  add_encoder_option()
+  Set an option from the command line on the encoder, and keep it
+  for the encoders of a batch
+*/
+static void add_encoder_option(twolame_options * encopts, int ch, char *optarg)
+{
+    encoder_option *options;
+
+    if (!set_encoder_option(encopts, ch, optarg))
+        usage_short();
+
+    options = (encoder_option *) realloc(encoder_options,
+                                         (num_encoder_options + 1) * sizeof(encoder_option));
+    if (options == NULL) {
+        fprintf(stderr, "Error: parse_args failed memory allocation\n");
+        exit(ERR_MEM_ALLOC);
+    }
+    options[num_encoder_options].ch = ch;
+    options[num_encoder_options].arg = optarg;
+    encoder_options = options;
+    num_encoder_options++;
+}
+
+
+/*
+  add_batch_file()
+  Add an input file to the batch
+*/
+static void add_batch_file(const char *filename)
+{
+    char **files = (char **) realloc(batch_files, (num_batch_files + 1) * sizeof(char *));
+
+    if (files == NULL || (files[num_batch_files] = strdup(filename)) == NULL) {
+        fprintf(stderr, "Error: batch file memory allocation failed\n");
+        exit(ERR_MEM_ALLOC);
+    }
+    batch_files = files;
+    num_batch_files++;
+}
+
+
+/*
+  read_file_list()
+  Add the files listed in a file, one per line, to the batch
+*/
+static void read_file_list(const char *filename)
+{
+    char line[MAX_NAME_SIZE];
+    FILE *file = fopen(filename, "r");
+
+    if (file == NULL) {
+        perror("Failed to open file list");
+        exit(ERR_OPENING_INPUT);
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        // Strip the end of line
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0')
+            add_batch_file(line);
+    }
+
+    fclose(file);
+}
+
+
+
 /*
   parse_args()
   Parse the command line arguments
@@ -312,6 +580,10 @@ static void parse_args(int argc, char **argv, twolame_options * encopts)
         {"deemphasis", required_argument, NULL, 'e'},
         {"energy", no_argument, NULL, 'E'},
 
+        // Batch
+        {"jobs", required_argument, NULL, 'j'},
+        {"file-list", required_argument, NULL, 1012},
+
         // Verbosity
         {"talkativity", required_argument, NULL, 't'},
         {"quiet", no_argument, NULL, 1006},
@@ -359,8 +631,8 @@ static void parse_args(int argc, char **argv, twolame_options * encopts)
             break;
 
         case 's':
-            twolame_set_out_samplerate(encopts, atoi(optarg));
             sfinfo.samplerate = atoi(optarg);
+            add_encoder_option(encopts, ch, optarg);
             break;
 
         case 1000:             // --samplesize
@@ -375,145 +647,36 @@ static void parse_args(int argc, char **argv, twolame_options * encopts)
             channelswap = TRUE;
             break;
 
-        case 1001:             // --scale
-            twolame_set_scale(encopts, atof(optarg));
-            break;
-
-        case 1002:             // --scale-l
-            twolame_set_scale_left(encopts, atof(optarg));
-            break;
-
-        case 1003:             // --scale-r
-            twolame_set_scale_right(encopts, atof(optarg));
-            break;
-
 
 
         // Output
-        case 'm':
-            if (*optarg == 's') {
-                twolame_set_mode(encopts, TWOLAME_STEREO);
-            } else if (*optarg == 'd') {
-                twolame_set_mode(encopts, TWOLAME_DUAL_CHANNEL);
-            } else if (*optarg == 'j') {
-                twolame_set_mode(encopts, TWOLAME_JOINT_STEREO);
-            } else if (*optarg == 'm') {
-                twolame_set_mode(encopts, TWOLAME_MONO);
-            } else if (*optarg == 'a') {
-                twolame_set_mode(encopts, TWOLAME_AUTO_MODE);
-            } else {
-                fprintf(stderr, "Error: mode must be a/s/d/j/m not '%s'\n\n", optarg);
-                usage_long();
-            }
-            break;
-
-        case 'a':              // downmix
-            twolame_set_mode(encopts, TWOLAME_MONO);
-            break;
-
-        case 'b':
-            twolame_set_bitrate(encopts, atoi(optarg));
-            break;
-
-        case 'P':
-            twolame_set_psymodel(encopts, atoi(optarg));
-            break;
-
-        case 'v':
-            twolame_set_VBR(encopts, TRUE);
-            break;
-
-        case 'V':
-            twolame_set_VBR(encopts, TRUE);
-            twolame_set_VBR_level(encopts, atof(optarg));
-            break;
-
-        case 'B':
-            twolame_set_VBR_max_bitrate_kbps(encopts, atoi(optarg));
-            break;
-
-        case 'l':
-            twolame_set_ATH_level(encopts, atof(optarg));
-            break;
-
-        case 'q':
-            twolame_set_quick_mode(encopts, TRUE);
-            twolame_set_quick_count(encopts, atoi(optarg));
-            break;
-
         case 'S':
             single_frame_mode = TRUE;
             break;
 
-        case 1009:
-            twolame_set_freeformat(encopts, TRUE);
-            break;
 
-        // Miscellaneous
-        case 'c':
-            twolame_set_copyright(encopts, TRUE);
-            break;
-        case 1004:              // --non-copyright
-            twolame_set_copyright(encopts, FALSE);
-            break;
-        case 'o':              // --non-original
-            twolame_set_original(encopts, FALSE);
-            break;
-        case 1005:             // --original
-            twolame_set_original(encopts, TRUE);
-            break;
-        case 1011:             // --private-ext
-            twolame_set_extension(encopts, TRUE);
-            break;
-        case 'p':
-            twolame_set_error_protection(encopts, TRUE);
-            break;
-        case 'd':
-            twolame_set_padding(encopts, TWOLAME_PAD_ALL);
-            break;
-        case 'R':
-            twolame_set_num_ancillary_bits(encopts, atoi(optarg));
-            break;
-        case 'e':
-            if (*optarg == 'n')
-                twolame_set_emphasis(encopts, TWOLAME_EMPHASIS_N);
-            else if (*optarg == '5')
-                twolame_set_emphasis(encopts, TWOLAME_EMPHASIS_5);
-            else if (*optarg == 'c')
-                twolame_set_emphasis(encopts, TWOLAME_EMPHASIS_C);
-            else {
-                fprintf(stderr, "Error: emphasis must be n/5/c not '%s'\n\n", optarg);
+
+        // Batch
+        case 'j':
+            num_jobs = atoi(optarg);
+            if (num_jobs < 1) {
+                fprintf(stderr, "Error: number of jobs must be at least 1 not '%s'\n\n", optarg);
                 usage_long();
             }
             break;
-        case 'E':
-            twolame_set_energy_levels(encopts, TRUE);
-            break;
-
-
-        // Verbosity
-        case 't':
-            twolame_set_verbosity(encopts, atoi(optarg));
-            break;
 
-        case 1006:             // --quiet
-            twolame_set_verbosity(encopts, 0);
+        case 1012:             // --file-list
+            strncpy(listfilename, optarg, MAX_NAME_SIZE-1);
             break;
 
-        case 1007:             // --brief
-            twolame_set_verbosity(encopts, 1);
-            break;
 
-        case 1008:             // --verbose
-            twolame_set_verbosity(encopts, 4);
-            break;
 
         case 'h':
             usage_long();
             break;
 
         default:
-            usage_short();
+            add_encoder_option(encopts, ch, optarg);
             break;
         }
     }
@@ -524,7 +687,9 @@ static void parse_args(int argc, char **argv, twolame_options * encopts)
     argc -= optind;
     argv += optind;
     while (argc) {
-        if (inputfilename[0] == '\0')
+        if (num_jobs > 0 || listfilename[0] != '\0')
+            add_batch_file(*argv);
+        else if (inputfilename[0] == '\0')
             strncpy(inputfilename, *argv, MAX_NAME_SIZE-1);
         else if (outputfilename[0] == '\0')
             strncpy(outputfilename, *argv, MAX_NAME_SIZE-1);
@@ -577,6 +742,28 @@ static void parse_args(int argc, char **argv, twolame_options * encopts)
         }
     }
 
+    // Encoding a batch of files ?
+    if (num_jobs > 0 || listfilename[0] != '\0') {
+        int i;
+
+        if (listfilename[0] != '\0')
+            read_file_list(listfilename);
+        if (num_jobs == 0)
+            num_jobs = 1;
+
+        if (num_batch_files == 0) {
+            fprintf(stderr, "Missing input filename.\n");
+            usage_short();
+        }
+        for (i = 0; i < num_batch_files; i++) {
+            if (strcmp(batch_files[i], "-") == 0) {
+                fprintf(stderr, "Error: can't read from STDIN when encoding a batch of files.\n");
+                usage_short();
+            }
+        }
+        return;
+    }
+
     // Check that we now have input and output file names ok
     if (inputfilename[0] == '\0') {
         fprintf(stderr, "Missing input filename.\n");
@@ -701,76 +888,36 @@ static void print_info_sndfile(SNDFILE *file, SF_INFO *sfinfo, unsigned int tota
 
 
 
-int main(int argc, char **argv)
+/*
+  encode_stream()
+  Read, encode and write out the audio of an input file
+
+  Returns ERR_NO_ERROR or the error code after reporting the error
+*/
+static int encode_stream(twolame_options * encopts, SNDFILE * inputfile, FILE * outputfile,
+                         int channels, unsigned int total_frames, int show_progress,
+                         unsigned int *total_samples, unsigned int *total_bytes)
 {
-    twolame_options *encopts = NULL;
-    SNDFILE *inputfile = NULL;
-    FILE *outputfile = NULL;
     short int *pcmaudio = NULL;
-    unsigned int frame_count = 0;
-    unsigned int total_samples = 0;
-    unsigned int total_frames = 0;
-    unsigned int total_bytes = 0;
     unsigned char *mp2buffer = NULL;
+    unsigned int frame_count = 0;
     int samples_read = 0;
     int mp2fill_size = 0;
     int audioReadSize = 0;
-    char filesize[20];
-
-
-    // Initialise Encoder Options Structure
-    encopts = twolame_init();
-    if (encopts == NULL) {
-        fprintf(stderr, "Error: initializing libtwolame encoder failed.\n");
-        exit(ERR_MEM_ALLOC);
-    }
-    // Get options and parameters from the command line
-    parse_args(argc, argv, encopts);
-
-    // Display the filenames
-    print_filenames(twolame_get_verbosity(encopts));
-
-    // Open the input file
-    inputfile = open_input_sndfile(inputfilename, &sfinfo);
-
-    // Calculate the size and number of frames we are going to encode
-    if (sfinfo.frames && !stdin_input)
-        total_frames = (sfinfo.frames -1) / TWOLAME_SAMPLES_PER_FRAME +1;
-    else
-        total_frames = 0;
-
-    // Display input information
-    if (twolame_get_verbosity(encopts) > 1) {
-        print_info_sndfile(inputfile, &sfinfo, total_frames);
-    }
-
-    // Use information from input file to configure libtwolame
-    twolame_set_num_channels(encopts, sfinfo.channels);
-    twolame_set_in_samplerate(encopts, sfinfo.samplerate);
-
-    // initialise twolame with this set of options
-    if (twolame_init_params(encopts) != 0) {
-        fprintf(stderr, "Error: configuring libtwolame encoder failed.\n");
-        exit(ERR_INVALID_PARAM);
-    }
-    // display encoder settings
-    twolame_print_config(encopts);
-
+    int result = ERR_NO_ERROR;
 
     // Allocate memory for the PCM audio data
     if ((pcmaudio = (short int *) calloc(AUDIO_BUF_SIZE, sizeof(short int))) == NULL) {
         fprintf(stderr, "Error: pcmaudio memory allocation failed\n");
-        exit(ERR_MEM_ALLOC);
+        return ERR_MEM_ALLOC;
     }
     // Allocate memory for the encoded MP2 audio data
     if ((mp2buffer = (unsigned char *) calloc(MP2_BUF_SIZE, sizeof(unsigned char))) == NULL) {
         fprintf(stderr, "Error: mp2buffer memory allocation failed\n");
-        exit(ERR_MEM_ALLOC);
+        free(pcmaudio);
+        return ERR_MEM_ALLOC;
     }
 
-    // Open the output file
-    outputfile = open_output_file(outputfilename);
-
     // Only encode a single frame of mpeg audio ?
     if (single_frame_mode)
         audioReadSize = TWOLAME_SAMPLES_PER_FRAME;
@@ -783,11 +930,11 @@ int main(int argc, char **argv)
         int bytes_out = 0;
 
         // Calculate the number of samples we have (per channel)
-        samples_read /= sfinfo.channels;
-        total_samples += (unsigned int)samples_read;
+        samples_read /= channels;
+        *total_samples += (unsigned int)samples_read;
 
         // Do swapping of left and right channels if requested
-        if (channelswap && sfinfo.channels == 2) {
+        if (channelswap && channels == 2) {
             int i;
             for (i = 0; i < samples_read; i++) {
                 short tmp = pcmaudio[(2 * i)];
@@ -806,7 +953,8 @@ int main(int argc, char **argv)
             break;
         if (mp2fill_size < 0) {
             fprintf(stderr, "error while encoding audio: %d\n", mp2fill_size);
-            exit(ERR_ENCODING);
+            result = ERR_ENCODING;
+            break;
         }
         // Check that a whole number of frame was written
         // if (mp2fill_size % frame_len != 0) {
@@ -818,9 +966,10 @@ int main(int argc, char **argv)
         bytes_out = fwrite(mp2buffer, sizeof(unsigned char), mp2fill_size, outputfile);
         if (bytes_out != mp2fill_size) {
             perror("error while writing to output file");
-            exit(ERR_WRITING_OUTPUT);
+            result = ERR_WRITING_OUTPUT;
+            break;
         }
-        total_bytes += bytes_out;
+        *total_bytes += bytes_out;
 
         // Only single frame ?
         if (single_frame_mode)
@@ -828,8 +977,8 @@ int main(int argc, char **argv)
 
 
         // Display Progress
-        frame_count = total_samples / TWOLAME_SAMPLES_PER_FRAME;
-        if (twolame_get_verbosity(encopts) > 0) {
+        frame_count = *total_samples / TWOLAME_SAMPLES_PER_FRAME;
+        if (show_progress) {
             fprintf(stderr, "\rEncoding frame: %i", frame_count);
             if (total_frames) {
                 fprintf(stderr, "/%i (%i%%)", total_frames, (frame_count * 100) / total_frames);
@@ -848,26 +997,315 @@ int main(int argc, char **argv)
     // should only ever be a max of 1 frame on a flush. There may be zero
     // frames if the audio data was an exact multiple of 1152
     //
-    mp2fill_size = twolame_encode_flush(encopts, mp2buffer, MP2_BUF_SIZE);
+    if (result == ERR_NO_ERROR)
+        mp2fill_size = twolame_encode_flush(encopts, mp2buffer, MP2_BUF_SIZE);
+    else
+        mp2fill_size = 0;
     if (mp2fill_size > 0) {
         int bytes_out = fwrite(mp2buffer, sizeof(unsigned char), mp2fill_size, outputfile);
         frame_count++;
         if (bytes_out <= 0) {
             perror("error while writing to output file");
-            exit(ERR_WRITING_OUTPUT);
+            result = ERR_WRITING_OUTPUT;
         }
         else {
-            if (twolame_get_verbosity(encopts) > 0) {
+            if (show_progress) {
                 fprintf(stderr, "\rEncoding frame: %i", frame_count);
                 if (total_frames) {
                     fprintf(stderr, "/%i (%i%%)", total_frames, (frame_count * 100) / total_frames);
                 }
                 fflush(stderr);
             }
+            *total_bytes += bytes_out;
         }
-        total_bytes += bytes_out;
     }
 
+    // Free up memory
+    free(pcmaudio);
+    free(mp2buffer);
+
+    return result;
+}
+
+
+
+/*
+  encode_batch_file()
+  Encode a file of a batch with an encoder of its own,
+  recording the outcome rather than exiting on errors
+*/
+static void encode_batch_file(batch_file * job)
+{
+    twolame_options *encopts = NULL;
+    SNDFILE *inputfile = NULL;
+    FILE *outputfile = NULL;
+    SF_INFO info = sfinfo;
+    unsigned int total_samples = 0;
+    unsigned int total_bytes = 0;
+    int i;
+
+    new_extension(job->inputfilename, OUTPUT_SUFFIX, job->outputfilename);
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&sndfile_lock);
+#endif
+    inputfile = sf_open(job->inputfilename, SFM_READ, &info);
+    if (inputfile == NULL) {
+        fprintf(stderr, "Failed to open input file (%s):\n", job->inputfilename);
+        fprintf(stderr, "  %s\n", sf_strerror(NULL));
+    }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&sndfile_lock);
+#endif
+    if (inputfile == NULL) {
+        job->result = ERR_OPENING_INPUT;
+        return;
+    }
+    sf_command(inputfile, SFC_SET_SCALE_FLOAT_INT_READ, NULL, SF_TRUE);
+
+    // Configure an encoder with the options of the command line
+    encopts = twolame_init();
+    if (encopts == NULL) {
+        fprintf(stderr, "Error: initializing libtwolame encoder failed.\n");
+        sf_close(inputfile);
+        job->result = ERR_MEM_ALLOC;
+        return;
+    }
+    for (i = 0; i < num_encoder_options; i++)
+        set_encoder_option(encopts, encoder_options[i].ch, encoder_options[i].arg);
+    twolame_set_num_channels(encopts, info.channels);
+    twolame_set_in_samplerate(encopts, info.samplerate);
+
+    if (twolame_init_params(encopts) != 0) {
+        fprintf(stderr, "Error: configuring libtwolame encoder for %s failed.\n",
+                job->inputfilename);
+        job->result = ERR_INVALID_PARAM;
+    } else if ((outputfile = fopen(job->outputfilename, "wb")) == NULL) {
+        fprintf(stderr, "Failed to open output file (%s)\n", job->outputfilename);
+        job->result = ERR_OPENING_OUTPUT;
+    } else {
+        job->result = encode_stream(encopts, inputfile, outputfile, info.channels, 0, FALSE,
+                                    &total_samples, &total_bytes);
+        if (fclose(outputfile) != 0 && job->result == ERR_NO_ERROR) {
+            perror("error while writing to output file");
+            job->result = ERR_WRITING_OUTPUT;
+        }
+        job->seconds = (double) total_samples / info.samplerate;
+
+        if (job->result == ERR_NO_ERROR && twolame_get_verbosity(encopts) > 0)
+            fprintf(stderr, "Encoded %s to %s\n", job->inputfilename, job->outputfilename);
+    }
+
+    sf_close(inputfile);
+    twolame_close(&encopts);
+}
+
+
+/*
+  The files of a batch, taken in turn by the threads encoding them
+*/
+typedef struct {
+    batch_file *files;
+    int num_files;
+    int next_file;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t lock;
+#endif
+} batch_queue;
+
+
+/*
+  next_batch_file()
+  Take the next file of a batch which no thread is encoding yet
+
+  Returns NULL once all the files are taken
+*/
+static batch_file *next_batch_file(batch_queue * queue)
+{
+    batch_file *job = NULL;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&queue->lock);
+#endif
+    if (queue->next_file < queue->num_files)
+        job = &queue->files[queue->next_file++];
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&queue->lock);
+#endif
+
+    return job;
+}
+
+
+static void *encode_batch_files(void *arg)
+{
+    batch_queue *queue = (batch_queue *) arg;
+    batch_file *job;
+
+    while ((job = next_batch_file(queue)) != NULL)
+        encode_batch_file(job);
+
+    return NULL;
+}
+
+
+/*
+  encode_batch()
+  Encode the files of a batch on num_jobs threads, each thread
+  taking the next file as soon as it has finished one, and
+  report how fast the batch was encoded.
+
+  Returns ERR_NO_ERROR or the error code of the first file which failed
+*/
+static int encode_batch(int verbosity)
+{
+    batch_queue queue;
+    struct timeval start, end;
+    double audio_seconds = 0.0, elapsed;
+    int num_encoded = 0;
+    int result = ERR_NO_ERROR;
+    int i;
+
+    queue.files = (batch_file *) calloc(num_batch_files, sizeof(batch_file));
+    if (queue.files == NULL) {
+        fprintf(stderr, "Error: batch memory allocation failed\n");
+        return ERR_MEM_ALLOC;
+    }
+    queue.num_files = num_batch_files;
+    queue.next_file = 0;
+    for (i = 0; i < num_batch_files; i++)
+        queue.files[i].inputfilename = batch_files[i];
+
+    gettimeofday(&start, NULL);
+
+#ifdef HAVE_PTHREAD_H
+    {
+        pthread_t *threads;
+        int *started;
+        int num_threads = (num_jobs < num_batch_files) ? num_jobs : num_batch_files;
+
+        threads = (pthread_t *) calloc(num_threads, sizeof(pthread_t));
+        started = (int *) calloc(num_threads, sizeof(int));
+        pthread_mutex_init(&queue.lock, NULL);
+
+        // The main thread encodes files too
+        for (i = 1; threads != NULL && started != NULL && i < num_threads; i++)
+            started[i] = (pthread_create(&threads[i], NULL, encode_batch_files, &queue) == 0);
+        encode_batch_files(&queue);
+        for (i = 1; threads != NULL && started != NULL && i < num_threads; i++) {
+            if (started[i])
+                pthread_join(threads[i], NULL);
+        }
+
+        pthread_mutex_destroy(&queue.lock);
+        free(threads);
+        free(started);
+    }
+#else
+    encode_batch_files(&queue);
+#endif
+
+    gettimeofday(&end, NULL);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+
+    for (i = 0; i < num_batch_files; i++) {
+        if (queue.files[i].result == ERR_NO_ERROR) {
+            audio_seconds += queue.files[i].seconds;
+            num_encoded++;
+        } else if (result == ERR_NO_ERROR) {
+            result = queue.files[i].result;
+        }
+    }
+
+    if (verbosity > 0) {
+        fprintf(stderr, "Encoded %i of %i files (%1.1fsec of audio) in %1.2fsec",
+                num_encoded, num_batch_files, audio_seconds, elapsed);
+        if (elapsed > 0.0)
+            fprintf(stderr, ": %1.1fx realtime", audio_seconds / elapsed);
+        fprintf(stderr, "\n");
+    }
+
+    free(queue.files);
+    return result;
+}
+
+
+
+int main(int argc, char **argv)
+{
+    twolame_options *encopts = NULL;
+    SNDFILE *inputfile = NULL;
+    FILE *outputfile = NULL;
+    unsigned int total_samples = 0;
+    unsigned int total_frames = 0;
+    unsigned int total_bytes = 0;
+    char filesize[20];
+    int result;
+
+
+    // Initialise Encoder Options Structure
+    encopts = twolame_init();
+    if (encopts == NULL) {
+        fprintf(stderr, "Error: initializing libtwolame encoder failed.\n");
+        exit(ERR_MEM_ALLOC);
+    }
+    // Get options and parameters from the command line
+    parse_args(argc, argv, encopts);
+
+    // Encode a batch of files, each with an encoder of its own
+    if (num_jobs > 0) {
+        int i;
+
+        result = encode_batch(twolame_get_verbosity(encopts));
+
+        twolame_close(&encopts);
+        for (i = 0; i < num_batch_files; i++)
+            free(batch_files[i]);
+        free(batch_files);
+        free(encoder_options);
+
+        return result;
+    }
+
+    // Display the filenames
+    print_filenames(twolame_get_verbosity(encopts));
+
+    // Open the input file
+    inputfile = open_input_sndfile(inputfilename, &sfinfo);
+
+    // Calculate the size and number of frames we are going to encode
+    if (sfinfo.frames && !stdin_input)
+        total_frames = (sfinfo.frames -1) / TWOLAME_SAMPLES_PER_FRAME +1;
+    else
+        total_frames = 0;
+
+    // Display input information
+    if (twolame_get_verbosity(encopts) > 1) {
+        print_info_sndfile(inputfile, &sfinfo, total_frames);
+    }
+
+    // Use information from input file to configure libtwolame
+    twolame_set_num_channels(encopts, sfinfo.channels);
+    twolame_set_in_samplerate(encopts, sfinfo.samplerate);
+
+    // initialise twolame with this set of options
+    if (twolame_init_params(encopts) != 0) {
+        fprintf(stderr, "Error: configuring libtwolame encoder failed.\n");
+        exit(ERR_INVALID_PARAM);
+    }
+    // display encoder settings
+    twolame_print_config(encopts);
+
+
+    // Open the output file
+    outputfile = open_output_file(outputfilename);
+
+    // Now do the reading/encoding/writing
+    result = encode_stream(encopts, inputfile, outputfile, sfinfo.channels, total_frames,
+                           twolame_get_verbosity(encopts) > 0, &total_samples, &total_bytes);
+    if (result != ERR_NO_ERROR)
+        exit(result);
+
     if (twolame_get_verbosity(encopts) > 1) {
         format_filesize_string(filesize, sizeof(filesize), total_bytes);
         fprintf(stderr, "\nEncoding Finished.\n");
@@ -879,11 +1317,7 @@ int main(int argc, char **argv)
 
     // Close the libtwolame encoder
     twolame_close(&encopts);
-
-
-    // Free up memory
-    free(pcmaudio);
-    free(mp2buffer);
+    free(encoder_options);
 
     return (ERR_NO_ERROR);
 }
@@ -71,8 +71,12 @@ FLOAT twolame_ath_db(FLOAT f, FLOAT value)
 /* Convert ATH values from dB into energy values as required by the psycho model */
 FLOAT twolame_ath_energy(FLOAT freq, FLOAT value)
 {
-    FLOAT db;
-    db = twolame_ath_db(freq, 0) + value;   // Originally: ath_db(freq,value)
+    return twolame_ath_db_to_energy(twolame_ath_db(freq, 0) + value);   // Originally: ath_db(freq,value)
+}
+
+
+FLOAT twolame_ath_db_to_energy(FLOAT db)
+{
     /* The values in the standard, and from the ATH formula are in dB. In the psycho model we are
        working in the energy domain. Hence the values that are in the absthr_X tables are not in
        dB. This function converts from dB into the energy domain. As noted on the LAME mailing list
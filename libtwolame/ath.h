@@ -25,6 +25,7 @@
 
 FLOAT twolame_ath_db(FLOAT f, FLOAT value);
 FLOAT twolame_ath_energy(FLOAT f, FLOAT value);
+FLOAT twolame_ath_db_to_energy(FLOAT db);
 FLOAT twolame_ath_freq2bark(FLOAT freq);
 
 #endif
@@ -26,9 +26,24 @@
 #include "twolame.h"
 #include "common.h"
 #include "availbits.h"
+#include "util.h"
 
 
 
+/* average number of slots (bytes) in a frame at a bitrate */
+static FLOAT bitrate_slots(twolame_options * glopts, int bitrate)
+{
+    return (1152.0 / ((FLOAT) glopts->samplerate_out / 1000.0))
+           * ((FLOAT) bitrate / 8.0);
+}
+
+/* average number of slots (bytes) in a frame at the current bitrate */
+static FLOAT average_slots(twolame_options * glopts)
+{
+    return bitrate_slots(glopts, glopts->bitrate);
+}
+
+
 /* function returns the number of available bits */
 int twolame_available_bits(twolame_options * glopts)
 {
@@ -38,8 +53,7 @@ int twolame_available_bits(twolame_options * glopts)
     int whole;
     int adb;
 
-    average = (1152.0 / ((FLOAT) glopts->samplerate_out / 1000.0))
-              * ((FLOAT) glopts->bitrate / 8.0);
+    average = average_slots(glopts);
 
     // fprintf(stderr,"availbits says: sampling freq is %i. version %i. bitrateindex %i slots
     // %f\n",header->sampling_frequency, header->version, header->bitrate_index, average);
@@ -64,4 +78,24 @@ int twolame_available_bits(twolame_options * glopts)
 }
 
 
+/* function returns the size of the current frame in bits, including any padding */
+int twolame_frame_bits(twolame_options * glopts)
+{
+    return ((int) average_slots(glopts) + glopts->header.padding) * 8;
+}
+
+
+/* function returns the size in bits of the largest frame the encoder can output:
+   at the upper VBR bitrate, or padded at the bitrate */
+int twolame_max_frame_bits(twolame_options * glopts)
+{
+    if (glopts->vbr)
+        return (int) bitrate_slots(glopts,
+                                   twolame_index_bitrate((int) glopts->version,
+                                                         glopts->upper_index)) * 8;
+
+    return ((int) average_slots(glopts) + (glopts->padding ? 1 : 0)) * 8;
+}
+
+
 // vim:ts=4:sw=4:nowrap:
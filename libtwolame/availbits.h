@@ -24,6 +24,8 @@
 #define TWOLAME_AVAILBITS_H
 
 int twolame_available_bits(twolame_options * glopts);
+int twolame_frame_bits(twolame_options * glopts);
+int twolame_max_frame_bits(twolame_options * glopts);
 
 #endif
 
@@ -27,35 +27,34 @@
 #include "twolame.h"
 #include "common.h"
 #include "bitbuffer.h"
-#include "mem.h"
 
 
-/*create bit buffer*/
-bit_stream *twolame_buffer_init(unsigned char *buffer, int buffer_size)
+/* initialise a bit buffer writing into buffer */
+void twolame_buffer_init(bit_stream * bs, unsigned char *buffer, int buffer_size)
 {
-    bit_stream *bs = (bit_stream *) TWOLAME_MALLOC(sizeof(bit_stream));
-
-    if (bs != NULL) {
-        bs->buf = buffer;
-        bs->buf_size = buffer_size;
-        bs->buf_byte_idx = 0;
-        bs->buf_bit_idx = 8;
-        bs->totbit = 0;
-        bs->eob = FALSE;
-        bs->eobs = FALSE;
-    }
-
-    return bs;
+    bs->buf = buffer;
+    bs->buf_size = buffer_size;
+    bs->buf_byte_idx = 0;
+    bs->acc = 0;
+    bs->acc_bits = 0;
 }
 
-/* Dellocate bit buffer */
-void twolame_buffer_deinit(bit_stream ** bs)
+/* check that there is space in the buffer for another 'bits' bits
+   returns 0 if there is, or -1 if the buffer is too small */
+int twolame_buffer_reserve(bit_stream * bs, long bits)
 {
+    long needed = (twolame_buffer_sstell(bs) + bits + 7) / 8;
 
-    if (bs == NULL || *bs == NULL)
-        return;
+    return (needed <= bs->buf_size) ? 0 : -1;
+}
 
-    TWOLAME_FREE(*bs);
+/* write out any whole bytes that are still in the accumulator */
+void twolame_buffer_flush(bit_stream * bs)
+{
+    while (bs->acc_bits >= 8) {
+        bs->acc_bits -= 8;
+        bs->buf[bs->buf_byte_idx++] = (unsigned char) (bs->acc >> bs->acc_bits);
+    }
 }
 
 
@@ -29,19 +29,18 @@
 typedef struct bit_stream_struc {
     unsigned char *buf;         /* bit stream buffer */
     int buf_size;               /* size of buffer (in number of bytes) */
-    long totbit;                /* bit counter of bit stream */
-    int buf_byte_idx;           /* pointer to top byte in buffer */
-    int buf_bit_idx;            /* pointer to top bit of top byte in buffer */
-    int eob;                    /* end of buffer index */
-    int eobs;                   /* end of bit stream flag */
+    int buf_byte_idx;           /* number of bytes written to buffer */
+    unsigned long long acc;     /* bits not yet written to buffer */
+    int acc_bits;               /* number of bits in acc */
 } bit_stream;
 
 
-bit_stream *twolame_buffer_init(unsigned char *buffer, int buffer_size);
-void twolame_buffer_deinit(bit_stream ** bs);
+void twolame_buffer_init(bit_stream * bs, unsigned char *buffer, int buffer_size);
+int twolame_buffer_reserve(bit_stream * bs, long bits);
+void twolame_buffer_flush(bit_stream * bs);
 
 /*return the current bit stream length (in bits)*/
-#define twolame_buffer_sstell(bs) (bs->totbit)
+#define twolame_buffer_sstell(bs) ((long) (bs)->buf_byte_idx * 8 + (bs)->acc_bits)
 
 #endif
 
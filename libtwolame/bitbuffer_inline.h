@@ -21,59 +21,44 @@
  */
 
 
-/* write 1 bit from the bit stream */
-static inline void buffer_put1bit(bit_stream * bs, int bit)
+/*
+  Bits are shifted into a 64-bit accumulator and written out 32 at a time.
+  There are no bounds checks here: twolame_buffer_reserve() checks once per
+  frame that the whole frame fits into the output buffer.
+*/
+
+/* write N bits (N <= 32) into the bit stream */
+static inline void buffer_putbits(bit_stream * bs, unsigned int val, int N)
 {
-    if (bs->buf_byte_idx < bs->buf_size) {
-        bs->totbit++;
+    bs->acc = (bs->acc << N) | (val & ((1ULL << N) - 1));
+    bs->acc_bits += N;
+
+    if (bs->acc_bits >= 32) {
+        unsigned char *p = bs->buf + bs->buf_byte_idx;
+        unsigned int word;
 
-        bs->buf[bs->buf_byte_idx] |= (bit & 0x1) << (bs->buf_bit_idx - 1);
-        bs->buf_bit_idx--;
-        if (!bs->buf_bit_idx) {
-            bs->buf_bit_idx = 8;
-            bs->buf_byte_idx++;
-            if (bs->buf_byte_idx < bs->buf_size) {
-                bs->buf[bs->buf_byte_idx] = 0;
-            }
-            else {
-                fprintf(stderr, "buffer_put1bit: error. bit_stream buffer full\n");
-            }
-        }
+        bs->acc_bits -= 32;
+        word = (unsigned int) (bs->acc >> bs->acc_bits);
+        p[0] = (unsigned char) (word >> 24);
+        p[1] = (unsigned char) (word >> 16);
+        p[2] = (unsigned char) (word >> 8);
+        p[3] = (unsigned char) word;
+        bs->buf_byte_idx += 4;
     }
-    else
-        fprintf(stderr, "buffer_put1bit: error. bit_stream buffer needs to be bigger\n");
 }
 
-/* write N bits into the bit stream */
-static inline void buffer_putbits(bit_stream * bs, unsigned int val, int N)
+/* write 1 bit into the bit stream */
+static inline void buffer_put1bit(bit_stream * bs, int bit)
 {
-    static const int putmask[9] = { 0x0, 0x1, 0x3, 0x7, 0xf, 0x1f, 0x3f, 0x7f, 0xff };
-    register int j = N;
-    register int k, tmp;
+    buffer_putbits(bs, bit, 1);
+}
 
-    if (bs->buf_byte_idx < bs->buf_size) {
-        while (j > 0) {
-            k = MIN(j, bs->buf_bit_idx);
-            tmp = val >> (j - k);
-            bs->buf[bs->buf_byte_idx] |= (tmp & putmask[k]) << (bs->buf_bit_idx - k);
-            bs->buf_bit_idx -= k;
-            bs->totbit += k;
-            if (!bs->buf_bit_idx) {
-                bs->buf_bit_idx = 8;
-                bs->buf_byte_idx++;
-                if (bs->buf_byte_idx < bs->buf_size) {
-                    bs->buf[bs->buf_byte_idx] = 0;
-                }
-                else {
-                    fprintf(stderr, "buffer_putbits: error. bit_stream buffer full\n");
-                    break;
-                }
-            }
-            j -= k;
-        }
-    }
-    else
-        fprintf(stderr, "buffer_putbits: error. bit_stream buffer needs to be bigger\n");
+/* write N zero bits into the bit stream */
+static inline void buffer_putzeros(bit_stream * bs, int N)
+{
+    for (; N >= 32; N -= 32)
+        buffer_putbits(bs, 0, 32);
+    buffer_putbits(bs, 0, N);
 }
 
 // vim:ts=4:sw=4:nowrap:
@@ -39,8 +39,12 @@
 ****************************************************************************************/
 
 #ifndef FLOAT
+#ifdef SINGLE_PRECISION
+#define            FLOAT                    float
+#else
 #define            FLOAT                    double
 #endif
+#endif
 
 #define            NULL_CHAR                '\0'
 
@@ -92,6 +96,10 @@
 #define POWERNORM       90.3090 /* = 20 * log10(32768) to normalize */
 /* max output power to 96 dB per spec */
 
+/* From this bitrate per channel on, models 1 and 3 lower the threshold in
+   quiet by 12 dB, the only way the bitrate changes their result */
+#define HIGH_BITRATE    96
+
 
 /***************************************************************************************
   Psychoacoustic Model 2/4 Definitions
@@ -118,12 +126,16 @@ psycho 1 mem struct
 typedef struct {
     int line;
     FLOAT bark, hear, x;
+    FLOAT mask;                 // the individual masking thresholds, x without hear
 } g_thres, *g_ptr;
 
+// tonal or non-tonal components, compacted from the lists of spectral lines
 typedef struct {
-    FLOAT x;
-    int type, next, map;
-} mask, *mask_ptr;
+    int count;
+    int line[HAN_SIZE];         // spectral line
+    FLOAT x[HAN_SIZE];          // level in dB
+    FLOAT bark[HAN_SIZE];       // critical band rate of its subsample line
+} masker_list;
 
 typedef struct psycho_1_mem_struct {
     int off[2];
@@ -131,9 +143,16 @@ typedef struct psycho_1_mem_struct {
     int *cbound;
     int crit_band;
     int sub_size;
-    mask_ptr power;
+
+    // the spectral lines, linked into the tonal and non-tonal lists while labelling
+    FLOAT x[HAN_SIZE];          // level in dB
+    int type[HAN_SIZE];         // TONE, NOISE or FALSE
+    int next[HAN_SIZE];         // next line of its list, LAST or STOP
+    int map[HAN_SIZE];          // subsample line of ltg[]
+
+    masker_list tonal, noise;
     g_ptr ltg;
-    FLOAT dbtable[DBTAB];
+    const FLOAT *dbtable;       /* see tables_data.c */
 } psycho_1_mem;
 
 
@@ -153,7 +172,7 @@ typedef struct psycho_3_mem_struct {
 #define CRITBANDMAX 32          /* this is much higher than it needs to be. really only about 24 */
     int cbands;                 /* How many critical bands there really are */
     int cbandindex[CRITBANDMAX];    /* The spectral line index of the start of each critical band */
-    FLOAT dbtable[DBTAB];
+    const FLOAT *dbtable;       /* see tables_data.c */
 } psycho_3_mem;
 
 
@@ -166,8 +185,6 @@ Psycho2 & 4 memory structure
 #define BLKSIZE         1024
 #define HBLKSIZE        513
 #define CBANDS          64
-#define TRIGTABLESIZE   6284
-#define TRIGTABLESCALE  2000.0
 typedef int ICB[CBANDS];
 typedef int IHBLK[HBLKSIZE];
 typedef FLOAT F32[32];
@@ -180,11 +197,34 @@ typedef FLOAT F2HBLK[2][HBLKSIZE];
 typedef FLOAT F22HBLK[2][2][HBLKSIZE];
 typedef FLOAT DCB[CBANDS];
 
-typedef struct psycho_4_mem_struct {
-    int new;
-    int old;
-    int oldest;
+/* extra zero entries so that vectors can run past the end of a column */
+#define SPREAD_PAD      8
+
+typedef struct spread_mem_struct {
+    FLOAT w[CBANDS][CBANDS + SPREAD_PAD];   // w[k][j] = s[j][k], zero where dropped
+    int start[CBANDS];          // first row kept in each column
+    int len[CBANDS];            // number of rows from start to the last one kept
+    FLOAT rnorm[CBANDS];        // sum of each row of s, before dropping any entries
+
+    // kernel selected at init for the running CPU
+    void (*convolve) (const struct spread_mem_struct * spread, const FLOAT * grouped_e,
+                      const FLOAT * grouped_c, FLOAT * ecb, FLOAT * cb);
+} spread_mem;
+
+typedef struct unpredict_mem_struct {
+    FLOAT r[2][3][HBLKSIZE];    // magnitude of the last three spectra of each channel
+    FLOAT phi[2][3][HBLKSIZE];  // and their phase
+    int newest[2];              // slot of the last spectrum of each channel
+    int fast;                   // polynomial sin() and cos()
+    const FLOAT *sin_coef, *cos_coef;
+    int sin_terms, cos_terms;
+
+    // kernel selected at init for the running CPU
+    void (*measure) (struct unpredict_mem_struct * u, int ch, const FLOAT * energy,
+                     const FLOAT * phi, FLOAT * c);
+} unpredict_mem;
 
+typedef struct psycho_4_mem_struct {
     int flush;
     int sync_flush;
     int syncsize;
@@ -197,18 +237,17 @@ typedef struct psycho_4_mem_struct {
     FLOAT ecb[CBANDS];
     FLOAT bc[CBANDS];
     FLOAT cbval[CBANDS];
-    FLOAT rnorm[CBANDS];
-    FLOAT wsamp_r[BLKSIZE], phi[BLKSIZE], energy[BLKSIZE], window[BLKSIZE];
+    FLOAT wsamp_r[2][2][BLKSIZE], phi[2][2][BLKSIZE], energy[2][2][BLKSIZE];    // [ch][half]
+    const FLOAT *window;        // twolame_hann_window
     FLOAT ath[HBLKSIZE], thr[HBLKSIZE], c[HBLKSIZE];
     FLOAT fthr[HBLKSIZE], absthr[HBLKSIZE]; // psy2 only
     int numlines[CBANDS];
     int partition[HBLKSIZE];
     FLOAT *tmn;
-    FCB *s;
+    const spread_mem *spread;   // banded spreading function, shared (see tables.c)
     FHBLK *lthr;
-    F2HBLK *r, *phi_sav;
+    unpredict_mem unpredict;    // history of the spectrum
     FLOAT snrtmp[2][32];
-    FLOAT cos_table[TRIGTABLESIZE];
 } psycho_4_mem, psycho_2_mem;
 
 
@@ -216,15 +255,78 @@ typedef struct psycho_4_mem_struct {
  Subband utility structures
 ****************************************************************************************/
 
-typedef struct subband_mem_struct {
-    FLOAT x[2][512];
+#define SUBBAND_HISTORY (TWOLAME_SAMPLES_PER_FRAME + 480)
+#ifdef SINGLE_PRECISION
+#define SUBBAND_MT_ROWS (32)
+#else
+#define SUBBAND_MT_ROWS (16)
+#endif
+
+// constant, generated at build time (see gentables.c)
+typedef struct subband_tables_struct {
     FLOAT m[16][32];
-    int off[2];
-    int half[2];
+    FLOAT mt[32][SUBBAND_MT_ROWS];      // m transposed, zero padded for the SIMD kernels
+    FLOAT dct_coef[32];         // butterfly factors of the fast DCT
+} subband_tables;
+
+typedef struct subband_mem_struct {
+    FLOAT x[2][SUBBAND_HISTORY];        // newest sample first
+    const subband_tables *tab;  // twolame_subband_tables
+
+    // kernels selected at init for the running CPU
+    void (*window) (const FLOAT * x, const FLOAT * enw, FLOAT * y);
+    void (*matrix) (const struct subband_mem_struct * smem, const FLOAT * yprime, FLOAT * s);
 } subband_mem;
 
 
 
+/***************************************************************************************
+ FFT structure
+****************************************************************************************/
+
+/* twiddles of the four radix-4 passes of the 512 point complex FFT */
+#define FFT_STAGE_TWIDDLES (3 * (128 + 32 + 8 + 2))
+/* most blocks transformed together: two half frames of two channels */
+#define FFT_BATCH       4
+
+typedef struct fft_mem_struct {
+    int fast;                   // use the real FFT rather than the Hartley transform
+    const FLOAT *stage_re;      // twolame_fft_stage_re/im
+    const FLOAT *stage_im;
+    const FLOAT *post_re;       // exp(-2 PI i k / 1024) for splitting the real transform
+    const FLOAT *post_im;
+
+    // kernels selected at init for the running CPU
+    void (*radix4) (const FLOAT * wr, const FLOAT * wi, const FLOAT * xr, const FLOAT * xi,
+                    FLOAT * yr, FLOAT * yi, int m, int s);
+    void (*split) (const struct fft_mem_struct * fft, const FLOAT * re, const FLOAT * im,
+                   FLOAT * fz);
+    void (*radix4_batch) (const FLOAT * wr, const FLOAT * wi, const FLOAT * xr,
+                          const FLOAT * xi, FLOAT * yr, FLOAT * yi, int m, int s, int lanes);
+    void (*split_batch) (const struct fft_mem_struct * fft, const FLOAT * re, const FLOAT * im,
+                         FLOAT * fz, int lanes);
+    int batch_width;            // blocks per vector of the batch kernels
+    void (*spectrum) (const struct fft_mem_struct * fft, const FLOAT * x_real, FLOAT * energy,
+                      FLOAT * phi);
+    const FLOAT *atan_coef;     // polynomial of the fast atan2(), odd powers
+    int atan_terms;
+} fft_mem;
+
+
+/***************************************************************************************
+ Decibel conversions
+****************************************************************************************/
+
+typedef struct decibel_mem_struct {
+    int fast;                   // polynomial log10() and exp10() in psycho models 1 and 3
+
+    // kernels selected at init for the running CPU
+    void (*to_db) (const FLOAT * x, FLOAT * y, int n, FLOAT scale, FLOAT offset, FLOAT lowest);
+    void (*from_db) (const FLOAT * x, FLOAT * y, int n, FLOAT scale);
+} decibel_mem;
+
+
+
 /***************************************************************************************
  Header and frame information
 ****************************************************************************************/
@@ -252,6 +354,24 @@ typedef FLOAT jsb_sample_t[3][SCALE_BLOCK][SBLIMIT];
 typedef FLOAT sb_sample_t[2][3][SCALE_BLOCK][SBLIMIT];
 
 
+/* The samples of one frame and the results of their analysis, which the
+   bit allocation and the packing of the frame read. Encoding with several
+   threads analyses one frame while the previous one is packed. */
+typedef struct frame_data_struct {
+    FLOAT buffer[2][TWOLAME_SAMPLES_PER_FRAME]; // Sample buffer, at 16-bit scale
+    int status;                 // 0, or -1 if the frame couldn't be analysed
+    unsigned int scalar[2][3][SBLIMIT];
+    unsigned int j_scale[3][SBLIMIT];
+    FLOAT smr[2][SBLIMIT];
+    FLOAT max_sc[2][SBLIMIT];
+    jsb_sample_t j_sample;
+    sb_sample_t sb_sample;
+} frame_data;
+
+/* A thread analysing frames, defined in worker.c */
+typedef struct twolame_worker_struct twolame_worker;
+
+
 
 /***************************************************************************************
  twolame Global Options structure.
@@ -283,6 +403,13 @@ struct twolame_options_struct {
     FLOAT athlevel;             // Adjust the Absolute Threshold of Hearing curve by [0] dB
     int quickmode;              // Only calculate psy model ever X frames [FALSE]
     int quickcount;             // Only calculate psy model every [10] frames
+    int fast_dct;               // Factorised DCT in the filterbank [FALSE]
+    int fast_fft;               // Real FFT in the psycho models [FALSE]
+    int fast_phase;             // Polynomial atan2() in psycho models 2 and 4 [0], 1, 2
+    FLOAT spread_tolerance;     // Spreading function entries dropped in psycho models 2 and 4 [0.0]
+    int fast_db;                // Polynomial log10() and exp10() in psycho models 1 and 3 [FALSE]
+    int num_threads;            // Threads encoding a stream, the analysis of the next frame
+    // running while the current one is packed [1]
 
     // VBR Options
     int vbr;                    // turn on VBR mode TRUE [FALSE]
@@ -326,22 +453,21 @@ struct twolame_options_struct {
 
     // Used by twolame_encode_frame
     int twolame_init;
-    short int buffer[2][TWOLAME_SAMPLES_PER_FRAME]; // Sample buffer
-    unsigned int samples_in_buffer; // Number of samples currently in buffer
+    frame_data *frames;         // One frame, or two when the frames are pipelined
+    frame_data *frame;          // The frame being filled with samples
+    unsigned int samples_in_buffer; // Number of samples currently in frame->buffer
+    int frame_pending;          // The other frame is analysed but not packed yet
     unsigned int psycount;
     unsigned int num_crc_bits;  // Number of bits CRC is calculated on
 
     unsigned int bit_alloc[2][SBLIMIT];
     unsigned int scfsi[2][SBLIMIT];
-    unsigned int scalar[2][3][SBLIMIT];
-    unsigned int j_scale[3][SBLIMIT];
     FLOAT smrdef[2][32];
-    FLOAT smr[2][SBLIMIT];
-    FLOAT max_sc[2][SBLIMIT];
 
     subband_t *subband;
-    jsb_sample_t *j_sample;
-    sb_sample_t *sb_sample;
+
+    // Threads analysing the frames, none unless num_threads > 1
+    twolame_worker *workers[2];
 
 
 
@@ -361,6 +487,12 @@ struct twolame_options_struct {
     // memory for subband
     subband_mem smem;
 
+    // FFT for the psycho models
+    fft_mem fft;
+
+    // dB conversions of psycho models 1 and 3
+    decibel_mem db;
+
     // Frame info
     frame_header header;
     int jsbound;                // first band of joint stereo coding
@@ -0,0 +1,51 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2001-2004 Michael Cheng
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#include "twolame.h"
+#include "common.h"
+#include "cpu.h"
+
+
+/*
+  Return the set of SIMD extensions that the encoder may use
+  on the CPU it is currently running on.
+*/
+int twolame_cpu_features(void)
+{
+    int flags = 0;
+
+#if defined(TWOLAME_X86_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        flags |= TWOLAME_CPU_SSE2;
+    if (__builtin_cpu_supports("avx2"))
+        flags |= TWOLAME_CPU_AVX2;
+#elif defined(TWOLAME_NEON_SIMD)
+    flags |= TWOLAME_CPU_NEON;
+#endif
+
+    return flags;
+}
+
+
+// vim:ts=4:sw=4:nowrap:
@@ -0,0 +1,49 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2001-2004 Michael Cheng
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef TWOLAME_CPU_H
+#define TWOLAME_CPU_H
+
+/*
+  Compile-time availability of the SIMD code paths.
+  x86 kernels are built with per-function target attributes and
+  selected at runtime; NEON is part of the AArch64 base ISA.
+*/
+#if !defined(DISABLE_SIMD) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define TWOLAME_X86_SIMD 1
+#elif !defined(DISABLE_SIMD) && defined(__aarch64__) && defined(__ARM_NEON)
+#define TWOLAME_NEON_SIMD 1
+#endif
+
+/* Instruction set extensions usable by the encoder */
+#define TWOLAME_CPU_SSE2    0x0001
+#define TWOLAME_CPU_AVX2    0x0002
+#define TWOLAME_CPU_NEON    0x0100
+
+int twolame_cpu_features(void);
+
+#endif                          /* TWOLAME_CPU_H */
+
+
+// vim:ts=4:sw=4:nowrap:
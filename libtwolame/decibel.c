@@ -0,0 +1,238 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2001-2004 Michael Cheng
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+
+#include <stdio.h>
+#include <math.h>
+
+#include "twolame.h"
+#include "common.h"
+#include "cpu.h"
+#include "simd.h"
+#include "decibel.h"
+
+
+/*
+  Conversions between power and dB for psycho models 1 and 3, on whole
+  spectra at once with fast_db instead of log10() and pow() per line.
+
+  log: x = m 2^e with m in [sqrt(2)/2, sqrt(2)), then with s = (m-1)/(m+1)
+      ln(m) = s (2 + z R(z))    z = s^2
+  where R is the fdlibm polynomial in double precision (error below
+  2^-58) or the one of its single precision logf() (2^-34).
+
+  exp: 10^a = 2^k e^r, with k the integer nearest a log2(10) and
+  r = a ln(10) - k ln(2) in [-ln(2)/2, ln(2)/2], ln(2) in two parts so
+  that k ln(2) is subtracted with little rounding. e^r is its Taylor
+  series to r^13, or r^7 in single precision, and 2^k is put together
+  in the exponent field of the result.
+
+  In double precision 10 log10() is within 2e-13 dB of libm, and 10^a
+  within a relative 2e-14; in single precision 5e-5 dB and 2e-5, most
+  of which is the rounding of the arguments and results to float.
+*/
+#ifdef SINGLE_PRECISION
+static const FLOAT log_coef[] = {
+    0.24279078841209412, 0.28498786687850952, 0.40000972151756287, 0.66666662693023682
+};
+
+static const FLOAT exp_coef[] = {
+    1.0 / 5040, 1.0 / 720, 1.0 / 120, 1.0 / 24, 1.0 / 6, 1.0 / 2, 1.0, 1.0
+};
+
+#define LN2_HI          6.9314575195e-01
+#define LN2_LO          1.4286067653e-06
+#define MAX_EXP10       37.0    /* largest |a| of 10^a, within the normal range */
+#define ROUND_MAGIC     12582912.0
+#else
+static const FLOAT log_coef[] = {
+    1.479819860511658591e-01, 1.531383769920937332e-01, 1.818357216161805012e-01,
+    2.222219843214978396e-01, 2.857142874366239149e-01, 3.999999999940941908e-01,
+    6.666666666666735130e-01
+};
+
+static const FLOAT exp_coef[] = {
+    1.0 / 6227020800.0, 1.0 / 479001600.0, 1.0 / 39916800.0, 1.0 / 3628800.0,
+    1.0 / 362880.0, 1.0 / 40320.0, 1.0 / 5040.0, 1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0,
+    1.0 / 6.0, 1.0 / 2.0, 1.0, 1.0
+};
+
+#define LN2_HI          6.93147180369123816490e-01
+#define LN2_LO          1.90821492927058770002e-10
+#define MAX_EXP10       300.0
+#define ROUND_MAGIC     6755399441055744.0
+#endif
+
+#define LOG_TERMS       ((int) (sizeof(log_coef) / sizeof(log_coef[0])))
+#define EXP_TERMS       ((int) (sizeof(exp_coef) / sizeof(exp_coef[0])))
+
+#define LN2             0.69314718055994530942
+#define LN10            2.30258509299404568402
+#define LOG2_10         3.32192809488736234787
+#define LOG10_E         0.43429448190325182765
+#define SQRT2           1.41421356237309504880
+
+/* y[] = scale log10(max(x[], lowest)) + offset */
+#define DECIBEL_LOG(P, W) \
+    for (; j + (W) <= n; j += (W)) { \
+        const P##_vec v = P##_max(P##_load(x + j), P##_set1(lowest)); \
+        P##_vec m = P##_mantissa(v), e = P##_exponent(v), s, z, r; \
+        const P##_vec high = P##_cmplt(P##_set1(SQRT2), m); \
+        m = P##_select(high, P##_mul(m, P##_set1(0.5)), m); \
+        e = P##_select(high, P##_add(e, P##_set1(1.0)), e); \
+        s = P##_div(P##_sub(m, P##_set1(1.0)), P##_add(m, P##_set1(1.0))); \
+        z = P##_mul(s, s); \
+        r = P##_set1(log_coef[0]); \
+        for (i = 1; i < LOG_TERMS; i++) \
+            r = P##_add(P##_mul(r, z), P##_set1(log_coef[i])); \
+        r = P##_add(P##_mul(e, P##_set1(LN2)), \
+                    P##_mul(s, P##_add(P##_set1(2.0), P##_mul(z, r)))); \
+        P##_store(y + j, P##_add(P##_mul(r, P##_set1(scale_e)), P##_set1(offset))); \
+    }
+
+/* y[] = 10^(scale x[]) */
+#define DECIBEL_EXP(P, W) \
+    for (; j + (W) <= n; j += (W)) { \
+        const P##_vec a = P##_min(P##_max(P##_mul(P##_load(x + j), P##_set1(scale)), \
+                                          P##_set1(-MAX_EXP10)), P##_set1(MAX_EXP10)); \
+        const P##_vec k = P##_sub(P##_add(P##_mul(a, P##_set1(LOG2_10)), P##_set1(ROUND_MAGIC)), \
+                                  P##_set1(ROUND_MAGIC)); \
+        const P##_vec r = P##_sub(P##_sub(P##_mul(a, P##_set1(LN10)), P##_mul(k, P##_set1(LN2_HI))), \
+                                  P##_mul(k, P##_set1(LN2_LO))); \
+        P##_vec p = P##_set1(exp_coef[0]); \
+        for (i = 1; i < EXP_TERMS; i++) \
+            p = P##_add(P##_mul(p, r), P##_set1(exp_coef[i])); \
+        P##_store(y + j, P##_mul(p, P##_exp2i(k))); \
+    }
+
+#define TO_DB(P, W) \
+    { \
+        const FLOAT scale_e = scale * LOG10_E; \
+        int i, j = 0; \
+        DECIBEL_LOG(P, W); \
+        DECIBEL_LOG(scalar, 1); \
+    }
+
+#define FROM_DB(P, W) \
+    { \
+        int i, j = 0; \
+        DECIBEL_EXP(P, W); \
+        DECIBEL_EXP(scalar, 1); \
+    }
+
+static void to_db_scalar(const FLOAT * x, FLOAT * y, int n, FLOAT scale, FLOAT offset,
+                         FLOAT lowest)
+{
+    TO_DB(scalar, 1);
+}
+
+static void from_db_scalar(const FLOAT * x, FLOAT * y, int n, FLOAT scale)
+{
+    FROM_DB(scalar, 1);
+}
+
+#if defined(TWOLAME_X86_SIMD)
+
+SSE2_TARGET static void to_db_sse2(const FLOAT * x, FLOAT * y, int n, FLOAT scale,
+                                   FLOAT offset, FLOAT lowest)
+{
+    TO_DB(sse, SSE_WIDTH);
+}
+
+SSE2_TARGET static void from_db_sse2(const FLOAT * x, FLOAT * y, int n, FLOAT scale)
+{
+    FROM_DB(sse, SSE_WIDTH);
+}
+
+AVX2_TARGET static void to_db_avx2(const FLOAT * x, FLOAT * y, int n, FLOAT scale,
+                                   FLOAT offset, FLOAT lowest)
+{
+    TO_DB(avx, AVX_WIDTH);
+    avx_zeroupper();
+}
+
+AVX2_TARGET static void from_db_avx2(const FLOAT * x, FLOAT * y, int n, FLOAT scale)
+{
+    FROM_DB(avx, AVX_WIDTH);
+    avx_zeroupper();
+}
+
+#elif defined(TWOLAME_NEON_SIMD)
+
+static void to_db_neon(const FLOAT * x, FLOAT * y, int n, FLOAT scale, FLOAT offset,
+                       FLOAT lowest)
+{
+    TO_DB(neon, NEON_WIDTH);
+}
+
+static void from_db_neon(const FLOAT * x, FLOAT * y, int n, FLOAT scale)
+{
+    FROM_DB(neon, NEON_WIDTH);
+}
+
+#endif
+
+
+void twolame_decibel_init(decibel_mem * db, int fast_db)
+{
+#if defined(TWOLAME_X86_SIMD) || defined(TWOLAME_NEON_SIMD)
+    int cpu = twolame_cpu_features();
+#endif
+
+    db->fast = fast_db;
+    db->to_db = to_db_scalar;
+    db->from_db = from_db_scalar;
+#if defined(TWOLAME_X86_SIMD)
+    if (cpu & TWOLAME_CPU_AVX2) {
+        db->to_db = to_db_avx2;
+        db->from_db = from_db_avx2;
+    } else if (cpu & TWOLAME_CPU_SSE2) {
+        db->to_db = to_db_sse2;
+        db->from_db = from_db_sse2;
+    }
+#elif defined(TWOLAME_NEON_SIMD)
+    if (cpu & TWOLAME_CPU_NEON) {
+        db->to_db = to_db_neon;
+        db->from_db = from_db_neon;
+    }
+#endif
+}
+
+
+/* y[i] = scale log10(x[i]) + offset, with x[i] no less than lowest,
+   which must be a positive normal number */
+void twolame_to_db(const decibel_mem * db, const FLOAT * x, FLOAT * y, int n, FLOAT scale,
+                   FLOAT offset, FLOAT lowest)
+{
+    db->to_db(x, y, n, scale, offset, lowest);
+}
+
+/* y[i] = 10^(scale x[i]) */
+void twolame_from_db(const decibel_mem * db, const FLOAT * x, FLOAT * y, int n, FLOAT scale)
+{
+    db->from_db(x, y, n, scale);
+}
+
+
+// vim:ts=4:sw=4:nowrap:
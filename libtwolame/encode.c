@@ -696,6 +696,49 @@ void twolame_write_samples(twolame_options * glopts,
 }
 
 
+/* lookup # sfs per scfsi */
+static const int sfsPerScfsi[] = { 3, 2, 1, 2 };
+
+/* Keep choosing the next number of steps for subband sb, starting at ba, until
+   the MNR of a channel with masking ratios SMR reaches min_mnr */
+static int nonoise_alloc(twolame_options * glopts, const FLOAT SMR[SBLIMIT], int sb, int ba,
+                         FLOAT min_mnr)
+{
+    int thisline = line[glopts->tablenum][sb];
+    int maxAlloc = (1 << nbal[thisline]) - 1;
+
+    for (; ba < maxAlloc - 1; ++ba) {
+        int thisstep_index = step_index[thisline][ba];
+        if ((SNR[thisstep_index] - SMR[sb]) >= min_mnr)
+            break;              /* we found enough bits */
+    }
+    return ba;
+}
+
+/* Bits for the samples, scfsi and scalefactors of subband sb of channel ch
+   (and of the other channel too if it is joint coded) */
+static int nonoise_bits(twolame_options * glopts, unsigned int scfsi[2][SBLIMIT], int sb,
+                        int ch, int joint, int ba)
+{
+    int thisstep_index, smp_bits, sel_bits, sc_bits;
+
+    if (ba == 0)
+        return 0;
+
+    // smp_bits = SCALE_BLOCK * ((*alloc)[sb][ba].group * (*alloc)[sb][ba].bits);
+    thisstep_index = step_index[line[glopts->tablenum][sb]][ba];
+    smp_bits = SCALE_BLOCK * group[thisstep_index] * bits[thisstep_index];
+    /* scale factor bits required for subband */
+    sel_bits = 2;
+    sc_bits = 6 * sfsPerScfsi[scfsi[ch][sb]];
+    if (joint) {
+        /* each new js sb has L+R scfsis */
+        sel_bits += 2;
+        sc_bits += 6 * sfsPerScfsi[scfsi[1 - ch][sb]];
+    }
+    return smp_bits + sel_bits + sc_bits;
+}
+
 /************************************************************************
 *
 * bits_for_nonoise (Layer II)
@@ -735,8 +778,6 @@ int twolame_bits_for_nonoise(twolame_options * glopts,
     int sblimit = glopts->sblimit;
     int jsbound = glopts->jsbound;
     int req_bits = 0, bbal = 0, berr = 0, banc = 32;
-    int maxAlloc, sel_bits, sc_bits, smp_bits;
-    static const int sfsPerScfsi[] = { 3, 2, 1, 2 };    /* lookup # sfs per scfsi */
 
     /* MFC Feb 2003 This works out the basic number of bits just to get a valid (but empty) frame.
        This needs to be done for every frame, since a joint_stereo frame will change the number of
@@ -759,44 +800,89 @@ int twolame_bits_for_nonoise(twolame_options * glopts,
 
     for (sb = 0; sb < sblimit; ++sb)
         for (ch = 0; ch < ((sb < jsbound) ? nch : 1); ++ch) {
-            int thisline = line[glopts->tablenum][sb];
-
-            /* How many possible steps are there to choose from ? */
-            maxAlloc = (1 << nbal[line[glopts->tablenum][sb]]) - 1; // (*alloc)[sb][0].bits) - 1;
-            sel_bits = sc_bits = smp_bits = 0;
-            /* Keep choosing the next number of steps (and hence our SNR value) until we have the
-               required MNR value */
-            for (ba = 0; ba < maxAlloc - 1; ++ba) {
-                int thisstep_index = step_index[thisline][ba];
-                if ((SNR[thisstep_index] - SMR[ch][sb]) >= min_mnr)
-                    break;      /* we found enough bits */
-            }
-            if (nch == 2 && sb >= jsbound)  /* check other JS channel */
-                for (; ba < maxAlloc - 1; ++ba) {
-                    int thisstep_index = step_index[thisline][ba];
-                    if ((SNR[thisstep_index] - SMR[1 - ch][sb]) >= min_mnr)
-                        break;
-                }
-            if (ba > 0) {
-                // smp_bits = SCALE_BLOCK * ((*alloc)[sb][ba].group * (*alloc)[sb][ba].bits);
-                int thisstep_index = step_index[thisline][ba];
-                smp_bits = SCALE_BLOCK * group[thisstep_index] * bits[thisstep_index];
-                /* scale factor bits required for subband */
-                sel_bits = 2;
-                sc_bits = 6 * sfsPerScfsi[scfsi[ch][sb]];
-                if (nch == 2 && sb >= jsbound) {
-                    /* each new js sb has L+R scfsis */
-                    sel_bits += 2;
-                    sc_bits += 6 * sfsPerScfsi[scfsi[1 - ch][sb]];
-                }
-                req_bits += smp_bits + sel_bits + sc_bits;
-            }
+            int joint = (nch == 2 && sb >= jsbound);
+
+            ba = nonoise_alloc(glopts, SMR[ch], sb, 0, min_mnr);
+            if (joint)          /* check other JS channel */
+                ba = nonoise_alloc(glopts, SMR[1 - ch], sb, ba, min_mnr);
+            req_bits += nonoise_bits(glopts, scfsi, sb, ch, joint, ba);
             bit_alloc[ch][sb] = ba;
         }
     return req_bits;
 }
 
 
+/************************************************************************
+*
+* choose_js_bound
+*
+* Pick the joint stereo bound for a frame: full stereo if there are
+* enough bits (adb) for no noise, otherwise the highest bound that
+* fits, down to mode_ext 0. Returns the mode_ext or -1 for stereo.
+*
+* The result is the same as calling twolame_bits_for_nonoise() for each
+* jsbound in turn, but every subband is only looked at once: the bits
+* it needs coded as stereo or joint are summed up from either end, so
+* the bits for any jsbound are just a sum of two totals.
+*
+************************************************************************/
+
+static int choose_js_bound(twolame_options * glopts,
+                           FLOAT SMR[2][SBLIMIT], unsigned int scfsi[2][SBLIMIT], int adb)
+{
+    frame_header *header = &glopts->header;
+    int sblimit = glopts->sblimit;
+    int stereo_bits[SBLIMIT + 1];   /* bits for subbands below sb in stereo */
+    int joint_bits[SBLIMIT + 1];    /* bits for subbands from sb on in joint stereo */
+    int fixed_bits = 32;
+    int sb, mode_ext;
+
+    if (header->error_protection)
+        fixed_bits += 16;
+
+    /* the totals go up to the largest jsbound, even if that is beyond sblimit,
+       where the subbands have no allocation bits */
+    stereo_bits[0] = 0;
+    for (sb = 0; sb < SBLIMIT; ++sb) {
+        int thisbits = 0;
+
+        if (sb < sblimit) {
+            int ba;
+            thisbits = 2 * nbal[line[glopts->tablenum][sb]];
+            ba = nonoise_alloc(glopts, SMR[0], sb, 0, 0.0);
+            thisbits += nonoise_bits(glopts, scfsi, sb, 0, FALSE, ba);
+            ba = nonoise_alloc(glopts, SMR[1], sb, 0, 0.0);
+            thisbits += nonoise_bits(glopts, scfsi, sb, 1, FALSE, ba);
+        }
+        stereo_bits[sb + 1] = stereo_bits[sb] + thisbits;
+    }
+
+    joint_bits[sblimit] = 0;
+    for (sb = sblimit - 1; sb >= 0; --sb) {
+        int ba = nonoise_alloc(glopts, SMR[0], sb, 0, 0.0);
+        ba = nonoise_alloc(glopts, SMR[1], sb, ba, 0.0);
+        joint_bits[sb] = joint_bits[sb + 1] + nbal[line[glopts->tablenum][sb]]
+            + nonoise_bits(glopts, scfsi, sb, 0, TRUE, ba);
+    }
+
+    if (fixed_bits + stereo_bits[sblimit] <= adb)
+        return -1;
+
+    mode_ext = 4;               /* 3 is least severe reduction */
+    do {
+        int jsbound;
+        --mode_ext;
+        jsbound = get_js_bound(mode_ext);
+        if (fixed_bits + stereo_bits[jsbound]
+            + joint_bits[(jsbound < sblimit) ? jsbound : sblimit] <= adb)
+            break;
+    }
+    while (mode_ext > 0);
+
+    return mode_ext;
+}
+
+
 /* must be called before calling main_bit_allocation */
 int twolame_init_bit_allocation(twolame_options * glopts)
 {
@@ -905,24 +991,19 @@ void twolame_main_bit_allocation(twolame_options * glopts,
     frame_header *header = &glopts->header;
     int mode = glopts->mode;
     int mode_ext;
-    int rq_db;                  /* av_db = *adb; Not Used MFC Nov 99 */
     int guessindex = 0;
 
 
     if (mode == TWOLAME_JOINT_STEREO) {
-        header->mode = TWOLAME_STEREO;
-        header->mode_ext = 0;
-        glopts->jsbound = glopts->sblimit;
-        if ((rq_db = twolame_bits_for_nonoise(glopts, SMR, scfsi, 0, bit_alloc)) > *adb) {
+        mode_ext = choose_js_bound(glopts, SMR, scfsi, *adb);
+        if (mode_ext < 0) {
+            header->mode = TWOLAME_STEREO;
+            header->mode_ext = 0;
+            glopts->jsbound = glopts->sblimit;
+        } else {
             header->mode = TWOLAME_JOINT_STEREO;
-            mode_ext = 4;       /* 3 is least severe reduction */
-            do {
-                --mode_ext;
-                glopts->jsbound = get_js_bound(mode_ext);
-                rq_db = twolame_bits_for_nonoise(glopts, SMR, scfsi, 0, bit_alloc);
-            }
-            while ((rq_db > *adb) && (mode_ext > 0));
             header->mode_ext = mode_ext;
+            glopts->jsbound = get_js_bound(mode_ext);
         }                       /* well we either eliminated noisy sbs or mode_ext == 0 */
     }
 
@@ -985,41 +1066,119 @@ void twolame_main_bit_allocation(twolame_options * glopts,
     }
 }
 
-static void vbr_maxmnr(FLOAT mnr[2][SBLIMIT], char used[2][SBLIMIT], int sblimit,
-                       int nch, int *min_sb, int *min_ch, FLOAT vbrlevel)
+/*
+  Indexed binary heap of the channels/subbands that can still be given more bits,
+  with the one that has the smallest MNR at the top. Ties are broken by channel
+  and then subband, so it picks the same subband as a linear scan would.
+  Entries are numbered ch * SBLIMIT + sb.
+*/
+
+/* subbands with an MNR this large (or NaN) are never chosen */
+#define MNR_LIMIT   ((FLOAT) 999999.0)
+
+typedef struct {
+    const FLOAT *mnr;           /* mnr[ch][sb] of the bit allocation */
+    int n;                      /* number of entries in the heap */
+    int entry[2 * SBLIMIT];     /* the heap */
+    int pos[2 * SBLIMIT];       /* position of each entry in the heap, -1 if not there */
+} mnr_heap;
+
+static inline int mnr_heap_less(const mnr_heap * h, int a, int b)
 {
-    int sb, ch;
-    FLOAT small;
+    return h->mnr[a] < h->mnr[b] || (h->mnr[a] == h->mnr[b] && a < b);
+}
 
-    small = 999999.0;
-    *min_sb = -1;
-    *min_ch = -1;
+static inline void mnr_heap_set(mnr_heap * h, int i, int idx)
+{
+    h->entry[i] = idx;
+    h->pos[idx] = i;
+}
 
-#define NEWBITx
-#ifdef NEWBIT
-    /* Keep going until all subbands have reached the MNR level that we specified */
-    for (ch = 0; ch < nch; ch++)
-        for (sb = 0; sb < sblimit; sb++)
-            if (mnr[ch][sb] < vbrlevel) {
-                *min_sb = sb;
-                *min_ch = ch;
-                // fprintf(stderr,".");
-                // fflush(stderr);
-                return;
+static void mnr_heap_sift_up(mnr_heap * h, int i)
+{
+    int idx = h->entry[i];
+
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!mnr_heap_less(h, idx, h->entry[parent]))
+            break;
+        mnr_heap_set(h, i, h->entry[parent]);
+        i = parent;
+    }
+    mnr_heap_set(h, i, idx);
+}
+
+static void mnr_heap_sift_down(mnr_heap * h, int i)
+{
+    int idx = h->entry[i];
+
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= h->n)
+            break;
+        if (child + 1 < h->n && mnr_heap_less(h, h->entry[child + 1], h->entry[child]))
+            child++;
+        if (!mnr_heap_less(h, h->entry[child], idx))
+            break;
+        mnr_heap_set(h, i, h->entry[child]);
+        i = child;
+    }
+    mnr_heap_set(h, i, idx);
+}
+
+/* Add, move or remove entry ch/sb after its MNR or 'used' state has changed */
+static void mnr_heap_update(mnr_heap * h, int ch, int sb, int available)
+{
+    int idx = ch * SBLIMIT + sb;
+    int i = h->pos[idx];
+
+    if (!available || !(h->mnr[idx] < MNR_LIMIT)) {
+        if (i >= 0) {
+            int last = h->entry[--h->n];
+            h->pos[idx] = -1;
+            if (last != idx) {
+                mnr_heap_set(h, i, last);
+                mnr_heap_sift_up(h, i);
+                mnr_heap_sift_down(h, h->pos[last]);
             }
-#endif
+        }
+        return;
+    }
 
-    /* Then start adding bits to whichever is the min MNR */
-    for (ch = 0; ch < nch; ++ch)
+    if (i < 0) {
+        i = h->n++;
+        mnr_heap_set(h, i, idx);
+    }
+    mnr_heap_sift_up(h, i);
+    mnr_heap_sift_down(h, h->pos[idx]);
+}
+
+static void mnr_heap_init(mnr_heap * h, FLOAT mnr[2][SBLIMIT], char used[2][SBLIMIT],
+                          int sblimit, int nch)
+{
+    int sb, ch;
+
+    h->mnr = &mnr[0][0];
+    h->n = 0;
+    for (sb = 0; sb < 2 * SBLIMIT; sb++)
+        h->pos[sb] = -1;
+
+    for (ch = 0; ch < nch; ch++)
         for (sb = 0; sb < sblimit; sb++)
-            if (used[ch][sb] != 2 && small > mnr[ch][sb]) {
-                small = mnr[ch][sb];
-                *min_sb = sb;
-                *min_ch = ch;
-            }
-    // fprintf(stderr,"Min sb: %i\n",*min_sb);
+            mnr_heap_update(h, ch, sb, used[ch][sb] != 2);
 }
 
+/* Find the channel/subband with the minimum MNR, or set min_sb to -1 if there is none */
+static void mnr_heap_min(const mnr_heap * h, int *min_sb, int *min_ch)
+{
+    if (h->n == 0) {
+        *min_sb = -1;
+        *min_ch = -1;
+    } else {
+        *min_sb = h->entry[0] % SBLIMIT;
+        *min_ch = h->entry[0] / SBLIMIT;
+    }
+}
 
 
 
@@ -1044,11 +1203,11 @@ int twolame_vbr_bit_allocation(twolame_options * glopts,
     frame_header *header = &glopts->header;
     FLOAT mnr[2][SBLIMIT];
     char used[2][SBLIMIT];
+    mnr_heap heap;
     int nch = glopts->num_channels_out;
     int sblimit = glopts->sblimit;
     int jsbound = glopts->jsbound;
     int banc, berr;
-    static const int sfsPerScfsi[] = { 3, 2, 1, 2 };    /* lookup # sfs per scfsi */
     int thisstep_index;
 
     if (header->error_protection) {
@@ -1073,10 +1232,11 @@ int twolame_vbr_bit_allocation(twolame_options * glopts,
             used[ch][sb] = 0;
         }
     bspl = bscf = bsel = 0;
+    mnr_heap_init(&heap, mnr, used, sblimit, nch);
 
     do {
         /* locate the subband with minimum SMR */
-        vbr_maxmnr(mnr, used, sblimit, nch, &min_sb, &min_ch, glopts->vbrlevel);
+        mnr_heap_min(&heap, &min_sb, &min_ch);
 
         if (min_sb > -1) {      /* there was something to find */
             int thisline = line[glopts->tablenum][min_sb];
@@ -1125,6 +1285,7 @@ int twolame_vbr_bit_allocation(twolame_options * glopts,
             } else {
                 used[min_ch][min_sb] = 2;   /* can't increase this alloc */
             }
+            mnr_heap_update(&heap, min_ch, min_sb, used[min_ch][min_sb] != 2);
         }
     }
     while (min_sb > -1);        /* until could find no channel */
@@ -1141,28 +1302,6 @@ int twolame_vbr_bit_allocation(twolame_options * glopts,
 
 
 
-static void maxmnr(FLOAT mnr[2][SBLIMIT], char used[2][SBLIMIT], int sblimit,
-                   int nch, int *min_sb, int *min_ch)
-{
-    int sb, ch;
-    FLOAT small;
-
-    small = 999999.0;
-    *min_sb = -1;
-    *min_ch = -1;
-    for (ch = 0; ch < nch; ++ch)
-        for (sb = 0; sb < sblimit; sb++)
-            if (used[ch][sb] != 2 && small > mnr[ch][sb]) {
-                small = mnr[ch][sb];
-                *min_sb = sb;
-                *min_ch = ch;
-            }
-}
-
-
-
-
-
 /************************************************************************
 *
 * a_bit_allocation (Layer II)
@@ -1195,12 +1334,12 @@ int twolame_a_bit_allocation(twolame_options * glopts, FLOAT SMR[2][SBLIMIT],
     int bspl, bscf, bsel, ad, bbal = 0;
     FLOAT mnr[2][SBLIMIT];
     char used[2][SBLIMIT];
+    mnr_heap heap;
     frame_header *header = &glopts->header;
     int nch = glopts->num_channels_out;
     int sblimit = glopts->sblimit;
     int jsbound = glopts->jsbound;
     int banc, berr;
-    static const int sfsPerScfsi[] = { 3, 2, 1, 2 };    /* lookup # sfs per scfsi */
 
     int thisstep_index;
 
@@ -1228,10 +1367,11 @@ int twolame_a_bit_allocation(twolame_options * glopts, FLOAT SMR[2][SBLIMIT],
         }
     }
     bspl = bscf = bsel = 0;
+    mnr_heap_init(&heap, mnr, used, sblimit, nch);
 
     do {
         /* locate the subband with minimum SMR */
-        maxmnr(mnr, used, sblimit, nch, &min_sb, &min_ch);
+        mnr_heap_min(&heap, &min_sb, &min_ch);
 
         if (min_sb > -1) {      /* there was something to find */
             int thisline = line[glopts->tablenum][min_sb];
@@ -1287,7 +1427,9 @@ int twolame_a_bit_allocation(twolame_options * glopts, FLOAT SMR[2][SBLIMIT],
                 thisstep_index = step_index[thisline][ba];
                 mnr[oth_ch][min_sb] = SNR[thisstep_index] - SMR[oth_ch][min_sb];
                 // mnr[oth_ch][min_sb] = SNR[(*alloc)[min_sb][ba].quant + 1] - SMR[oth_ch][min_sb];
+                mnr_heap_update(&heap, oth_ch, min_sb, used[oth_ch][min_sb] != 2);
             }
+            mnr_heap_update(&heap, min_ch, min_sb, used[min_ch][min_sb] != 2);
 
         }
     }
@@ -23,6 +23,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "twolame.h"
 #include "common.h"
@@ -47,9 +48,10 @@ int twolame_get_required_energy_bits(twolame_options * glopts)
 }
 
 
-// Calculates the energy levels of current frame and
+// Calculates the energy levels of the frame in buffer and
 // inserts it into the end of the frame
-void twolame_do_energy_levels(twolame_options * glopts, bit_stream * bs)
+void twolame_do_energy_levels(twolame_options * glopts,
+                              FLOAT buffer[2][TWOLAME_SAMPLES_PER_FRAME], bit_stream * bs)
 {
     /* Reference: Using the BWF Energy Levels in AudioScience Bitstreams
        http://www.audioscience.com/internet/download/notes/note0001_MPEG_energy.pdf
@@ -64,8 +66,8 @@ void twolame_do_energy_levels(twolame_options * glopts, bit_stream * bs)
        The last 5 bytes *must* be reserved for this to work correctly (otherwise you'll be
        overwriting mpeg audio data) */
 
-    short int *leftpcm = glopts->buffer[0];
-    short int *rightpcm = glopts->buffer[1];
+    FLOAT *leftpcm = buffer[0];
+    FLOAT *rightpcm = buffer[1];
 
     int i, leftMax, rightMax;
     unsigned char rhibyte, rlobyte, lhibyte, llobyte;
@@ -77,10 +79,10 @@ void twolame_do_energy_levels(twolame_options * glopts, bit_stream * bs)
     // find the maximum in the left and right channels
     leftMax = rightMax = -1;
     for (i = 0; i < TWOLAME_SAMPLES_PER_FRAME; i++) {
-        if (abs(leftpcm[i]) > leftMax)
-            leftMax = abs(leftpcm[i]);
-        if (abs(rightpcm[i]) > rightMax)
-            rightMax = abs(rightpcm[i]);
+        if ((int) fabs(leftpcm[i]) > leftMax)
+            leftMax = (int) fabs(leftpcm[i]);
+        if ((int) fabs(rightpcm[i]) > rightMax)
+            rightMax = (int) fabs(rightpcm[i]);
     }
 
 
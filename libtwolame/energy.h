@@ -26,7 +26,8 @@
 #define TWOLAME_ENERGY_H
 
 int twolame_get_required_energy_bits(twolame_options * glopts);
-void twolame_do_energy_levels(twolame_options * glopts, bit_stream * bs);
+void twolame_do_energy_levels(twolame_options * glopts,
+                              FLOAT buffer[2][TWOLAME_SAMPLES_PER_FRAME], bit_stream * bs);
 
 #endif
 
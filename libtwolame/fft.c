@@ -58,7 +58,10 @@
 
 #include "twolame.h"
 #include "common.h"
+#include "cpu.h"
+#include "simd.h"
 #include "fft.h"
+#include "tables.h"
 
 
 
@@ -1218,68 +1221,525 @@ static void fht(FLOAT * fz)
     while (k4 < 1024);
 }
 
-#ifdef NEWATAN
-#define ATANSIZE 6000
-#define ATANSCALE 100.0
-/* Create a table of ATAN2 values.
-   Valid for ratios of (y/x) from 0 to ATANSIZE/ATANSCALE (60)
-   Largest absolute error in angle: 0.0167 radians i.e. ATANSCALE/ATANSIZE
-   Depending on how you want to trade off speed/accuracy and mem usage, twiddle the defines
-   MFC March 2003 */
-static FLOAT atan_t[ATANSIZE];
-
-static inline FLOAT atan_table(FLOAT y, FLOAT x)
+/*
+  Fast alternative to fht(): a real FFT of the 1024 samples, done as
+  a 512 point complex FFT of the even and odd samples followed by a
+  split into the spectrum of the real input. The result is written
+  back out in the same order as fht(), so that fz[k] and fz[1024 - k]
+  hold Re X[k] - Im X[k] and Re X[k] + Im X[k].
+
+  The complex FFT is a Stockham autosort FFT (no bit reversal) with
+  four radix-4 passes and a last radix-2 pass that is merged into the
+  split. The data are kept as separate real and imaginary arrays, so
+  that the SIMD kernels can work on vectors of consecutive points.
+  Every kernel does the same operations in the same order, so that
+  all code paths give identical results.
+
+  The pass with span n = 4m reads x[q + s(p + km)] and writes
+  y[q + s(4p + k)] for k = 0..3, p < m and q < s, multiplied by the
+  twiddles exp(-2 PI i kp / n) held in wr/wi[(k - 1)m + p].
+  The SIMD kernels take vectors of q, or of p for the first pass
+  (s = 1) and scatter the results.
+*/
+
+#define FFT_RADIX4(VEC, ADD, SUB, MUL, LOAD, STORE, xr, xi, in, in_stride, yr, yi, out, out_stride, \
+                   w1r, w1i, w2r, w2i, w3r, w3i) \
+    { \
+        VEC ar = LOAD((xr) + (in)), ai = LOAD((xi) + (in)); \
+        VEC br = LOAD((xr) + (in) + (in_stride)), bi = LOAD((xi) + (in) + (in_stride)); \
+        VEC cr = LOAD((xr) + (in) + 2 * (in_stride)), ci = LOAD((xi) + (in) + 2 * (in_stride)); \
+        VEC dr = LOAD((xr) + (in) + 3 * (in_stride)), di = LOAD((xi) + (in) + 3 * (in_stride)); \
+        VEC apc_r = ADD(ar, cr), apc_i = ADD(ai, ci); \
+        VEC amc_r = SUB(ar, cr), amc_i = SUB(ai, ci); \
+        VEC bpd_r = ADD(br, dr), bpd_i = ADD(bi, di); \
+        VEC bmd_r = SUB(br, dr), bmd_i = SUB(bi, di); \
+        VEC t1r = ADD(amc_r, bmd_i), t1i = SUB(amc_i, bmd_r); \
+        VEC t2r = SUB(apc_r, bpd_r), t2i = SUB(apc_i, bpd_i); \
+        VEC t3r = SUB(amc_r, bmd_i), t3i = ADD(amc_i, bmd_r); \
+        STORE((yr) + (out), ADD(apc_r, bpd_r)); \
+        STORE((yi) + (out), ADD(apc_i, bpd_i)); \
+        STORE((yr) + (out) + (out_stride), SUB(MUL(t1r, w1r), MUL(t1i, w1i))); \
+        STORE((yi) + (out) + (out_stride), ADD(MUL(t1r, w1i), MUL(t1i, w1r))); \
+        STORE((yr) + (out) + 2 * (out_stride), SUB(MUL(t2r, w2r), MUL(t2i, w2i))); \
+        STORE((yi) + (out) + 2 * (out_stride), ADD(MUL(t2r, w2i), MUL(t2i, w2r))); \
+        STORE((yr) + (out) + 3 * (out_stride), SUB(MUL(t3r, w3r), MUL(t3i, w3i))); \
+        STORE((yi) + (out) + 3 * (out_stride), ADD(MUL(t3r, w3i), MUL(t3i, w3r))); \
+    }
+
+/* Radix-4 pass vectorised over q */
+#define FFT_PASS_Q(VEC, W, ADD, SUB, MUL, LOAD, STORE, SET1) \
+    for (p = 0; p < m; p++) { \
+        const VEC w1r = SET1(wr[p]), w2r = SET1(wr[m + p]), w3r = SET1(wr[2 * m + p]); \
+        const VEC w1i = SET1(wi[p]), w2i = SET1(wi[m + p]), w3i = SET1(wi[2 * m + p]); \
+        for (q = 0; q < s; q += (W)) \
+            FFT_RADIX4(VEC, ADD, SUB, MUL, LOAD, STORE, xr, xi, q + s * p, s * m, \
+                       yr, yi, q + 4 * s * p, s, w1r, w1i, w2r, w2i, w3r, w3i); \
+    }
+
+/* First radix-4 pass (s = 1) vectorised over p */
+#define FFT_PASS_P(VEC, W, ADD, SUB, MUL, LOAD, STORE) \
+    for (p = 0; p < m; p += (W)) { \
+        FLOAT tr[4 * (W)], ti[4 * (W)]; \
+        const VEC w1r = LOAD(wr + p), w2r = LOAD(wr + m + p), w3r = LOAD(wr + 2 * m + p); \
+        const VEC w1i = LOAD(wi + p), w2i = LOAD(wi + m + p), w3i = LOAD(wi + 2 * m + p); \
+        FFT_RADIX4(VEC, ADD, SUB, MUL, LOAD, STORE, xr, xi, p, m, \
+                   tr, ti, 0, (W), w1r, w1i, w2r, w2i, w3r, w3i); \
+        for (q = 0; q < (W); q++) \
+            for (k = 0; k < 4; k++) { \
+                yr[4 * (p + q) + k] = tr[k * (W) + q]; \
+                yi[4 * (p + q) + k] = ti[k * (W) + q]; \
+            } \
+    }
+
+/*
+  The last radix-2 pass gives Z[k] = A[k] + B[k] and Z[k + 256] = A[k] - B[k].
+  With E = (Z[k] + conj(Z[512 - k])) / 2 and O = (Z[k] - conj(Z[512 - k])) / 2i,
+  X[k] = E + W^k O and X[512 - k] = conj(E - W^k O), where W^k is in post_re/im[k - 1].
+  The SIMD kernels do W values of k at a time, reading and writing the mirrored
+  values in reverse, and leave the last few values to split_from().
+*/
+#define FFT_SPLIT(VEC, W, ADD, SUB, MUL, LOAD, STORE, SET1, REVERSE) \
+    for (k = 1; k + (W) <= 256; k += (W)) { \
+        const int rk = 257 - k - (W); \
+        const VEC half = SET1(0.5); \
+        VEC zr = ADD(LOAD(re + k), LOAD(re + 256 + k)); \
+        VEC zi = ADD(LOAD(im + k), LOAD(im + 256 + k)); \
+        VEC cr = REVERSE(SUB(LOAD(re + rk), LOAD(re + 256 + rk))); \
+        VEC ci = REVERSE(SUB(LOAD(im + rk), LOAD(im + 256 + rk))); \
+        VEC er = MUL(half, ADD(zr, cr)), ei = MUL(half, SUB(zi, ci)); \
+        VEC odd_r = MUL(half, ADD(zi, ci)), odd_i = MUL(half, SUB(cr, zr)); \
+        VEC wr = LOAD(fft->post_re + k - 1), wi = LOAD(fft->post_im + k - 1); \
+        VEC tr = SUB(MUL(wr, odd_r), MUL(wi, odd_i)), ti = ADD(MUL(wr, odd_i), MUL(wi, odd_r)); \
+        STORE(fz + k, SUB(ADD(er, tr), ADD(ei, ti))); \
+        STORE(fz + 1024 - k - ((W) - 1), REVERSE(ADD(ADD(er, tr), ADD(ei, ti)))); \
+        STORE(fz + 512 - k - ((W) - 1), REVERSE(ADD(SUB(er, tr), SUB(ei, ti)))); \
+        STORE(fz + 512 + k, SUB(SUB(er, tr), SUB(ei, ti))); \
+    }
+
+#define SCALAR_ADD(a, b)        ((a) + (b))
+#define SCALAR_SUB(a, b)        ((a) - (b))
+#define SCALAR_MUL(a, b)        ((a) * (b))
+#define SCALAR_LOAD(p)          (*(p))
+#define SCALAR_STORE(p, v)      (*(p) = (v))
+#define SCALAR_SET1(v)          (v)
+
+static void radix4_scalar(const FLOAT * wr, const FLOAT * wi, const FLOAT * xr, const FLOAT * xi,
+                          FLOAT * yr, FLOAT * yi, int m, int s)
 {
-    int index;
+    int p, q;
 
-    index = (int) (ATANSCALE * fabs(y / x));
-    if (index >= ATANSIZE)
-        index = ATANSIZE - 1;
+    FFT_PASS_Q(FLOAT, 1, SCALAR_ADD, SCALAR_SUB, SCALAR_MUL, SCALAR_LOAD, SCALAR_STORE,
+               SCALAR_SET1);
+}
 
-    /* Have to work out the correct quadrant as well */
-    if (y > 0 && x < 0)
-        return (PI - atan_t[index]);
+static void split_from(const fft_mem * fft, const FLOAT * re, const FLOAT * im, FLOAT * fz, int k)
+{
+    for (; k <= 256; k++) {
+        FLOAT zr, zi, cr, ci, er, ei, odd_r, odd_i, tr, ti;
 
-    if (y < 0 && x > 0)
-        return (-atan_t[index]);
+        if (k < 256) {
+            zr = re[k] + re[256 + k];
+            zi = im[k] + im[256 + k];
+        } else {
+            zr = re[0] - re[256];
+            zi = im[0] - im[256];
+        }
+        cr = re[256 - k] - re[512 - k];
+        ci = im[256 - k] - im[512 - k];
 
-    if (y < 0 && x < 0)
-        return (atan_t[index] - PI);
+        er = 0.5 * (zr + cr);
+        ei = 0.5 * (zi - ci);
+        odd_r = 0.5 * (zi + ci);
+        odd_i = 0.5 * (cr - zr);
+        tr = fft->post_re[k - 1] * odd_r - fft->post_im[k - 1] * odd_i;
+        ti = fft->post_re[k - 1] * odd_i + fft->post_im[k - 1] * odd_r;
 
-    return (atan_t[index]);
+        fz[k] = (er + tr) - (ei + ti);
+        fz[1024 - k] = (er + tr) + (ei + ti);
+        fz[512 - k] = (er - tr) + (ei - ti);
+        fz[512 + k] = (er - tr) - (ei - ti);
+    }
 }
 
-static void atan_table_init(void)
+static void split_scalar(const fft_mem * fft, const FLOAT * re, const FLOAT * im, FLOAT * fz)
 {
-    int i;
-    for (i = 0; i < ATANSIZE; i++)
-        atan_t[i] = atan((FLOAT) i / ATANSCALE);
+    split_from(fft, re, im, fz, 1);
 }
 
-#endif                          // NEWATAN
+#if defined(TWOLAME_X86_SIMD)
 
-/* For variations on psycho model 2:
-   N always equals 1024
-   BUT in the returned values, no energy/phi is used at or above an index of 513 */
-void twolame_psycho_2_fft(FLOAT * x_real, FLOAT * energy, FLOAT * phi)
-/* got rid of size "N" argument as it is always 1024 for layerII */
+SSE2_TARGET static void radix4_sse2(const FLOAT * wr, const FLOAT * wi, const FLOAT * xr,
+                                    const FLOAT * xi, FLOAT * yr, FLOAT * yi, int m, int s)
 {
-    FLOAT imag, real;
-    int i, j;
-#ifdef NEWATAN
-    static int init = 0;
+    int p, q, k;
+
+    if (s >= SSE_WIDTH) {
+        FFT_PASS_Q(sse_vec, SSE_WIDTH, sse_add, sse_sub, sse_mul, sse_load, sse_store, sse_set1);
+    } else if (s == 1) {
+        FFT_PASS_P(sse_vec, SSE_WIDTH, sse_add, sse_sub, sse_mul, sse_load, sse_store);
+    } else {
+        radix4_scalar(wr, wi, xr, xi, yr, yi, m, s);
+    }
+}
+
+SSE2_TARGET static void split_sse2(const fft_mem * fft, const FLOAT * re, const FLOAT * im,
+                                   FLOAT * fz)
+{
+    int k;
+
+    FFT_SPLIT(sse_vec, SSE_WIDTH, sse_add, sse_sub, sse_mul, sse_load, sse_store, sse_set1,
+              sse_reverse);
+
+    split_from(fft, re, im, fz, k);
+}
+
+AVX2_TARGET static void radix4_avx2(const FLOAT * wr, const FLOAT * wi, const FLOAT * xr,
+                                    const FLOAT * xi, FLOAT * yr, FLOAT * yi, int m, int s)
+{
+    int p, q, k;
 
-    if (!init) {
-        atan_table_init();
-        init=1;
+    if (s >= AVX_WIDTH) {
+        FFT_PASS_Q(avx_vec, AVX_WIDTH, avx_add, avx_sub, avx_mul, avx_load, avx_store, avx_set1);
+    } else if (s == 1) {
+        FFT_PASS_P(avx_vec, AVX_WIDTH, avx_add, avx_sub, avx_mul, avx_load, avx_store);
+    } else {
+        radix4_sse2(wr, wi, xr, xi, yr, yi, m, s);
     }
+}
+
+AVX2_TARGET static void split_avx2(const fft_mem * fft, const FLOAT * re, const FLOAT * im,
+                                   FLOAT * fz)
+{
+    int k;
+
+    FFT_SPLIT(avx_vec, AVX_WIDTH, avx_add, avx_sub, avx_mul, avx_load, avx_store, avx_set1,
+              avx_reverse);
+
+    /* clean the upper halves of the registers before the SSE code of split_from(),
+       the compiler doesn't do this before a tail call */
+    avx_zeroupper();
+    split_from(fft, re, im, fz, k);
+}
+
+#elif defined(TWOLAME_NEON_SIMD)
+
+static void radix4_neon(const FLOAT * wr, const FLOAT * wi, const FLOAT * xr, const FLOAT * xi,
+                        FLOAT * yr, FLOAT * yi, int m, int s)
+{
+    int p, q, k;
+
+    if (s >= NEON_WIDTH) {
+        FFT_PASS_Q(neon_vec, NEON_WIDTH, neon_add, neon_sub, neon_mul, neon_load, neon_store,
+                   neon_set1);
+    } else if (s == 1) {
+        FFT_PASS_P(neon_vec, NEON_WIDTH, neon_add, neon_sub, neon_mul, neon_load, neon_store);
+    } else {
+        radix4_scalar(wr, wi, xr, xi, yr, yi, m, s);
+    }
+}
+
+static void split_neon(const fft_mem * fft, const FLOAT * re, const FLOAT * im, FLOAT * fz)
+{
+    int k;
+
+    FFT_SPLIT(neon_vec, NEON_WIDTH, neon_add, neon_sub, neon_mul, neon_load, neon_store,
+              neon_set1, neon_reverse);
+
+    split_from(fft, re, im, fz, k);
+}
+
 #endif
 
+/*
+  Batched transforms keep FFT_BATCH blocks side by side, point i of
+  block b at x[i * FFT_BATCH + b], so that the SIMD kernels work on
+  vectors of blocks and every pass and the split are the same shape.
+  The operations on each block are those of the single transform, so
+  the results are identical. Only the first lanes blocks are computed
+  (rounded up to the vector width, the extra blocks are zero).
+*/
+#define FFT_PASS_BATCH(VEC, W, ADD, SUB, MUL, LOAD, STORE, SET1) \
+    for (p = 0; p < m; p++) { \
+        const VEC w1r = SET1(wr[p]), w2r = SET1(wr[m + p]), w3r = SET1(wr[2 * m + p]); \
+        const VEC w1i = SET1(wi[p]), w2i = SET1(wi[m + p]), w3i = SET1(wi[2 * m + p]); \
+        for (q = 0; q < s; q++) \
+            for (l = 0; l < lanes; l += (W)) \
+                FFT_RADIX4(VEC, ADD, SUB, MUL, LOAD, STORE, xr, xi, \
+                           (q + s * p) * FFT_BATCH + l, s * m * FFT_BATCH, \
+                           yr, yi, (q + 4 * s * p) * FFT_BATCH + l, s * FFT_BATCH, \
+                           w1r, w1i, w2r, w2i, w3r, w3i); \
+    }
 
-    fht(x_real);
+#define FFT_SPLIT_BATCH(VEC, W, ADD, SUB, MUL, LOAD, STORE, SET1) \
+    for (k = 1; k <= 256; k++) { \
+        const int zk = (k < 256) ? k : 0; \
+        const VEC half = SET1(0.5); \
+        const VEC wr = SET1(fft->post_re[k - 1]), wi = SET1(fft->post_im[k - 1]); \
+        for (l = 0; l < lanes; l += (W)) { \
+            VEC zr, zi, cr, ci, er, ei, odd_r, odd_i, tr, ti; \
+            if (k < 256) { \
+                zr = ADD(LOAD(re + zk * FFT_BATCH + l), LOAD(re + (256 + zk) * FFT_BATCH + l)); \
+                zi = ADD(LOAD(im + zk * FFT_BATCH + l), LOAD(im + (256 + zk) * FFT_BATCH + l)); \
+            } else { \
+                zr = SUB(LOAD(re + zk * FFT_BATCH + l), LOAD(re + (256 + zk) * FFT_BATCH + l)); \
+                zi = SUB(LOAD(im + zk * FFT_BATCH + l), LOAD(im + (256 + zk) * FFT_BATCH + l)); \
+            } \
+            cr = SUB(LOAD(re + (256 - k) * FFT_BATCH + l), LOAD(re + (512 - k) * FFT_BATCH + l)); \
+            ci = SUB(LOAD(im + (256 - k) * FFT_BATCH + l), LOAD(im + (512 - k) * FFT_BATCH + l)); \
+            er = MUL(half, ADD(zr, cr)); \
+            ei = MUL(half, SUB(zi, ci)); \
+            odd_r = MUL(half, ADD(zi, ci)); \
+            odd_i = MUL(half, SUB(cr, zr)); \
+            tr = SUB(MUL(wr, odd_r), MUL(wi, odd_i)); \
+            ti = ADD(MUL(wr, odd_i), MUL(wi, odd_r)); \
+            STORE(fz + k * FFT_BATCH + l, SUB(ADD(er, tr), ADD(ei, ti))); \
+            STORE(fz + (1024 - k) * FFT_BATCH + l, ADD(ADD(er, tr), ADD(ei, ti))); \
+            STORE(fz + (512 - k) * FFT_BATCH + l, ADD(SUB(er, tr), SUB(ei, ti))); \
+            STORE(fz + (512 + k) * FFT_BATCH + l, SUB(SUB(er, tr), SUB(ei, ti))); \
+        } \
+    }
 
+static void radix4_batch_scalar(const FLOAT * wr, const FLOAT * wi, const FLOAT * xr,
+                                const FLOAT * xi, FLOAT * yr, FLOAT * yi, int m, int s, int lanes)
+{
+    int p, q, l;
 
-    energy[0] = x_real[0] * x_real[0];
+    FFT_PASS_BATCH(FLOAT, 1, SCALAR_ADD, SCALAR_SUB, SCALAR_MUL, SCALAR_LOAD, SCALAR_STORE,
+                   SCALAR_SET1);
+}
+
+static void split_batch_scalar(const fft_mem * fft, const FLOAT * re, const FLOAT * im,
+                               FLOAT * fz, int lanes)
+{
+    int k, l;
+
+    FFT_SPLIT_BATCH(FLOAT, 1, SCALAR_ADD, SCALAR_SUB, SCALAR_MUL, SCALAR_LOAD, SCALAR_STORE,
+                    SCALAR_SET1);
+}
+
+#if defined(TWOLAME_X86_SIMD)
+
+SSE2_TARGET static void radix4_batch_sse2(const FLOAT * wr, const FLOAT * wi, const FLOAT * xr,
+                                          const FLOAT * xi, FLOAT * yr, FLOAT * yi, int m, int s,
+                                          int lanes)
+{
+    int p, q, l;
+
+    FFT_PASS_BATCH(sse_vec, SSE_WIDTH, sse_add, sse_sub, sse_mul, sse_load, sse_store, sse_set1);
+}
+
+SSE2_TARGET static void split_batch_sse2(const fft_mem * fft, const FLOAT * re, const FLOAT * im,
+                                         FLOAT * fz, int lanes)
+{
+    int k, l;
+
+    FFT_SPLIT_BATCH(sse_vec, SSE_WIDTH, sse_add, sse_sub, sse_mul, sse_load, sse_store, sse_set1);
+}
+
+#if AVX_WIDTH <= FFT_BATCH
+
+AVX2_TARGET static void radix4_batch_avx2(const FLOAT * wr, const FLOAT * wi, const FLOAT * xr,
+                                          const FLOAT * xi, FLOAT * yr, FLOAT * yi, int m, int s,
+                                          int lanes)
+{
+    int p, q, l;
+
+    FFT_PASS_BATCH(avx_vec, AVX_WIDTH, avx_add, avx_sub, avx_mul, avx_load, avx_store, avx_set1);
+}
+
+AVX2_TARGET static void split_batch_avx2(const fft_mem * fft, const FLOAT * re, const FLOAT * im,
+                                         FLOAT * fz, int lanes)
+{
+    int k, l;
+
+    FFT_SPLIT_BATCH(avx_vec, AVX_WIDTH, avx_add, avx_sub, avx_mul, avx_load, avx_store, avx_set1);
+}
+
+#endif
+
+#elif defined(TWOLAME_NEON_SIMD)
+
+static void radix4_batch_neon(const FLOAT * wr, const FLOAT * wi, const FLOAT * xr,
+                              const FLOAT * xi, FLOAT * yr, FLOAT * yi, int m, int s, int lanes)
+{
+    int p, q, l;
+
+    FFT_PASS_BATCH(neon_vec, NEON_WIDTH, neon_add, neon_sub, neon_mul, neon_load, neon_store,
+                   neon_set1);
+}
+
+static void split_batch_neon(const fft_mem * fft, const FLOAT * re, const FLOAT * im,
+                             FLOAT * fz, int lanes)
+{
+    int k, l;
+
+    FFT_SPLIT_BATCH(neon_vec, NEON_WIDTH, neon_add, neon_sub, neon_mul, neon_load, neon_store,
+                    neon_set1);
+}
+
+#endif
+
+static void real_fft(const fft_mem * fft, FLOAT * fz)
+{
+    FLOAT re[2][512], im[2][512];
+    const FLOAT *wr = fft->stage_re, *wi = fft->stage_im;
+    int i, m, s, src;
+
+    /* the even samples are the real part, the odd ones the imaginary part */
+    for (i = 0; i < 512; i++) {
+        re[0][i] = fz[2 * i];
+        im[0][i] = fz[2 * i + 1];
+    }
+
+    src = 0;
+    for (m = 128, s = 1; m > 1; m /= 4, s *= 4) {
+        fft->radix4(wr, wi, re[src], im[src], re[1 - src], im[1 - src], m, s);
+        wr += 3 * m;
+        wi += 3 * m;
+        src = 1 - src;
+    }
+
+    fz[0] = (re[src][0] + re[src][256]) + (im[src][0] + im[src][256]);
+    fz[512] = (re[src][0] + re[src][256]) - (im[src][0] + im[src][256]);
+    fft->split(fft, re[src], im[src], fz);
+}
+
+static void real_fft_batch(const fft_mem * fft, FLOAT fz[][BLKSIZE], int n)
+{
+    FLOAT buf[2][2][512 * FFT_BATCH];   // real and imaginary parts, twice
+    const FLOAT *wr = fft->stage_re, *wi = fft->stage_im;
+    FLOAT *out;
+    int lanes = (n + fft->batch_width - 1) / fft->batch_width * fft->batch_width;
+    int b, i, m, s, src;
+
+    for (i = 0; i < 512; i++)
+        for (b = 0; b < FFT_BATCH; b++) {
+            buf[0][0][i * FFT_BATCH + b] = (b < n) ? fz[b][2 * i] : 0.0;
+            buf[0][1][i * FFT_BATCH + b] = (b < n) ? fz[b][2 * i + 1] : 0.0;
+        }
+
+    src = 0;
+    for (m = 128, s = 1; m > 1; m /= 4, s *= 4) {
+        fft->radix4_batch(wr, wi, buf[src][0], buf[src][1], buf[1 - src][0], buf[1 - src][1], m,
+                          s, lanes);
+        wr += 3 * m;
+        wi += 3 * m;
+        src = 1 - src;
+    }
+
+    /* the spectrum goes into the other half of the buffer */
+    out = buf[1 - src][0];
+    fft->split_batch(fft, buf[src][0], buf[src][1], out, lanes);
+
+    for (b = 0; b < n; b++) {
+        const FLOAT *re = buf[src][0], *im = buf[src][1];
+        fz[b][0] = (re[b] + re[256 * FFT_BATCH + b]) + (im[b] + im[256 * FFT_BATCH + b]);
+        fz[b][512] = (re[b] + re[256 * FFT_BATCH + b]) - (im[b] + im[256 * FFT_BATCH + b]);
+        for (i = 1; i < 1024; i++)
+            if (i != 512)
+                fz[b][i] = out[i * FFT_BATCH + b];
+    }
+}
+
+
+/*
+  Energy and phase of the spectrum for psycho model 2, computed in
+  bulk with a polynomial atan2() rather than the libm one.
+
+  atan(t) for 0 <= t <= 1 is t P(t^2), with the coefficients of
+  Abramowitz and Stegun 4.4.49 (|error| < 1.4e-8 rad) or 4.4.47
+  (|error| < 1.2e-5 rad), and the octant is restored with selects:
+  atan(y/x) = PI/2 - atan(x/y) when |y| > |x|, PI - r when x < 0
+  and -r when y < 0. Bins with too little energy get the floor
+  energy and a zero phase through a mask, as in the libm version.
+  The scalar version is the same macro with one lane, so every
+  kernel gives the same results.
+*/
+static const FLOAT atan_coef_fine[] = {
+    1.0, -0.3333314528, 0.1999355085, -0.1420889944, 0.1065626393,
+    -0.0752896400, 0.0429096138, -0.0161657367, 0.0028662257
+};
+
+static const FLOAT atan_coef_coarse[] = {
+    0.9998660, -0.3302995, 0.1801410, -0.0851330, 0.0208351
+};
+
+#define PHASE_SPECTRUM(P, W) \
+    for (; i + (W) <= 512; i += (W)) { \
+        const P##_vec imag = P##_load(x_real + i); \
+        const P##_vec real = P##_reverse(P##_load(x_real + 1024 - i - ((W) - 1))); \
+        const P##_vec e = P##_mul(P##_add(P##_mul(imag, imag), P##_mul(real, real)), \
+                                  P##_set1(0.5)); \
+        const P##_vec y = P##_sub(P##_zero(), imag), x = real; \
+        const P##_vec ax = P##_abs(x), ay = P##_abs(y); \
+        const P##_vec t = P##_div(P##_min(ax, ay), P##_max(ax, ay)), t2 = P##_mul(t, t); \
+        P##_vec r = P##_set1(fft->atan_coef[fft->atan_terms - 1]); \
+        for (j = fft->atan_terms - 2; j >= 0; j--) \
+            r = P##_add(P##_mul(r, t2), P##_set1(fft->atan_coef[j])); \
+        r = P##_mul(r, t); \
+        r = P##_select(P##_cmplt(ax, ay), P##_sub(P##_set1(PI / 2), r), r); \
+        r = P##_select(P##_cmplt(x, P##_zero()), P##_sub(P##_set1(PI), r), r); \
+        r = P##_select(P##_cmplt(y, P##_zero()), P##_sub(P##_zero(), r), r); \
+        r = P##_add(r, P##_set1(PI / 4)); \
+        P##_store(energy + i, P##_select(P##_cmplt(e, P##_set1(0.0005)), P##_set1(0.0005), e)); \
+        P##_store(phi + i, P##_select(P##_cmplt(e, P##_set1(0.0005)), P##_zero(), r)); \
+    }
+
+static void spectrum_from(const fft_mem * fft, const FLOAT * x_real, FLOAT * energy, FLOAT * phi,
+                          int i)
+{
+    int j;
+
+    PHASE_SPECTRUM(scalar, 1);
+}
+
+static void spectrum_scalar(const fft_mem * fft, const FLOAT * x_real, FLOAT * energy, FLOAT * phi)
+{
+    spectrum_from(fft, x_real, energy, phi, 1);
+}
+
+#if defined(TWOLAME_X86_SIMD)
+
+SSE2_TARGET static void spectrum_sse2(const fft_mem * fft, const FLOAT * x_real, FLOAT * energy,
+                                      FLOAT * phi)
+{
+    int i = 1, j;
+
+    PHASE_SPECTRUM(sse, SSE_WIDTH);
+
+    spectrum_from(fft, x_real, energy, phi, i);
+}
+
+AVX2_TARGET static void spectrum_avx2(const fft_mem * fft, const FLOAT * x_real, FLOAT * energy,
+                                      FLOAT * phi)
+{
+    int i = 1, j;
+
+    PHASE_SPECTRUM(avx, AVX_WIDTH);
+
+    avx_zeroupper();
+    spectrum_from(fft, x_real, energy, phi, i);
+}
+
+#elif defined(TWOLAME_NEON_SIMD)
+
+static void spectrum_neon(const fft_mem * fft, const FLOAT * x_real, FLOAT * energy, FLOAT * phi)
+{
+    int i = 1, j;
+
+    PHASE_SPECTRUM(neon, NEON_WIDTH);
+
+    spectrum_from(fft, x_real, energy, phi, i);
+}
+
+#endif
+
+static void spectrum_libm(const fft_mem * fft, const FLOAT * x_real, FLOAT * energy, FLOAT * phi)
+{
+    FLOAT imag, real;
+    int i, j;
+
+    (void) fft;                 // only the vectorised phases need the tables
 
     for (i = 1, j = 1023; i < 512; i++, j--) {
         imag = x_real[i];
@@ -1291,28 +1751,128 @@ void twolame_psycho_2_fft(FLOAT * x_real, FLOAT * energy, FLOAT * phi)
         if (energy[i] < 0.0005) {
             energy[i] = 0.0005;
             phi[i] = 0;
-        } else
-#ifdef NEWATAN
-        {
-            phi[i] = atan_table(-imag, real) + PI / 4;
-        }
-#else
-        {
+        } else {
             phi[i] = atan2(-(FLOAT) imag, (FLOAT) real) + PI / 4;
         }
+    }
+}
+
+void twolame_fft_init(fft_mem * fft, int fast_fft, int fast_phase)
+{
+#if defined(TWOLAME_X86_SIMD) || defined(TWOLAME_NEON_SIMD)
+    int cpu = twolame_cpu_features();
 #endif
+
+    fft->fast = fast_fft;
+    if (fast_phase == 2) {
+        fft->atan_coef = atan_coef_coarse;
+        fft->atan_terms = sizeof(atan_coef_coarse) / sizeof(atan_coef_coarse[0]);
+    } else {
+        fft->atan_coef = atan_coef_fine;
+        fft->atan_terms = sizeof(atan_coef_fine) / sizeof(atan_coef_fine[0]);
+    }
+
+    fft->stage_re = twolame_fft_stage_re;
+    fft->stage_im = twolame_fft_stage_im;
+    fft->post_re = twolame_fft_post_re;
+    fft->post_im = twolame_fft_post_im;
+
+    fft->radix4 = radix4_scalar;
+    fft->split = split_scalar;
+    fft->radix4_batch = radix4_batch_scalar;
+    fft->split_batch = split_batch_scalar;
+    fft->batch_width = 1;
+    fft->spectrum = spectrum_scalar;
+#if defined(TWOLAME_X86_SIMD)
+    if (cpu & TWOLAME_CPU_AVX2)
+        fft->spectrum = spectrum_avx2;
+    else if (cpu & TWOLAME_CPU_SSE2)
+        fft->spectrum = spectrum_sse2;
+    if (cpu & TWOLAME_CPU_AVX2) {
+        fft->radix4 = radix4_avx2;
+        fft->split = split_avx2;
+    } else if (cpu & TWOLAME_CPU_SSE2) {
+        fft->radix4 = radix4_sse2;
+        fft->split = split_sse2;
     }
+#if AVX_WIDTH <= FFT_BATCH
+    if (cpu & TWOLAME_CPU_AVX2) {
+        fft->radix4_batch = radix4_batch_avx2;
+        fft->split_batch = split_batch_avx2;
+        fft->batch_width = AVX_WIDTH;
+    } else
+#endif
+    if (cpu & TWOLAME_CPU_SSE2) {
+        fft->radix4_batch = radix4_batch_sse2;
+        fft->split_batch = split_batch_sse2;
+        fft->batch_width = SSE_WIDTH;
+    }
+#elif defined(TWOLAME_NEON_SIMD)
+    if (cpu & TWOLAME_CPU_NEON) {
+        fft->radix4 = radix4_neon;
+        fft->split = split_neon;
+        fft->radix4_batch = radix4_batch_neon;
+        fft->split_batch = split_batch_neon;
+        fft->batch_width = NEON_WIDTH;
+        fft->spectrum = spectrum_neon;
+    }
+#endif
+    if (!fast_phase)
+        fft->spectrum = spectrum_libm;
+}
+
+
+/* For variations on psycho model 2:
+   N always equals 1024
+   BUT in the returned values, no energy/phi is used at or above an index of 513 */
+static void psycho_2_spectrum(const fft_mem * fft, const FLOAT * x_real, FLOAT * energy,
+                              FLOAT * phi)
+{
+    energy[0] = x_real[0] * x_real[0];
+    fft->spectrum(fft, x_real, energy, phi);
     energy[512] = x_real[512] * x_real[512];
     phi[512] = atan2(0.0, (FLOAT) x_real[512]);
 }
 
 
-void twolame_psycho_1_fft(FLOAT * x_real, FLOAT * energy, int N)
+void twolame_psycho_2_fft(const fft_mem * fft, FLOAT * x_real, FLOAT * energy, FLOAT * phi)
+/* got rid of size "N" argument as it is always 1024 for layerII */
+{
+    if (fft->fast)
+        real_fft(fft, x_real);
+    else
+        fht(x_real);
+
+    psycho_2_spectrum(fft, x_real, energy, phi);
+}
+
+
+/* The same as twolame_psycho_2_fft() on n <= FFT_BATCH blocks */
+void twolame_psycho_2_fft_batch(const fft_mem * fft, FLOAT x_real[][BLKSIZE],
+                                FLOAT energy[][BLKSIZE], FLOAT phi[][BLKSIZE], int n)
+{
+    int b;
+
+    if (fft->fast)
+        real_fft_batch(fft, x_real, n);
+    else
+        for (b = 0; b < n; b++)
+            fht(x_real[b]);
+
+    for (b = 0; b < n; b++)
+        psycho_2_spectrum(fft, x_real[b], energy[b], phi[b]);
+}
+
+
+void twolame_psycho_1_fft(const fft_mem * fft, FLOAT * x_real, FLOAT * energy, int N)
 {
     FLOAT a, b;
     int i, j;
 
-    fht(x_real);
+    if (fft->fast)
+        real_fft(fft, x_real);
+    else
+        fht(x_real);
 
     energy[0] = x_real[0] * x_real[0];
 
@@ -26,8 +26,11 @@
 
 //void fft (FLOAT[BLKSIZE], FLOAT[BLKSIZE], FLOAT[BLKSIZE], FLOAT[BLKSIZE], int);
 
-void twolame_psycho_2_fft(FLOAT * x_real, FLOAT * energy, FLOAT * phi);
-void twolame_psycho_1_fft(FLOAT * x_real, FLOAT * energy, int N);
+void twolame_fft_init(fft_mem * fft, int fast_fft, int fast_phase);
+void twolame_psycho_2_fft(const fft_mem * fft, FLOAT * x_real, FLOAT * energy, FLOAT * phi);
+void twolame_psycho_2_fft_batch(const fft_mem * fft, FLOAT x_real[][BLKSIZE],
+                                FLOAT energy[][BLKSIZE], FLOAT phi[][BLKSIZE], int n);
+void twolame_psycho_1_fft(const fft_mem * fft, FLOAT * x_real, FLOAT * energy, int N);
 
 
 #endif
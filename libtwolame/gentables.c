@@ -0,0 +1,270 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2001-2004 Michael Cheng
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+/*
+  Build-time generator of the constant tables of libtwolame.
+
+  It writes tables_data.c to stdout, with the tables as const arrays
+  so that encoders don't compute them when they start up and all the
+  processes using the library share them. It is compiled for the
+  build machine, with the same FLOAT as the library, and linked with
+  ath.c so that the ATH tables use the library's own formulas.
+*/
+
+#include <stdio.h>
+#include <math.h>
+
+#include "twolame.h"
+#include "common.h"
+#include "ath.h"
+
+
+/* sample rates of the ATH tables, in the order of twolame_table_samplerates[] */
+static const int samplerates[] = { 44100, 48000, 32000, 22050, 24000, 16000 };
+
+#define NUM_SAMPLERATES ((int) (sizeof(samplerates) / sizeof(samplerates[0])))
+
+
+static void print_values(const FLOAT * v, int n, const char *indent)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (i % 4 == 0)
+            printf("%s", indent);
+        // enough digits for the literal to round back to the same value
+        if (sizeof(FLOAT) == sizeof(float))
+            printf("%.8ef,", (double) v[i]);
+        else
+            printf("%.16e,", (double) v[i]);
+        fputs((i % 4 == 3 || i == n - 1) ? "\n" : " ", stdout);
+    }
+}
+
+static void print_array(const char *decl, const FLOAT * v, int n)
+{
+    printf("const FLOAT %s = {\n", decl);
+    print_values(v, n, "    ");
+    printf("};\n\n");
+}
+
+static void print_rows(const char *indent, const char *inner, const FLOAT * v, int rows, int cols)
+{
+    int r;
+
+    for (r = 0; r < rows; r++) {
+        printf("%s{\n", indent);
+        print_values(v + r * cols, cols, inner);
+        printf("%s},\n", indent);
+    }
+}
+
+static void print_table(const char *decl, const FLOAT * v, int rows, int cols)
+{
+    printf("const FLOAT %s = {\n", decl);
+    print_rows("    ", "        ", v, rows, cols);
+    printf("};\n\n");
+}
+
+
+/* The 16x32 cosine matrix of the filterbank, rounded to 9 decimals
+   as in the ISO dist10 code, its transpose for the SIMD kernels and
+   the butterfly factors 1 / (2 cos((i + 0.5) PI / len)) of the fast DCT */
+static void dct_tables(void)
+{
+    static FLOAT m[16][32], mt[32][SUBBAND_MT_ROWS], dct_coef[32];
+    int i, k, len;
+    double v;
+
+    for (i = 0; i < 16; i++)
+        for (k = 0; k < 32; k++) {
+            if ((v = 1e9 * cos((FLOAT) ((2 * i + 1) * k * PI64))) >= 0)
+                modf(v + 0.5, &v);
+            else
+                modf(v - 0.5, &v);
+            m[i][k] = v * 1e-9;
+        }
+    for (i = 0; i < 16; i++)
+        for (k = 0; k < 32; k++)
+            mt[k][i] = m[i][k];
+
+    for (len = 32; len > 1; len /= 2)
+        for (i = 0; i < len / 2; i++)
+            dct_coef[32 - len + i] = 1.0 / (2.0 * cos((i + 0.5) * PI / len));
+
+    printf("const subband_tables twolame_subband_tables = {\n");
+    printf("    {\n");
+    print_rows("        ", "            ", &m[0][0], 16, 32);
+    printf("    },\n    {\n");
+    print_rows("        ", "            ", &mt[0][0], 32, SUBBAND_MT_ROWS);
+    printf("    },\n    {\n");
+    print_values(dct_coef, 32, "        ");
+    printf("    }\n};\n\n");
+}
+
+
+/* add_db() of psycho models 1 and 3: the dB to add to the largest
+   of two levels which are i/10 dB apart */
+static void add_db_table(void)
+{
+    static FLOAT dbtable[DBTAB];
+    int i;
+    FLOAT x;
+
+    for (i = 0; i < DBTAB; i++) {
+        x = (FLOAT) i / 10.0;
+        dbtable[i] = 10 * log10(1 + pow(10.0, x / 10.0)) - x;
+    }
+    print_array("twolame_add_db[DBTAB]", dbtable, DBTAB);
+}
+
+
+/* Hann window of the psycho model 2 and 4 FFT */
+static void hann_window(void)
+{
+    static FLOAT window[BLKSIZE];
+    int i;
+
+    for (i = 0; i < BLKSIZE; i++)
+        window[i] = 0.5 * (1 - cos(2.0 * PI * (i - 0.5) / BLKSIZE));
+    print_array("twolame_hann_window[BLKSIZE]", window, BLKSIZE);
+}
+
+
+/* Hann window of the psycho model 1 and 3 FFT, scaled by sqrt(8/3) / FFT_SIZE */
+static void scaled_hann_window(void)
+{
+    static FLOAT window[FFT_SIZE];
+    FLOAT sqrt_8_over_3 = pow(8.0 / 3.0, 0.5);
+    int i;
+
+    for (i = 0; i < FFT_SIZE; i++)
+        window[i] = sqrt_8_over_3 * 0.5 * (1 - cos(2.0 * PI * i / (FFT_SIZE))) / FFT_SIZE;
+    print_array("twolame_hann_window_scaled[FFT_SIZE]", window, FFT_SIZE);
+}
+
+
+/* Twiddles of the radix-4 passes of the 512 point complex FFT and
+   exp(-2 PI i k / 1024) for splitting the real transform */
+static void fft_twiddles(void)
+{
+    static FLOAT stage_re[FFT_STAGE_TWIDDLES], stage_im[FFT_STAGE_TWIDDLES];
+    static FLOAT post_re[256], post_im[256];
+    FLOAT *wr = stage_re, *wi = stage_im;
+    int i, k, m;
+
+    for (m = 128; m > 1; m /= 4) {
+        for (k = 1; k < 4; k++)
+            for (i = 0; i < m; i++) {
+                *wr++ = cos(2.0 * PI * k * i / (4 * m));
+                *wi++ = -sin(2.0 * PI * k * i / (4 * m));
+            }
+    }
+
+    for (k = 1; k <= 256; k++) {
+        post_re[k - 1] = cos(2.0 * PI * k / 1024);
+        post_im[k - 1] = -sin(2.0 * PI * k / 1024);
+    }
+
+    print_array("twolame_fft_stage_re[FFT_STAGE_TWIDDLES]", stage_re, FFT_STAGE_TWIDDLES);
+    print_array("twolame_fft_stage_im[FFT_STAGE_TWIDDLES]", stage_im, FFT_STAGE_TWIDDLES);
+    print_array("twolame_fft_post_re[256]", post_re, 256);
+    print_array("twolame_fft_post_im[256]", post_im, 256);
+}
+
+
+/* For each sample rate: the lowest ATH (in dB) of each subband, over
+   the lines of the psycho model 0 spectrum, and the bark value, the
+   ATH in dB and the ATH energy of each line of the 1024 point FFT of
+   psycho models 3 and 4 */
+static void ath_tables(void)
+{
+    static FLOAT ath_min[NUM_SAMPLERATES][SBLIMIT];
+    static FLOAT bark[NUM_SAMPLERATES][HBLKSIZE];
+    static FLOAT ath_db[NUM_SAMPLERATES][HBLKSIZE];
+    static FLOAT ath_energy[NUM_SAMPLERATES][HBLKSIZE];
+    int sr, sb, i;
+
+    for (sr = 0; sr < NUM_SAMPLERATES; sr++) {
+        FLOAT freqperline = (FLOAT) samplerates[sr] / 1024.0;
+
+        for (sb = 0; sb < SBLIMIT; sb++)
+            ath_min[sr][sb] = 1000;     /* set it huge */
+        for (i = 0; i < 512; i++) {
+            FLOAT thisfreq = i * freqperline;
+            FLOAT ath_val = twolame_ath_db(thisfreq, 0);
+            if (ath_val < ath_min[sr][i >> 4])
+                ath_min[sr][i >> 4] = ath_val;
+        }
+
+        for (i = 0; i < HBLKSIZE; i++) {
+            FLOAT freq = i * (FLOAT) samplerates[sr] / (FLOAT) BLKSIZE;
+            bark[sr][i] = twolame_ath_freq2bark(freq);
+            ath_db[sr][i] = twolame_ath_db(freq, 0);
+            ath_energy[sr][i] = twolame_ath_energy(freq, 0);
+        }
+    }
+
+    printf("const int twolame_table_samplerates[TWOLAME_TABLE_SAMPLERATES] = {\n    ");
+    for (sr = 0; sr < NUM_SAMPLERATES; sr++)
+        printf("%d,%s", samplerates[sr], sr == NUM_SAMPLERATES - 1 ? "\n" : " ");
+    printf("};\n\n");
+
+    print_table("twolame_ath_min[TWOLAME_TABLE_SAMPLERATES][SBLIMIT]",
+                &ath_min[0][0], NUM_SAMPLERATES, SBLIMIT);
+    print_table("twolame_bark[TWOLAME_TABLE_SAMPLERATES][HBLKSIZE]",
+                &bark[0][0], NUM_SAMPLERATES, HBLKSIZE);
+    print_table("twolame_ath_db_table[TWOLAME_TABLE_SAMPLERATES][HBLKSIZE]",
+                &ath_db[0][0], NUM_SAMPLERATES, HBLKSIZE);
+    print_table("twolame_ath_energy_table[TWOLAME_TABLE_SAMPLERATES][HBLKSIZE]",
+                &ath_energy[0][0], NUM_SAMPLERATES, HBLKSIZE);
+}
+
+
+int main(void)
+{
+    printf("/* Generated by gentables, do not edit */\n\n");
+    printf("#include <stdio.h>\n\n");
+    printf("#include \"twolame.h\"\n");
+    printf("#include \"common.h\"\n");
+    printf("#include \"tables.h\"\n\n");
+#ifdef SINGLE_PRECISION
+    printf("#ifndef SINGLE_PRECISION\n");
+#else
+    printf("#ifdef SINGLE_PRECISION\n");
+#endif
+    printf("#error \"tables_data.c was generated for a different FLOAT\"\n");
+    printf("#endif\n\n");
+
+    dct_tables();
+    add_db_table();
+    hann_window();
+    scaled_hann_window();
+    fft_twiddles();
+    ath_tables();
+
+    return 0;
+}
+
+
+// vim:ts=4:sw=4:nowrap:
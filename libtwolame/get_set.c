@@ -331,6 +331,99 @@ int twolame_get_quick_count(twolame_options * glopts)
     return (glopts->quickcount);
 }
 
+int twolame_set_fast_dct(twolame_options * glopts, int fast_dct)
+{
+    if (fast_dct)
+        glopts->fast_dct = TRUE;
+    else
+        glopts->fast_dct = FALSE;
+    return (0);
+}
+
+int twolame_get_fast_dct(twolame_options * glopts)
+{
+    return (glopts->fast_dct);
+}
+
+int twolame_set_fast_fft(twolame_options * glopts, int fast_fft)
+{
+    if (fast_fft)
+        glopts->fast_fft = TRUE;
+    else
+        glopts->fast_fft = FALSE;
+    return (0);
+}
+
+int twolame_get_fast_fft(twolame_options * glopts)
+{
+    return (glopts->fast_fft);
+}
+
+int twolame_set_fast_phase(twolame_options * glopts, int fast_phase)
+{
+    if (fast_phase < 0 || fast_phase > 2) {
+        fprintf(stderr, "invalid fast phase level %i\n", fast_phase);
+        return (-1);
+    }
+    glopts->fast_phase = fast_phase;
+    return (0);
+}
+
+int twolame_get_fast_phase(twolame_options * glopts)
+{
+    return (glopts->fast_phase);
+}
+
+int twolame_set_spreading_tolerance(twolame_options * glopts, float tolerance)
+{
+    if (tolerance < 0.0 || tolerance >= 1.0) {
+        fprintf(stderr, "invalid spreading function tolerance %f\n", tolerance);
+        return (-1);
+    }
+    glopts->spread_tolerance = tolerance;
+    return (0);
+}
+
+float twolame_get_spreading_tolerance(twolame_options * glopts)
+{
+    return (glopts->spread_tolerance);
+}
+
+int twolame_set_fast_db(twolame_options * glopts, int fast_db)
+{
+    if (fast_db)
+        glopts->fast_db = TRUE;
+    else
+        glopts->fast_db = FALSE;
+    return (0);
+}
+
+int twolame_get_fast_db(twolame_options * glopts)
+{
+    return (glopts->fast_db);
+}
+
+int twolame_set_num_threads(twolame_options * glopts, int num_threads)
+{
+    if (num_threads < 1) {
+        fprintf(stderr, "invalid number of threads %i\n", num_threads);
+        return (-1);
+    }
+#ifndef HAVE_PTHREAD_H
+    if (num_threads > 1) {
+        fprintf(stderr, "this build of twolame can only encode with one thread\n");
+        return (-1);
+    }
+#endif
+    glopts->num_threads = num_threads;
+    return (0);
+}
+
+int twolame_get_num_threads(twolame_options * glopts)
+{
+    return (glopts->num_threads);
+}
+
 
 int twolame_set_verbosity(twolame_options * glopts, int verbosity)
 {
@@ -26,9 +26,9 @@
 
 #include "twolame.h"
 #include "common.h"
-#include "ath.h"
 #include "mem.h"
 #include "psycho_0.h"
+#include "tables.h"
 
 /* MFC Mar 03
    It's almost obscene how well this psycho model works for the amount of
@@ -50,23 +50,21 @@
    logs, whatever. Fiddle with the numbers until we get a good SMR output */
 
 
-static psycho_0_mem *twolame_psycho_0_init(twolame_options * glopts, int sfreq)
+psycho_0_mem *twolame_psycho_0_init(twolame_options * glopts, int sfreq)
 {
-    FLOAT freqperline = (FLOAT) sfreq / 1024.0;
-    psycho_0_mem *mem = (psycho_0_mem *) TWOLAME_MALLOC(sizeof(psycho_0_mem));
-    int sb, i;
+    int sr = twolame_table_samplerate(sfreq);
+    psycho_0_mem *mem;
+    int sb;
 
-    for (sb = 0; sb < SBLIMIT; sb++) {
-        mem->ath_min[sb] = 1000;    /* set it huge */
-    }
+    if (sr < 0)
+        return NULL;
+    mem = (psycho_0_mem *) TWOLAME_MALLOC(sizeof(psycho_0_mem));
+    if (!mem)
+        return NULL;
 
-    /* Find the minimum ATH in each subband */
-    for (i = 0; i < 512; i++) {
-        FLOAT thisfreq = i * freqperline;
-        FLOAT ath_val = twolame_ath_db(thisfreq, 0);
-        if (ath_val < mem->ath_min[i >> 4])
-            mem->ath_min[i >> 4] = ath_val;
-    }
+    /* The minimum ATH in each subband */
+    for (sb = 0; sb < SBLIMIT; sb++)
+        mem->ath_min[sb] = twolame_ath_min[sr][sb];
 
     return mem;
 }
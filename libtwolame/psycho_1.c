@@ -29,7 +29,9 @@
 #include "common.h"
 #include "mem.h"
 #include "fft.h"
+#include "decibel.h"
 #include "psycho_1.h"
+#include "tables.h"
 
 /**********************************************************************
 
@@ -106,24 +108,14 @@ static void psycho_1_read_freq_band(g_ptr * ltg, int lay, int freq, int *sub_siz
 }
 
 
-static void psycho_1_make_map(int sub_size, mask power[HAN_SIZE], g_thres * ltg)
+static void psycho_1_make_map(int sub_size, int map[HAN_SIZE], g_thres * ltg)
 /* this function calculates the global masking threshold */
 {
     int i, j;
 
     for (i = 1; i < sub_size; i++)
         for (j = ltg[i - 1].line; j <= ltg[i].line; j++)
-            power[j].map = i;
-}
-
-static void psycho_1_init_add_db(psycho_1_mem * mem)
-{
-    int i;
-    FLOAT x;
-    for (i = 0; i < DBTAB; i++) {
-        x = (FLOAT) i / 10.0;
-        mem->dbtable[i] = 10 * log10(1 + pow(10.0, x / 10.0)) - x;
-    }
+            map[j] = i;
 }
 
 static inline FLOAT add_db(psycho_1_mem * mem, FLOAT a, FLOAT b)
@@ -159,48 +151,50 @@ static inline FLOAT add_db(psycho_1_mem * mem, FLOAT a, FLOAT b)
 *
 *
 ****************************************************************/
-static void psycho_1_hann_fft_pickmax(FLOAT sample[FFT_SIZE], mask power[HAN_SIZE],
+static void psycho_1_hann_fft_pickmax(psycho_1_mem * mem, const fft_mem * fft,
+                                      const decibel_mem * db, FLOAT sample[FFT_SIZE],
                                       FLOAT spike[SBLIMIT], FLOAT energy[FFT_SIZE])
 {
     FLOAT x_real[FFT_SIZE];
+    FLOAT *x = mem->x;
     register int i, j;
-    register FLOAT sqrt_8_over_3;
-    static int init = 0;
-    static FLOAT window[FFT_SIZE];
+    const FLOAT *window = twolame_hann_window_scaled;   /* see gentables.c */
     FLOAT sum;
 
-    if (!init) {
-        /* calculate window function for the Fourier transform */
-        /* These values need only be initialised once, regardless of the caller */
-        sqrt_8_over_3 = pow(8.0 / 3.0, 0.5);
-        for (i = 0; i < FFT_SIZE; i++) {
-            /* Hann window formula */
-            window[i] = sqrt_8_over_3 * 0.5 * (1 - cos(2.0 * PI * i / (FFT_SIZE))) / FFT_SIZE;
-        }
-        init = 1;
-    }
     for (i = 0; i < FFT_SIZE; i++)
         x_real[i] = (FLOAT) (sample[i] * window[i]);
 
-    twolame_psycho_1_fft(x_real, energy, FFT_SIZE);
+    twolame_psycho_1_fft(fft, x_real, energy, FFT_SIZE);
 
-    for (i = 0; i < HAN_SIZE; i++) {    /* calculate power density spectrum */
-        if (energy[i] < 1E-20)
-            power[i].x = -200.0 + POWERNORM;
-        else
-            power[i].x = 10 * log10(energy[i]) + POWERNORM;
-        power[i].next = STOP;
-        power[i].type = FALSE;
+    /* calculate power density spectrum */
+    if (db->fast)
+        twolame_to_db(db, energy, x, HAN_SIZE, 10.0, POWERNORM, 1E-20);
+    else
+        for (i = 0; i < HAN_SIZE; i++) {
+            if (energy[i] < 1E-20)
+                x[i] = -200.0 + POWERNORM;
+            else
+                x[i] = 10 * log10(energy[i]) + POWERNORM;
+        }
+
+    for (i = 0; i < HAN_SIZE; i++) {
+        mem->next[i] = STOP;
+        mem->type[i] = FALSE;
     }
 
     /* Calculate the sum of spectral component in each subband from bound 4-16 */
 
 #define CF 1073741824           /* pow(10, 0.1*POWERNORM) */
 #define DBM     1E-20              /* pow(10.0, 0.1*DBMIN */
-    for (i = 0; i < HAN_SIZE; spike[i >> 4] = 10.0 * log10(sum), i += 16) {
+    for (i = 0; i < HAN_SIZE; spike[i >> 4] = sum, i += 16) {
         for (j = 0, sum = DBM; j < 16; j++)
             sum += CF * energy[i + j];
     }
+    if (db->fast)
+        twolame_to_db(db, spike, spike, SBLIMIT, 10.0, 0.0, DBM);
+    else
+        for (i = 0; i < SBLIMIT; i++)
+            spike[i] = 10.0 * log10(spike[i]);
 }
 
 /****************************************************************
@@ -215,15 +209,16 @@ static void psycho_1_tonal_label(psycho_1_mem * mem, int *tone)
 {
     int i, j, last = LAST, first, run, last_but_one = LAST; /* dpwe */
     FLOAT max;
-    mask *power = mem->power;
+    FLOAT *x = mem->x;
+    int *type = mem->type, *next = mem->next;
 
     *tone = LAST;
     for (i = 2; i < HAN_SIZE - 12; i++) {
-        if (power[i].x > power[i - 1].x && power[i].x >= power[i + 1].x) {
-            power[i].type = TONE;
-            power[i].next = LAST;
+        if (x[i] > x[i - 1] && x[i] >= x[i + 1]) {
+            type[i] = TONE;
+            next[i] = LAST;
             if (last != LAST)
-                power[last].next = i;
+                next[last] = i;
             else
                 first = *tone = i;
             last = i;
@@ -243,45 +238,45 @@ static void psycho_1_tonal_label(psycho_1_mem * mem, int *tone)
             run = 6;            /* the tonal components */
         else
             run = 12;
-        max = power[first].x - 7;   /* after calculation of tonal */
+        max = x[first] - 7;   /* after calculation of tonal */
         for (j = 2; j <= run; j++)  /* components, set to local max */
-            if (max < power[first - j].x || max < power[first + j].x) {
-                power[first].type = FALSE;
+            if (max < x[first - j] || max < x[first + j]) {
+                type[first] = FALSE;
                 break;
             }
-        if (power[first].type == TONE) {    /* extract tonal components */
+        if (type[first] == TONE) {    /* extract tonal components */
             int help = first;
             if (*tone == LAST)
                 *tone = first;
-            while ((power[help].next != LAST) && (power[help].next - first) <= run)
-                help = power[help].next;
-            help = power[help].next;
-            power[first].next = help;
+            while ((next[help] != LAST) && (next[help] - first) <= run)
+                help = next[help];
+            help = next[help];
+            next[first] = help;
             if ((first - last) <= run) {
                 if (last_but_one != LAST)
-                    power[last_but_one].next = first;
+                    next[last_but_one] = first;
             }
             if (first > 1 && first < 500) { /* calculate the sum of the */
                 FLOAT tmp;      /* powers of the components */
-                tmp = add_db(mem, power[first - 1].x, power[first + 1].x);
-                power[first].x = add_db(mem, power[first].x, tmp);
+                tmp = add_db(mem, x[first - 1], x[first + 1]);
+                x[first] = add_db(mem, x[first], tmp);
             }
             for (j = 1; j <= run; j++) {
-                power[first - j].x = power[first + j].x = DBMIN;
-                power[first - j].next = power[first + j].next = STOP;
-                power[first - j].type = power[first + j].type = FALSE;
+                x[first - j] = x[first + j] = DBMIN;
+                next[first - j] = next[first + j] = STOP;
+                type[first - j] = type[first + j] = FALSE;
             }
             last_but_one = last;
             last = first;
-            first = power[first].next;
+            first = next[first];
         } else {
             int ll;
-            if (last == LAST);  /* *tone = power[first].next; dpwe */
+            if (last == LAST);  /* *tone = next[first]; dpwe */
             else
-                power[last].next = power[first].next;
+                next[last] = next[first];
             ll = first;
-            first = power[first].next;
-            power[ll].next = STOP;
+            first = next[first];
+            next[ll] = STOP;
         }
     }
 }
@@ -294,24 +289,26 @@ static void psycho_1_tonal_label(psycho_1_mem * mem, int *tone)
 *
 ****************************************************************/
 
-static void psycho_1_noise_label(psycho_1_mem * mem, int *noise, FLOAT energy[FFT_SIZE])
+static void psycho_1_noise_label(psycho_1_mem * mem, const decibel_mem * db, int *noise,
+                                 FLOAT energy[FFT_SIZE])
 {
     int i, j, centre, last = LAST;
-    FLOAT index, weight, sum;
+    FLOAT index, weight, sum, level;
     int crit_band = mem->crit_band;
     int *cbound = mem->cbound;
-    mask *power = mem->power;
+    FLOAT *x = mem->x;
+    int *type = mem->type, *next = mem->next;
     /* calculate the remaining spectral */
     for (i = 0; i < crit_band - 1; i++) {   /* lines for non-tonal components */
         for (j = cbound[i], weight = 0.0, sum = DBMIN; j < cbound[i + 1]; j++) {
-            if (power[j].type != TONE) {
-                if (power[j].x != DBMIN) {
-                    sum = add_db(mem, power[j].x, sum);
+            if (type[j] != TONE) {
+                if (x[j] != DBMIN) {
+                    sum = add_db(mem, x[j], sum);
                     /* Weight is used in finding the geometric mean of the noise energy within a
                        subband */
                     weight += CF * energy[j] * (FLOAT) (j - cbound[i]) / (FLOAT) (cbound[i + 1] - cbound[i]);   /* correction
                                                                                                                  */
-                    power[j].x = DBMIN;
+                    x[j] = DBMIN;
                 }
             }                   /* check to see if the spectral line is low dB, and if */
         }                       /* so replace the center of the critical band, which is */
@@ -322,7 +319,11 @@ static void psycho_1_noise_label(psycho_1_mem * mem, int *noise, FLOAT energy[FF
         else {
             /* fprintf(stderr, "%i [%f %f] -", count++,weight/pow(10.0,0.1*sum),
                weight*pow(10.0,-0.1*sum)); */
-            index = weight * pow(10.0, -0.1 * sum);
+            if (db->fast)
+                twolame_from_db(db, &sum, &level, 1, -0.1);
+            else
+                level = pow(10.0, -0.1 * sum);
+            index = weight * level;
             centre = cbound[i] + (int) (index * (FLOAT) (cbound[i + 1] - cbound[i]));
         }
 
@@ -331,8 +332,8 @@ static void psycho_1_noise_label(psycho_1_mem * mem, int *noise, FLOAT energy[FF
         /* add to list of non-tonal components */
 
         /* Masahiro Iwadare's fix for infinite looping problem? */
-        if (power[centre].type == TONE) {
-            if (power[centre + 1].type == TONE) {
+        if (type[centre] == TONE) {
+            if (type[centre + 1] == TONE) {
                 centre++;
             } else
                 centre--;
@@ -341,11 +342,11 @@ static void psycho_1_noise_label(psycho_1_mem * mem, int *noise, FLOAT energy[FF
         if (last == LAST)
             *noise = centre;
         else {
-            power[centre].next = LAST;
-            power[last].next = centre;
+            next[centre] = LAST;
+            next[last] = centre;
         }
-        power[centre].x = sum;
-        power[centre].type = NOISE;
+        x[centre] = sum;
+        type[centre] = NOISE;
         last = centre;
     }
 }
@@ -357,63 +358,66 @@ static void psycho_1_noise_label(psycho_1_mem * mem, int *noise, FLOAT energy[FF
 *
 ****************************************************************/
 
-static void psycho_1_subsampling(mask power[HAN_SIZE], g_thres * ltg, int *tone, int *noise)
+static void psycho_1_subsampling(psycho_1_mem * mem, int *tone, int *noise)
 {
+    g_thres *ltg = mem->ltg;
+    FLOAT *x = mem->x;
+    int *type = mem->type, *next = mem->next, *map = mem->map;
     int i, old;
 
     i = *tone;
     old = STOP;                 /* calculate tonal components for */
 
     while ((i != LAST) && (i != STOP)) {    /* reduction of spectral lines */
-        if (power[i].x < ltg[power[i].map].hear) {
-            power[i].type = FALSE;
-            power[i].x = DBMIN;
+        if (x[i] < ltg[map[i]].hear) {
+            type[i] = FALSE;
+            x[i] = DBMIN;
             if (old == STOP)
-                *tone = power[i].next;
+                *tone = next[i];
             else
-                power[old].next = power[i].next;
+                next[old] = next[i];
         } else
             old = i;
-        i = power[i].next;
+        i = next[i];
     }
     i = *noise;
     old = STOP;                 /* calculate non-tonal components for */
     while ((i != LAST) && (i != STOP)) {    /* reduction of spectral lines */
-        if (power[i].x < ltg[power[i].map].hear) {
-            power[i].type = FALSE;
-            power[i].x = DBMIN;
+        if (x[i] < ltg[map[i]].hear) {
+            type[i] = FALSE;
+            x[i] = DBMIN;
             if (old == STOP)
-                *noise = power[i].next;
+                *noise = next[i];
             else
-                power[old].next = power[i].next;
+                next[old] = next[i];
         } else
             old = i;
-        i = power[i].next;
+        i = next[i];
     }
     i = *tone;
     old = STOP;
     while ((i != LAST) && (i != STOP)) {    /* if more than one */
-        if (power[i].next == LAST)
+        if (next[i] == LAST)
             break;              /* tonal component */
-        if (ltg[power[power[i].next].map].bark -    /* is less than .5 */
-                ltg[power[i].map].bark < 0.5) { /* bark, take the */
-            if (power[power[i].next].x > power[i].x) {  /* maximum */
+        if (ltg[map[next[i]]].bark -    /* is less than .5 */
+                ltg[map[i]].bark < 0.5) { /* bark, take the */
+            if (x[next[i]] > x[i]) {  /* maximum */
                 if (old == STOP)
-                    *tone = power[i].next;
+                    *tone = next[i];
                 else
-                    power[old].next = power[i].next;
-                power[i].type = FALSE;
-                power[i].x = DBMIN;
-                i = power[i].next;
+                    next[old] = next[i];
+                type[i] = FALSE;
+                x[i] = DBMIN;
+                i = next[i];
             } else {
-                power[power[i].next].type = FALSE;
-                power[power[i].next].x = DBMIN;
-                power[i].next = power[power[i].next].next;
+                type[next[i]] = FALSE;
+                x[next[i]] = DBMIN;
+                next[i] = next[next[i]];
                 old = i;
             }
         } else {
             old = i;
-            i = power[i].next;
+            i = next[i];
         }
     }
 }
@@ -425,60 +429,99 @@ static void psycho_1_subsampling(mask power[HAN_SIZE], g_thres * ltg, int *tone,
 *
 ****************************************************************/
 
-/* mainly just changed the way range checking was done MFC Nov 1999 */
-static void psycho_1_threshold(psycho_1_mem * mem, int *tone, int *noise, int bit_rate)
+/* Copy the components of a list into the arrays of the threshold */
+static void psycho_1_compact(psycho_1_mem * mem, masker_list * m, int first)
+{
+    int t, n = 0;
+
+    for (t = first; (t != LAST) && (t != STOP); t = mem->next[t]) {
+        m->line[n] = t;
+        m->x[n] = mem->x[t];
+        m->bark[n] = mem->ltg[mem->map[t]].bark;
+        n++;
+    }
+    m->count = n;
+}
+
+/* Add the individual masking thresholds of the components in m to the
+   subsample lines within -3 to +8 bark of each of them; slope and offset
+   set the masking index of tonal or non-tonal components. */
+static void psycho_1_mask(psycho_1_mem * mem, const masker_list * m, FLOAT slope,
+                          FLOAT offset)
 {
     int sub_size = mem->sub_size;
-    mask *power = mem->power;
     g_thres *ltg = mem->ltg;
-    int k, t;
+    int k, t, lo, hi;
     FLOAT dz, tmps, vf;
 
-    for (k = 1; k < sub_size; k++) {
-        ltg[k].x = DBMIN;
-        t = *tone;              /* calculate individual masking threshold for */
-        while ((t != LAST) && (t != STOP)) {    /* components in order to find the global */
-            dz = ltg[k].bark - ltg[power[t].map].bark;  /* distance of bark value */
-            if (dz >= -3.0 && dz < 8.0) {
-                tmps = -1.525 - 0.275 * ltg[power[t].map].bark - 4.5 + power[t].x;
-                /* masking function for lower & upper slopes */
-                if (dz < -1)
-                    vf = 17 * (dz + 1) - (0.4 * power[t].x + 6);
-                else if (dz < 0)
-                    vf = (0.4 * power[t].x + 6) * dz;
-                else if (dz < 1)
-                    vf = (-17 * dz);
-                else
-                    vf = -(dz - 1) * (17 - 0.15 * power[t].x) - 17;
-                ltg[k].x = add_db(mem, ltg[k].x, tmps + vf);
-            }
-            t = power[t].next;
+    for (t = 0; t < m->count; t++) {
+        const FLOAT bark = m->bark[t], x = m->x[t];
+        const double lower = 0.4 * x + 6, upper = 17 - 0.15 * x;
+
+        /* the bark values of ltg[] increase, so dz does too: find the first
+           subsample line with dz >= -3 */
+        lo = 1;
+        hi = sub_size;
+        while (lo < hi) {
+            k = (lo + hi) / 2;
+            if (ltg[k].bark - bark < -3.0)
+                lo = k + 1;
+            else
+                hi = k;
         }
 
-        t = *noise;             /* calculate individual masking threshold */
-        while ((t != LAST) && (t != STOP)) {    /* for non-tonal components to find LTG */
-            dz = ltg[k].bark - ltg[power[t].map].bark;  /* distance of bark value */
-            if (dz >= -3.0 && dz < 8.0) {
-                tmps = -1.525 - 0.175 * ltg[power[t].map].bark - 0.5 + power[t].x;
-                /* masking function for lower & upper slopes */
-                if (dz < -1)
-                    vf = 17 * (dz + 1) - (0.4 * power[t].x + 6);
-                else if (dz < 0)
-                    vf = (0.4 * power[t].x + 6) * dz;
-                else if (dz < 1)
-                    vf = (-17 * dz);
-                else
-                    vf = -(dz - 1) * (17 - 0.15 * power[t].x) - 17;
-                ltg[k].x = add_db(mem, ltg[k].x, tmps + vf);
-            }
-            t = power[t].next;
+        tmps = -1.525 - slope * bark - offset + x;
+        for (k = lo; k < sub_size; k++) {
+            dz = ltg[k].bark - bark;    /* distance of bark value */
+            if (dz >= 8.0)
+                break;
+            /* masking function for lower & upper slopes */
+            if (dz < -1)
+                vf = 17 * (dz + 1) - lower;
+            else if (dz < 0)
+                vf = lower * dz;
+            else if (dz < 1)
+                vf = (-17 * dz);
+            else
+                vf = -(dz - 1) * upper - 17;
+            ltg[k].mask = add_db(mem, ltg[k].mask, tmps + vf);
         }
-        if (bit_rate < 96)
-            ltg[k].x = add_db(mem, ltg[k].hear, ltg[k].x);
-        else
-            ltg[k].x = add_db(mem, ltg[k].hear - 12.0, ltg[k].x);
     }
+}
 
+/* mainly just changed the way range checking was done MFC Nov 1999 */
+static void psycho_1_threshold(psycho_1_mem * mem, int *tone, int *noise)
+{
+    int sub_size = mem->sub_size;
+    g_thres *ltg = mem->ltg;
+    int k;
+
+    /* individual masking thresholds of the tonal then the non-tonal
+       components, summed up with the threshold in quiet for the global
+       masking threshold by psycho_1_global() */
+    psycho_1_compact(mem, &mem->tonal, *tone);
+    psycho_1_compact(mem, &mem->noise, *noise);
+
+    for (k = 1; k < sub_size; k++)
+        ltg[k].mask = DBMIN;
+    psycho_1_mask(mem, &mem->tonal, 0.275, 4.5);
+    psycho_1_mask(mem, &mem->noise, 0.175, 0.5);
+}
+
+/* The global masking threshold, for a bitrate per channel from HIGH_BITRATE
+   if high is TRUE, else below it */
+static void psycho_1_global(psycho_1_mem * mem, int high)
+{
+    int sub_size = mem->sub_size;
+    g_thres *ltg = mem->ltg;
+    int k;
+
+    for (k = 1; k < sub_size; k++) {
+        if (!high)
+            ltg[k].x = add_db(mem, ltg[k].hear, ltg[k].mask);
+        else
+            ltg[k].x = add_db(mem, ltg[k].hear - 12.0, ltg[k].mask);
+    }
 }
 
 /****************************************************************
@@ -515,14 +558,22 @@ static void psycho_1_minimum_mask(int sub_size, g_thres * ltg, FLOAT ltmin[SBLIM
 *
 *****************************************************************/
 
-static void psycho_1_smr(FLOAT ltmin[SBLIMIT], FLOAT spike[SBLIMIT], FLOAT scale[SBLIMIT],
-                         int sblimit)
+static void psycho_1_smr(const decibel_mem * db, FLOAT ltmin[SBLIMIT], FLOAT spike[SBLIMIT],
+                         FLOAT scale[SBLIMIT], int sblimit)
 {
     int i;
-    FLOAT max;
+    FLOAT max, level[SBLIMIT];
+
+    for (i = 0; i < sblimit; i++)
+        level[i] = scale[i] * 32768;
+    if (db->fast)
+        twolame_to_db(db, level, level, sblimit, 20.0, -10.0, 1E-20);
+    else
+        for (i = 0; i < sblimit; i++)
+            level[i] = 20 * log10(level[i]) - 10;
 
     for (i = 0; i < sblimit; i++) { /* determine the signal */
-        max = 20 * log10(scale[i] * 32768) - 10;    /* level for each subband */
+        max = level[i];         /* level for each subband */
         if (spike[i] > max)
             max = spike[i];     /* for the maximum scale */
         max -= ltmin[i];        /* factors */
@@ -532,66 +583,80 @@ static void psycho_1_smr(FLOAT ltmin[SBLIMIT], FLOAT spike[SBLIMIT], FLOAT scale
 
 
 /*
-static void psycho_1_dump(mask power[HAN_SIZE], int *tone, int *noise) {
+static void psycho_1_dump(psycho_1_mem * mem, int *tone, int *noise) {
   int t;
 
   fprintf(stderr,"1 Ton: ");
   t=*tone;
   while (t!=LAST && t!=STOP) {
-    fprintf(stderr,"[%i] %3.0f ",t, power[t].x);
-    t = power[t].next;
+    fprintf(stderr,"[%i] %3.0f ",t, mem->x[t]);
+    t = mem->next[t];
   }
   fprintf(stderr,"\n");
 
   fprintf(stderr,"1 Nos: ");
   t=*noise;
   while (t!=LAST && t!=STOP) {
-    fprintf(stderr,"[%i] %3.0f ",t, power[t].x);
-    t = power[t].next;
+    fprintf(stderr,"[%i] %3.0f ",t, mem->x[t]);
+    t = mem->next[t];
   }
   fprintf(stderr,"\n");
 }
 */
 
 
-void twolame_psycho_1(twolame_options * glopts, short buffer[2][1152], FLOAT scale[2][SBLIMIT],
-                      FLOAT ltmin[2][SBLIMIT])
+psycho_1_mem *twolame_psycho_1_init(twolame_options * glopts)
 {
-    psycho_1_mem *mem;
     frame_header *header = &glopts->header;
+    psycho_1_mem *mem;
+    int i;
+
+    /* call functions for critical boundaries, freq. bands, bark values, and mapping */
+    mem = (psycho_1_mem *) TWOLAME_MALLOC(sizeof(psycho_1_mem));
+    if (!mem)
+        return NULL;
+
+    if (header->version == TWOLAME_MPEG1) {
+        mem->cbound = psycho_1_read_cbound(header->lay, header->samplerate_idx, &mem->crit_band);
+        psycho_1_read_freq_band(&mem->ltg, header->lay, header->samplerate_idx, &mem->sub_size);
+    } else {
+        mem->cbound =
+            psycho_1_read_cbound(header->lay, header->samplerate_idx + 4, &mem->crit_band);
+        psycho_1_read_freq_band(&mem->ltg, header->lay, header->samplerate_idx + 4,
+                                &mem->sub_size);
+    }
+    psycho_1_make_map(mem->sub_size, mem->map, mem->ltg);
+    for (i = 0; i < 1408; i++)
+        mem->fft_buf[0][i] = mem->fft_buf[1][i] = 0;
+
+    /* get the add_db table */
+    mem->dbtable = twolame_add_db;
+
+    mem->off[0] = 256;
+    mem->off[1] = 256;
+
+    return mem;
+}
+
+/* Run the model on a frame, for the bitrate classes whose smr array is given:
+   low for bitrates per channel below HIGH_BITRATE, high for the others.
+   Only the global masking threshold is calculated for each class. */
+void twolame_psycho_1_classes(twolame_options * glopts, FLOAT buffer[2][1152],
+                              FLOAT scale[2][SBLIMIT], FLOAT low[2][SBLIMIT],
+                              FLOAT high[2][SBLIMIT])
+{
+    psycho_1_mem *mem;
     int nch = glopts->num_channels_out;
     int sblimit = glopts->sblimit;
-    int k, i, tone = 0, noise = 0;
+    int k, i, c, tone = 0, noise = 0;
+    FLOAT (*smr[2])[SBLIMIT];
     FLOAT sample[FFT_SIZE];
     FLOAT spike[2][SBLIMIT];
     FLOAT *fft_buf[2];
     FLOAT energy[FFT_SIZE];
 
-    /* call functions for critical boundaries, freq. */
-    if (!glopts->p1mem) {       /* bands, bark values, and mapping */
-        mem = (psycho_1_mem *) TWOLAME_MALLOC(sizeof(psycho_1_mem));
-
-        mem->power = (mask_ptr) TWOLAME_MALLOC(sizeof(mask) * HAN_SIZE);
-        if (header->version == TWOLAME_MPEG1) {
-            mem->cbound =
-                psycho_1_read_cbound(header->lay, header->samplerate_idx, &mem->crit_band);
-            psycho_1_read_freq_band(&mem->ltg, header->lay, header->samplerate_idx, &mem->sub_size);
-        } else {
-            mem->cbound =
-                psycho_1_read_cbound(header->lay, header->samplerate_idx + 4, &mem->crit_band);
-            psycho_1_read_freq_band(&mem->ltg, header->lay, header->samplerate_idx + 4,
-                                    &mem->sub_size);
-        }
-        psycho_1_make_map(mem->sub_size, mem->power, mem->ltg);
-        for (i = 0; i < 1408; i++)
-            mem->fft_buf[0][i] = mem->fft_buf[1][i] = 0;
-
-        psycho_1_init_add_db(mem);  /* create the add_db table */
-
-        mem->off[0] = 256;
-        mem->off[1] = 256;
-
-        glopts->p1mem = mem;
+    if (!glopts->p1mem) {
+        glopts->p1mem = twolame_psycho_1_init(glopts);
     }
     {
         mem = glopts->p1mem;
@@ -599,6 +664,8 @@ void twolame_psycho_1(twolame_options * glopts, short buffer[2][1152], FLOAT sca
         fft_buf[0] = mem->fft_buf[0];
         fft_buf[1] = mem->fft_buf[1];
     }
+    smr[0] = low;
+    smr[1] = high;
 
 
     for (k = 0; k < nch; k++) {
@@ -606,7 +673,7 @@ void twolame_psycho_1(twolame_options * glopts, short buffer[2][1152], FLOAT sca
         /* sami's speedup, added in 02j saves about 4% overall during an encode */
         int ok = mem->off[k] % 1408;
         for (i = 0; i < 1152; i++) {
-            fft_buf[k][ok++] = (FLOAT) buffer[k][i] / SCALE;
+            fft_buf[k][ok++] = buffer[k][i] / SCALE;
             if (ok >= 1408)
                 ok = 0;
         }
@@ -619,18 +686,33 @@ void twolame_psycho_1(twolame_options * glopts, short buffer[2][1152], FLOAT sca
         mem->off[k] += 1152;
         mem->off[k] %= 1408;
 
-        psycho_1_hann_fft_pickmax(sample, mem->power, &spike[k][0], energy);
+        psycho_1_hann_fft_pickmax(mem, &glopts->fft, &glopts->db, sample, &spike[k][0], energy);
         psycho_1_tonal_label(mem, &tone);
-        psycho_1_noise_label(mem, &noise, energy);
-        // psycho_1_dump(power, &tone, &noise) ;
-        psycho_1_subsampling(mem->power, mem->ltg, &tone, &noise);
-        psycho_1_threshold(mem, &tone, &noise, glopts->bitrate / nch);
-        psycho_1_minimum_mask(mem->sub_size, mem->ltg, &ltmin[k][0], sblimit);
-        psycho_1_smr(&ltmin[k][0], &spike[k][0], &scale[k][0], sblimit);
+        psycho_1_noise_label(mem, &glopts->db, &noise, energy);
+        // psycho_1_dump(mem, &tone, &noise) ;
+        psycho_1_subsampling(mem, &tone, &noise);
+        psycho_1_threshold(mem, &tone, &noise);
+        for (c = 0; c < 2; c++) {
+            if (smr[c] == NULL)
+                continue;
+            psycho_1_global(mem, c);
+            psycho_1_minimum_mask(mem->sub_size, mem->ltg, &smr[c][k][0], sblimit);
+            psycho_1_smr(&glopts->db, &smr[c][k][0], &spike[k][0], &scale[k][0], sblimit);
+        }
     }
 
 }
 
+void twolame_psycho_1(twolame_options * glopts, FLOAT buffer[2][1152], FLOAT scale[2][SBLIMIT],
+                      FLOAT ltmin[2][SBLIMIT])
+{
+    if (glopts->bitrate / glopts->num_channels_out < HIGH_BITRATE)
+        twolame_psycho_1_classes(glopts, buffer, scale, ltmin, NULL);
+    else
+        twolame_psycho_1_classes(glopts, buffer, scale, NULL, ltmin);
+}
+
+
 void twolame_psycho_1_deinit(psycho_1_mem ** mem)
 {
 
@@ -639,7 +721,6 @@ void twolame_psycho_1_deinit(psycho_1_mem ** mem)
 
     TWOLAME_FREE((*mem)->cbound);
     TWOLAME_FREE((*mem)->ltg);
-    TWOLAME_FREE((*mem)->power);
     TWOLAME_FREE((*mem));
 }
 
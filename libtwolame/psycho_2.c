@@ -30,13 +30,10 @@
 #include "common.h"
 #include "mem.h"
 #include "fft.h"
+#include "spread.h"
+#include "unpredict.h"
 #include "psycho_2.h"
-
-/* The static variables "r", "phi_sav", "new", "old" and "oldest" have      */
-/* to be remembered for the unpredictability measure.  For "r" and          */
-/* "phi_sav", the first index from the left is the channel select and      */
-/* the second index is the "age" of the data.                              */
-
+#include "tables.h"
 
 /* The following static variables are constants.                           */
 
@@ -72,22 +69,42 @@ int table;
     return;
 }
 
+/* The spreading function, in units of energy, for a difference of
+   'bark' between the centres of two partitions */
+static FLOAT psycho_2_spreading_function(FLOAT bark)
+{
+    FLOAT temp1, ftemp2, temp3;
+
+    temp1 = bark;
+    if (temp1 >= 0.5 && temp1 <= 2.5) {
+        ftemp2 = temp1 - 0.5;
+        ftemp2 = 8.0 * (ftemp2 * ftemp2 - 2.0 * ftemp2);
+    } else
+        ftemp2 = 0.0;
+    temp1 += 0.474;
+    temp3 = 15.811389 + 7.5 * temp1 - 17.5 * sqrt((FLOAT) (1.0 + temp1 * temp1));
+    if (temp3 <= -100)
+        return 0;
+
+    temp3 = (ftemp2 + temp3) * LN_TO_LOG10;
+    return exp(temp3);
+}
+
 /********************************
  * init psycho model 2
  ********************************/
 psycho_2_mem *twolame_psycho_2_init(twolame_options * glopts, int sfreq)
 {
     psycho_2_mem *mem;
-    FLOAT *cbval, *rnorm;
-    FLOAT *window;
+    FLOAT *cbval;
     int *numlines;
     int *partition;
-    FCB *s;
+    spread_params spread;
     FLOAT *tmn;
 
     int i, j, itemp2;
     FLOAT freq_mult;
-    FLOAT temp1, ftemp2, temp3;
+    FLOAT temp1;
     FLOAT bval_lo, *fthr;
 
     int sfreq_idx;
@@ -98,15 +115,7 @@ psycho_2_mem *twolame_psycho_2_init(twolame_options * glopts, int sfreq)
             return NULL;
 
         mem->tmn = (FLOAT *) TWOLAME_MALLOC(sizeof(DCB));
-        mem->s = (FCB *) TWOLAME_MALLOC(sizeof(FCBCB));
         mem->lthr = (FHBLK *) TWOLAME_MALLOC(sizeof(F2HBLK));
-        mem->r = (F2HBLK *) TWOLAME_MALLOC(sizeof(F22HBLK));
-        mem->phi_sav = (F2HBLK *) TWOLAME_MALLOC(sizeof(F22HBLK));
-
-        // static int new = 0, old = 1, oldest = 0;
-        mem->new = 0;
-        mem->old = 1;
-        mem->oldest = 0;
 
         mem->flush = (int) (384 * 3.0 / 2.0);
         mem->syncsize = 1056;
@@ -115,11 +124,8 @@ psycho_2_mem *twolame_psycho_2_init(twolame_options * glopts, int sfreq)
 
     {
         cbval = mem->cbval;
-        rnorm = mem->rnorm;
-        window = mem->window;
         numlines = mem->numlines;
         partition = mem->partition;
-        s = mem->s;
         tmn = mem->tmn;
         fthr = mem->fthr;
     }
@@ -145,15 +151,13 @@ psycho_2_mem *twolame_psycho_2_init(twolame_options * glopts, int sfreq)
     psycho_2_read_absthr(mem->absthr, sfreq_idx);
 
 
-    /* calculate HANN window coefficients */
+    /* HANN window coefficients */
     /* for(i=0;i<BLKSIZE;i++)window[i]=0.5*(1-cos(2.0*PI*i/(BLKSIZE-1.0))); */
-    for (i = 0; i < BLKSIZE; i++)
-        window[i] = 0.5 * (1 - cos(2.0 * PI * (i - 0.5) / BLKSIZE));
+    mem->window = twolame_hann_window;
+
     /* reset states used in unpredictability measure */
+    twolame_unpredict_init(&mem->unpredict, glopts->fast_phase);
     for (i = 0; i < HBLKSIZE; i++) {
-        mem->r[0][0][i] = mem->r[1][0][i] = mem->r[0][1][i] = mem->r[1][1][i] = 0;
-        mem->phi_sav[0][0][i] = mem->phi_sav[1][0][i] = 0;
-        mem->phi_sav[0][1][i] = mem->phi_sav[1][1][i] = 0;
         mem->lthr[0][i] = 60802371420160.0;
         mem->lthr[1][i] = 60802371420160.0;
     }
@@ -201,36 +205,25 @@ psycho_2_mem *twolame_psycho_2_init(twolame_options * glopts, int sfreq)
 
     /************************************************************************
      * Now compute the spreading function, s[j][i], the value of the spread-*
-     * ing function, centered at band j, for band i, store for later use      *
+     * ing function, centered at band j, for band i, store for later use    *
+     * along with the normalization factors for the net spreading functions *
      ************************************************************************/
-    for (j = 0; j < CBANDS; j++) {
-        for (i = 0; i < CBANDS; i++) {
-            temp1 = (cbval[i] - cbval[j]) * 1.05;
-            if (temp1 >= 0.5 && temp1 <= 2.5) {
-                ftemp2 = temp1 - 0.5;
-                ftemp2 = 8.0 * (ftemp2 * ftemp2 - 2.0 * ftemp2);
-            } else
-                ftemp2 = 0.0;
-            temp1 += 0.474;
-            temp3 = 15.811389 + 7.5 * temp1 - 17.5 * sqrt((FLOAT) (1.0 + temp1 * temp1));
-            if (temp3 <= -100)
-                s[i][j] = 0;
-            else {
-                temp3 = (ftemp2 + temp3) * LN_TO_LOG10;
-                s[i][j] = exp(temp3);
-            }
-        }
+    spread.cbval = cbval;
+    spread.function = psycho_2_spreading_function;
+    spread.tolerance = glopts->spread_tolerance;
+    mem->spread = (const spread_mem *) twolame_table_acquire(TWOLAME_TABLE_SPREAD_2, sfreq,
+                                                             glopts->spread_tolerance,
+                                                             sizeof(spread_mem),
+                                                             twolame_spread_build, &spread);
+    if (!mem->spread) {
+        twolame_psycho_2_deinit(&mem);
+        return NULL;
     }
 
     /* Calculate Tone Masking Noise values */
     for (j = 0; j < CBANDS; j++) {
         temp1 = 15.5 + cbval[j];
         tmn[j] = (temp1 > 24.5) ? temp1 : 24.5;
-        /* Calculate normalization factors for the net spreading functions */
-        rnorm[j] = 0;
-        for (i = 0; i < CBANDS; i++) {
-            rnorm[j] += s[j][i];
-        }
     }
 
     if (glopts->verbosity > 5) {
@@ -249,19 +242,19 @@ psycho_2_mem *twolame_psycho_2_init(twolame_options * glopts, int sfreq)
     return (mem);
 }
 
-void twolame_psycho_2(twolame_options * glopts, short int buffer[2][1152],
-                      short int savebuf[2][1056], FLOAT smr[2][32])
+void twolame_psycho_2(twolame_options * glopts, FLOAT buffer[2][1152],
+                      FLOAT savebuf[2][1056], FLOAT smr[2][32])
 {
     psycho_2_mem *mem;
     unsigned int i, j, k, ch;
-    int new, old, oldest;
-    FLOAT r_prime, phi_prime;
     FLOAT minthres, sum_energy;
-    FLOAT tb, temp1, temp2, temp3;
+    FLOAT tb, temp1;
     FLOAT *grouped_c, *grouped_e;
     FLOAT *nb, *cb, *ecb, *bc;
-    FLOAT *cbval, *rnorm;
-    FLOAT *wsamp_r, *phi, *energy, *window;
+    FLOAT *cbval;
+    const FLOAT *rnorm;
+    FLOAT *wsamp_r, *phi, *energy;
+    const FLOAT *window;
     FLOAT *c;
     FLOAT *fthr;
 
@@ -269,12 +262,10 @@ void twolame_psycho_2(twolame_options * glopts, short int buffer[2][1152],
     int *numlines;
     int *partition;
     FLOAT *tmn;
-    FCB *s;
     FHBLK *lthr;
-    F2HBLK *r, *phi_sav;
     FLOAT *absthr;
 
-    int nch = glopts->num_channels_out;
+    unsigned int nch = glopts->num_channels_out;
     int sfreq = glopts->samplerate_out;
 
 
@@ -289,11 +280,8 @@ void twolame_psycho_2(twolame_options * glopts, short int buffer[2][1152],
         cb = mem->cb;
         ecb = mem->ecb;
         bc = mem->bc;
-        rnorm = mem->rnorm;
+        rnorm = mem->spread->rnorm;
         cbval = mem->cbval;
-        wsamp_r = mem->wsamp_r;
-        phi = mem->phi;
-        energy = mem->energy;
         window = mem->window;
         c = mem->c;
 
@@ -303,10 +291,7 @@ void twolame_psycho_2(twolame_options * glopts, short int buffer[2][1152],
         numlines = mem->numlines;
         partition = mem->partition;
         tmn = mem->tmn;
-        s = mem->s;
         lthr = mem->lthr;
-        r = mem->r;
-        phi_sav = mem->phi_sav;
         fthr = mem->fthr;
         absthr = mem->absthr;
     }
@@ -326,72 +311,34 @@ void twolame_psycho_2(twolame_options * glopts, short int buffer[2][1152],
                  BLKSIZE = 1024
              *****************************************************************************/
             {
-                short int *bufferp = buffer[ch];
+                FLOAT *bufferp = buffer[ch];
+                wsamp_r = mem->wsamp_r[ch][i];
                 for (j = 0; j < 480; j++) {
                     savebuf[ch][j] = savebuf[ch][j + mem->flush];
-                    wsamp_r[j] = window[j] * ((FLOAT) savebuf[ch][j]);
+                    wsamp_r[j] = window[j] * savebuf[ch][j];
                 }
                 for (; j < 1024; j++) {
                     savebuf[ch][j] = *bufferp++;
-                    wsamp_r[j] = window[j] * ((FLOAT) savebuf[ch][j]);
+                    wsamp_r[j] = window[j] * savebuf[ch][j];
                 }
                 for (; j < 1056; j++)
                     savebuf[ch][j] = *bufferp++;
             }
+        }
+    }
+
+    /**Compute the FFTs of both halves of every channel together*******************/
+    twolame_psycho_2_fft_batch(&glopts->fft, mem->wsamp_r[0], mem->energy[0], mem->phi[0],
+                               2 * nch);
 
-            /**Compute FFT****************************************************************/
-            twolame_psycho_2_fft(wsamp_r, energy, phi);
+    for (ch = 0; ch < nch; ch++) {
+        for (i = 0; i < 2; i++) {
+            energy = mem->energy[ch][i];
+            phi = mem->phi[ch][i];
             /*****************************************************************************
              * calculate the unpredictability measure, given energy[f] and phi[f]           *
              *****************************************************************************/
-            /* only update data "age" pointers after you are done with both channels */
-            /* for layer 1 computations, for the layer 2 FLOAT computations, the pointers */
-            /* are reset automatically on the second pass */
-            {
-                if (mem->new == 0) {
-                    mem->new = 1;
-                    mem->oldest = 1;
-                } else {
-                    mem->new = 0;
-                    mem->oldest = 0;
-                }
-                if (mem->old == 0)
-                    mem->old = 1;
-                else
-                    mem->old = 0;
-
-                new = mem->new;
-                old = mem->old;
-                oldest = mem->oldest;
-            }
-
-
-            for (j = 0; j < HBLKSIZE; j++) {
-                r_prime = 2.0 * r[ch][old][j] - r[ch][oldest][j];
-                phi_prime = 2.0 * phi_sav[ch][old][j] - phi_sav[ch][oldest][j];
-                r[ch][new][j] = sqrt((FLOAT) energy[j]);
-                phi_sav[ch][new][j] = phi[j];
-#ifdef SINCOS
-                {
-                    // 12% faster
-                    // #warning "Use __sincos"
-                    FLOAT sphi, cphi, sprime, cprime;
-                    __sincos((FLOAT) phi[j], &sphi, &cphi);
-                    __sincos((FLOAT) phi_prime, &sprime, &cprime);
-                    temp1 = r[chn][new][j] * cphi - r_prime * cprime;
-                    temp2 = r[chn][new][j] * sphi - r_prime * sprime;
-                }
-#else
-                temp1 = r[ch][new][j] * cos((FLOAT) phi[j]) - r_prime * cos((FLOAT) phi_prime);
-                temp2 = r[ch][new][j] * sin((FLOAT) phi[j]) - r_prime * sin((FLOAT) phi_prime);
-#endif
-
-                temp3 = r[ch][new][j] + fabs((FLOAT) r_prime);
-                if (temp3 != 0)
-                    c[j] = sqrt(temp1 * temp1 + temp2 * temp2) / temp3;
-                else
-                    c[j] = 0;
-            }
+            twolame_unpredict(&mem->unpredict, ch, energy, phi, c);
             /*****************************************************************************
              * Calculate the grouped, energy-weighted, unpredictability measure,           *
              * grouped_c[], and the grouped energy. grouped_e[]                           *
@@ -412,15 +359,8 @@ void twolame_psycho_2(twolame_options * glopts, short int buffer[2][1152],
              * convolve the grouped energy-weighted unpredictability measure               *
              * and the grouped energy with the spreading function, s[j][k]               *
              *****************************************************************************/
+            twolame_spread_convolve(mem->spread, grouped_e, grouped_c, ecb, cb);
             for (j = 0; j < CBANDS; j++) {
-                ecb[j] = 0;
-                cb[j] = 0;
-                for (k = 0; k < CBANDS; k++) {
-                    if (s[j][k] != 0.0) {
-                        ecb[j] += s[j][k] * grouped_e[k];
-                        cb[j] += s[j][k] * grouped_c[k];
-                    }
-                }
                 if (ecb[j] != 0)
                     cb[j] = cb[j] / ecb[j];
                 else
@@ -517,10 +457,8 @@ void twolame_psycho_2_deinit(psycho_2_mem ** mem)
         return;
 
     TWOLAME_FREE((*mem)->tmn);
-    TWOLAME_FREE((*mem)->s);
     TWOLAME_FREE((*mem)->lthr);
-    TWOLAME_FREE((*mem)->r);
-    TWOLAME_FREE((*mem)->phi_sav);
+    twolame_table_release((*mem)->spread);
 
     TWOLAME_FREE((*mem));
 }
@@ -29,8 +29,9 @@
 #include "common.h"
 #include "mem.h"
 #include "fft.h"
-#include "ath.h"
+#include "decibel.h"
 #include "psycho_3.h"
+#include "tables.h"
 
 /* This is a reimplementation of psy model 1 using the ISO11172 standard.
    I found the original dist10 code (which is full of pointers) to be
@@ -68,47 +69,42 @@ static inline FLOAT psycho_3_add_db(psycho_3_mem * mem, FLOAT a, FLOAT b)
 
 
 /* ISO11172 Sec D.1 Step 1 - Window with HANN and then perform the FFT */
-static void psycho_3_fft(FLOAT sample[BLKSIZE], FLOAT energy[BLKSIZE])
+static void psycho_3_fft(const fft_mem * fft, FLOAT sample[BLKSIZE], FLOAT energy[BLKSIZE])
 {
     FLOAT x_real[BLKSIZE];
     int i;
-    static int init = 0;
-    static FLOAT window[FFT_SIZE];
-
-    if (!init) {                /* calculate window function for the Fourier transform */
-        FLOAT sqrt_8_over_3 = pow(8.0 / 3.0, 0.5);
-        for (i = 0; i < BLKSIZE; i++) {
-            window[i] = sqrt_8_over_3 * 0.5 * (1 - cos(2.0 * PI * i / (BLKSIZE))) / BLKSIZE;
-        }
-        init=1;
-    }
+    const FLOAT *window = twolame_hann_window_scaled;   /* see gentables.c */
 
     /* convolve the samples with the hann window */
     for (i = 0; i < BLKSIZE; i++)
         x_real[i] = (FLOAT) (sample[i] * window[i]);
     /* do the FFT */
-    twolame_psycho_1_fft(x_real, energy, BLKSIZE);
+    twolame_psycho_1_fft(fft, x_real, energy, BLKSIZE);
 }
 
 
 /* Sect D.1 Step 1 - convert the energies into dB */
-static void psycho_3_powerdensityspectrum(FLOAT energy[BLKSIZE], FLOAT power[HBLKSIZE])
+static void psycho_3_powerdensityspectrum(const decibel_mem * db, FLOAT energy[BLKSIZE],
+                                          FLOAT power[HBLKSIZE])
 {
     int i;
-    for (i = 1; i < HBLKSIZE; i++) {
-        if (energy[i] < 1E-20)
-            power[i] = -200.0 + POWERNORM;
-        else
-            power[i] = 10 * log10(energy[i]) + POWERNORM;
-    }
+    if (db->fast)
+        twolame_to_db(db, energy + 1, power + 1, HBLKSIZE - 1, 10.0, POWERNORM, 1E-20);
+    else
+        for (i = 1; i < HBLKSIZE; i++) {
+            if (energy[i] < 1E-20)
+                power[i] = -200.0 + POWERNORM;
+            else
+                power[i] = 10 * log10(energy[i]) + POWERNORM;
+        }
 }
 
 
 /* Sect D.1 Step 2 - Determine the sound pressure level in each subband */
-static void psycho_3_spl(FLOAT * Lsb, FLOAT * power, FLOAT * scale)
+static void psycho_3_spl(const decibel_mem * db, FLOAT * Lsb, FLOAT * power, FLOAT * scale)
 {
     int i;
-    FLOAT Xmax[SBLIMIT];
+    FLOAT Xmax[SBLIMIT], val[SBLIMIT];
 
     for (i = 0; i < SBLIMIT; i++) {
         Xmax[i] = DBMIN;
@@ -122,10 +118,15 @@ static void psycho_3_spl(FLOAT * Lsb, FLOAT * power, FLOAT * scale)
 
     /* Compare it to the sound pressure based upon the scale for this subband and pick the maximum
        one */
-    for (i = 0; i < SBLIMIT; i++) {
-        FLOAT val = 20 * log10(scale[i] * 32768) - 10;
-        Lsb[i] = MAX(Xmax[i], val);
-    }
+    for (i = 0; i < SBLIMIT; i++)
+        val[i] = scale[i] * 32768;
+    if (db->fast)
+        twolame_to_db(db, val, val, SBLIMIT, 20.0, -10.0, 1E-20);
+    else
+        for (i = 0; i < SBLIMIT; i++)
+            val[i] = 20 * log10(val[i]) - 10;
+    for (i = 0; i < SBLIMIT; i++)
+        Lsb[i] = MAX(Xmax[i], val[i]);
 }
 
 
@@ -197,17 +198,6 @@ static void psycho_3_tonal_label(psycho_3_mem * mem, FLOAT power[HBLKSIZE], int
 
 
 
-static void psycho_3_init_add_db(psycho_3_mem * mem)
-{
-    int i;
-    FLOAT x;
-    for (i = 0; i < DBTAB; i++) {
-        x = (FLOAT) i / 10.0;
-        mem->dbtable[i] = 10 * log10(1 + pow(10.0, x / 10.0)) - x;
-    }
-}
-
-
 /* D.1 Step 4.c Labelling non-tonal (noise) components
    Sum the energies in each critical band (the tone energies have been removed
    during the tone labelling).
@@ -298,9 +288,8 @@ static void psycho_3_decimation(FLOAT * ath, int *tonelabel, FLOAT * Xtm, int *n
    NOTE: Only a subset of other frequencies is checked. According to the
    standard different subbands are subsampled to different amounts.
    See psycho_3_init and freq_subset */
-static void psycho_3_threshold(psycho_3_mem * mem, FLOAT * LTg, int *tonelabel, FLOAT * Xtm,
-                               int *noiselabel, FLOAT * Xnm, FLOAT * bark, FLOAT * ath,
-                               int bit_rate, int *freq_subset)
+static void psycho_3_threshold(psycho_3_mem * mem, FLOAT * LTm, int *tonelabel, FLOAT * Xtm,
+                               int *noiselabel, FLOAT * Xnm, FLOAT * bark, int *freq_subset)
 {
     int i, j, k;
     FLOAT LTtm[SUBSIZE];
@@ -358,13 +347,24 @@ static void psycho_3_threshold(psycho_3_mem * mem, FLOAT * LTg, int *tonelabel,
         }
     }
 
-    /* ISO11172 D.1 Step 7 Calculate the global masking threshold */
+    for (i = 0; i < SUBSIZE; i++)
+        LTm[i] = psycho_3_add_db(mem, LTnm[i], LTtm[i]);
+}
+
+
+/* ISO11172 D.1 Step 7 Calculate the global masking threshold from the
+   individual ones, for a bitrate per channel from HIGH_BITRATE if high
+   is TRUE, else below it */
+static void psycho_3_global(psycho_3_mem * mem, FLOAT * LTg, FLOAT * LTm, FLOAT * ath, int high,
+                            int *freq_subset)
+{
+    int i;
+
     for (i = 0; i < SUBSIZE; i++) {
-        LTg[i] = psycho_3_add_db(mem, LTnm[i], LTtm[i]);
-        if (bit_rate < 96)
-            LTg[i] = psycho_3_add_db(mem, ath[freq_subset[i]], LTg[i]);
+        if (!high)
+            LTg[i] = psycho_3_add_db(mem, ath[freq_subset[i]], LTm[i]);
         else
-            LTg[i] = psycho_3_add_db(mem, ath[freq_subset[i]] - 12.0, LTg[i]);
+            LTg[i] = psycho_3_add_db(mem, ath[freq_subset[i]] - 12.0, LTm[i]);
     }
 }
 
@@ -399,11 +399,10 @@ static void psycho_3_smr(FLOAT * LTmin, FLOAT * Lsb)
 }
 
 
-static psycho_3_mem *twolame_psycho_3_init(twolame_options * glopts)
+psycho_3_mem *twolame_psycho_3_init(twolame_options * glopts)
 {
     int i;
     int cbase = 0;              /* current base index for the bark range calculation */
-    FLOAT sfreq;
     psycho_3_mem *mem;
     int numlines[HBLKSIZE];
     FLOAT cbval[HBLKSIZE];
@@ -412,23 +411,27 @@ static psycho_3_mem *twolame_psycho_3_init(twolame_options * glopts)
     FLOAT *bark, *ath;
     int cbands = 0;
     int *cbandindex;
+    int sr = twolame_table_samplerate(glopts->samplerate_out);
+
+    if (sr < 0)
+        return NULL;
 
     mem = (psycho_3_mem *) TWOLAME_MALLOC(sizeof(psycho_3_mem));
+    if (!mem)
+        return NULL;
     mem->off[0] = mem->off[1] = 256;
     freq_subset = mem->freq_subset;
     bark = mem->bark;
     ath = mem->ath;
     cbandindex = mem->cbandindex;
 
-    /* Initialise the tables for the adding dB */
-    psycho_3_init_add_db(mem);
+    /* Get the table for the adding dB */
+    mem->dbtable = twolame_add_db;
 
-    /* For each spectral line calculate the bark and the ATH (in dB) */
-    sfreq = (FLOAT) glopts->samplerate_out;
+    /* For each spectral line get the bark and the ATH (in dB) */
     for (i = 1; i < HBLKSIZE; i++) {
-        FLOAT freq = i * sfreq / BLKSIZE;
-        bark[i] = twolame_ath_freq2bark(freq);
-        ath[i] = twolame_ath_db(freq, glopts->athlevel);
+        bark[i] = twolame_bark[sr][i];
+        ath[i] = twolame_ath_db_table[sr][i] + glopts->athlevel;
     }
 
     {   /* Work out the critical bands Starting from line 0, all lines
@@ -521,30 +524,36 @@ static void psycho_3_dump(int *tonelabel, FLOAT * Xtm, int *noiselabel, FLOAT *
 }
 
 
-void twolame_psycho_3(twolame_options * glopts, short int buffer[2][1152], FLOAT scale[2][32],
-                      FLOAT ltmin[2][32])
+/* Run the model on a frame, for the bitrate classes whose smr array is given:
+   low for bitrates per channel below HIGH_BITRATE, high for the others.
+   Only the global masking threshold is calculated for each class. */
+void twolame_psycho_3_classes(twolame_options * glopts, FLOAT buffer[2][1152],
+                              FLOAT scale[2][32], FLOAT low[2][32], FLOAT high[2][32])
 {
     psycho_3_mem *mem;
     int nch = glopts->num_channels_out;
-    int k, i;
+    int k, i, c;
+    FLOAT (*smr[2])[32];
     FLOAT sample[BLKSIZE];
 
     FLOAT energy[BLKSIZE];
     FLOAT power[HBLKSIZE] = {0};
     FLOAT Xtm[HBLKSIZE], Xnm[HBLKSIZE];
     int tonelabel[HBLKSIZE], noiselabel[HBLKSIZE] = {0};
-    FLOAT LTg[HBLKSIZE];
+    FLOAT LTm[HBLKSIZE], LTg[HBLKSIZE];
     FLOAT Lsb[SBLIMIT];
 
     if (!glopts->p3mem) {
         glopts->p3mem = twolame_psycho_3_init(glopts);
     }
     mem = glopts->p3mem;
+    smr[0] = low;
+    smr[1] = high;
 
     for (k = 0; k < nch; k++) {
         int ok = mem->off[k] % 1408;
         for (i = 0; i < 1152; i++) {
-            mem->fft_buf[k][ok++] = (FLOAT) buffer[k][i] / SCALE;
+            mem->fft_buf[k][ok++] = buffer[k][i] / SCALE;
             if (ok >= 1408)
                 ok = 0;
         }
@@ -558,22 +567,37 @@ void twolame_psycho_3(twolame_options * glopts, short int buffer[2][1152], FLOAT
         mem->off[k] += 1152;
         mem->off[k] %= 1408;
 
-        psycho_3_fft(sample, energy);
-        psycho_3_powerdensityspectrum(energy, power);
-        psycho_3_spl(Lsb, power, &scale[k][0]);
+        psycho_3_fft(&glopts->fft, sample, energy);
+        psycho_3_powerdensityspectrum(&glopts->db, energy, power);
+        psycho_3_spl(&glopts->db, Lsb, power, &scale[k][0]);
         psycho_3_tonal_label(mem, power, tonelabel, Xtm);
         psycho_3_noise_label(mem, power, energy, tonelabel, noiselabel, Xnm);
         if (glopts->verbosity > 8)
             psycho_3_dump(tonelabel, Xtm, noiselabel, Xnm);
         psycho_3_decimation(mem->ath, tonelabel, Xtm, noiselabel, Xnm, mem->bark);
-        psycho_3_threshold(mem, LTg, tonelabel, Xtm, noiselabel, Xnm, mem->bark, mem->ath,
-                           glopts->bitrate / nch, mem->freq_subset);
-        psycho_3_minimummasking(LTg, &ltmin[k][0], mem->freq_subset);
-        psycho_3_smr(&ltmin[k][0], Lsb);
+        psycho_3_threshold(mem, LTm, tonelabel, Xtm, noiselabel, Xnm, mem->bark,
+                           mem->freq_subset);
+        for (c = 0; c < 2; c++) {
+            if (smr[c] == NULL)
+                continue;
+            psycho_3_global(mem, LTg, LTm, mem->ath, c, mem->freq_subset);
+            psycho_3_minimummasking(LTg, &smr[c][k][0], mem->freq_subset);
+            psycho_3_smr(&smr[c][k][0], Lsb);
+        }
     }
 }
 
 
+void twolame_psycho_3(twolame_options * glopts, FLOAT buffer[2][1152], FLOAT scale[2][32],
+                      FLOAT ltmin[2][32])
+{
+    if (glopts->bitrate / glopts->num_channels_out < HIGH_BITRATE)
+        twolame_psycho_3_classes(glopts, buffer, scale, ltmin, NULL);
+    else
+        twolame_psycho_3_classes(glopts, buffer, scale, NULL, ltmin);
+}
+
+
 void twolame_psycho_3_deinit(psycho_3_mem ** mem)
 {
 
@@ -23,8 +23,11 @@
 #ifndef TWOLAME_PSYCHO_3_H
 #define TWOLAME_PSYCHO_3_H
 
-void twolame_psycho_3(twolame_options * glopts, short int buffer[2][1152], FLOAT scale[2][32],
+psycho_3_mem *twolame_psycho_3_init(twolame_options * glopts);
+void twolame_psycho_3(twolame_options * glopts, FLOAT buffer[2][1152], FLOAT scale[2][32],
                       FLOAT ltmin[2][32]);
+void twolame_psycho_3_classes(twolame_options * glopts, FLOAT buffer[2][1152],
+                              FLOAT scale[2][32], FLOAT low[2][32], FLOAT high[2][32]);
 void twolame_psycho_3_deinit(psycho_3_mem ** mem);
 
 #endif
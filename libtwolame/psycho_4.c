@@ -29,8 +29,11 @@
 #include "common.h"
 #include "mem.h"
 #include "fft.h"
+#include "spread.h"
+#include "unpredict.h"
 #include "ath.h"
 #include "psycho_4.h"
+#include "tables.h"
 
 /****************************************************************
 PSYCHO_4 by MFC Feb 2003
@@ -58,12 +61,6 @@ that much difference to the final SNR values, but it's something worth trying
 ****************************************************************/
 
 
-/* The static variables "r", "phi_sav", "new", "old" and "oldest" have
- to be remembered for the unpredictability measure.     For "r" and
- "phi_sav", the first index from the left is the channel select and
- the second index is the "age" of the data.                                */
-
-
 /* NMT is a constant 5.5dB. ISO11172 Sec D.2.4.h */
 static const FLOAT NMT = 5.5;
 
@@ -86,38 +83,6 @@ static const FLOAT minval[27] = {
 };
 
 
-/* Table covers angles from     0 to TRIGTABLESIZE/TRIGTABLESCALE (3.142) radians
-   In steps of 1/TRIGTABLESCALE (0.0005) radians.
-   Largest absolute error: 0.0005
-   Only create a table for cos, and then use trig to work out sin.
-   sin(theta) = cos(PI/2 - theta)
-   MFC March 2003 */
-static void psycho_4_trigtable_init(psycho_4_mem * p4mem)
-{
-
-    int i;
-    for (i = 0; i < TRIGTABLESIZE; i++) {
-        p4mem->cos_table[i] = cos((FLOAT) i / TRIGTABLESCALE);
-    }
-}
-
-#ifdef NEWTAN
-static inline FLOAT psycho_4_cos(psycho_4_mem * p4mem, FLOAT phi)
-{
-    int index;
-    int sign = 1;
-
-    index = (int) (fabs(phi) * TRIGTABLESCALE);
-    while (index >= TRIGTABLESIZE) {
-        /* If we're larger than PI, then subtract PI until we aren't each time the sign will flip -
-           Year 11 trig again. MFC March 2003 */
-        index -= TRIGTABLESIZE;
-        sign *= -1;
-    }
-    return (sign * p4mem->cos_table[index]);
-}
-#endif
-
 /* The spreading function.    Values returned in units of energy
    Argument 'bark' is the difference in bark values between the
    centre of two partitions.
@@ -162,66 +127,59 @@ static FLOAT psycho_4_spreading_function(FLOAT bark)
 /********************************
  * init psycho model 2
  ********************************/
-static psycho_4_mem *twolame_psycho_4_init(twolame_options * glopts, int sfreq)
+psycho_4_mem *twolame_psycho_4_init(twolame_options * glopts, int sfreq)
 {
     psycho_4_mem *mem;
-    FLOAT *cbval, *rnorm;
-    FLOAT *window;
-    FLOAT bark[HBLKSIZE], *ath;
+    FLOAT *cbval;
+    const FLOAT *bark;
+    FLOAT *ath;
     int *numlines;
     int *partition;
-    FCB *s;
+    spread_params spread;
     FLOAT *tmn;
     int i, j;
+    int sr = twolame_table_samplerate(sfreq);
+
+    if (sr < 0)
+        return NULL;
 
     {
         mem = (psycho_4_mem *) TWOLAME_MALLOC(sizeof(psycho_4_mem));
 
         mem->tmn = (FLOAT *) TWOLAME_MALLOC(sizeof(DCB));
-        mem->s = (FCB *) TWOLAME_MALLOC(sizeof(FCBCB));
         mem->lthr = (FHBLK *) TWOLAME_MALLOC(sizeof(F2HBLK));
-        mem->r = (F2HBLK *) TWOLAME_MALLOC(sizeof(F22HBLK));
-        mem->phi_sav = (F2HBLK *) TWOLAME_MALLOC(sizeof(F22HBLK));
-
-        mem->new = 0;
-        mem->old = 1;
-        mem->oldest = 0;
     }
 
     {
         cbval = mem->cbval;
-        rnorm = mem->rnorm;
-        window = mem->window;
-        // bark = mem->bark;
         ath = mem->ath;
         numlines = mem->numlines;
         partition = mem->partition;
-        s = mem->s;
         tmn = mem->tmn;
     }
 
 
-    /* Set up the SIN/COS tables */
-    psycho_4_trigtable_init(mem);
+    /* reset states used in unpredictability measure */
+    twolame_unpredict_init(&mem->unpredict, glopts->fast_phase);
 
-    /* calculate HANN window coefficients */
-    for (i = 0; i < BLKSIZE; i++)
-        window[i] = 0.5 * (1 - cos(2.0 * PI * (i - 0.5) / BLKSIZE));
+    /* HANN window coefficients */
+    mem->window = twolame_hann_window;
 
-    /* For each FFT line from 0(DC) to 512(Nyquist) calculate - bark : the bark value of this fft
+    /* For each FFT line from 0(DC) to 512(Nyquist) get - bark : the bark value of this fft
        line - ath : the absolute threshold of hearing for this line [ATH]
 
        Since it is a 1024 point FFT, each line in the fft corresponds to 1/1024 of the total
        frequency. Line 0 should correspond to DC - which doesn't really have a ATH afaik Line 1
        should be 1/1024th of the Sampling Freq Line 512 should be the nyquist freq */
+    bark = twolame_bark[sr];
     for (i = 0; i < HBLKSIZE; i++) {
-        FLOAT freq = i * (FLOAT) sfreq / (FLOAT) BLKSIZE;
-        bark[i] = twolame_ath_freq2bark(freq);
         /* The ath tables in the dist10 code seem to be a little out of kilter. they seem to start
            with index 0 corresponding to (sampling freq)/1024. When in doubt, i'm going to assume
            that the dist10 code is wrong. MFC Feb2003 */
-        ath[i] = twolame_ath_energy(freq, glopts->athlevel);
-        // fprintf(stderr,"%.2f ",ath[i]);
+        if (glopts->athlevel == 0)
+            ath[i] = twolame_ath_energy_table[sr][i];
+        else
+            ath[i] = twolame_ath_db_to_energy(twolame_ath_db_table[sr][i] + glopts->athlevel);
     }
 
 
@@ -260,12 +218,16 @@ static psycho_4_mem *twolame_psycho_4_init(twolame_options * glopts, int sfreq)
 
 
     /* Calculate the spreading function. ISO 11172 Section D.2.3 */
-    for (i = 0; i < CBANDS; i++) {
-        for (j = 0; j < CBANDS; j++) {
-            s[i][j] = psycho_4_spreading_function(1.05 * (cbval[i] - cbval[j]));
-            rnorm[i] += s[i][j];    /* sum the spreading function values for each partition so that
-                                       they can be normalised later on */
-        }
+    spread.cbval = cbval;
+    spread.function = psycho_4_spreading_function;
+    spread.tolerance = glopts->spread_tolerance;
+    mem->spread = (const spread_mem *) twolame_table_acquire(TWOLAME_TABLE_SPREAD_4, sfreq,
+                                                             glopts->spread_tolerance,
+                                                             sizeof(spread_mem),
+                                                             twolame_spread_build, &spread);
+    if (!mem->spread) {
+        twolame_psycho_4_deinit(&mem);
+        return NULL;
     }
 
     /* Calculate Tone Masking Noise values. ISO 11172 Tables D.3.x */
@@ -295,28 +257,26 @@ static psycho_4_mem *twolame_psycho_4_init(twolame_options * glopts, int sfreq)
 
 
 void twolame_psycho_4(twolame_options * glopts,
-                      short int buffer[2][1152], short int savebuf[2][1056], FLOAT smr[2][32])
+                      FLOAT buffer[2][1152], FLOAT savebuf[2][1056], FLOAT smr[2][32])
 /* to match prototype : FLOAT args are always FLOAT */
 {
     psycho_4_mem *mem;
     unsigned int run, i, j, k, ch;
-    FLOAT r_prime, phi_prime;
     FLOAT npart, epart;
-    int new, old, oldest;
     FLOAT *grouped_c, *grouped_e;
     FLOAT *nb, *cb, *tb, *ecb, *bc;
-    FLOAT *cbval, *rnorm;
-    FLOAT *wsamp_r, *phi, *energy, *window;
+    FLOAT *cbval;
+    const FLOAT *rnorm;
+    FLOAT *wsamp_r, *phi, *energy;
+    const FLOAT *window;
     FLOAT *ath, *thr, *c;
 
     FLOAT *snrtmp[2];
     int *numlines;
     int *partition;
     FLOAT *tmn;
-    FCB *s;
-    F2HBLK *r, *phi_sav;
 
-    int nch = glopts->num_channels_out;
+    unsigned int nch = glopts->num_channels_out;
     int sfreq = glopts->samplerate_out;
 
     if (!glopts->p4mem) {
@@ -332,11 +292,8 @@ void twolame_psycho_4(twolame_options * glopts,
         tb = mem->tb;
         ecb = mem->ecb;
         bc = mem->bc;
-        rnorm = mem->rnorm;
+        rnorm = mem->spread->rnorm;
         cbval = mem->cbval;
-        wsamp_r = mem->wsamp_r;
-        phi = mem->phi;
-        energy = mem->energy;
         window = mem->window;
         ath = mem->ath;
         thr = mem->thr;
@@ -348,9 +305,6 @@ void twolame_psycho_4(twolame_options * glopts,
         numlines = mem->numlines;
         partition = mem->partition;
         tmn = mem->tmn;
-        s = mem->s;
-        r = mem->r;
-        phi_sav = mem->phi_sav;
     }
 
     for (ch = 0; ch < nch; ch++) {
@@ -363,86 +317,33 @@ void twolame_psycho_4(twolame_options * glopts,
                flush = 384*3.0/2.0; = 576 syncsize = 1056; sync_flush = syncsize - flush; 480
                BLKSIZE = 1024 */
             {
-                short int *bufferp = buffer[ch];
+                FLOAT *bufferp = buffer[ch];
+                wsamp_r = mem->wsamp_r[ch][run];
                 for (j = 0; j < 480; j++) {
                     savebuf[ch][j] = savebuf[ch][j + 576];
-                    wsamp_r[j] = window[j] * ((FLOAT) savebuf[ch][j]);
+                    wsamp_r[j] = window[j] * savebuf[ch][j];
                 }
                 for (; j < 1024; j++) {
                     savebuf[ch][j] = *bufferp++;
-                    wsamp_r[j] = window[j] * ((FLOAT) savebuf[ch][j]);
+                    wsamp_r[j] = window[j] * savebuf[ch][j];
                 }
                 for (; j < 1056; j++)
                     savebuf[ch][j] = *bufferp++;
             }
+        }
+    }
 
-            /* Compute FFT */
-            twolame_psycho_2_fft(wsamp_r, energy, phi);
-
-            /* calculate the unpredictability measure, given energy[f] and phi[f] (the age pointers
-               [new/old/oldest] are reset automatically on the second pass */
-            {
-                if (mem->new == 0) {
-                    mem->new = 1;
-                    mem->oldest = 1;
-                } else {
-                    mem->new = 0;
-                    mem->oldest = 0;
-                }
-                if (mem->old == 0)
-                    mem->old = 1;
-                else
-                    mem->old = 0;
-            }
-            old = mem->old;
-            new = mem->new;
-            oldest = mem->oldest;
-
-
-            for (j = 0; j < HBLKSIZE; j++) {
-#ifdef NEWATAN
-                FLOAT temp1, temp2, temp3;
-                r_prime = 2.0 * r[ch][old][j] - r[ch][oldest][j];
-                phi_prime = 2.0 * phi_sav[ch][old][j] - phi_sav[ch][oldest][j];
-
-                r[ch][new][j] = sqrt((FLOAT) energy[j]);
-                phi_sav[ch][new][j] = phi[j];
-
-                {
-                    temp1 =
-                        r[ch][new][j] * psycho_4_cos(mem, phi[j]) -
-                        r_prime * psycho_4_cos(mem, phi_prime);
-                    /* Remember your grade 11 trig? sin(theta) = cos(PI/2 - theta) */
-                    temp2 =
-                        r[ch][new][j] * psycho_4_cos(mem, PI2 - phi[j]) -
-                        r_prime * psycho_4_cos(mem, PI2 - phi_prime);
-                }
-
-
-                temp3 = r[ch][new][j] + fabs((FLOAT) r_prime);
-                if (temp3 != 0)
-                    c[j] = sqrt(temp1 * temp1 + temp2 * temp2) / temp3;
-                else
-                    c[j] = 0;
-#else
-                FLOAT temp1, temp2, temp3;
-                r_prime = 2.0 * r[ch][old][j] - r[ch][oldest][j];
-                phi_prime = 2.0 * phi_sav[ch][old][j] - phi_sav[ch][oldest][j];
-
-                r[ch][new][j] = sqrt((FLOAT) energy[j]);
-                phi_sav[ch][new][j] = phi[j];
+    /* Compute the FFTs of both halves of every channel together */
+    twolame_psycho_2_fft_batch(&glopts->fft, mem->wsamp_r[0], mem->energy[0], mem->phi[0],
+                               2 * nch);
 
+    for (ch = 0; ch < nch; ch++) {
+        for (run = 0; run < 2; run++) {
+            energy = mem->energy[ch][run];
+            phi = mem->phi[ch][run];
 
-                temp1 = r[ch][new][j] * cos((FLOAT) phi[j]) - r_prime * cos((FLOAT) phi_prime);
-                temp2 = r[ch][new][j] * sin((FLOAT) phi[j]) - r_prime * sin((FLOAT) phi_prime);
-
-                temp3 = r[ch][new][j] + fabs((FLOAT) r_prime);
-                if (temp3 != 0)
-                    c[j] = sqrt(temp1 * temp1 + temp2 * temp2) / temp3;
-                else
-                    c[j] = 0;
-#endif
-            }
+            /* calculate the unpredictability measure, given energy[f] and phi[f] */
+            twolame_unpredict(&mem->unpredict, ch, energy, phi, c);
 
             /* For each partition, sum all the energy in that partition - grouped_e and calculated
                the energy-weighted unpredictability measure - grouped_c ISO 11172 Section D.2.4.e */
@@ -459,15 +360,8 @@ void twolame_psycho_4(twolame_options * glopts,
 
             /* convolve the grouped energy-weighted unpredictability measure and the grouped energy
                with the spreading function ISO 11172 D.2.4.f */
+            twolame_spread_convolve(mem->spread, grouped_e, grouped_c, ecb, cb);
             for (j = 0; j < CBANDS; j++) {
-                ecb[j] = 0;
-                cb[j] = 0;
-                for (k = 0; k < CBANDS; k++) {
-                    if (s[j][k] != 0.0) {
-                        ecb[j] += s[j][k] * grouped_e[k];
-                        cb[j] += s[j][k] * grouped_c[k];
-                    }
-                }
                 if (ecb[j] != 0)
                     cb[j] = cb[j] / ecb[j];
                 else
@@ -549,10 +443,8 @@ void twolame_psycho_4_deinit(psycho_4_mem ** mem)
         return;
 
     TWOLAME_FREE((*mem)->tmn);
-    TWOLAME_FREE((*mem)->s);
     TWOLAME_FREE((*mem)->lthr);
-    TWOLAME_FREE((*mem)->r);
-    TWOLAME_FREE((*mem)->phi_sav);
+    twolame_table_release((*mem)->spread);
 
     TWOLAME_FREE((*mem));
 }
@@ -23,7 +23,8 @@
 #ifndef TWOLAME_PSYCHO_4_H
 #define TWOLAME_PSYCHO_4_H
 
-void twolame_psycho_4(twolame_options * glopts, short int buffer[2][1152], short int savebuf[2][1056],
+psycho_4_mem *twolame_psycho_4_init(twolame_options * glopts, int sfreq);
+void twolame_psycho_4(twolame_options * glopts, FLOAT buffer[2][1152], FLOAT savebuf[2][1056],
                       FLOAT smr[2][32]);
 void twolame_psycho_4_deinit(psycho_4_mem ** mem);
 
@@ -0,0 +1,297 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2001-2004 Michael Cheng
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "twolame.h"
+#include "common.h"
+#include "mem.h"
+#include "availbits.h"
+#include "worker.h"
+
+
+/*
+  Encoding of a whole stream in segments, on several threads.
+
+  The state carried from one frame to the next is the history of the
+  input: the last 480 samples in the filterbank, the last 1408 samples
+  in psycho models 1 and 3, and the spectra of the last three blocks of
+  1024 samples in psycho models 2 and 4. Once an encoder has been fed
+  the frames before its segment, that state holds exactly what it would
+  hold in a single encoder, so its frames come out identical. Each
+  segment is encoded by a copy of the options, which first encodes
+  segment_warmup() frames before the segment and throws them
+  away. The padding of the frames and the quick mode counter only
+  depend on the number of frames before, and are set from it.
+
+  The one exception is VBR with psycho models 1 and 3, which lower the
+  threshold of hearing from the bitrate chosen for the previous frame.
+  That bitrate is found again from the warm-up frames in most cases,
+  and otherwise only the masking threshold of the first frames of the
+  segment differs, to that of a neighbouring bitrate.
+*/
+
+/* frames before a segment which are encoded to fill the history: one is
+   enough for all the models, the second one gives the bitrate of VBR
+   with psycho models 1 and 3 a chance to settle */
+#define SEGMENT_WARMUP  2
+
+typedef struct {
+    twolame_options *glopts;    // the initialised options of the stream
+    const short *pcm;           // the samples of the stream, interleaved
+    int first_frame;            // the first frame of the segment in the stream
+    int num_frames;             // its number of whole frames
+    int num_samples;            // the samples after them, only in the last segment
+    unsigned char *mp2;         // its frames
+    int mp2_size;
+    int bytes;                  // number of bytes in mp2, or <0 on error
+} segment;
+
+
+static int segment_warmup(twolame_options * glopts)
+{
+    /* In quick mode the model only sees every quickcount-th frame, and the last
+       one it saw before the segment must come after the warm-up of the model */
+    if (glopts->quickmode)
+        return (SEGMENT_WARMUP + 1) * glopts->quickcount;
+
+    return SEGMENT_WARMUP;
+}
+
+
+/* New options with the same settings as glopts, initialised for a new stream.
+   The settings which twolame_init_params() chose for glopts are set explicitly,
+   so the copy makes the same choices. */
+static twolame_options *copy_options(twolame_options * glopts)
+{
+    twolame_options *opts = twolame_init();
+
+    if (opts == NULL)
+        return NULL;
+
+    twolame_set_verbosity(opts, glopts->verbosity);
+    twolame_set_num_channels(opts, glopts->num_channels_in);
+    twolame_set_in_samplerate(opts, glopts->samplerate_in);
+    twolame_set_out_samplerate(opts, glopts->samplerate_out);
+    twolame_set_version(opts, glopts->version);
+    twolame_set_mode(opts, glopts->mode);
+    twolame_set_bitrate(opts, glopts->bitrate);
+    twolame_set_freeformat(opts, glopts->freeformat);
+    twolame_set_padding(opts, glopts->padding);
+    twolame_set_energy_levels(opts, glopts->do_energy_levels);
+    twolame_set_num_ancillary_bits(opts, glopts->num_ancillary_bits);
+    twolame_set_scale(opts, glopts->scale);
+    twolame_set_scale_left(opts, glopts->scale_left);
+    twolame_set_scale_right(opts, glopts->scale_right);
+
+    twolame_set_psymodel(opts, glopts->psymodel);
+    twolame_set_ATH_level(opts, glopts->athlevel);
+    twolame_set_quick_mode(opts, glopts->quickmode);
+    twolame_set_quick_count(opts, glopts->quickcount);
+    twolame_set_fast_dct(opts, glopts->fast_dct);
+    twolame_set_fast_fft(opts, glopts->fast_fft);
+    twolame_set_fast_phase(opts, glopts->fast_phase);
+    twolame_set_spreading_tolerance(opts, glopts->spread_tolerance);
+    twolame_set_fast_db(opts, glopts->fast_db);
+
+    twolame_set_VBR(opts, glopts->vbr);
+    twolame_set_VBR_level(opts, glopts->vbrlevel);
+    twolame_set_VBR_max_bitrate_kbps(opts, glopts->vbr_max_bitrate);
+
+    twolame_set_emphasis(opts, glopts->emphasis);
+    twolame_set_copyright(opts, glopts->copyright);
+    twolame_set_original(opts, glopts->original);
+    twolame_set_extension(opts, glopts->private_extension);
+    twolame_set_error_protection(opts, glopts->error_protection);
+
+    // the segments are the threads
+    twolame_set_num_threads(opts, 1);
+
+    if (twolame_init_params(opts) != 0) {
+        twolame_close(&opts);
+        return NULL;
+    }
+
+    return opts;
+}
+
+
+/* Encode the warm-up frames and then the segment with opts, returning the size of the segment */
+static int encode_frames(twolame_options * opts, segment * seg, unsigned char *scratch,
+                         int scratch_size)
+{
+    int nch = opts->num_channels_in;
+    int start, i, n, bytes;
+
+    start = seg->first_frame - segment_warmup(opts);
+    if (start < 0)
+        start = 0;
+
+    // the padding and the quick mode counter of the frames before
+    for (i = 0; i < start; i++)
+        twolame_available_bits(opts);
+    opts->psycount = start;
+
+    for (i = start; i < seg->first_frame; i++) {
+        n = twolame_encode_buffer_interleaved(opts, seg->pcm + i * TWOLAME_SAMPLES_PER_FRAME * nch,
+                                              TWOLAME_SAMPLES_PER_FRAME, scratch, scratch_size);
+        if (n < 0)
+            return n;
+    }
+
+    bytes = twolame_encode_buffer_interleaved(opts,
+                                              seg->pcm +
+                                              seg->first_frame * TWOLAME_SAMPLES_PER_FRAME * nch,
+                                              seg->num_frames * TWOLAME_SAMPLES_PER_FRAME +
+                                              seg->num_samples, seg->mp2, seg->mp2_size);
+    if (bytes < 0 || seg->num_samples == 0)
+        return bytes;
+
+    n = twolame_encode_flush(opts, seg->mp2 + bytes, seg->mp2_size - bytes);
+    return (n < 0) ? n : bytes + n;
+}
+
+
+static void encode_segment(segment * seg)
+{
+    int max_bytes = twolame_max_frame_bits(seg->glopts) / 8;
+    twolame_options *opts = copy_options(seg->glopts);
+    unsigned char *scratch = (unsigned char *) TWOLAME_MALLOC(max_bytes);
+
+    if (opts != NULL && scratch != NULL)
+        seg->bytes = encode_frames(opts, seg, scratch, max_bytes);
+    else
+        seg->bytes = -1;
+
+    TWOLAME_FREE(scratch);
+    twolame_close(&opts);
+}
+
+
+typedef struct {
+    segment *segs;
+    int num_segments;
+} segment_queue;
+
+/* Encode every num_threads-th segment, from the index-th on */
+static void segment_job(void *arg, int index, int num_threads)
+{
+    segment_queue *queue = (segment_queue *) arg;
+    int i;
+
+    for (i = index; i < queue->num_segments; i += num_threads)
+        encode_segment(&queue->segs[i]);
+}
+
+
+/* Encode the segments on up to MAX_THREADS threads, which share them out */
+static void encode_segments(segment * segs, int num_segments)
+{
+    segment_queue queue;
+
+    queue.segs = segs;
+    queue.num_segments = num_segments;
+    twolame_run_threads(segment_job, &queue,
+                        (num_segments < MAX_THREADS) ? num_segments : MAX_THREADS);
+}
+
+
+int twolame_encode_segments_interleaved(twolame_options * glopts,
+                                        const short int pcm[],
+                                        int num_samples, int num_segments,
+                                        unsigned char *mp2buffer, int mp2buffer_size)
+{
+    int num_frames = num_samples / TWOLAME_SAMPLES_PER_FRAME;
+    int max_bytes, mp2_size = 0;
+    int i;
+    segment *segs;
+
+    if (!glopts->twolame_init) {
+        fprintf(stderr, "Please call twolame_init_params() before starting encoding.\n");
+        return -1;
+    }
+    if (num_segments < 1) {
+        fprintf(stderr, "twolame_encode_segments_interleaved(): invalid number of segments %i\n",
+                num_segments);
+        return -1;
+    }
+    if (glopts->do_dab) {
+        fprintf(stderr, "twolame_encode_segments_interleaved(): can't encode DAB in segments\n");
+        return -1;
+    }
+    if (num_samples == 0)
+        return 0;
+
+    // every segment has one frame at least, the last one also the samples left over
+    if (num_segments > num_frames)
+        num_segments = (num_frames > 0) ? num_frames : 1;
+
+    max_bytes = twolame_max_frame_bits(glopts) / 8;
+    segs = (segment *) TWOLAME_MALLOC(sizeof(segment) * num_segments);
+    if (segs == NULL)
+        return -1;
+
+    for (i = 0; i < num_segments; i++) {
+        segment *seg = &segs[i];
+        int extra = num_frames % num_segments;
+
+        seg->glopts = glopts;
+        seg->pcm = pcm;
+        seg->first_frame = i * (num_frames / num_segments) + (i < extra ? i : extra);
+        seg->num_frames = num_frames / num_segments + (i < extra ? 1 : 0);
+        seg->num_samples = (i == num_segments - 1) ? num_samples % TWOLAME_SAMPLES_PER_FRAME : 0;
+        seg->mp2_size = (seg->num_frames + 1) * max_bytes;
+        seg->mp2 = (unsigned char *) TWOLAME_MALLOC(seg->mp2_size);
+        if (seg->mp2 == NULL)
+            mp2_size = -1;
+    }
+
+    if (mp2_size == 0)
+        encode_segments(segs, num_segments);
+
+    // join the segments into one stream
+    for (i = 0; i < num_segments && mp2_size >= 0; i++) {
+        if (segs[i].bytes < 0)
+            mp2_size = segs[i].bytes;
+        else if (mp2_size + segs[i].bytes > mp2buffer_size)
+            mp2_size = TWOLAME_ERROR_BUFFER_FULL;
+        else {
+            memcpy(mp2buffer + mp2_size, segs[i].mp2, segs[i].bytes);
+            mp2_size += segs[i].bytes;
+        }
+    }
+
+    for (i = 0; i < num_segments; i++)
+        TWOLAME_FREE(segs[i].mp2);
+    TWOLAME_FREE(segs);
+
+    return mp2_size;
+}
+
+
+// vim:ts=4:sw=4:nowrap:
@@ -0,0 +1,288 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2001-2004 Michael Cheng
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef TWOLAME_SIMD_H
+#define TWOLAME_SIMD_H
+
+/*
+  Vector types and operations on FLOAT for each SIMD instruction set,
+  so that kernels are written once for single and double precision.
+  Loads and stores are unaligned; reverse swaps the order of the lanes.
+  cmplt gives a mask for select(mask, a, b), which picks a where the
+  mask is set and b elsewhere.
+  For positive normal v, exponent(v) and mantissa(v) give e and m in
+  [1, 2) with v = m 2^e; exp2i(n) gives 2^n for an integer valued n
+  within the exponent range of FLOAT.
+*/
+
+#include "cpu.h"
+
+/* a single lane, for the scalar versions of the kernels */
+#define scalar_vec              FLOAT
+#define scalar_load(p)          (*(p))
+#define scalar_store(p, v)      (*(p) = (v))
+#define scalar_add(a, b)        ((a) + (b))
+#define scalar_sub(a, b)        ((a) - (b))
+#define scalar_mul(a, b)        ((a) * (b))
+#define scalar_div(a, b)        ((a) / (b))
+#define scalar_sqrt(v)          sqrt(v)
+#define scalar_min(a, b)        ((a) < (b) ? (a) : (b))
+#define scalar_max(a, b)        ((a) > (b) ? (a) : (b))
+#define scalar_abs(v)           fabs(v)
+#define scalar_cmplt(a, b)      ((a) < (b))
+#define scalar_select(m, a, b)  ((m) ? (a) : (b))
+#define scalar_set1(v)          ((FLOAT) (v))
+#define scalar_zero()           ((FLOAT) 0.0)
+#define scalar_reverse(v)       (v)
+#define scalar_exponent(v)      scalar_exponent_bits(v)
+#define scalar_mantissa(v)      scalar_mantissa_bits(v)
+#define scalar_exp2i(n)         scalar_exp2i_bits(n)
+
+/* fields of the IEEE 754 representation of FLOAT */
+#ifdef SINGLE_PRECISION
+typedef unsigned int float_bits;
+#define FLOAT_MANT_BITS         23
+#define FLOAT_EXP_BIAS          127
+#define FLOAT_MANT_MASK         0x007FFFFFU
+#define FLOAT_EXP_MAGIC         8388608.0f      /* 2^23, ORed with the exponent field */
+#else
+typedef unsigned long long float_bits;
+#define FLOAT_MANT_BITS         52
+#define FLOAT_EXP_BIAS          1023
+#define FLOAT_MANT_MASK         0x000FFFFFFFFFFFFFULL
+#define FLOAT_EXP_MAGIC         4503599627370496.0      /* 2^52 */
+#endif
+
+typedef union {
+    FLOAT f;
+    float_bits u;
+} float_pun;
+
+static inline FLOAT scalar_exponent_bits(FLOAT v)
+{
+    float_pun p;
+    p.f = v;
+    return (FLOAT) (int) (p.u >> FLOAT_MANT_BITS) - FLOAT_EXP_BIAS;
+}
+
+static inline FLOAT scalar_mantissa_bits(FLOAT v)
+{
+    float_pun p, one;
+    p.f = v;
+    one.f = 1.0;
+    p.u = (p.u & FLOAT_MANT_MASK) | one.u;
+    return p.f;
+}
+
+static inline FLOAT scalar_exp2i_bits(FLOAT n)
+{
+    float_pun p;
+    p.u = (float_bits) ((int) n + FLOAT_EXP_BIAS) << FLOAT_MANT_BITS;
+    return p.f;
+}
+
+#if defined(TWOLAME_X86_SIMD)
+
+#include <immintrin.h>
+
+#ifdef SINGLE_PRECISION
+
+#define SSE_WIDTH               4
+#define sse_vec                 __m128
+#define sse_load                _mm_loadu_ps
+#define sse_store               _mm_storeu_ps
+#define sse_add                 _mm_add_ps
+#define sse_sub                 _mm_sub_ps
+#define sse_mul                 _mm_mul_ps
+#define sse_set1                _mm_set1_ps
+#define sse_zero                _mm_setzero_ps
+#define sse_reverse(v)          _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3))
+#define sse_div                 _mm_div_ps
+#define sse_sqrt                _mm_sqrt_ps
+#define sse_min                 _mm_min_ps
+#define sse_max                 _mm_max_ps
+#define sse_abs(v)              _mm_andnot_ps(_mm_set1_ps(-0.0f), v)
+#define sse_cmplt               _mm_cmplt_ps
+#define sse_select(m, a, b)     _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b))
+#define sse_exponent(v)         _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(_mm_castps_si128(v), 23), \
+                                    _mm_castps_si128(_mm_set1_ps(FLOAT_EXP_MAGIC)))), \
+                                    _mm_set1_ps(FLOAT_EXP_MAGIC + FLOAT_EXP_BIAS))
+#define sse_mantissa(v)         _mm_or_ps(_mm_and_ps(v, _mm_castsi128_ps(_mm_set1_epi32(FLOAT_MANT_MASK))), \
+                                    _mm_set1_ps(1.0f))
+#define sse_exp2i(n)            _mm_castsi128_ps(_mm_slli_epi32(_mm_castps_si128( \
+                                    _mm_add_ps(n, _mm_set1_ps(FLOAT_EXP_MAGIC + FLOAT_EXP_BIAS))), 23))
+
+#define AVX_WIDTH               8
+#define avx_vec                 __m256
+#define avx_load                _mm256_loadu_ps
+#define avx_store               _mm256_storeu_ps
+#define avx_add                 _mm256_add_ps
+#define avx_sub                 _mm256_sub_ps
+#define avx_mul                 _mm256_mul_ps
+#define avx_set1                _mm256_set1_ps
+#define avx_zero                _mm256_setzero_ps
+#define avx_reverse(v)          _mm256_permutevar8x32_ps(v, _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7))
+#define avx_div                 _mm256_div_ps
+#define avx_sqrt                _mm256_sqrt_ps
+#define avx_min                 _mm256_min_ps
+#define avx_max                 _mm256_max_ps
+#define avx_abs(v)              _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v)
+#define avx_cmplt(a, b)         _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define avx_select(m, a, b)     _mm256_blendv_ps(b, a, m)
+#define avx_exponent(v)         _mm256_sub_ps(_mm256_castsi256_ps(_mm256_or_si256( \
+                                    _mm256_srli_epi32(_mm256_castps_si256(v), 23), \
+                                    _mm256_castps_si256(_mm256_set1_ps(FLOAT_EXP_MAGIC)))), \
+                                    _mm256_set1_ps(FLOAT_EXP_MAGIC + FLOAT_EXP_BIAS))
+#define avx_mantissa(v)         _mm256_or_ps(_mm256_and_ps(v, \
+                                    _mm256_castsi256_ps(_mm256_set1_epi32(FLOAT_MANT_MASK))), \
+                                    _mm256_set1_ps(1.0f))
+#define avx_exp2i(n)            _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_castps_si256( \
+                                    _mm256_add_ps(n, _mm256_set1_ps(FLOAT_EXP_MAGIC + FLOAT_EXP_BIAS))), 23))
+
+#else
+
+#define SSE_WIDTH               2
+#define sse_vec                 __m128d
+#define sse_load                _mm_loadu_pd
+#define sse_store               _mm_storeu_pd
+#define sse_add                 _mm_add_pd
+#define sse_sub                 _mm_sub_pd
+#define sse_mul                 _mm_mul_pd
+#define sse_set1                _mm_set1_pd
+#define sse_zero                _mm_setzero_pd
+#define sse_reverse(v)          _mm_shuffle_pd(v, v, 1)
+#define sse_div                 _mm_div_pd
+#define sse_sqrt                _mm_sqrt_pd
+#define sse_min                 _mm_min_pd
+#define sse_max                 _mm_max_pd
+#define sse_abs(v)              _mm_andnot_pd(_mm_set1_pd(-0.0), v)
+#define sse_cmplt               _mm_cmplt_pd
+#define sse_select(m, a, b)     _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b))
+#define sse_exponent(v)         _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(_mm_castpd_si128(v), 52), \
+                                    _mm_castpd_si128(_mm_set1_pd(FLOAT_EXP_MAGIC)))), \
+                                    _mm_set1_pd(FLOAT_EXP_MAGIC + FLOAT_EXP_BIAS))
+#define sse_mantissa(v)         _mm_or_pd(_mm_and_pd(v, _mm_castsi128_pd(_mm_set1_epi64x(FLOAT_MANT_MASK))), \
+                                    _mm_set1_pd(1.0))
+#define sse_exp2i(n)            _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128( \
+                                    _mm_add_pd(n, _mm_set1_pd(FLOAT_EXP_MAGIC + FLOAT_EXP_BIAS))), 52))
+
+#define AVX_WIDTH               4
+#define avx_vec                 __m256d
+#define avx_load                _mm256_loadu_pd
+#define avx_store               _mm256_storeu_pd
+#define avx_add                 _mm256_add_pd
+#define avx_sub                 _mm256_sub_pd
+#define avx_mul                 _mm256_mul_pd
+#define avx_set1                _mm256_set1_pd
+#define avx_zero                _mm256_setzero_pd
+#define avx_reverse(v)          _mm256_permute4x64_pd(v, _MM_SHUFFLE(0, 1, 2, 3))
+#define avx_div                 _mm256_div_pd
+#define avx_sqrt                _mm256_sqrt_pd
+#define avx_min                 _mm256_min_pd
+#define avx_max                 _mm256_max_pd
+#define avx_abs(v)              _mm256_andnot_pd(_mm256_set1_pd(-0.0), v)
+#define avx_cmplt(a, b)         _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define avx_select(m, a, b)     _mm256_blendv_pd(b, a, m)
+#define avx_exponent(v)         _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256( \
+                                    _mm256_srli_epi64(_mm256_castpd_si256(v), 52), \
+                                    _mm256_castpd_si256(_mm256_set1_pd(FLOAT_EXP_MAGIC)))), \
+                                    _mm256_set1_pd(FLOAT_EXP_MAGIC + FLOAT_EXP_BIAS))
+#define avx_mantissa(v)         _mm256_or_pd(_mm256_and_pd(v, \
+                                    _mm256_castsi256_pd(_mm256_set1_epi64x(FLOAT_MANT_MASK))), \
+                                    _mm256_set1_pd(1.0))
+#define avx_exp2i(n)            _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256( \
+                                    _mm256_add_pd(n, _mm256_set1_pd(FLOAT_EXP_MAGIC + FLOAT_EXP_BIAS))), 52))
+
+#endif
+
+#define avx_zeroupper           _mm256_zeroupper
+
+#define SSE2_TARGET             __attribute__ ((target("sse2")))
+#define AVX2_TARGET             __attribute__ ((target("avx2")))
+
+#elif defined(TWOLAME_NEON_SIMD)
+
+#include <arm_neon.h>
+
+#ifdef SINGLE_PRECISION
+
+#define NEON_WIDTH              4
+#define neon_vec                float32x4_t
+#define neon_load               vld1q_f32
+#define neon_store              vst1q_f32
+#define neon_add                vaddq_f32
+#define neon_sub                vsubq_f32
+#define neon_mul                vmulq_f32
+#define neon_set1               vdupq_n_f32
+#define neon_zero()             vdupq_n_f32(0.0f)
+#define neon_reverse(v)         vextq_f32(vrev64q_f32(v), vrev64q_f32(v), 2)
+#define neon_div                vdivq_f32
+#define neon_sqrt               vsqrtq_f32
+#define neon_min                vminq_f32
+#define neon_max                vmaxq_f32
+#define neon_abs                vabsq_f32
+#define neon_cmplt              vcltq_f32
+#define neon_select             vbslq_f32
+#define neon_exponent(v)        vsubq_f32(vreinterpretq_f32_u32(vorrq_u32(vshrq_n_u32(vreinterpretq_u32_f32(v), 23), \
+                                    vreinterpretq_u32_f32(vdupq_n_f32(FLOAT_EXP_MAGIC)))), \
+                                    vdupq_n_f32(FLOAT_EXP_MAGIC + FLOAT_EXP_BIAS))
+#define neon_mantissa(v)        vreinterpretq_f32_u32(vorrq_u32(vandq_u32(vreinterpretq_u32_f32(v), \
+                                    vdupq_n_u32(FLOAT_MANT_MASK)), vreinterpretq_u32_f32(vdupq_n_f32(1.0f))))
+#define neon_exp2i(n)           vreinterpretq_f32_u32(vshlq_n_u32(vreinterpretq_u32_f32( \
+                                    vaddq_f32(n, vdupq_n_f32(FLOAT_EXP_MAGIC + FLOAT_EXP_BIAS))), 23))
+
+#else
+
+#define NEON_WIDTH              2
+#define neon_vec                float64x2_t
+#define neon_load               vld1q_f64
+#define neon_store              vst1q_f64
+#define neon_add                vaddq_f64
+#define neon_sub                vsubq_f64
+#define neon_mul                vmulq_f64
+#define neon_set1               vdupq_n_f64
+#define neon_zero()             vdupq_n_f64(0.0)
+#define neon_reverse(v)         vextq_f64(v, v, 1)
+#define neon_div                vdivq_f64
+#define neon_sqrt               vsqrtq_f64
+#define neon_min                vminq_f64
+#define neon_max                vmaxq_f64
+#define neon_abs                vabsq_f64
+#define neon_cmplt              vcltq_f64
+#define neon_select             vbslq_f64
+#define neon_exponent(v)        vsubq_f64(vreinterpretq_f64_u64(vorrq_u64(vshrq_n_u64(vreinterpretq_u64_f64(v), 52), \
+                                    vreinterpretq_u64_f64(vdupq_n_f64(FLOAT_EXP_MAGIC)))), \
+                                    vdupq_n_f64(FLOAT_EXP_MAGIC + FLOAT_EXP_BIAS))
+#define neon_mantissa(v)        vreinterpretq_f64_u64(vorrq_u64(vandq_u64(vreinterpretq_u64_f64(v), \
+                                    vdupq_n_u64(FLOAT_MANT_MASK)), vreinterpretq_u64_f64(vdupq_n_f64(1.0))))
+#define neon_exp2i(n)           vreinterpretq_f64_u64(vshlq_n_u64(vreinterpretq_u64_f64( \
+                                    vaddq_f64(n, vdupq_n_f64(FLOAT_EXP_MAGIC + FLOAT_EXP_BIAS))), 52))
+
+#endif
+
+#endif
+
+#endif                          /* TWOLAME_SIMD_H */
+
+
+// vim:ts=4:sw=4:nowrap:
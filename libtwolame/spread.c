@@ -0,0 +1,196 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2001-2004 Michael Cheng
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <math.h>
+
+#include "twolame.h"
+#include "common.h"
+#include "cpu.h"
+#include "simd.h"
+#include "mem.h"
+#include "spread.h"
+
+
+/*
+  Convolution of the grouped energies of psycho models 2 and 4 with
+  the spreading function, ecb[j] = sum over k of s[j][k] e[k].
+
+  s[j][k] is negligible more than a few Bark away from the diagonal,
+  so it is stored by columns w[k][j] = s[j][k], keeping only the rows
+  start[k] to start[k] + len[k] - 1 where it is non zero. Each column
+  is added to all the rows at once, so the SIMD kernels work on
+  vectors of rows and every row still sums its terms in the order of
+  k. Entries within a column or its padding that were dropped are
+  zero and leave the sums unchanged, so all kernels give the same
+  results as the dense product that skips the zeros.
+*/
+#define SPREAD_CONVOLVE(P, W) \
+    for (k = 0; k < CBANDS; k++) { \
+        const FLOAT *w = spread->w[k]; \
+        const P##_vec e = P##_set1(grouped_e[k]), c = P##_set1(grouped_c[k]); \
+        for (j = spread->start[k]; j < spread->start[k] + spread->len[k]; j += (W)) { \
+            const P##_vec wj = P##_load(w + j); \
+            P##_store(ecb + j, P##_add(P##_load(ecb + j), P##_mul(wj, e))); \
+            P##_store(cb + j, P##_add(P##_load(cb + j), P##_mul(wj, c))); \
+        } \
+    }
+
+static void convolve_scalar(const spread_mem * spread, const FLOAT * grouped_e,
+                            const FLOAT * grouped_c, FLOAT * ecb, FLOAT * cb)
+{
+    int j, k;
+
+    SPREAD_CONVOLVE(scalar, 1);
+}
+
+#if defined(TWOLAME_X86_SIMD)
+
+SSE2_TARGET static void convolve_sse2(const spread_mem * spread, const FLOAT * grouped_e,
+                                      const FLOAT * grouped_c, FLOAT * ecb, FLOAT * cb)
+{
+    int j, k;
+
+    SPREAD_CONVOLVE(sse, SSE_WIDTH);
+}
+
+AVX2_TARGET static void convolve_avx2(const spread_mem * spread, const FLOAT * grouped_e,
+                                      const FLOAT * grouped_c, FLOAT * ecb, FLOAT * cb)
+{
+    int j, k;
+
+    SPREAD_CONVOLVE(avx, AVX_WIDTH);
+}
+
+#elif defined(TWOLAME_NEON_SIMD)
+
+static void convolve_neon(const spread_mem * spread, const FLOAT * grouped_e,
+                          const FLOAT * grouped_c, FLOAT * ecb, FLOAT * cb)
+{
+    int j, k;
+
+    SPREAD_CONVOLVE(neon, NEON_WIDTH);
+}
+
+#endif
+
+
+/* Store the spreading function s[j][k] by columns, dropping the entries
+   below tolerance times the largest entry of their row */
+static void spread_init(spread_mem * spread, FCB * s, FLOAT tolerance)
+{
+    int j, k;
+#if defined(TWOLAME_X86_SIMD) || defined(TWOLAME_NEON_SIMD)
+    int cpu = twolame_cpu_features();
+#endif
+
+    for (k = 0; k < CBANDS; k++) {
+        spread->start[k] = CBANDS;
+        spread->len[k] = 0;
+        for (j = 0; j < CBANDS + SPREAD_PAD; j++)
+            spread->w[k][j] = 0.0;
+    }
+
+    for (j = 0; j < CBANDS; j++) {
+        FLOAT peak = 0.0;
+
+        for (k = 0; k < CBANDS; k++)
+            if (s[j][k] > peak)
+                peak = s[j][k];
+
+        for (k = 0; k < CBANDS; k++) {
+            if (s[j][k] == 0.0 || s[j][k] < tolerance * peak)
+                continue;
+            spread->w[k][j] = s[j][k];
+            if (spread->len[k] == 0)
+                spread->start[k] = j;
+            spread->len[k] = j - spread->start[k] + 1;
+        }
+    }
+
+    spread->convolve = convolve_scalar;
+#if defined(TWOLAME_X86_SIMD)
+    if (cpu & TWOLAME_CPU_AVX2)
+        spread->convolve = convolve_avx2;
+    else if (cpu & TWOLAME_CPU_SSE2)
+        spread->convolve = convolve_sse2;
+#elif defined(TWOLAME_NEON_SIMD)
+    if (cpu & TWOLAME_CPU_NEON)
+        spread->convolve = convolve_neon;
+#endif
+}
+
+
+/* Build the spreading function s[i][j] = function(1.05 (cbval[i] - cbval[j]))
+   of a model into spread, a table for twolame_table_acquire() */
+int twolame_spread_build(void *table, const void *params)
+{
+    spread_mem *spread = (spread_mem *) table;
+    const spread_params *p = (const spread_params *) params;
+    FCB *s;
+    int i, j;
+
+    s = (FCB *) TWOLAME_MALLOC(sizeof(FCBCB));
+    if (!s)
+        return -1;
+
+    for (i = 0; i < CBANDS; i++) {
+        spread->rnorm[i] = 0.0;
+        for (j = 0; j < CBANDS; j++) {
+            s[i][j] = p->function((p->cbval[i] - p->cbval[j]) * 1.05);
+            /* sum the spreading function values for each partition so that they can be
+               normalised later on */
+            spread->rnorm[i] += s[i][j];
+        }
+    }
+
+    spread_init(spread, s, p->tolerance);
+    TWOLAME_FREE(s);
+
+    return 0;
+}
+
+
+/* ecb[j] = sum of s[j][k] grouped_e[k] and cb[j] = sum of s[j][k] grouped_c[k] */
+void twolame_spread_convolve(const spread_mem * spread, const FLOAT * grouped_e,
+                             const FLOAT * grouped_c, FLOAT * ecb, FLOAT * cb)
+{
+    FLOAT sum_e[CBANDS + SPREAD_PAD], sum_c[CBANDS + SPREAD_PAD];
+    int j;
+
+    for (j = 0; j < CBANDS + SPREAD_PAD; j++) {
+        sum_e[j] = 0.0;
+        sum_c[j] = 0.0;
+    }
+
+    spread->convolve(spread, grouped_e, grouped_c, sum_e, sum_c);
+
+    for (j = 0; j < CBANDS; j++) {
+        ecb[j] = sum_e[j];
+        cb[j] = sum_c[j];
+    }
+}
+
+
+// vim:ts=4:sw=4:nowrap:
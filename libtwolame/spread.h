@@ -0,0 +1,42 @@
+
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2001-2004 Michael Cheng
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef TWOLAME_SPREAD_H
+#define TWOLAME_SPREAD_H
+
+/* How twolame_spread_build() computes the spreading function of a model */
+typedef struct spread_params_struct {
+    const FLOAT *cbval;         // centre bark value of each partition
+    FLOAT (*function) (FLOAT bark); // spreading over a difference in bark
+    FLOAT tolerance;
+} spread_params;
+
+int twolame_spread_build(void *table, const void *params);
+void twolame_spread_convolve(const spread_mem * spread, const FLOAT * grouped_e,
+                             const FLOAT * grouped_c, FLOAT * ecb, FLOAT * cb);
+
+#endif
+
+
+// vim:ts=4:sw=4:nowrap:
@@ -30,110 +30,50 @@
 #include "mem.h"
 #include "bitbuffer.h"
 #include "enwindow.h"
+#include "cpu.h"
+#include "simd.h"
 #include "subband.h"
+#include "tables.h"
 
 
-static void create_dct_matrix(FLOAT filter[16][32])
-{
-    register int i, k;
-
-    for (i = 0; i < 16; i++)
-        for (k = 0; k < 32; k++) {
-            if ((filter[i][k] = 1e9 * cos((FLOAT) ((2 * i + 1) * k * PI64))) >= 0)
-                modf(filter[i][k] + 0.5, &filter[i][k]);
-            else
-                modf(filter[i][k] - 0.5, &filter[i][k]);
-            filter[i][k] *= 1e-9;
-        }
-}
-
-int twolame_init_subband(subband_mem * smem)
-{
-    memset(smem, 0, sizeof(subband_mem));
-    create_dct_matrix(smem->m);
-
-    return 0;
-}
+/*
+  Window kernels: y[i] = sum over k of x[i + 64k] * enw[i + 64k]
+  for the 64 outputs of one block, where x points at the newest of
+  the 512 samples in the window. The eight products are always
+  accumulated in the same order so that every code path gives
+  identical results.
 
+  Matrix kernels: the 16x32 part of Michael Chen's DCT, giving
+  s[i] = s0 + s1 and s[31-i] = s0 - s1 where s0 and s1 are the
+  even and odd partial sums of row i.
+*/
 
-void twolame_window_filter_subband(subband_mem * smem, short *pBuffer, int ch, FLOAT s[SBLIMIT])
+static void window_scalar(const FLOAT * x, const FLOAT * enw, FLOAT * y)
 {
-    register int i, j;
-    int pa, pb, pc, pd, pe, pf, pg, ph;
-    FLOAT t;
-    FLOAT *dp, *dp2;
-    const FLOAT *pEnw;
-    FLOAT y[64];
-    FLOAT yprime[32];
+    register int i;
 
-    dp = smem->x[ch] + smem->off[ch] + smem->half[ch] * 256;
-
-    /* replace 32 oldest samples with 32 new samples */
-    for (i = 0; i < 32; i++)
-        dp[(31 - i) * 8] = (FLOAT) pBuffer[i] / SCALE;
-
-    // looks like "school example" but does faster ...
-    dp = (smem->x[ch] + smem->half[ch] * 256);
-    pa = smem->off[ch];
-    pb = (pa + 1) % 8;
-    pc = (pa + 2) % 8;
-    pd = (pa + 3) % 8;
-    pe = (pa + 4) % 8;
-    pf = (pa + 5) % 8;
-    pg = (pa + 6) % 8;
-    ph = (pa + 7) % 8;
-
-    for (i = 0; i < 32; i++) {
-        dp2 = dp + i * 8;
-        pEnw = enwindow + i;
-        t = dp2[pa] * pEnw[0];
-        t += dp2[pb] * pEnw[64];
-        t += dp2[pc] * pEnw[128];
-        t += dp2[pd] * pEnw[192];
-        t += dp2[pe] * pEnw[256];
-        t += dp2[pf] * pEnw[320];
-        t += dp2[pg] * pEnw[384];
-        t += dp2[ph] * pEnw[448];
+    for (i = 0; i < 64; i++) {
+        register FLOAT t;
+        t = x[i] * enw[i];
+        t += x[i + 64] * enw[i + 64];
+        t += x[i + 128] * enw[i + 128];
+        t += x[i + 192] * enw[i + 192];
+        t += x[i + 256] * enw[i + 256];
+        t += x[i + 320] * enw[i + 320];
+        t += x[i + 384] * enw[i + 384];
+        t += x[i + 448] * enw[i + 448];
         y[i] = t;
     }
+}
 
-    yprime[0] = y[16];          // Michael Chen's dct filter
-
-    dp = smem->half[ch] ? smem->x[ch] : (smem->x[ch] + 256);
-    pa = smem->half[ch] ? (smem->off[ch] + 1) & 7 : smem->off[ch];
-    pb = (pa + 1) % 8;
-    pc = (pa + 2) % 8;
-    pd = (pa + 3) % 8;
-    pe = (pa + 4) % 8;
-    pf = (pa + 5) % 8;
-    pg = (pa + 6) % 8;
-    ph = (pa + 7) % 8;
-
-    for (i = 0; i < 32; i++) {
-        dp2 = dp + i * 8;
-        pEnw = enwindow + i + 32;
-        t = dp2[pa] * pEnw[0];
-        t += dp2[pb] * pEnw[64];
-        t += dp2[pc] * pEnw[128];
-        t += dp2[pd] * pEnw[192];
-        t += dp2[pe] * pEnw[256];
-        t += dp2[pf] * pEnw[320];
-        t += dp2[pg] * pEnw[384];
-        t += dp2[ph] * pEnw[448];
-        y[i + 32] = t;
-        // 1st pass on Michael Chen's dct filter
-        if (i > 0 && i < 17)
-            yprime[i] = y[i + 16] + y[16 - i];
-    }
-
-    // 2nd pass on Michael Chen's dct filter
-    for (i = 17; i < 32; i++)
-        yprime[i] = y[i + 16] - y[80 - i];
+static void matrix_scalar(const subband_mem * smem, const FLOAT * yprime, FLOAT * s)
+{
+    register int i, j;
 
     for (i = 15; i >= 0; i--) {
         register FLOAT s0 = 0.0, s1 = 0.0;
-        register FLOAT *mp = smem->m[i];
-        register FLOAT *xinp = yprime;
+        register const FLOAT *mp = smem->tab->m[i];
+        register const FLOAT *xinp = yprime;
         for (j = 0; j < 8; j++) {
             s0 += *mp++ * *xinp++;
             s1 += *mp++ * *xinp++;
@@ -143,11 +83,296 @@ void twolame_window_filter_subband(subband_mem * smem, short *pBuffer, int ch, F
         s[i] = s0 + s1;
         s[31 - i] = s0 - s1;
     }
+}
+
+
+/*
+  Fast alternative to the matrix kernels: the same 32-point DCT-III,
+  s[i] = sum over k of yprime[k] * cos((2i + 1) k PI / 64), factorised
+  with Byeong Gi Lee's algorithm into 80 multiplies. The recursion is
+  flattened: the inputs are split down to blocks of one sample, then
+  the blocks are combined back up with the butterflies.
+  dct_coef holds 1 / (2 cos((i + 0.5) PI / len)) for len = 32, 16, ... 2,
+  the factors for length len starting at dct_coef + 32 - len.
+*/
+static inline void dct_split(const FLOAT * src, FLOAT * dst, const int len)
+{
+    const int half = len / 2;
+    int off, i;
+
+    for (off = 0; off < 32; off += len) {
+        dst[off] = src[off];
+        dst[off + half] = src[off + 1];
+        for (i = 1; i < half; i++) {
+            dst[off + i] = src[off + 2 * i];
+            dst[off + half + i] = src[off + 2 * i - 1] + src[off + 2 * i + 1];
+        }
+    }
+}
+
+static inline void dct_combine(const FLOAT * src, FLOAT * dst, const FLOAT * coef, const int len)
+{
+    const FLOAT *c = coef + 32 - len;
+    const int half = len / 2;
+    int off, i;
+
+    for (off = 0; off < 32; off += len)
+        for (i = 0; i < half; i++) {
+            FLOAT x = src[off + i];
+            FLOAT y = src[off + half + i] * c[i];
+            dst[off + i] = x + y;
+            dst[off + len - 1 - i] = x - y;
+        }
+}
+
+static void matrix_fast(const subband_mem * smem, const FLOAT * yprime, FLOAT * s)
+{
+    FLOAT a[32], b[32];
+
+    dct_split(yprime, a, 32);
+    dct_split(a, b, 16);
+    dct_split(b, a, 8);
+    dct_split(a, b, 4);
+    dct_split(b, a, 2);
+
+    dct_combine(a, b, smem->tab->dct_coef, 2);
+    dct_combine(b, a, smem->tab->dct_coef, 4);
+    dct_combine(a, b, smem->tab->dct_coef, 8);
+    dct_combine(b, a, smem->tab->dct_coef, 16);
+    dct_combine(a, s, smem->tab->dct_coef, 32);
+}
+
+#if defined(TWOLAME_X86_SIMD)
+
+/*
+  The SIMD matrix kernels work on 4 vectors of rows at a time, using
+  smem->tab->mt[k][i] = m[i][k]; any rows beyond the 16 of the matrix are
+  zero padding and their results are dropped.
+*/
+
+#define SSE2_TAP(t, k, i) \
+    t = sse_add(t, sse_mul(sse_load(x + (i) + 64 * (k)), sse_load(enw + (i) + 64 * (k))))
+
+SSE2_TARGET static void window_sse2(const FLOAT * x, const FLOAT * enw, FLOAT * y)
+{
+    int i, k;
+
+    for (i = 0; i < 64; i += 2 * SSE_WIDTH) {
+        sse_vec t0 = sse_mul(sse_load(x + i), sse_load(enw + i));
+        sse_vec t1 = sse_mul(sse_load(x + i + SSE_WIDTH), sse_load(enw + i + SSE_WIDTH));
+        for (k = 1; k < 8; k++) {
+            SSE2_TAP(t0, k, i);
+            SSE2_TAP(t1, k, i + SSE_WIDTH);
+        }
+        sse_store(y + i, t0);
+        sse_store(y + i + SSE_WIDTH, t1);
+    }
+}
+
+#define SSE2_ROWS(acc, k, i, y) \
+    acc##a = sse_add(acc##a, sse_mul(sse_load(&smem->tab->mt[k][(i)]), y)); \
+    acc##b = sse_add(acc##b, sse_mul(sse_load(&smem->tab->mt[k][(i) + SSE_WIDTH]), y)); \
+    acc##c = sse_add(acc##c, sse_mul(sse_load(&smem->tab->mt[k][(i) + 2 * SSE_WIDTH]), y)); \
+    acc##d = sse_add(acc##d, sse_mul(sse_load(&smem->tab->mt[k][(i) + 3 * SSE_WIDTH]), y))
+
+SSE2_TARGET static void matrix_sse2(const subband_mem * smem, const FLOAT * yprime, FLOAT * s)
+{
+    FLOAT sum[4 * SSE_WIDTH], diff[4 * SSE_WIDTH];
+    int i, j, k;
+
+    for (i = 0; i < 16; i += 4 * SSE_WIDTH) {
+        sse_vec s0a, s0b, s0c, s0d, s1a, s1b, s1c, s1d;
+
+        s0a = s0b = s0c = s0d = sse_zero();
+        s1a = s1b = s1c = s1d = sse_zero();
+
+        for (k = 0; k < 32; k += 2) {
+            sse_vec y0 = sse_set1(yprime[k]);
+            sse_vec y1 = sse_set1(yprime[k + 1]);
+            SSE2_ROWS(s0, k, i, y0);
+            SSE2_ROWS(s1, k + 1, i, y1);
+        }
+
+        sse_store(sum, sse_add(s0a, s1a));
+        sse_store(sum + SSE_WIDTH, sse_add(s0b, s1b));
+        sse_store(sum + 2 * SSE_WIDTH, sse_add(s0c, s1c));
+        sse_store(sum + 3 * SSE_WIDTH, sse_add(s0d, s1d));
+        sse_store(diff, sse_sub(s0a, s1a));
+        sse_store(diff + SSE_WIDTH, sse_sub(s0b, s1b));
+        sse_store(diff + 2 * SSE_WIDTH, sse_sub(s0c, s1c));
+        sse_store(diff + 3 * SSE_WIDTH, sse_sub(s0d, s1d));
+        for (j = 0; j < 4 * SSE_WIDTH && i + j < 16; j++) {
+            s[i + j] = sum[j];
+            s[31 - i - j] = diff[j];
+        }
+    }
+}
+
+#define AVX2_TAP(t, k, i) \
+    t = avx_add(t, avx_mul(avx_load(x + (i) + 64 * (k)), avx_load(enw + (i) + 64 * (k))))
+
+AVX2_TARGET static void window_avx2(const FLOAT * x, const FLOAT * enw, FLOAT * y)
+{
+    int i, k;
 
-    smem->half[ch] = (smem->half[ch] + 1) & 1;
+    for (i = 0; i < 64; i += 2 * AVX_WIDTH) {
+        avx_vec t0 = avx_mul(avx_load(x + i), avx_load(enw + i));
+        avx_vec t1 = avx_mul(avx_load(x + i + AVX_WIDTH), avx_load(enw + i + AVX_WIDTH));
+        for (k = 1; k < 8; k++) {
+            AVX2_TAP(t0, k, i);
+            AVX2_TAP(t1, k, i + AVX_WIDTH);
+        }
+        avx_store(y + i, t0);
+        avx_store(y + i + AVX_WIDTH, t1);
+    }
+}
+
+#define AVX2_ROWS(acc, k, i, y) \
+    acc##a = avx_add(acc##a, avx_mul(avx_load(&smem->tab->mt[k][(i)]), y)); \
+    acc##b = avx_add(acc##b, avx_mul(avx_load(&smem->tab->mt[k][(i) + AVX_WIDTH]), y)); \
+    acc##c = avx_add(acc##c, avx_mul(avx_load(&smem->tab->mt[k][(i) + 2 * AVX_WIDTH]), y)); \
+    acc##d = avx_add(acc##d, avx_mul(avx_load(&smem->tab->mt[k][(i) + 3 * AVX_WIDTH]), y))
+
+AVX2_TARGET static void matrix_avx2(const subband_mem * smem, const FLOAT * yprime, FLOAT * s)
+{
+    FLOAT sum[4 * AVX_WIDTH], diff[4 * AVX_WIDTH];
+    int i, j, k;
+
+    for (i = 0; i < 16; i += 4 * AVX_WIDTH) {
+        avx_vec s0a, s0b, s0c, s0d, s1a, s1b, s1c, s1d;
+
+        s0a = s0b = s0c = s0d = avx_zero();
+        s1a = s1b = s1c = s1d = avx_zero();
+
+        for (k = 0; k < 32; k += 2) {
+            avx_vec y0 = avx_set1(yprime[k]);
+            avx_vec y1 = avx_set1(yprime[k + 1]);
+            AVX2_ROWS(s0, k, i, y0);
+            AVX2_ROWS(s1, k + 1, i, y1);
+        }
 
-    if (smem->half[ch] == 1)
-        smem->off[ch] = (smem->off[ch] + 7) & 7;
+        avx_store(sum, avx_add(s0a, s1a));
+        avx_store(sum + AVX_WIDTH, avx_add(s0b, s1b));
+        avx_store(sum + 2 * AVX_WIDTH, avx_add(s0c, s1c));
+        avx_store(sum + 3 * AVX_WIDTH, avx_add(s0d, s1d));
+        avx_store(diff, avx_sub(s0a, s1a));
+        avx_store(diff + AVX_WIDTH, avx_sub(s0b, s1b));
+        avx_store(diff + 2 * AVX_WIDTH, avx_sub(s0c, s1c));
+        avx_store(diff + 3 * AVX_WIDTH, avx_sub(s0d, s1d));
+        for (j = 0; j < 4 * AVX_WIDTH && i + j < 16; j++) {
+            s[i + j] = sum[j];
+            s[31 - i - j] = diff[j];
+        }
+    }
+}
+
+#elif defined(TWOLAME_NEON_SIMD)
+
+static void window_neon(const FLOAT * x, const FLOAT * enw, FLOAT * y)
+{
+    int i, k;
+
+    for (i = 0; i < 64; i += NEON_WIDTH) {
+        neon_vec t = neon_mul(neon_load(x + i), neon_load(enw + i));
+        for (k = 1; k < 8; k++)
+            t = neon_add(t, neon_mul(neon_load(x + i + 64 * k), neon_load(enw + i + 64 * k)));
+        neon_store(y + i, t);
+    }
+}
+
+static void matrix_neon(const subband_mem * smem, const FLOAT * yprime, FLOAT * s)
+{
+    FLOAT sum[NEON_WIDTH], diff[NEON_WIDTH];
+    int i, j, k;
+
+    for (i = 0; i < 16; i += NEON_WIDTH) {
+        neon_vec s0 = neon_zero();
+        neon_vec s1 = neon_zero();
+        for (k = 0; k < 32; k += 2) {
+            s0 = neon_add(s0, neon_mul(neon_load(&smem->tab->mt[k][i]), neon_set1(yprime[k])));
+            s1 = neon_add(s1, neon_mul(neon_load(&smem->tab->mt[k + 1][i]), neon_set1(yprime[k + 1])));
+        }
+        neon_store(sum, neon_add(s0, s1));
+        neon_store(diff, neon_sub(s0, s1));
+        for (j = 0; j < NEON_WIDTH; j++) {
+            s[i + j] = sum[j];
+            s[31 - i - j] = diff[j];
+        }
+    }
+}
+
+#endif
+
+
+int twolame_init_subband(subband_mem * smem, int fast_dct)
+{
+#if defined(TWOLAME_X86_SIMD) || defined(TWOLAME_NEON_SIMD)
+    int cpu = twolame_cpu_features();
+#endif
+
+    memset(smem, 0, sizeof(subband_mem));
+    smem->tab = &twolame_subband_tables;
+
+    smem->window = window_scalar;
+    smem->matrix = matrix_scalar;
+#if defined(TWOLAME_X86_SIMD)
+    if (cpu & TWOLAME_CPU_AVX2) {
+        smem->window = window_avx2;
+        smem->matrix = matrix_avx2;
+    } else if (cpu & TWOLAME_CPU_SSE2) {
+        smem->window = window_sse2;
+        smem->matrix = matrix_sse2;
+    }
+#elif defined(TWOLAME_NEON_SIMD)
+    if (cpu & TWOLAME_CPU_NEON) {
+        smem->window = window_neon;
+        smem->matrix = matrix_neon;
+    }
+#endif
+
+    if (fast_dct)
+        smem->matrix = matrix_fast;
+
+    return 0;
+}
+
+
+/*
+  Filter one frame of one channel into 36 blocks of 32 subband samples.
+
+  The history is kept newest-sample-first: the frame is stored in
+  reverse at the start of smem->x[ch], followed by the newest 480
+  samples of the previous frame. The 512 samples of the window for
+  block b then start at x + 1120 - 32 * b, so every block is a plain
+  linear slice of the buffer.
+*/
+void twolame_window_filter_frame(subband_mem * smem, const FLOAT * pBuffer, int ch,
+                                 FLOAT s[3][SCALE_BLOCK][SBLIMIT])
+{
+    register int i;
+    int b;
+    FLOAT *x = smem->x[ch];
+    FLOAT *sp = &s[0][0][0];
+    FLOAT y[64];
+    FLOAT yprime[32];
+
+    memmove(x + TWOLAME_SAMPLES_PER_FRAME, x,
+            (SUBBAND_HISTORY - TWOLAME_SAMPLES_PER_FRAME) * sizeof(FLOAT));
+    for (i = 0; i < TWOLAME_SAMPLES_PER_FRAME; i++)
+        x[TWOLAME_SAMPLES_PER_FRAME - 1 - i] = pBuffer[i] * (1.0 / SCALE);
+
+    for (b = 0; b < 3 * SCALE_BLOCK; b++) {
+        smem->window(x + TWOLAME_SAMPLES_PER_FRAME - 32 * (b + 1), enwindow, y);
+
+        // Michael Chen's dct filter
+        yprime[0] = y[16];
+        for (i = 1; i < 17; i++)
+            yprime[i] = y[i + 16] + y[16 - i];
+        for (i = 17; i < 32; i++)
+            yprime[i] = y[i + 16] - y[80 - i];
+
+        smem->matrix(smem, yprime, sp + SBLIMIT * b);
+    }
 }
 
 
@@ -24,8 +24,9 @@
 #ifndef TWOLAME_SUBBAND_H
 #define TWOLAME_SUBBAND_H
 
-int twolame_init_subband(subband_mem * smem);
-void twolame_window_filter_subband(subband_mem * smem, short *pBuffer, int ch, FLOAT s[SBLIMIT]);
+int twolame_init_subband(subband_mem * smem, int fast_dct);
+void twolame_window_filter_frame(subband_mem * smem, const FLOAT * pBuffer, int ch,
+                                 FLOAT s[3][SCALE_BLOCK][SBLIMIT]);
 
 #endif
 
@@ -0,0 +1,190 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2001-2004 Michael Cheng
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "twolame.h"
+#include "common.h"
+#include "mem.h"
+#include "tables.h"
+
+#if defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+
+/*
+  Cache of the constant tables which depend on the settings of the
+  encoder, too many to be generated at build time like those of
+  tables_data.c, so that all the instances of a process with the
+  same settings share one read-only copy. A table is identified by
+  its kind, the sample rate and one more parameter (0 when they
+  don't matter), built by the first twolame_table_acquire() and
+  freed by the last twolame_table_release(). The list is only
+  touched with the lock held, which is also held while a table is
+  built, so a table is never seen half built.
+*/
+typedef struct shared_table_struct {
+    struct shared_table_struct *next;
+    int kind;
+    int samplerate;
+    double param;
+    int refs;
+    void *data;
+} shared_table;
+
+static shared_table *shared_tables = NULL;
+
+#if defined(HAVE_PTHREAD_H)
+
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void lock_tables(void)
+{
+    pthread_mutex_lock(&tables_lock);
+}
+
+static void unlock_tables(void)
+{
+    pthread_mutex_unlock(&tables_lock);
+}
+
+#elif defined(_WIN32)
+
+static volatile LONG tables_lock = 0;
+
+static void lock_tables(void)
+{
+    while (InterlockedExchange(&tables_lock, 1))
+        Sleep(0);
+}
+
+static void unlock_tables(void)
+{
+    InterlockedExchange(&tables_lock, 0);
+}
+
+#else
+
+/* Without threads there is nothing to lock against, so encoders may not
+   be initialised or closed concurrently on such builds. */
+static void lock_tables(void)
+{
+}
+
+static void unlock_tables(void)
+{
+}
+
+#endif
+
+
+/* Index of a sample rate in the tables of tables_data.c, or -1 */
+int twolame_table_samplerate(int samplerate)
+{
+    int i;
+
+    for (i = 0; i < TWOLAME_TABLE_SAMPLERATES; i++)
+        if (twolame_table_samplerates[i] == samplerate)
+            return i;
+
+    fprintf(stderr, "twolame_table_samplerate(): no tables for %d Hz\n", samplerate);
+    return -1;
+}
+
+
+/* Get the table of this kind and settings, building it with build(table, arg)
+   into size bytes of zeroed memory if no encoder uses it yet.
+   Returns NULL if it can't be allocated or built. */
+const void *twolame_table_acquire(int kind, int samplerate, double param, size_t size,
+                                  twolame_table_builder build, const void *arg)
+{
+    shared_table *t;
+
+    lock_tables();
+
+    for (t = shared_tables; t != NULL; t = t->next) {
+        if (t->kind == kind && t->samplerate == samplerate && t->param == param) {
+            t->refs++;
+            unlock_tables();
+            return t->data;
+        }
+    }
+
+    t = (shared_table *) TWOLAME_MALLOC(sizeof(shared_table));
+    if (t == NULL) {
+        unlock_tables();
+        return NULL;
+    }
+    t->data = TWOLAME_MALLOC(size);
+    if (t->data == NULL || build(t->data, arg) < 0) {
+        TWOLAME_FREE(t->data);
+        TWOLAME_FREE(t);
+        unlock_tables();
+        return NULL;
+    }
+    t->kind = kind;
+    t->samplerate = samplerate;
+    t->param = param;
+    t->refs = 1;
+
+    t->next = shared_tables;
+    shared_tables = t;
+
+    unlock_tables();
+    return t->data;
+}
+
+
+/* Drop a reference to a table from twolame_table_acquire(), NULL is ignored */
+void twolame_table_release(const void *table)
+{
+    shared_table **p;
+
+    if (table == NULL)
+        return;
+
+    lock_tables();
+
+    for (p = &shared_tables; *p != NULL; p = &(*p)->next) {
+        shared_table *t = *p;
+
+        if (t->data == table) {
+            if (--t->refs == 0) {
+                *p = t->next;
+                TWOLAME_FREE(t->data);
+                TWOLAME_FREE(t);
+            }
+            break;
+        }
+    }
+
+    unlock_tables();
+}
+
+
+// vim:ts=4:sw=4:nowrap:
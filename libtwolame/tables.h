@@ -0,0 +1,60 @@
+
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2001-2004 Michael Cheng
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef TWOLAME_TABLES_H
+#define TWOLAME_TABLES_H
+
+/* Constant tables, generated at build time by gentables.c (tables_data.c) */
+#define TWOLAME_TABLE_SAMPLERATES   6
+
+extern const subband_tables twolame_subband_tables;
+extern const FLOAT twolame_add_db[DBTAB];
+extern const FLOAT twolame_hann_window[BLKSIZE];
+extern const FLOAT twolame_hann_window_scaled[FFT_SIZE];
+extern const FLOAT twolame_fft_stage_re[FFT_STAGE_TWIDDLES];
+extern const FLOAT twolame_fft_stage_im[FFT_STAGE_TWIDDLES];
+extern const FLOAT twolame_fft_post_re[256];
+extern const FLOAT twolame_fft_post_im[256];
+extern const int twolame_table_samplerates[TWOLAME_TABLE_SAMPLERATES];
+extern const FLOAT twolame_ath_min[TWOLAME_TABLE_SAMPLERATES][SBLIMIT];
+extern const FLOAT twolame_bark[TWOLAME_TABLE_SAMPLERATES][HBLKSIZE];
+extern const FLOAT twolame_ath_db_table[TWOLAME_TABLE_SAMPLERATES][HBLKSIZE];
+extern const FLOAT twolame_ath_energy_table[TWOLAME_TABLE_SAMPLERATES][HBLKSIZE];
+
+int twolame_table_samplerate(int samplerate);
+
+/* Kinds of tables built at run time and shared by all the encoders of the process */
+#define TWOLAME_TABLE_SPREAD_2  1   // spreading function of psycho model 2
+#define TWOLAME_TABLE_SPREAD_4  2   // spreading function of psycho model 4
+
+typedef int (*twolame_table_builder) (void *table, const void *arg);
+
+const void *twolame_table_acquire(int kind, int samplerate, double param, size_t size,
+                                  twolame_table_builder build, const void *arg);
+void twolame_table_release(const void *table);
+
+#endif
+
+
+// vim:ts=4:sw=4:nowrap:
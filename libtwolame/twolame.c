@@ -41,9 +41,12 @@
 #include "psycho_4.h"
 #include "availbits.h"
 #include "subband.h"
+#include "fft.h"
+#include "decibel.h"
 #include "encode.h"
 #include "energy.h"
 #include "util.h"
+#include "worker.h"
 
 #include "bitbuffer_inline.h"
 
@@ -82,6 +85,12 @@ twolame_options *twolame_init(void)
 
     newoptions->quickmode = FALSE;
     newoptions->quickcount = 10;
+    newoptions->fast_dct = FALSE;
+    newoptions->fast_fft = FALSE;
+    newoptions->fast_phase = 0;
+    newoptions->spread_tolerance = 0.0;
+    newoptions->fast_db = FALSE;
+    newoptions->num_threads = 1;
     newoptions->emphasis = TWOLAME_EMPHASIS_N;
     newoptions->private_extension = 0;
     newoptions->copyright = FALSE;
@@ -108,8 +117,10 @@ twolame_options *twolame_init(void)
 
     newoptions->twolame_init = 0;
     newoptions->subband = NULL;
-    newoptions->j_sample = NULL;
-    newoptions->sb_sample = NULL;
+    newoptions->frames = NULL;
+    newoptions->frame = NULL;
+    newoptions->workers[0] = NULL;
+    newoptions->workers[1] = NULL;
     newoptions->psycount = 0;
 
     newoptions->p0mem = NULL;
@@ -179,6 +190,39 @@ static int init_header_info(twolame_options * glopts)
 
 
 
+/* Allocate and set up the memory of the selected psychoacoustic model */
+static int init_psycho_model(twolame_options * glopts)
+{
+    int sfreq = glopts->samplerate_out;
+
+    switch (glopts->psymodel) {
+    case 0:
+        if (!glopts->p0mem)
+            glopts->p0mem = twolame_psycho_0_init(glopts, sfreq);
+        return glopts->p0mem ? 0 : -1;
+    case 1:
+        if (!glopts->p1mem)
+            glopts->p1mem = twolame_psycho_1_init(glopts);
+        return glopts->p1mem ? 0 : -1;
+    case 2:
+        if (!glopts->p2mem)
+            glopts->p2mem = twolame_psycho_2_init(glopts, sfreq);
+        return glopts->p2mem ? 0 : -1;
+    case 3:
+        if (!glopts->p3mem)
+            glopts->p3mem = twolame_psycho_3_init(glopts);
+        return glopts->p3mem ? 0 : -1;
+    case 4:
+        if (!glopts->p4mem)
+            glopts->p4mem = twolame_psycho_4_init(glopts, sfreq);
+        return glopts->p4mem ? 0 : -1;
+    default:
+        // psychoacoustic model -1 has no memory, invalid models are reported by encode_frame()
+        return 0;
+    }
+}
+
+
 /**
  * This function should actually *check* the parameters to see if they
  * make sense.
@@ -186,6 +230,7 @@ static int init_header_info(twolame_options * glopts)
 
 int twolame_init_params(twolame_options * glopts)
 {
+    int pipelined;
 
     if (glopts->twolame_init) {
         fprintf(stderr, "Already called twolame_init_params() once.\n");
@@ -393,37 +438,56 @@ int twolame_init_params(twolame_options * glopts)
     glopts->samples_in_buffer = 0;
     glopts->psycount = 0;
 
+    /* Psycho models 1 and 3 read the bitrate which the bit allocation of the previous frame
+       chose in VBR mode, so the frames can't be pipelined then */
+    pipelined = glopts->num_threads > 1
+        && !(glopts->vbr && (glopts->psymodel == 1 || glopts->psymodel == 3));
+
 
     // Allocate memory to larger buffers
     glopts->subband = (subband_t *) TWOLAME_MALLOC(sizeof(subband_t));
-    glopts->j_sample = (jsb_sample_t *) TWOLAME_MALLOC(sizeof(jsb_sample_t));
-    glopts->sb_sample = (sb_sample_t *) TWOLAME_MALLOC(sizeof(sb_sample_t));
+    glopts->frames = (frame_data *) TWOLAME_MALLOC(sizeof(frame_data) * (pipelined ? 2 : 1));
     if (glopts->subband == NULL
             ||
-            glopts->j_sample == NULL
-            ||
-            glopts->sb_sample == NULL)
+            glopts->frames == NULL)
     {
         TWOLAME_FREE(glopts->subband);
-        TWOLAME_FREE(glopts->j_sample);
-        TWOLAME_FREE(glopts->sb_sample);
+        TWOLAME_FREE(glopts->frames);
         return -1;
     }
+    glopts->frame = glopts->frames;
+    glopts->frame_pending = FALSE;
 
     // clear buffers
-    memset((char *) glopts->buffer, 0, sizeof(glopts->buffer));
     memset((char *) glopts->bit_alloc, 0, sizeof(glopts->bit_alloc));
     memset((char *) glopts->scfsi, 0, sizeof(glopts->scfsi));
-    memset((char *) glopts->scalar, 0, sizeof(glopts->scalar));
-    memset((char *) glopts->j_scale, 0, sizeof(glopts->j_scale));
     memset((char *) glopts->smrdef, 0, sizeof(glopts->smrdef));
-    memset((char *) glopts->smr, 0, sizeof(glopts->smr));
-    memset((char *) glopts->max_sc, 0, sizeof(glopts->max_sc));
 
     // Initialise subband windowfilter
-    if (twolame_init_subband(&glopts->smem) < 0) {
+    if (twolame_init_subband(&glopts->smem, glopts->fast_dct) < 0) {
+        return -1;
+    }
+    // Initialise the FFT of the psycho models
+    twolame_fft_init(&glopts->fft, glopts->fast_fft, glopts->fast_phase);
+    twolame_decibel_init(&glopts->db, glopts->fast_db);
+    // Initialise the psychoacoustic model now, so that encoding doesn't allocate memory
+    if (init_psycho_model(glopts) < 0) {
+        fprintf(stderr, "twolame_init_params(): failed to initialise psychoacoustic model %d\n",
+                glopts->psymodel);
         return -1;
     }
+    // Start the threads analysing the frames
+    if (pipelined) {
+        glopts->workers[0] = twolame_worker_start();
+        if (glopts->num_threads > 2)
+            glopts->workers[1] = twolame_worker_start();
+        if (glopts->workers[0] == NULL || (glopts->num_threads > 2 && glopts->workers[1] == NULL)) {
+            fprintf(stderr, "twolame_init_params(): failed to start the encoding threads\n");
+            twolame_worker_stop(&glopts->workers[0]);
+            twolame_worker_stop(&glopts->workers[1]);
+            return -1;
+        }
+    }
     // All initialised now :)
     glopts->twolame_init++;
 
@@ -431,81 +495,206 @@ int twolame_init_params(twolame_options * glopts)
 }
 
 
-/* Scale the samples in the frame sample buffer
+/* Scale the samples just copied into the frame sample buffer
    using the user specified values
-   and downmix/upmix according to the number of input/output channels
+   and downmix/upmix according to the number of input/output channels.
+   Whole (16-bit) samples are truncated after each step, so they
+   are encoded exactly as they were with a 16-bit frame buffer.
 */
-static void scale_and_mix_samples(twolame_options * glopts)
+static void scale_and_mix_samples(twolame_options * glopts, int offset, int num_samples,
+                                  int whole_samples)
 {
-    int num_samples = glopts->samples_in_buffer;
+    FLOAT *left = glopts->frame->buffer[0] + offset;
+    FLOAT *right = glopts->frame->buffer[1] + offset;
     int i;
 
     // apply scaling to both channels
     if (glopts->scale != 0 && glopts->scale != 1.0) {
         if (glopts->num_channels_in == 2)
             for (i = 0; i < num_samples; ++i) {
-                glopts->buffer[0][i] *= glopts->scale;
-                glopts->buffer[1][i] *= glopts->scale;
+                left[i] *= glopts->scale;
+                right[i] *= glopts->scale;
             }
         else
             for (i = 0; i < num_samples; ++i)
-                glopts->buffer[0][i] *= glopts->scale;
+                left[i] *= glopts->scale;
+        if (whole_samples)
+            for (i = 0; i < num_samples; ++i) {
+                left[i] = (long) left[i];
+                right[i] = (long) right[i];
+            }
     }
     // apply scaling to channel 0 (left)
     if (glopts->scale_left != 0 && glopts->scale_left != 1.0) {
         for (i = 0; i < num_samples; ++i) {
-            glopts->buffer[0][i] *= glopts->scale_left;
+            left[i] *= glopts->scale_left;
+            if (whole_samples)
+                left[i] = (long) left[i];
         }
     }
     // apply scaling to channel 1 (right)
     if (glopts->scale_right != 0 && glopts->scale_right != 1.0) {
         for (i = 0; i < num_samples; ++i) {
-            glopts->buffer[1][i] *= glopts->scale_right;
+            right[i] *= glopts->scale_right;
+            if (whole_samples)
+                right[i] = (long) right[i];
         }
     }
     // Downmix to Mono if 2 channels in and 1 channel out
     if (glopts->num_channels_in == 2 && glopts->num_channels_out == 1) {
         for (i = 0; i < num_samples; ++i) {
-            glopts->buffer[0][i] = ((long) glopts->buffer[0][i] + glopts->buffer[1][i]) / 2;
-            glopts->buffer[1][i] = 0;
+            left[i] = (left[i] + right[i]) * (FLOAT) 0.5;
+            if (whole_samples)
+                left[i] = (long) left[i];
+            right[i] = 0;
         }
     }
     // Upmix to Stereo if 2 channels out and 1 channel in
     if (glopts->num_channels_in == 1 && glopts->num_channels_out == 2) {
         for (i = 0; i < num_samples; ++i) {
-            glopts->buffer[1][i] = glopts->buffer[0][i];
+            right[i] = left[i];
         }
     }
 
 }
 
 /*
-    Encode a single frame of audio from 1152 samples
-    Audio samples are taken from glopts->buffer
-    Encoded bit stream is placed in to parameter bs
-    (not intended for use outside the library)
-
-    Returns the size of the frame
-    or -1 if there is an error
+    Analyse the subbands of a frame: filter it into 32 subbands
+    and calculate the scalefactors, also of the joint stereo subbands
 */
-static int encode_frame(twolame_options * glopts, bit_stream * bs)
+static void analyse_subbands(twolame_options * glopts, frame_data * frame)
 {
     int nch = glopts->num_channels_out;
-    int sb, ch, adb, i;
-    unsigned long frameBits, initial_bits;
-    short sam[2][1056];
+    int ch;
 
-    if (!glopts->twolame_init) {
-        fprintf(stderr, "Please call twolame_init_params() before starting encoding.\n");
-        return -1;
+    /* New polyphase filter Combines windowing and filtering. Ricardo Feb'03 */
+    for (ch = 0; ch < nch; ch++)
+        twolame_window_filter_frame(&glopts->smem, frame->buffer[ch], ch, frame->sb_sample[ch]);
+
+    twolame_scalefactor_calc(frame->sb_sample, frame->scalar, nch, glopts->sblimit);
+    twolame_find_sf_max(glopts, frame->scalar, frame->max_sc);
+    if (glopts->mode == TWOLAME_JOINT_STEREO) {
+        // this way we calculate more mono than we need but it is cheap
+        twolame_combine_lr(frame->sb_sample, frame->j_sample, glopts->sblimit);
+        twolame_scalefactor_calc(&frame->j_sample, &frame->j_scale, 1, glopts->sblimit);
     }
-    // Scale and mix the input buffer
-    scale_and_mix_samples(glopts);
+}
+
 
+/*
+    Calculate the signal to mask ratios of a frame with the psychoacoustic model.
+    Models 0, 1 and 3 need the scalefactors from analyse_subbands()
+*/
+static void analyse_psycho(twolame_options * glopts, frame_data * frame)
+{
+    int nch = glopts->num_channels_out;
+    int sb, ch;
+    FLOAT sam[2][1056];
+
+    if ((glopts->quickmode == TRUE) && (++glopts->psycount % glopts->quickcount != 0)) {
+        /* We're using quick mode, so we're only calculating the model every 'quickcount' frames.
+           Otherwise, just copy the old ones across */
+        for (ch = 0; ch < nch; ch++) {
+            for (sb = 0; sb < SBLIMIT; sb++) {
+                frame->smr[ch][sb] = glopts->smrdef[ch][sb];
+            }
+        }
+        return;
+    }
 
     // Clear the saved audio buffer
     memset((char *) sam, 0, sizeof(sam));
 
+    // calculate the psymodel
+    switch (glopts->psymodel) {
+    case -1:
+        twolame_psycho_n1(glopts, frame->smr, nch);
+        break;
+    case 0:                    // Psy Model A
+        twolame_psycho_0(glopts, frame->smr, frame->scalar);
+        break;
+    case 1:
+        twolame_psycho_1(glopts, frame->buffer, frame->max_sc, frame->smr);
+        break;
+    case 2:
+        twolame_psycho_2(glopts, frame->buffer, sam, frame->smr);
+        break;
+    case 3:
+        // Modified psy model 1
+        twolame_psycho_3(glopts, frame->buffer, frame->max_sc, frame->smr);
+        break;
+    case 4:
+        // Modified psy model 2
+        twolame_psycho_4(glopts, frame->buffer, sam, frame->smr);
+        break;
+    default:
+        fprintf(stderr, "Invalid psy model specification: %i\n", glopts->psymodel);
+        frame->status = -1;
+        return;
+    }
+
+    if (glopts->quickmode == TRUE) {
+        // copy the smr values and reuse them later
+        for (ch = 0; ch < nch; ch++) {
+            for (sb = 0; sb < SBLIMIT; sb++)
+                glopts->smrdef[ch][sb] = frame->smr[ch][sb];
+        }
+    }
+}
+
+
+static void analyse_frame(twolame_options * glopts, frame_data * frame)
+{
+    analyse_subbands(glopts, frame);
+    analyse_psycho(glopts, frame);
+}
+
+
+/*
+    Start the analysis of a frame on the worker threads.
+    With a second worker the psychoacoustic models which don't need
+    the scalefactors run beside the filterbank.
+*/
+static void start_analysis(twolame_options * glopts, frame_data * frame)
+{
+    frame->status = 0;
+
+    if (glopts->workers[1] != NULL
+            && (glopts->psymodel == -1 || glopts->psymodel == 2 || glopts->psymodel == 4)) {
+        twolame_worker_run(glopts->workers[0], analyse_subbands, glopts, frame);
+        twolame_worker_run(glopts->workers[1], analyse_psycho, glopts, frame);
+    } else {
+        twolame_worker_run(glopts->workers[0], analyse_frame, glopts, frame);
+    }
+}
+
+
+static void wait_analysis(twolame_options * glopts)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (glopts->workers[i] != NULL)
+            twolame_worker_wait(glopts->workers[i]);
+    }
+}
+
+
+/*
+    Allocate the bits of an analysed frame and write it out.
+    Encoded bit stream is placed in to parameter bs
+
+    Returns the size of the frame
+    or -1 if there is an error
+*/
+static int pack_frame(twolame_options * glopts, frame_data * frame, bit_stream * bs)
+{
+    int adb, i;
+    unsigned long frameBits, initial_bits;
+
+    if (frame->status < 0)
+        return -1;
+
     // Number of bits to calculate CRC on
     glopts->num_crc_bits = 0;
 
@@ -532,74 +721,12 @@ static int encode_frame(twolame_options * glopts, bit_stream * bs)
        memory. As of 09May 2014 all that needs to be done is for the frontend to buffer one frame in
        memory and call twolame_set_DAB_scf_crc */
 
-    {
-        int gr, bl, ch;
-        /* New polyphase filter Combines windowing and filtering. Ricardo Feb'03 */
-        for (gr = 0; gr < 3; gr++)
-            for (bl = 0; bl < 12; bl++)
-                for (ch = 0; ch < nch; ch++)
-                    twolame_window_filter_subband(&glopts->smem,
-                                                  &glopts->buffer[ch][gr * 12 * 32 + 32 * bl], ch,
-                                                  &(*glopts->sb_sample)[ch][gr][bl][0]);
-    }
-
-    twolame_scalefactor_calc(*glopts->sb_sample, glopts->scalar, nch, glopts->sblimit);
-    twolame_find_sf_max(glopts, glopts->scalar, glopts->max_sc);
-    if (glopts->mode == TWOLAME_JOINT_STEREO) {
-        // this way we calculate more mono than we need but it is cheap
-        twolame_combine_lr(*glopts->sb_sample, *glopts->j_sample, glopts->sblimit);
-        twolame_scalefactor_calc(glopts->j_sample, &glopts->j_scale, 1, glopts->sblimit);
-    }
+    twolame_sf_transmission_pattern(glopts, frame->scalar, glopts->scfsi);
+    twolame_main_bit_allocation(glopts, frame->smr, glopts->scfsi, glopts->bit_alloc, &adb);
 
-    if ((glopts->quickmode == TRUE) && (++glopts->psycount % glopts->quickcount != 0)) {
-        /* We're using quick mode, so we're only calculating the model every 'quickcount' frames.
-           Otherwise, just copy the old ones across */
-        for (ch = 0; ch < nch; ch++) {
-            for (sb = 0; sb < SBLIMIT; sb++) {
-                glopts->smr[ch][sb] = glopts->smrdef[ch][sb];
-            }
-        }
-    } else {
-        // calculate the psymodel
-        switch (glopts->psymodel) {
-        case -1:
-            twolame_psycho_n1(glopts, glopts->smr, nch);
-            break;
-        case 0:                // Psy Model A
-            twolame_psycho_0(glopts, glopts->smr, glopts->scalar);
-            break;
-        case 1:
-            twolame_psycho_1(glopts, glopts->buffer, glopts->max_sc, glopts->smr);
-            break;
-        case 2:
-            twolame_psycho_2(glopts, glopts->buffer, sam, glopts->smr);
-            break;
-        case 3:
-            // Modified psy model 1
-            twolame_psycho_3(glopts, glopts->buffer, glopts->max_sc, glopts->smr);
-            break;
-        case 4:
-            // Modified psy model 2
-            twolame_psycho_4(glopts, glopts->buffer, sam, glopts->smr);
-            break;
-        default:
-            fprintf(stderr, "Invalid psy model specification: %i\n", glopts->psymodel);
-            return -1;
-            break;
-        }
-
-        if (glopts->quickmode == TRUE) {
-            // copy the smr values and reuse them later
-            for (ch = 0; ch < nch; ch++) {
-                for (sb = 0; sb < SBLIMIT; sb++)
-                    glopts->smrdef[ch][sb] = glopts->smr[ch][sb];
-            }
-        }
-    }
-
-
-    twolame_sf_transmission_pattern(glopts, glopts->scalar, glopts->scfsi);
-    twolame_main_bit_allocation(glopts, glopts->smr, glopts->scfsi, glopts->bit_alloc, &adb);
+    // The frame is written without bounds checks, so make sure that all of it fits
+    if (twolame_buffer_reserve(bs, twolame_frame_bits(glopts)) < 0)
+        return TWOLAME_ERROR_BUFFER_FULL;
 
     twolame_write_header(glopts, bs);
 
@@ -608,15 +735,15 @@ static int encode_frame(twolame_options * glopts, bit_stream * bs)
         buffer_putbits(bs, 0, 16);
 
     twolame_write_bit_alloc(glopts, glopts->bit_alloc, bs);
-    twolame_write_scalefactors(glopts, glopts->bit_alloc, glopts->scfsi, glopts->scalar, bs);
+    twolame_write_scalefactors(glopts, glopts->bit_alloc, glopts->scfsi, frame->scalar, bs);
 
-    twolame_subband_quantization(glopts, glopts->scalar, *glopts->sb_sample, glopts->j_scale,
-                                 *glopts->j_sample, glopts->bit_alloc, *glopts->subband);
+    twolame_subband_quantization(glopts, frame->scalar, frame->sb_sample, frame->j_scale,
+                                 frame->j_sample, glopts->bit_alloc, *glopts->subband);
     twolame_write_samples(glopts, *glopts->subband, glopts->bit_alloc, bs);
 
     // If not all the bits were used, write out a stack of zeros
-    for (i = 0; i < adb; i++)
-        buffer_put1bit(bs, 0);
+    if (adb > 0)
+        buffer_putzeros(bs, adb);
 
 
     /* pad the current frame when needed */
@@ -629,13 +756,13 @@ static int encode_frame(twolame_options * glopts, bit_stream * bs)
         // It will be up to the frontend to insert it into the end of the
         // previous frame.
         for (i = glopts->dab_crc_len - 1; i >= 0; i--) {
-            twolame_dab_crc_calc(glopts, glopts->bit_alloc, glopts->scfsi, glopts->scalar,
+            twolame_dab_crc_calc(glopts, glopts->bit_alloc, glopts->scfsi, frame->scalar,
                                  &glopts->dab_crc[i], i);
         }
     }
     // Allocate space for the reserved ancillary bits
-    for (i = 0; i < glopts->num_ancillary_bits; i++)
-        buffer_put1bit(bs, 0);
+    if (glopts->num_ancillary_bits > 0)
+        buffer_putzeros(bs, glopts->num_ancillary_bits);
 
 
     // Calculate the number of bits in this frame
@@ -648,9 +775,11 @@ static int encode_frame(twolame_options * glopts, bit_stream * bs)
                 PACKAGE_BUGREPORT);
         return -1;
     }
+    twolame_buffer_flush(bs);
+
     // Store the energy levels at the end of the frame
     if (glopts->do_energy_levels)
-        twolame_do_energy_levels(glopts, bs);
+        twolame_do_energy_levels(glopts, frame->buffer, bs);
 
     // MEANX: Recompute checksum from bitstream
     if (glopts->error_protection) {
@@ -663,314 +792,696 @@ static int encode_frame(twolame_options * glopts, bit_stream * bs)
 }
 
 
+/*
+    Encode a single frame of audio from 1152 samples
+    Audio samples are taken from frame->buffer
+    Encoded bit stream is placed in to parameter bs
+    (not intended for use outside the library)
+
+    Returns the size of the frame
+    or -1 if there is an error
+*/
+static int encode_frame(twolame_options * glopts, frame_data * frame, bit_stream * bs)
+{
+    frame->status = 0;
+    analyse_frame(glopts, frame);
+
+    return pack_frame(glopts, frame, bs);
+}
+
+
+/*
+    Encode the frame just filled with samples when the frames are pipelined:
+    its analysis is started on the worker threads, and the previous frame,
+    whose analysis is complete, is packed meanwhile. The frame is output
+    by the next call, or by twolame_encode_flush().
+
+    Returns the size of the previous frame, 0 if there was none,
+    or <0 if there is an error
+*/
+static int encode_frame_pipelined(twolame_options * glopts, bit_stream * bs)
+{
+    frame_data *next = glopts->frame;
+    frame_data *prev = (next == glopts->frames) ? next + 1 : glopts->frames;
+    int pending = glopts->frame_pending;
+
+    // The analyses of the frames run one after the other
+    if (pending)
+        wait_analysis(glopts);
+    start_analysis(glopts, next);
+
+    // The previous frame is filled with the next samples once it is packed
+    glopts->frame = prev;
+    glopts->frame_pending = TRUE;
+
+    return pending ? pack_frame(glopts, prev, bs) : 0;
+}
+
+
+
+/* Sample formats accepted by the twolame_encode_buffer functions */
+typedef enum {
+    SAMPLE_S16,
+    SAMPLE_FLOAT32,
+    SAMPLE_S32,
+    SAMPLE_S24_PACKED
+} sample_format;
+
+static const int sample_size[] = { sizeof(short), sizeof(float), sizeof(int), 3 };
+
+
+/*
+  Copy the samples of one channel into the frame buffer.
+  The frame buffer holds samples at 16-bit scale, so 16-bit input is copied
+  unchanged and other formats are scaled without rounding them to 16 bits.
+*/
+static void copy_samples(FLOAT out[], const void *in, sample_format format,
+                         int num_samples, int stride)
+{
+    int n;
+
+    switch (format) {
+    case SAMPLE_S16:{
+            const short *pcm = (const short *) in;
+            for (n = 0; n < num_samples; n++)
+                out[n] = pcm[n * stride];
+            break;
+        }
+    case SAMPLE_FLOAT32:{
+            const float *pcm = (const float *) in;
+            for (n = 0; n < num_samples; n++) {
+                FLOAT sample = pcm[n * stride] * (FLOAT) 32768.0;
+                if (sample > SHRT_MAX)
+                    sample = SHRT_MAX;
+                else if (sample < SHRT_MIN)
+                    sample = SHRT_MIN;
+                out[n] = sample;
+            }
+            break;
+        }
+    case SAMPLE_S32:{
+            const int *pcm = (const int *) in;
+            for (n = 0; n < num_samples; n++)
+                out[n] = pcm[n * stride] * (FLOAT) (1.0 / 65536.0);
+            break;
+        }
+    case SAMPLE_S24_PACKED:{
+            const unsigned char *pcm = (const unsigned char *) in;
+            for (n = 0; n < num_samples; n++) {
+                const unsigned char *p = pcm + 3 * n * stride;
+                long sample = (long) (signed char) p[2] * 65536 + (p[1] << 8) + p[0];
+                out[n] = sample * (FLOAT) (1.0 / 256.0);
+            }
+            break;
+        }
+    }
+}
+
+
+/*
+  Copy as many samples as fit into the frame being filled, advancing
+  left and right past them.
+
+  Returns the number of samples copied from each channel
+*/
+static int fill_frame(twolame_options * glopts, const char **left, const char **right,
+                      sample_format format, int stride, int num_samples)
+{
+    int step = sample_size[format] * stride;
+
+    // fill up glopts->frame with as much as we can
+    int samples_to_copy = TWOLAME_SAMPLES_PER_FRAME - glopts->samples_in_buffer;
+    if (num_samples < samples_to_copy)
+        samples_to_copy = num_samples;
+
+    /* Copy across samples */
+    copy_samples(&glopts->frame->buffer[0][glopts->samples_in_buffer], *left, format,
+                 samples_to_copy, stride);
+    *left += samples_to_copy * step;
+    if (glopts->num_channels_in == 2) {
+        copy_samples(&glopts->frame->buffer[1][glopts->samples_in_buffer], *right, format,
+                     samples_to_copy, stride);
+        *right += samples_to_copy * step;
+    }
+    scale_and_mix_samples(glopts, glopts->samples_in_buffer, samples_to_copy,
+                          format == SAMPLE_S16);
+
+    /* Update sample counts */
+    glopts->samples_in_buffer += samples_to_copy;
+
+    return samples_to_copy;
+}
+
+
+/*
+  Check that an output buffer can hold num_frames frames of the largest
+  size the encoder can output. It is checked before anything is encoded,
+  as a frame which doesn't fit can't be written out once it is analysed.
+
+  Returns 0, or TWOLAME_ERROR_BUFFER_FULL
+*/
+static int check_output_space(twolame_options * glopts, int num_frames, int mp2buffer_size)
+{
+    if ((long) num_frames * (twolame_max_frame_bits(glopts) / 8) > mp2buffer_size)
+        return TWOLAME_ERROR_BUFFER_FULL;
+
+    return 0;
+}
+
 
 /*
-  glopts
+  Common part of the twolame_encode_buffer functions: fill up the frame
+  buffer and encode every complete frame.
+
   leftpcm - holds left channel (or mono channel)
-  rightpcm - d'uh
+  rightpcm - holds right channel (unused for mono input)
+  stride - distance between two samples of a channel, in samples
   num_samples - the number of samples in each channel
   mp2buffer - a pointer to the place where we want the mpeg data to be written
   mp2buffer_size - how much space the user allocated for this buffer
-  mp2fill_size - how much mpeg data the library has put into the mp2buffer
-*/
 
-int twolame_encode_buffer(twolame_options * glopts,
-                          const short int leftpcm[],
-                          const short int rightpcm[],
+  Returns the number of bytes put into mp2buffer, or <0 on error,
+  leaving the encoder as it was
+*/
+static int encode_samples(twolame_options * glopts,
+                          const void *leftpcm, const void *rightpcm,
+                          sample_format format, int stride,
                           int num_samples, unsigned char *mp2buffer, int mp2buffer_size)
 {
+    const char *left = (const char *) leftpcm;
+    const char *right = (const char *) rightpcm;
     int mp2_size = 0;
-    bit_stream *mybs;
-    int i;
+    bit_stream mybs;
 
     if (num_samples == 0)
         return 0;
 
+    if (!glopts->twolame_init) {
+        fprintf(stderr, "Please call twolame_init_params() before starting encoding.\n");
+        return -1;
+    }
 
-    // now would be a great time to validate the size of the buffer.
-    // samples/1152 * sizeof(frame) < mp2buffer_size
-    mybs = twolame_buffer_init(mp2buffer, mp2buffer_size);
+    // Make sure that all the frames of these samples fit in the buffer
+    if (check_output_space(glopts, (glopts->samples_in_buffer + num_samples)
+                           / TWOLAME_SAMPLES_PER_FRAME, mp2buffer_size) < 0)
+        return TWOLAME_ERROR_BUFFER_FULL;
 
-    if (mybs != NULL) {
-        // Use up all the samples in in_buffer
-        while (num_samples) {
+    twolame_buffer_init(&mybs, mp2buffer, mp2buffer_size);
 
-            // fill up glopts->buffer with as much as we can
-            int samples_to_copy = TWOLAME_SAMPLES_PER_FRAME - glopts->samples_in_buffer;
-            if (num_samples < samples_to_copy)
-                samples_to_copy = num_samples;
+    // Use up all the samples in in_buffer
+    while (num_samples) {
+        num_samples -= fill_frame(glopts, &left, &right, format, stride, num_samples);
 
-            /* Copy across samples */
-            if (glopts->num_channels_in == 2)
-                for (i = 0; i < samples_to_copy; i++) {
-                    glopts->buffer[0][glopts->samples_in_buffer + i] = *leftpcm++;
-                    glopts->buffer[1][glopts->samples_in_buffer + i] = *rightpcm++;
-                }
+        // is there enough to encode a whole frame ?
+        if (glopts->samples_in_buffer >= TWOLAME_SAMPLES_PER_FRAME) {
+            int bytes;
+            if (glopts->workers[0] != NULL)
+                bytes = encode_frame_pipelined(glopts, &mybs);
             else
-                for (i = 0; i < samples_to_copy; i++)
-                    glopts->buffer[0][glopts->samples_in_buffer + i] = *leftpcm++;
-
-
-            /* Update sample counts */
-            glopts->samples_in_buffer += samples_to_copy;
-            num_samples -= samples_to_copy;
-
-
-            // is there enough to encode a whole frame ?
-            if (glopts->samples_in_buffer >= TWOLAME_SAMPLES_PER_FRAME) {
-                int bytes = encode_frame(glopts, mybs);
-                if (bytes <= 0) {
-                    twolame_buffer_deinit(&mybs);
-                    return bytes;
-                }
-                mp2_size += bytes;
-                glopts->samples_in_buffer -= TWOLAME_SAMPLES_PER_FRAME;
-            }
+                bytes = encode_frame(glopts, glopts->frame, &mybs);
+            if (bytes < 0)
+                return bytes;
+            mp2_size += bytes;
+            glopts->samples_in_buffer -= TWOLAME_SAMPLES_PER_FRAME;
         }
-
-        // free up the bit stream buffer structure
-        twolame_buffer_deinit(&mybs);
     }
 
     return (mp2_size);
 }
 
 
+int twolame_encode_buffer(twolame_options * glopts,
+                          const short int leftpcm[],
+                          const short int rightpcm[],
+                          int num_samples, unsigned char *mp2buffer, int mp2buffer_size)
+{
+    return encode_samples(glopts, leftpcm, rightpcm, SAMPLE_S16, 1,
+                          num_samples, mp2buffer, mp2buffer_size);
+}
+
+
 int twolame_encode_buffer_interleaved(twolame_options * glopts,
                                       const short int pcm[],
                                       int num_samples, unsigned char *mp2buffer, int mp2buffer_size)
 {
+    return encode_samples(glopts, pcm, pcm + 1, SAMPLE_S16, glopts->num_channels_in,
+                          num_samples, mp2buffer, mp2buffer_size);
+}
+
+
+int twolame_encode_buffer_float32(twolame_options * glopts,
+                                  const float leftpcm[],
+                                  const float rightpcm[],
+                                  int num_samples, unsigned char *mp2buffer, int mp2buffer_size)
+{
+    return encode_samples(glopts, leftpcm, rightpcm, SAMPLE_FLOAT32, 1,
+                          num_samples, mp2buffer, mp2buffer_size);
+}
+
+
+int twolame_encode_buffer_float32_interleaved(twolame_options * glopts,
+        const float pcm[],
+        int num_samples,
+        unsigned char *mp2buffer, int mp2buffer_size)
+{
+    return encode_samples(glopts, pcm, pcm + 1, SAMPLE_FLOAT32, glopts->num_channels_in,
+                          num_samples, mp2buffer, mp2buffer_size);
+}
+
+
+int twolame_encode_buffer_s32(twolame_options * glopts,
+                              const int leftpcm[],
+                              const int rightpcm[],
+                              int num_samples, unsigned char *mp2buffer, int mp2buffer_size)
+{
+    return encode_samples(glopts, leftpcm, rightpcm, SAMPLE_S32, 1,
+                          num_samples, mp2buffer, mp2buffer_size);
+}
+
+
+int twolame_encode_buffer_s32_interleaved(twolame_options * glopts,
+        const int pcm[],
+        int num_samples,
+        unsigned char *mp2buffer, int mp2buffer_size)
+{
+    return encode_samples(glopts, pcm, pcm + 1, SAMPLE_S32, glopts->num_channels_in,
+                          num_samples, mp2buffer, mp2buffer_size);
+}
+
+
+int twolame_encode_buffer_s24_packed(twolame_options * glopts,
+                                     const unsigned char leftpcm[],
+                                     const unsigned char rightpcm[],
+                                     int num_samples,
+                                     unsigned char *mp2buffer, int mp2buffer_size)
+{
+    return encode_samples(glopts, leftpcm, rightpcm, SAMPLE_S24_PACKED, 1,
+                          num_samples, mp2buffer, mp2buffer_size);
+}
+
+
+int twolame_encode_buffer_s24_packed_interleaved(twolame_options * glopts,
+        const unsigned char pcm[],
+        int num_samples,
+        unsigned char *mp2buffer, int mp2buffer_size)
+{
+    return encode_samples(glopts, pcm, pcm + 3, SAMPLE_S24_PACKED, glopts->num_channels_in,
+                          num_samples, mp2buffer, mp2buffer_size);
+}
+
+
+
+int twolame_encode_flush(twolame_options * glopts, unsigned char *mp2buffer, int mp2buffer_size)
+{
+    bit_stream mybs;
     int mp2_size = 0;
-    bit_stream *mybs;
     int i;
 
-    if (num_samples == 0)
+    if (glopts->samples_in_buffer == 0 && !glopts->frame_pending) {
+        // No samples left over
         return 0;
+    }
+    if (check_output_space(glopts, (glopts->samples_in_buffer > 0) + glopts->frame_pending,
+                           mp2buffer_size) < 0)
+        return TWOLAME_ERROR_BUFFER_FULL;
 
+    // Create bit stream structure
+    twolame_buffer_init(&mybs, mp2buffer, mp2buffer_size);
 
-    // now would be a great time to validate the size of the buffer.
-    // samples/1152 * sizeof(frame) < mp2buffer_size
-    mybs = twolame_buffer_init(mp2buffer, mp2buffer_size);
+    // Output the frame still being analysed when the frames are pipelined
+    if (glopts->frame_pending) {
+        frame_data *prev = (glopts->frame == glopts->frames) ? glopts->frame + 1 : glopts->frames;
 
-    if (mybs != NULL) {
-        // Use up all the samples in in_buffer
-        while (num_samples) {
+        wait_analysis(glopts);
+        glopts->frame_pending = FALSE;
+        mp2_size = pack_frame(glopts, prev, &mybs);
+        if (mp2_size < 0 || glopts->samples_in_buffer == 0)
+            return mp2_size;
+    }
 
-            // fill up glopts->buffer with as much as we can
-            int samples_to_copy = TWOLAME_SAMPLES_PER_FRAME - glopts->samples_in_buffer;
-            if (num_samples < samples_to_copy)
-                samples_to_copy = num_samples;
+    // Pad out the PCM buffers with 0 and encode the frame
+    for (i = glopts->samples_in_buffer; i < TWOLAME_SAMPLES_PER_FRAME; i++) {
+        glopts->frame->buffer[0][i] = glopts->frame->buffer[1][i] = 0;
+    }
 
-            /* Copy across samples */
-            if (glopts->num_channels_in == 2)
-                for (i = 0; i < samples_to_copy; i++) {
-                    glopts->buffer[0][glopts->samples_in_buffer + i] = *pcm++;
-                    glopts->buffer[1][glopts->samples_in_buffer + i] = *pcm++;
-                }
-            else
-                for (i = 0; i < samples_to_copy; i++)
-                    glopts->buffer[0][glopts->samples_in_buffer + i] = *pcm++;
+    // Encode the frame
+    i = encode_frame(glopts, glopts->frame, &mybs);
+    glopts->samples_in_buffer = 0;
 
+    return i < 0 ? i : mp2_size + i;
+}
 
-            /* Update sample counts */
-            glopts->samples_in_buffer += samples_to_copy;
-            num_samples -= samples_to_copy;
 
 
-            // is there enough to encode a whole frame ?
-            if (glopts->samples_in_buffer >= TWOLAME_SAMPLES_PER_FRAME) {
-                int bytes = encode_frame(glopts, mybs);
-                if (bytes <= 0) {
-                    twolame_buffer_deinit(&mybs);
-                    return bytes;
-                }
-                mp2_size += bytes;
-                glopts->samples_in_buffer -= TWOLAME_SAMPLES_PER_FRAME;
-            }
-        }
 
-        // free up the bit stream buffer structure
-        twolame_buffer_deinit(&mybs);
+/*
+  Check that the encoders of a simulcast analyse their input the same way,
+  and choose the one whose analysis they share: the first one with
+  the most subbands, as the others only read the subbands below theirs.
+
+  Returns the encoder analysing the frames, or NULL if they can't share it
+*/
+static twolame_options *simulcast_leader(twolame_options * glopts[], int num_encoders)
+{
+    twolame_options *leader = glopts[0];
+    int i;
+
+    if (num_encoders < 1) {
+        fprintf(stderr, "Invalid number of simulcast encoders: %i\n", num_encoders);
+        return NULL;
     }
 
-    return (mp2_size);
+    for (i = 0; i < num_encoders; i++) {
+        twolame_options *opts = glopts[i];
+
+        if (!opts->twolame_init) {
+            fprintf(stderr, "Please call twolame_init_params() before starting encoding.\n");
+            return NULL;
+        }
+        if (opts->samplerate_out != glopts[0]->samplerate_out
+                || opts->num_channels_in != glopts[0]->num_channels_in
+                || opts->num_channels_out != glopts[0]->num_channels_out
+                || opts->scale != glopts[0]->scale
+                || opts->scale_left != glopts[0]->scale_left
+                || opts->scale_right != glopts[0]->scale_right
+                || opts->fast_dct != glopts[0]->fast_dct
+                || opts->psymodel != glopts[0]->psymodel
+                || opts->athlevel != glopts[0]->athlevel
+                || opts->quickmode != glopts[0]->quickmode
+                || opts->quickcount != glopts[0]->quickcount
+                || opts->fast_fft != glopts[0]->fast_fft
+                || opts->fast_phase != glopts[0]->fast_phase
+                || opts->spread_tolerance != glopts[0]->spread_tolerance
+                || opts->fast_db != glopts[0]->fast_db) {
+            fprintf(stderr,
+                    "Simulcast encoder %i differs in its input or psychoacoustic model settings\n",
+                    i);
+            return NULL;
+        }
+        if (opts->sblimit > leader->sblimit)
+            leader = opts;
+    }
+
+    return leader;
 }
 
 
-static void float32_to_short(const float in[], short out[], int num_samples, int stride)
+/* The bitrate class of an encoder with psycho model 1 or 3: 1 from HIGH_BITRATE per channel */
+static int psycho_class(twolame_options * glopts)
 {
-    int n;
+    return glopts->bitrate / glopts->num_channels_out >= HIGH_BITRATE;
+}
 
-    for (n = 0; n < num_samples; n++) {
-        int tmp = lrintf(in[n * stride] * 32768.0f);
-        if (tmp > SHRT_MAX) {
-            out[n] = SHRT_MAX;
-        } else if (tmp < SHRT_MIN) {
-            out[n] = SHRT_MIN;
-        } else {
-            out[n] = (short) tmp;
+
+/*
+  Give the frame the smr of an encoder of a simulcast with psycho model
+  1 or 3: that of its bitrate class, or if the model didn't run on the
+  frame (smr is NULL), the one saved in quick mode.
+*/
+static void simulcast_smr(twolame_options * glopts, frame_data * frame, FLOAT smr[2][SBLIMIT])
+{
+    int nch = glopts->num_channels_out;
+    int sb, ch;
+
+    for (ch = 0; ch < nch; ch++) {
+        for (sb = 0; sb < glopts->sblimit; sb++) {
+            if (smr == NULL)
+                frame->smr[ch][sb] = glopts->smrdef[ch][sb];
+            else
+                frame->smr[ch][sb] = smr[ch][sb];
         }
     }
+
+    if (glopts->quickmode == TRUE && smr != NULL) {
+        for (ch = 0; ch < nch; ch++)
+            for (sb = 0; sb < glopts->sblimit; sb++)
+                glopts->smrdef[ch][sb] = smr[ch][sb];
+    }
 }
 
 
 /*
-  glopts
-  leftpcm - holds left channel (or mono channel)
-  rightpcm - d'uh
-  num_samples - the number of samples in each channel
-  mp2buffer - a pointer to the place where we want the mpeg data to be written
-  mp2buffer_size - how much space the user allocated for this buffer
-  mp2fill_size - how much mpeg data the library has put into the mp2buffer
+  Encode the frame of the leader with every encoder of a simulcast:
+  the filterbank and the scalefactors are calculated once, and so is
+  the psychoacoustic model. Models 1 and 3 depend on the bitrate, but
+  only through the threshold in quiet, so their spectrum and masking
+  components are found once, and the global masking threshold once
+  for each bitrate class among the encoders. The scalefactors are
+  restored for each encoder, as the transmission pattern of the
+  scalefactors overwrites those it doesn't send.
+
+  The callers check the output space of every encoder first, so that
+  once the frame is analysed, each encoder writes it out.
 */
+static int encode_simulcast_frame(twolame_options * glopts[], int num_encoders,
+                                  twolame_options * leader, unsigned char *mp2buffers[],
+                                  const int mp2buffer_sizes[], int mp2_bytes[])
+{
+    frame_data *frame = leader->frame;
+    int per_class = (leader->psymodel == 1 || leader->psymodel == 3);
+    int joint = FALSE, analysed = FALSE;
+    int classes[2] = { FALSE, FALSE };
+    unsigned int scalar[2][3][SBLIMIT];
+    FLOAT smr[2][2][SBLIMIT];   // of each bitrate class with models 1 and 3
+    int i;
 
-int twolame_encode_buffer_float32(twolame_options * glopts,
-                                  const float leftpcm[],
-                                  const float rightpcm[],
-                                  int num_samples, unsigned char *mp2buffer, int mp2buffer_size)
+    for (i = 0; i < num_encoders; i++) {
+        if (glopts[i]->mode == TWOLAME_JOINT_STEREO)
+            joint = TRUE;
+        classes[psycho_class(glopts[i])] = TRUE;
+    }
+
+    frame->status = 0;
+    analyse_subbands(leader, frame);
+    if (joint && leader->mode != TWOLAME_JOINT_STEREO) {
+        twolame_combine_lr(frame->sb_sample, frame->j_sample, leader->sblimit);
+        twolame_scalefactor_calc(&frame->j_sample, &frame->j_scale, 1, leader->sblimit);
+    }
+    if (!per_class) {
+        analyse_psycho(leader, frame);
+    } else if (leader->quickmode != TRUE || ++leader->psycount % leader->quickcount == 0) {
+        if (leader->psymodel == 1)
+            twolame_psycho_1_classes(leader, frame->buffer, frame->max_sc,
+                                     classes[0] ? smr[0] : NULL, classes[1] ? smr[1] : NULL);
+        else
+            twolame_psycho_3_classes(leader, frame->buffer, frame->max_sc,
+                                     classes[0] ? smr[0] : NULL, classes[1] ? smr[1] : NULL);
+        analysed = TRUE;
+    }
+    if (frame->status < 0)
+        return -1;
+    memcpy(scalar, frame->scalar, sizeof(scalar));
+
+    for (i = 0; i < num_encoders; i++) {
+        bit_stream mybs;
+        int bytes;
+
+        if (i > 0)
+            memcpy(frame->scalar, scalar, sizeof(scalar));
+        if (per_class)
+            simulcast_smr(glopts[i], frame, analysed ? smr[psycho_class(glopts[i])] : NULL);
+
+        twolame_buffer_init(&mybs, mp2buffers[i] + mp2_bytes[i],
+                            mp2buffer_sizes[i] - mp2_bytes[i]);
+        bytes = pack_frame(glopts[i], frame, &mybs);
+        if (bytes < 0)
+            return bytes;
+        mp2_bytes[i] += bytes;
+    }
+
+    return 0;
+}
+
+
+/* Check that the buffer of each encoder of a simulcast can hold num_frames frames */
+static int check_simulcast_space(twolame_options * glopts[], int num_encoders, int num_frames,
+                                 const int mp2buffer_sizes[])
 {
-    int mp2_size = 0;
-    bit_stream *mybs;
+    int i;
 
-    if (num_samples == 0)
-        return 0;
+    for (i = 0; i < num_encoders; i++)
+        if (check_output_space(glopts[i], num_frames, mp2buffer_sizes[i]) < 0)
+            return TWOLAME_ERROR_BUFFER_FULL;
 
+    return 0;
+}
 
-    // now would be a great time to validate the size of the buffer.
-    // samples/1152 * sizeof(frame) < mp2buffer_size
-    mybs = twolame_buffer_init(mp2buffer, mp2buffer_size);
-
-    if (mybs != NULL) {
-        // Use up all the samples in in_buffer
-        while (num_samples) {
-
-            // fill up glopts->buffer with as much as we can
-            int samples_to_copy = TWOLAME_SAMPLES_PER_FRAME - glopts->samples_in_buffer;
-            if (num_samples < samples_to_copy)
-                samples_to_copy = num_samples;
-
-            /* Copy across samples */
-            float32_to_short(leftpcm, &glopts->buffer[0][glopts->samples_in_buffer], samples_to_copy,
-                             1);
-            if (glopts->num_channels_in == 2)
-                float32_to_short(rightpcm, &glopts->buffer[1][glopts->samples_in_buffer],
-                                 samples_to_copy, 1);
-            leftpcm += samples_to_copy;
-            rightpcm += samples_to_copy;
-
-            /* Update sample counts */
-            glopts->samples_in_buffer += samples_to_copy;
-            num_samples -= samples_to_copy;
-
-
-            // is there enough to encode a whole frame ?
-            if (glopts->samples_in_buffer >= TWOLAME_SAMPLES_PER_FRAME) {
-                int bytes = encode_frame(glopts, mybs);
-                if (bytes <= 0) {
-                    twolame_buffer_deinit(&mybs);
-                    return bytes;
-                }
-                mp2_size += bytes;
-                glopts->samples_in_buffer -= TWOLAME_SAMPLES_PER_FRAME;
-            }
-        }
 
-        // free up the bit stream buffer structure
-        twolame_buffer_deinit(&mybs);
+int twolame_encode_simulcast_interleaved(twolame_options * glopts[], int num_encoders,
+        const short int pcm[], int num_samples,
+        unsigned char *mp2buffers[], const int mp2buffer_sizes[],
+        int mp2_bytes[])
+{
+    twolame_options *leader = simulcast_leader(glopts, num_encoders);
+    const char *left = (const char *) pcm;
+    const char *right = (const char *) (pcm + 1);
+    int i;
+
+    if (leader == NULL)
+        return -1;
+
+    for (i = 0; i < num_encoders; i++)
+        mp2_bytes[i] = 0;
+
+    // Make sure that all the frames of these samples fit in every buffer
+    if (check_simulcast_space(glopts, num_encoders, (leader->samples_in_buffer + num_samples)
+                              / TWOLAME_SAMPLES_PER_FRAME, mp2buffer_sizes) < 0)
+        return TWOLAME_ERROR_BUFFER_FULL;
+
+    while (num_samples) {
+        num_samples -= fill_frame(leader, &left, &right, SAMPLE_S16, leader->num_channels_in,
+                                  num_samples);
+
+        if (leader->samples_in_buffer >= TWOLAME_SAMPLES_PER_FRAME) {
+            int error = encode_simulcast_frame(glopts, num_encoders, leader, mp2buffers,
+                                               mp2buffer_sizes, mp2_bytes);
+            if (error < 0)
+                return error;
+            leader->samples_in_buffer -= TWOLAME_SAMPLES_PER_FRAME;
+        }
     }
 
-    return (mp2_size);
+    return 0;
 }
 
 
-int twolame_encode_buffer_float32_interleaved(twolame_options * glopts,
-        const float pcm[],
-        int num_samples,
-        unsigned char *mp2buffer, int mp2buffer_size)
+int twolame_encode_simulcast_flush(twolame_options * glopts[], int num_encoders,
+                                   unsigned char *mp2buffers[], const int mp2buffer_sizes[],
+                                   int mp2_bytes[])
 {
-    int mp2_size = 0;
-    bit_stream *mybs;
+    twolame_options *leader = simulcast_leader(glopts, num_encoders);
+    int i;
 
-    if (num_samples == 0)
+    if (leader == NULL)
+        return -1;
+
+    for (i = 0; i < num_encoders; i++)
+        mp2_bytes[i] = 0;
+
+    if (leader->samples_in_buffer == 0) {
+        // No samples left over
         return 0;
+    }
+    if (check_simulcast_space(glopts, num_encoders, 1, mp2buffer_sizes) < 0)
+        return TWOLAME_ERROR_BUFFER_FULL;
 
+    // Pad out the PCM buffers with 0 and encode the frame
+    for (i = leader->samples_in_buffer; i < TWOLAME_SAMPLES_PER_FRAME; i++) {
+        leader->frame->buffer[0][i] = leader->frame->buffer[1][i] = 0;
+    }
+    leader->samples_in_buffer = 0;
 
-    // now would be a great time to validate the size of the buffer.
-    // samples/1152 * sizeof(frame) < mp2buffer_size
-    mybs = twolame_buffer_init(mp2buffer, mp2buffer_size);
+    return encode_simulcast_frame(glopts, num_encoders, leader, mp2buffers, mp2buffer_sizes,
+                                  mp2_bytes);
+}
 
-    if (mybs != NULL) {
-        // Use up all the samples in in_buffer
-        while (num_samples) {
 
-            // fill up glopts->buffer with as much as we can
-            int samples_to_copy = TWOLAME_SAMPLES_PER_FRAME - glopts->samples_in_buffer;
-            if (num_samples < samples_to_copy)
-                samples_to_copy = num_samples;
 
-            /* Copy across samples */
-            float32_to_short(pcm, &glopts->buffer[0][glopts->samples_in_buffer], samples_to_copy,
-                             glopts->num_channels_in);
-            if (glopts->num_channels_in == 2)
-                float32_to_short(pcm + 1, &glopts->buffer[1][glopts->samples_in_buffer],
-                                 samples_to_copy, glopts->num_channels_in);
-            pcm += (samples_to_copy * glopts->num_channels_in);
 
+/* The items of a batch and how many threads share them out */
+typedef struct {
+    twolame_batch_item *items;
+    int num_items;
+} batch_job;
 
-            /* Update sample counts */
-            glopts->samples_in_buffer += samples_to_copy;
-            num_samples -= samples_to_copy;
 
+/*
+  Is the frame of an encoder taking the stages of a batch:
+  a whole frame from the batch and no pipelined frames.
+  The others go through encode_samples() in the last stage.
+*/
+static int batch_staged(twolame_options * glopts)
+{
+    return glopts->twolame_init && glopts->workers[0] == NULL
+        && glopts->samples_in_buffer == TWOLAME_SAMPLES_PER_FRAME;
+}
 
-            // is there enough to encode a whole frame ?
-            if (glopts->samples_in_buffer >= TWOLAME_SAMPLES_PER_FRAME) {
-                int bytes = encode_frame(glopts, mybs);
-                if (bytes <= 0) {
-                    twolame_buffer_deinit(&mybs);
-                    return bytes;
-                }
-                mp2_size += bytes;
-                glopts->samples_in_buffer -= TWOLAME_SAMPLES_PER_FRAME;
-            }
+
+/* The psychoacoustic models in the order a batch runs them, invalid ones last */
+static int psycho_group(twolame_options * glopts)
+{
+    if (glopts->psymodel < -1 || glopts->psymodel > 4)
+        return 6;
+    return glopts->psymodel + 1;
+}
+
+
+/*
+  Encode the share of a batch of one thread, a stage at a time
+  across its items
+*/
+static void encode_batch_items(void *arg, int index, int num_threads)
+{
+    batch_job *job = (batch_job *) arg;
+    twolame_batch_item *first = job->items + job->num_items * index / num_threads;
+    twolame_batch_item *last = job->items + job->num_items * (index + 1) / num_threads;
+    twolame_batch_item *item;
+    int group;
+
+    for (item = first; item < last; item++) {
+        twolame_options *glopts = item->glopts;
+        const char *left = (const char *) item->pcm;
+        const char *right = (const char *) (item->pcm + 1);
+
+        // a frame which doesn't fit is left to encode_samples(), which reports it
+        if (glopts->twolame_init && glopts->workers[0] == NULL && glopts->samples_in_buffer == 0
+                && check_output_space(glopts, 1, item->mp2buffer_size) == 0) {
+            fill_frame(glopts, &left, &right, SAMPLE_S16, glopts->num_channels_in,
+                       TWOLAME_SAMPLES_PER_FRAME);
+            glopts->frame->status = 0;
+            analyse_subbands(glopts, glopts->frame);
         }
+    }
 
-        // free up the bit stream buffer structure
-        twolame_buffer_deinit(&mybs);
+    for (group = 0; group <= 6; group++) {
+        for (item = first; item < last; item++) {
+            if (batch_staged(item->glopts) && psycho_group(item->glopts) == group)
+                analyse_psycho(item->glopts, item->glopts->frame);
+        }
     }
 
-    return (mp2_size);
-}
+    for (item = first; item < last; item++) {
+        twolame_options *glopts = item->glopts;
 
+        if (batch_staged(glopts)) {
+            bit_stream mybs;
 
+            twolame_buffer_init(&mybs, item->mp2buffer, item->mp2buffer_size);
+            item->mp2_bytes = pack_frame(glopts, glopts->frame, &mybs);
+            glopts->samples_in_buffer = 0;
+        } else {
+            item->mp2_bytes = encode_samples(glopts, item->pcm, item->pcm + 1, SAMPLE_S16,
+                                             glopts->num_channels_in, TWOLAME_SAMPLES_PER_FRAME,
+                                             item->mp2buffer, item->mp2buffer_size);
+        }
+    }
+}
 
-int twolame_encode_flush(twolame_options * glopts, unsigned char *mp2buffer, int mp2buffer_size)
+
+int twolame_encode_batch(twolame_batch_item items[], int num_items, int num_threads)
 {
-    bit_stream *mybs = NULL;
-    int mp2_size = 0;
+    batch_job job;
     int i;
 
-    if (glopts->samples_in_buffer == 0) {
-        // No samples left over
-        return 0;
+    if (num_items < 0 || num_threads < 1) {
+        fprintf(stderr, "Invalid batch of %i items on %i threads\n", num_items, num_threads);
+        return -1;
     }
-    // Create bit stream structure
-    mybs = twolame_buffer_init(mp2buffer, mp2buffer_size);
-
-    if (mybs != NULL) {
-        // Pad out the PCM buffers with 0 and encode the frame
-        for (i = glopts->samples_in_buffer; i < TWOLAME_SAMPLES_PER_FRAME; i++) {
-            glopts->buffer[0][i] = glopts->buffer[1][i] = 0;
-        }
+    if (num_items == 0)
+        return 0;
+    if (num_threads > num_items)
+        num_threads = num_items;
 
-        // Encode the frame
-        mp2_size = encode_frame(glopts, mybs);
-        glopts->samples_in_buffer = 0;
+    job.items = items;
+    job.num_items = num_items;
+    twolame_run_threads(encode_batch_items, &job, num_threads);
 
-        // free up the bit stream buffer structure
-        twolame_buffer_deinit(&mybs);
+    for (i = 0; i < num_items; i++) {
+        if (items[i].mp2_bytes < 0)
+            return -1;
     }
 
-    return mp2_size;
+    return 0;
 }
 
 
@@ -987,6 +1498,10 @@ void twolame_close(twolame_options ** glopts)
     if (opts == NULL)
         return;
 
+    // let the threads finish the frame they analyse, if any
+    twolame_worker_stop(&opts->workers[0]);
+    twolame_worker_stop(&opts->workers[1]);
+
     // free mem
     twolame_psycho_4_deinit(&opts->p4mem);
     twolame_psycho_3_deinit(&opts->p3mem);
@@ -995,8 +1510,7 @@ void twolame_close(twolame_options ** glopts)
     twolame_psycho_0_deinit(&opts->p0mem);
 
     TWOLAME_FREE(opts->subband);
-    TWOLAME_FREE(opts->j_sample);
-    TWOLAME_FREE(opts->sb_sample);
+    TWOLAME_FREE(opts->frames);
 
     // Free the memory and zero the pointer
     TWOLAME_FREE(opts);
@@ -120,6 +120,12 @@ typedef enum {
 /** Number of samples per frame of Layer 2 MPEG Audio */
 #define TWOLAME_SAMPLES_PER_FRAME        (1152)
 
+/** Returned by the encoding functions when the output buffer can't hold the frames of
+ *  the call at the largest size the encoder can output (at the upper VBR bitrate, padded
+ *  at a constant bitrate). Nothing is encoded then, so the same samples can be passed
+ *  again with a larger buffer. */
+#define TWOLAME_ERROR_BUFFER_FULL        (-2)
+
 
 /** Opaque structure for the twolame encoder options. */
 struct twolame_options_struct;
@@ -179,6 +185,11 @@ TL_API twolame_options *twolame_init(void);
  *  as well as allocating buffers and initising internally used
  *  variables.
  *
+ *  Encoders with the same settings share some constant tables.
+ *  On builds without pthreads or Win32 threads, the tables aren't
+ *  locked, so twolame_init_params() and twolame_close() must not
+ *  be called concurrently for different encoders.
+ *
  *  \param glopts          Options pointer created by twolame_init()
  *  \return                0 if all patameters are valid,
  *                         non-zero if something is invalid
@@ -231,8 +242,8 @@ TL_API int twolame_encode_buffer_interleaved(twolame_options * glopts,
  *  Takes 32-bit floating point PCM audio samples from separate
  *  left and right buffers and places encoded audio into mp2buffer.
  *
- *  Note: the 32-bit samples are currently scaled down to
- *  16-bit samples internally.
+ *  Note: samples are clipped to the range -1.0 to 1.0, but
+ *  are not rounded to 16-bit precision.
  *
  *  \param glopts          twolame options pointer
  *  \param leftpcm         Left channel audio samples
@@ -269,11 +280,128 @@ TL_API int twolame_encode_buffer_float32_interleaved(twolame_options * glopts,
         unsigned char *mp2buffer, int mp2buffer_size);
 
 
+/** Encode some 32-bit integer PCM audio to MP2.
+ *
+ *  Takes signed 32-bit integer PCM audio samples from separate
+ *  left and right buffers and places encoded audio into mp2buffer.
+ *
+ *  \param glopts          twolame options pointer
+ *  \param leftpcm         Left channel audio samples
+ *  \param rightpcm        Right channel audio samples
+ *  \param num_samples     Number of samples per channel
+ *  \param mp2buffer       Buffer to place encoded audio into
+ *  \param mp2buffer_size  Size of the output buffer
+ *  \return                The number of bytes put in output buffer
+ *                         or a negative value on error
+ */
+TL_API int twolame_encode_buffer_s32(twolame_options * glopts,
+                                     const int leftpcm[],
+                                     const int rightpcm[],
+                                     int num_samples,
+                                     unsigned char *mp2buffer, int mp2buffer_size);
+
+
+/** Encode some 32-bit integer PCM audio to MP2.
+ *
+ *  Takes interleaved signed 32-bit integer PCM audio samples from
+ *  a single buffer and places encoded audio into mp2buffer.
+ *
+ *  \param glopts          twolame options pointer
+ *  \param pcm             Audio samples for left AND right channels
+ *  \param num_samples     Number of samples per channel
+ *  \param mp2buffer       Buffer to place encoded audio into
+ *  \param mp2buffer_size  Size of the output buffer
+ *  \return                The number of bytes put in output buffer
+ *                         or a negative value on error
+ */
+TL_API int twolame_encode_buffer_s32_interleaved(twolame_options * glopts,
+        const int pcm[],
+        int num_samples,
+        unsigned char *mp2buffer, int mp2buffer_size);
+
+
+/** Encode some packed 24-bit PCM audio to MP2.
+ *
+ *  Takes signed 24-bit little-endian PCM audio samples, packed
+ *  into 3 bytes each, from separate left and right buffers
+ *  and places encoded audio into mp2buffer.
+ *
+ *  \param glopts          twolame options pointer
+ *  \param leftpcm         Left channel audio samples
+ *  \param rightpcm        Right channel audio samples
+ *  \param num_samples     Number of samples per channel
+ *  \param mp2buffer       Buffer to place encoded audio into
+ *  \param mp2buffer_size  Size of the output buffer
+ *  \return                The number of bytes put in output buffer
+ *                         or a negative value on error
+ */
+TL_API int twolame_encode_buffer_s24_packed(twolame_options * glopts,
+        const unsigned char leftpcm[],
+        const unsigned char rightpcm[],
+        int num_samples,
+        unsigned char *mp2buffer, int mp2buffer_size);
+
+
+/** Encode some packed 24-bit PCM audio to MP2.
+ *
+ *  Takes interleaved signed 24-bit little-endian PCM audio samples,
+ *  packed into 3 bytes each, from a single buffer and places
+ *  encoded audio into mp2buffer.
+ *
+ *  \param glopts          twolame options pointer
+ *  \param pcm             Audio samples for left AND right channels
+ *  \param num_samples     Number of samples per channel
+ *  \param mp2buffer       Buffer to place encoded audio into
+ *  \param mp2buffer_size  Size of the output buffer
+ *  \return                The number of bytes put in output buffer
+ *                         or a negative value on error
+ */
+TL_API int twolame_encode_buffer_s24_packed_interleaved(twolame_options * glopts,
+        const unsigned char pcm[],
+        int num_samples,
+        unsigned char *mp2buffer, int mp2buffer_size);
+
+
+/** Encode a whole stream of 16-bit interleaved PCM audio
+ *  to MP2 in segments, on several threads.
+ *
+ *  The frames of the audio are split into num_segments segments
+ *  of about the same length, which are shared out between at most
+ *  16 threads and joined into one stream, including the last
+ *  partial frame that twolame_encode_flush() would return. Each
+ *  segment is encoded by a copy of the options, which first
+ *  encodes a few frames before the segment to fill the history of
+ *  the filterbank and of the psychoacoustic model, so the stream
+ *  is the same as encoded by glopts in one go. The one exception is
+ *  VBR with psychoacoustic models 1 and 3, whose masking threshold
+ *  depends on the bitrate of the previous frame: in the first
+ *  frames of a segment it can be that of a neighbouring bitrate.
+ *
+ *  glopts must be initialised with twolame_init_params(), and is
+ *  not changed, so it can encode several streams like this.
+ *  The DAB extensions can't be encoded in segments.
+ *
+ *  \param glopts          twolame options pointer
+ *  \param pcm             Audio samples for left AND right channels
+ *  \param num_samples     Number of samples per channel
+ *  \param num_segments    Number of segments
+ *  \param mp2buffer       Buffer to place encoded audio into
+ *  \param mp2buffer_size  Size of the output buffer
+ *  \return                The number of bytes put in output buffer
+ *                         or a negative value on error
+ */
+TL_API int twolame_encode_segments_interleaved(twolame_options * glopts,
+        const short int pcm[],
+        int num_samples, int num_segments,
+        unsigned char *mp2buffer, int mp2buffer_size);
+
+
 /** Encode any remains buffered PCM audio to MP2.
  *
  *  Encodes any remaining audio samples in the libtwolame
  *  internal sample buffer. This function will return at
- *  most a single frame of MPEG Audio, and at least 0 frames.
+ *  most a single frame of MPEG Audio, and at least 0 frames
+ *  (two frames when encoding with twolame_set_num_threads()).
  *
  *  \param glopts          twolame options pointer
  *  \param mp2buffer       Buffer to place encoded audio into
@@ -285,6 +413,105 @@ TL_API int twolame_encode_flush(twolame_options * glopts,
                                     unsigned char *mp2buffer, int mp2buffer_size);
 
 
+/** Encode the same 16-bit interleaved PCM audio with several encoders.
+ *
+ *  The encoders of a simulcast differ in the settings of their
+ *  output, such as the bitrate, VBR, the mode or the padding, but
+ *  must have the same number of channels, sample rate, scaling and
+ *  psychoacoustic model settings. The filterbank, the scalefactors
+ *  and the psychoacoustic model run once per frame for all of them,
+ *  and each encoder allocates the bits of the frame and writes it to
+ *  its own buffer. The streams are the same as each encoder would
+ *  encode on its own. Psychoacoustic models 1 and 3 depend on the
+ *  bitrate, but only in the threshold in quiet, which is lowered
+ *  from 96 kbps per channel, so their masking threshold is
+ *  calculated for each side of that bitrate with an encoder on it.
+ *
+ *  If a buffer can't hold the frames of the samples, nothing is
+ *  encoded and TWOLAME_ERROR_BUFFER_FULL is returned, with every
+ *  mp2_bytes 0. On other errors mp2_bytes holds the bytes each
+ *  encoder put in its buffer before it.
+ *
+ *  The same encoders must be passed in the same order to every call,
+ *  and to twolame_encode_simulcast_flush() at the end, and not be
+ *  used with the other encoding functions.
+ *
+ *  \param glopts          array of num_encoders twolame options pointers
+ *  \param num_encoders    Number of encoders
+ *  \param pcm             Audio samples for left AND right channels
+ *  \param num_samples     Number of samples per channel
+ *  \param mp2buffers      Buffer of each encoder to place encoded audio into
+ *  \param mp2buffer_sizes Size of each output buffer
+ *  \param mp2_bytes       Set to the number of bytes put in each output buffer
+ *  \return                0 if successful, or a negative value on error
+ */
+TL_API int twolame_encode_simulcast_interleaved(twolame_options * glopts[], int num_encoders,
+        const short int pcm[], int num_samples,
+        unsigned char *mp2buffers[], const int mp2buffer_sizes[],
+        int mp2_bytes[]);
+
+
+/** Encode the remaining buffered PCM audio of a simulcast to MP2.
+ *
+ *  The simulcast counterpart of twolame_encode_flush(): each encoder
+ *  puts at most a single frame of MPEG Audio in its buffer. Errors
+ *  are reported as by twolame_encode_simulcast_interleaved().
+ *
+ *  \param glopts          array of num_encoders twolame options pointers
+ *  \param num_encoders    Number of encoders
+ *  \param mp2buffers      Buffer of each encoder to place encoded audio into
+ *  \param mp2buffer_sizes Size of each output buffer
+ *  \param mp2_bytes       Set to the number of bytes put in each output buffer
+ *  \return                0 if successful, or a negative value on error
+ */
+TL_API int twolame_encode_simulcast_flush(twolame_options * glopts[], int num_encoders,
+        unsigned char *mp2buffers[], const int mp2buffer_sizes[],
+        int mp2_bytes[]);
+
+
+/** A stream encoded by twolame_encode_batch() */
+typedef struct {
+    twolame_options *glopts;        /**< Encoder of the stream */
+    const short int *pcm;           /**< TWOLAME_SAMPLES_PER_FRAME interleaved
+                                         samples of each channel */
+    unsigned char *mp2buffer;       /**< Buffer to place encoded audio into */
+    int mp2buffer_size;             /**< Size of the output buffer */
+    int mp2_bytes;                  /**< Set to the number of bytes put in the
+                                         output buffer, or a negative value on error */
+} twolame_batch_item;
+
+
+/** Encode one frame of 16-bit interleaved PCM audio for each of many streams.
+ *
+ *  Each item of the batch passes TWOLAME_SAMPLES_PER_FRAME samples to
+ *  its own encoder, as twolame_encode_buffer_interleaved() would, so
+ *  a stream comes out the same whether it is encoded in batches or
+ *  on its own. Every item must have a different encoder.
+ *
+ *  The frames of the batch go through each stage of the encoder
+ *  together: the filterbanks of all streams, then their
+ *  psychoacoustic models, grouped by model, then the bit allocation,
+ *  which keeps the tables and code of a stage in the cache when
+ *  encoding many low bitrate streams. With num_threads above 1 the
+ *  items are shared out between as many threads (at most 16). There
+ *  is no pool: the threads are started and joined in every call,
+ *  which takes some tens of microseconds per thread, so a batch
+ *  should hold several items for each thread. Builds without threads
+ *  encode the items one after the other.
+ *
+ *  An item whose buffer can't hold its frame is not encoded, and its
+ *  mp2_bytes is TWOLAME_ERROR_BUFFER_FULL; the frame can be passed
+ *  again in a later call.
+ *
+ *  \param items           array of num_items streams
+ *  \param num_items       Number of streams
+ *  \param num_threads     Number of threads encoding the batch
+ *  \return                0 if every stream was encoded, or a negative
+ *                         value if the mp2_bytes of any item is an error
+ */
+TL_API int twolame_encode_batch(twolame_batch_item items[], int num_items, int num_threads);
+
+
 /** Shut down the twolame encoder.
  *
  *  Shuts down the twolame encoder and frees all memory
@@ -853,6 +1080,168 @@ TL_API int twolame_set_quick_count(twolame_options * glopts, int quickcount);
 TL_API int twolame_get_quick_count(twolame_options * glopts);
 
 
+/** Enable/Disable the fast DCT in the analysis filterbank.
+ *
+ *  The fast DCT uses a factorised transform with 80 multiplies
+ *  per block instead of the 16x32 cosine matrix. Its results
+ *  differ from the matrix by rounding only. It is mostly of use
+ *  on CPUs where no SIMD version of the matrix is available.
+ *  Must be set before calling twolame_init_params().
+ *
+ *  Default: FALSE
+ *
+ *  \param glopts          pointer to twolame options pointer
+ *  \param fast_dct        the state of the fast DCT (TRUE/FALSE)
+ *  \return                0 if successful, non-zero on failure
+ */
+TL_API int twolame_set_fast_dct(twolame_options * glopts, int fast_dct);
+
+
+/** Get the state of the fast DCT.
+ *
+ *  \param glopts          pointer to twolame options pointer
+ *  \return                the state of the fast DCT (TRUE/FALSE)
+ */
+TL_API int twolame_get_fast_dct(twolame_options * glopts);
+
+
+/** Enable/Disable the fast FFT in the psychoacoustic models.
+ *
+ *  The fast FFT replaces the Hartley transform used by
+ *  psychoacoustic models 1 to 4 with a real FFT that uses
+ *  SIMD instructions where the CPU has them. Its results
+ *  differ from the Hartley transform by rounding only.
+ *  Must be set before calling twolame_init_params().
+ *
+ *  Default: FALSE
+ *
+ *  \param glopts          pointer to twolame options pointer
+ *  \param fast_fft        the state of the fast FFT (TRUE/FALSE)
+ *  \return                0 if successful, non-zero on failure
+ */
+TL_API int twolame_set_fast_fft(twolame_options * glopts, int fast_fft);
+
+
+/** Get the state of the fast FFT.
+ *
+ *  \param glopts          pointer to twolame options pointer
+ *  \return                the state of the fast FFT (TRUE/FALSE)
+ */
+TL_API int twolame_get_fast_fft(twolame_options * glopts);
+
+
+/** Set how the phase of the spectrum is computed in psychoacoustic models 2 and 4.
+ *
+ *  Level 0 uses atan2() from the C library. Levels 1 and 2
+ *  use a polynomial approximation, computed with SIMD
+ *  instructions where the CPU has them, with an error of at
+ *  most 1.4e-8 and 1.2e-5 radians respectively. They also
+ *  replace sin() and cos() in the unpredictability measure
+ *  with polynomials accurate to 1e-16 and 1e-7.
+ *  Must be set before calling twolame_init_params().
+ *
+ *  Default: 0
+ *
+ *  \param glopts          pointer to twolame options pointer
+ *  \param fast_phase      the level of approximation (0 to 2)
+ *  \return                0 if successful, non-zero on failure
+ */
+TL_API int twolame_set_fast_phase(twolame_options * glopts, int fast_phase);
+
+
+/** Get the level of approximation of the phase in psychoacoustic models 2 and 4.
+ *
+ *  \param glopts          pointer to twolame options pointer
+ *  \return                the level of approximation (0 to 2)
+ */
+TL_API int twolame_get_fast_phase(twolame_options * glopts);
+
+
+/** Set the tolerance of the spreading function in psychoacoustic models 2 and 4.
+ *
+ *  Entries of the spreading function smaller than tolerance
+ *  times the largest entry of their band are left out of the
+ *  convolution. 0 keeps every non zero entry and gives the
+ *  same results as the full convolution; 1e-6 or so drops
+ *  the bands that make no audible difference.
+ *  Must be set before calling twolame_init_params().
+ *
+ *  Default: 0.0
+ *
+ *  \param glopts          pointer to twolame options pointer
+ *  \param tolerance       the tolerance (0 <= tolerance < 1)
+ *  \return                0 if successful, non-zero on failure
+ */
+TL_API int twolame_set_spreading_tolerance(twolame_options * glopts, float tolerance);
+
+
+/** Get the tolerance of the spreading function in psychoacoustic models 2 and 4.
+ *
+ *  \param glopts          pointer to twolame options pointer
+ *  \return                the tolerance
+ */
+TL_API float twolame_get_spreading_tolerance(twolame_options * glopts);
+
+
+/** Enable/Disable the fast dB conversions in psychoacoustic models 1 and 3.
+ *
+ *  The fast conversions replace log10() and pow() from the C
+ *  library with polynomials computed on whole spectra at once,
+ *  with SIMD instructions where the CPU has them. Levels in dB
+ *  are within 2e-13 dB of the C library, and powers within a
+ *  relative 2e-14 (5e-5 dB and 2e-5 in a single precision
+ *  build).
+ *  Must be set before calling twolame_init_params().
+ *
+ *  Default: FALSE
+ *
+ *  \param glopts          pointer to twolame options pointer
+ *  \param fast_db         the state of the fast dB conversions (TRUE/FALSE)
+ *  \return                0 if successful, non-zero on failure
+ */
+TL_API int twolame_set_fast_db(twolame_options * glopts, int fast_db);
+
+
+/** Get the state of the fast dB conversions.
+ *
+ *  \param glopts          pointer to twolame options pointer
+ *  \return                the state of the fast dB conversions (TRUE/FALSE)
+ */
+TL_API int twolame_get_fast_db(twolame_options * glopts);
+
+
+/** Set the number of threads encoding the stream.
+ *
+ *  With more than one thread the encoding is pipelined: a worker
+ *  thread runs the filterbank and the psychoacoustic model of a
+ *  frame while the calling thread allocates the bits of the previous
+ *  frame and writes it out. With three threads, psychoacoustic
+ *  models -1, 2 and 4 also run beside the filterbank; more threads
+ *  than that are not used. The output is the same as with one thread,
+ *  but each frame is returned one call later: the last frame of the
+ *  stream is returned by twolame_encode_flush().
+ *  Psychoacoustic models 1 and 3 in VBR mode depend on the previous
+ *  frame and are always encoded with one thread.
+ *  Must be set before calling twolame_init_params().
+ *
+ *  Default: 1
+ *
+ *  \param glopts          pointer to twolame options pointer
+ *  \param num_threads     the number of threads
+ *  \return                0 if successful, non-zero on failure
+ *                         (also if the library was built without threads)
+ */
+TL_API int twolame_set_num_threads(twolame_options * glopts, int num_threads);
+
+
+/** Get the number of threads encoding the stream.
+ *
+ *  \param glopts          pointer to twolame options pointer
+ *  \return                the number of threads
+ */
+TL_API int twolame_get_num_threads(twolame_options * glopts);
+
+
 /** Enable/Disable the Eureka 147 DAB extensions for MP2.
  *
  *  Default: FALSE
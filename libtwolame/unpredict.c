@@ -0,0 +1,261 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2001-2004 Michael Cheng
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+#include <stdio.h>
+#include <math.h>
+
+#include "twolame.h"
+#include "common.h"
+#include "cpu.h"
+#include "simd.h"
+#include "unpredict.h"
+
+
+/*
+  Unpredictability measure of psycho models 2 and 4, ISO 11172 D.2.4.c.
+  The magnitude r and phase phi of every line are predicted from the
+  spectra of the two previous blocks of the channel,
+      r' = 2 r[old] - r[oldest]    phi' = 2 phi[old] - phi[oldest]
+  and c is the distance between the actual and predicted values,
+      c = |r e^(i phi) - r' e^(i phi')| / (r + |r'|)
+
+  The last three spectra of each channel are kept in a triple buffer
+  whose slots rotate, so that every stage streams through the lines.
+  The stages work on vectors of lines, then on the last few lines
+  one at a time with the same operations.
+
+  The sines and cosines come from libm, or with fast_phase from a
+  polynomial: x = k PI/2 + r with |r| <= PI/4, then the Cephes
+  polynomials for sin(r) and cos(r), swapped and negated for the
+  quadrant of k. In double precision they are within 1e-16 of libm
+  (level 1), or 1e-7 with the single precision coefficients (level 2).
+*/
+static const FLOAT sin_coef_fine[] = {
+    1.58962301576546568060E-10, -2.50507477628578072866E-8, 2.75573136213857245213E-6,
+    -1.98412698295895385996E-4, 8.33333333332211858878E-3, -1.66666666666666307295E-1
+};
+
+static const FLOAT cos_coef_fine[] = {
+    -1.13585365213876817300E-11, 2.08757008419747316778E-9, -2.75573141792967388112E-7,
+    2.48015872888517045348E-5, -1.38888888888730564116E-3, 4.16666666666665929218E-2
+};
+
+static const FLOAT sin_coef_coarse[] = {
+    -1.9515295891E-4, 8.3321608736E-3, -1.6666654611E-1
+};
+
+static const FLOAT cos_coef_coarse[] = {
+    2.443315711809948E-005, -1.388731625493765E-003, 4.166664568298827E-002
+};
+
+/* PI/2 in three parts, so that k PI/2 is subtracted with little rounding,
+   and the constant that rounds to an integer when added and subtracted */
+#ifdef SINGLE_PRECISION
+#define PIO2_1          1.5703125
+#define PIO2_2          4.837512969970703125e-4
+#define PIO2_3          7.54978995489188216e-8
+#define ROUND_MAGIC     12582912.0
+#else
+#define PIO2_1          1.57079632673412561417e+00
+#define PIO2_2          6.07710050650619224932e-11
+#define PIO2_3          2.02226624879595063154e-21
+#define ROUND_MAGIC     6755399441055744.0
+#endif
+
+#define UNPREDICT_ROUND(P, v) P##_sub(P##_add(v, P##_set1(ROUND_MAGIC)), P##_set1(ROUND_MAGIC))
+
+/* Predicted magnitude and phase, and the new spectrum into the history */
+#define UNPREDICT_PRIME(P, W) \
+    for (; j + (W) <= HBLKSIZE; j += (W)) { \
+        const P##_vec two = P##_set1(2.0); \
+        P##_store(r_prime + j, P##_sub(P##_mul(two, P##_load(r1 + j)), P##_load(r2 + j))); \
+        P##_store(phi_prime + j, P##_sub(P##_mul(two, P##_load(phi1 + j)), P##_load(phi2 + j))); \
+        P##_store(r0 + j, P##_sqrt(P##_load(energy + j))); \
+        P##_store(phi0 + j, P##_load(phi + j)); \
+    }
+
+/* Polynomial cosine and sine of x[] */
+#define UNPREDICT_SINCOS(P, W, x, cos_x, sin_x) \
+    for (; j + (W) <= HBLKSIZE; j += (W)) { \
+        const P##_vec v = P##_load((x) + j); \
+        const P##_vec k = UNPREDICT_ROUND(P, P##_mul(v, P##_set1(2.0 / PI))); \
+        const P##_vec h = UNPREDICT_ROUND(P, P##_mul(k, P##_set1(0.5))); \
+        const P##_vec q = P##_sub(k, P##_mul(P##_set1(4.0), \
+                                             UNPREDICT_ROUND(P, P##_mul(k, P##_set1(0.25))))); \
+        const P##_vec r = P##_sub(P##_sub(P##_sub(v, P##_mul(k, P##_set1(PIO2_1))), \
+                                          P##_mul(k, P##_set1(PIO2_2))), \
+                                  P##_mul(k, P##_set1(PIO2_3))); \
+        const P##_vec z = P##_mul(r, r); \
+        P##_vec ps = P##_set1(u->sin_coef[0]), pc = P##_set1(u->cos_coef[0]), sr, cr; \
+        for (i = 1; i < u->sin_terms; i++) \
+            ps = P##_add(P##_mul(ps, z), P##_set1(u->sin_coef[i])); \
+        for (i = 1; i < u->cos_terms; i++) \
+            pc = P##_add(P##_mul(pc, z), P##_set1(u->cos_coef[i])); \
+        sr = P##_add(r, P##_mul(P##_mul(r, z), ps)); \
+        cr = P##_add(P##_sub(P##_set1(1.0), P##_mul(P##_set1(0.5), z)), \
+                    P##_mul(P##_mul(z, z), pc)); \
+        { \
+            /* odd k swaps sine and cosine, k mod 4 (q in -2..2) gives the signs */ \
+            const P##_vec odd = P##_abs(P##_sub(k, P##_mul(P##_set1(2.0), h))); \
+            P##_vec sin_v = P##_select(P##_cmplt(P##_set1(0.5), odd), cr, sr); \
+            P##_vec cos_v = P##_select(P##_cmplt(P##_set1(0.5), odd), sr, cr); \
+            sin_v = P##_select(P##_cmplt(q, P##_set1(-0.5)), P##_sub(P##_zero(), sin_v), sin_v); \
+            sin_v = P##_select(P##_cmplt(P##_set1(1.5), q), P##_sub(P##_zero(), sin_v), sin_v); \
+            cos_v = P##_select(P##_cmplt(P##_set1(0.5), q), P##_sub(P##_zero(), cos_v), cos_v); \
+            cos_v = P##_select(P##_cmplt(q, P##_set1(-1.5)), P##_sub(P##_zero(), cos_v), cos_v); \
+            P##_store((sin_x) + j, sin_v); \
+            P##_store((cos_x) + j, cos_v); \
+        } \
+    }
+
+/* c[] from the actual and predicted values */
+#define UNPREDICT_MEASURE(P, W) \
+    for (; j + (W) <= HBLKSIZE; j += (W)) { \
+        const P##_vec r = P##_load(r0 + j), rp = P##_load(r_prime + j); \
+        const P##_vec t1 = P##_sub(P##_mul(r, P##_load(cos_phi + j)), \
+                                   P##_mul(rp, P##_load(cos_prime + j))); \
+        const P##_vec t2 = P##_sub(P##_mul(r, P##_load(sin_phi + j)), \
+                                   P##_mul(rp, P##_load(sin_prime + j))); \
+        const P##_vec t3 = P##_add(r, P##_abs(rp)); \
+        P##_store(c + j, P##_select(P##_cmplt(P##_zero(), t3), \
+                                    P##_div(P##_sqrt(P##_add(P##_mul(t1, t1), P##_mul(t2, t2))), \
+                                            t3), P##_zero())); \
+    }
+
+#define UNPREDICT(P, W) \
+    { \
+        FLOAT r_prime[HBLKSIZE], phi_prime[HBLKSIZE]; \
+        FLOAT cos_phi[HBLKSIZE], sin_phi[HBLKSIZE], cos_prime[HBLKSIZE], sin_prime[HBLKSIZE]; \
+        const int old = u->newest[ch], new = (old + 1) % 3, oldest = (old + 2) % 3; \
+        FLOAT *r0 = u->r[ch][new], *phi0 = u->phi[ch][new]; \
+        const FLOAT *r1 = u->r[ch][old], *phi1 = u->phi[ch][old]; \
+        const FLOAT *r2 = u->r[ch][oldest], *phi2 = u->phi[ch][oldest]; \
+        int i, j; \
+        j = 0; \
+        UNPREDICT_PRIME(P, W); \
+        UNPREDICT_PRIME(scalar, 1); \
+        if (u->fast) { \
+            j = 0; \
+            UNPREDICT_SINCOS(P, W, phi, cos_phi, sin_phi); \
+            UNPREDICT_SINCOS(scalar, 1, phi, cos_phi, sin_phi); \
+            j = 0; \
+            UNPREDICT_SINCOS(P, W, phi_prime, cos_prime, sin_prime); \
+            UNPREDICT_SINCOS(scalar, 1, phi_prime, cos_prime, sin_prime); \
+        } else { \
+            for (i = 0; i < HBLKSIZE; i++) { \
+                cos_phi[i] = cos(phi[i]); \
+                sin_phi[i] = sin(phi[i]); \
+                cos_prime[i] = cos(phi_prime[i]); \
+                sin_prime[i] = sin(phi_prime[i]); \
+            } \
+        } \
+        j = 0; \
+        UNPREDICT_MEASURE(P, W); \
+        UNPREDICT_MEASURE(scalar, 1); \
+        u->newest[ch] = new; \
+    }
+
+static void measure_scalar(unpredict_mem * u, int ch, const FLOAT * energy, const FLOAT * phi,
+                           FLOAT * c)
+{
+    UNPREDICT(scalar, 1);
+}
+
+#if defined(TWOLAME_X86_SIMD)
+
+SSE2_TARGET static void measure_sse2(unpredict_mem * u, int ch, const FLOAT * energy,
+                                     const FLOAT * phi, FLOAT * c)
+{
+    UNPREDICT(sse, SSE_WIDTH);
+}
+
+AVX2_TARGET static void measure_avx2(unpredict_mem * u, int ch, const FLOAT * energy,
+                                     const FLOAT * phi, FLOAT * c)
+{
+    UNPREDICT(avx, AVX_WIDTH);
+}
+
+#elif defined(TWOLAME_NEON_SIMD)
+
+static void measure_neon(unpredict_mem * u, int ch, const FLOAT * energy, const FLOAT * phi,
+                         FLOAT * c)
+{
+    UNPREDICT(neon, NEON_WIDTH);
+}
+
+#endif
+
+
+void twolame_unpredict_init(unpredict_mem * u, int fast_phase)
+{
+#if defined(TWOLAME_X86_SIMD) || defined(TWOLAME_NEON_SIMD)
+    int cpu = twolame_cpu_features();
+#endif
+    int ch, slot, j;
+
+    for (ch = 0; ch < 2; ch++) {
+        for (slot = 0; slot < 3; slot++)
+            for (j = 0; j < HBLKSIZE; j++) {
+                u->r[ch][slot][j] = 0.0;
+                u->phi[ch][slot][j] = 0.0;
+            }
+        u->newest[ch] = 0;
+    }
+
+    u->fast = (fast_phase != 0);
+    if (fast_phase == 2) {
+        u->sin_coef = sin_coef_coarse;
+        u->sin_terms = sizeof(sin_coef_coarse) / sizeof(sin_coef_coarse[0]);
+        u->cos_coef = cos_coef_coarse;
+        u->cos_terms = sizeof(cos_coef_coarse) / sizeof(cos_coef_coarse[0]);
+    } else {
+        u->sin_coef = sin_coef_fine;
+        u->sin_terms = sizeof(sin_coef_fine) / sizeof(sin_coef_fine[0]);
+        u->cos_coef = cos_coef_fine;
+        u->cos_terms = sizeof(cos_coef_fine) / sizeof(cos_coef_fine[0]);
+    }
+
+    u->measure = measure_scalar;
+#if defined(TWOLAME_X86_SIMD)
+    if (cpu & TWOLAME_CPU_AVX2)
+        u->measure = measure_avx2;
+    else if (cpu & TWOLAME_CPU_SSE2)
+        u->measure = measure_sse2;
+#elif defined(TWOLAME_NEON_SIMD)
+    if (cpu & TWOLAME_CPU_NEON)
+        u->measure = measure_neon;
+#endif
+}
+
+
+/* Unpredictability c[] of the spectrum (energy[], phi[]) of channel ch,
+   which then becomes the newest spectrum of its history */
+void twolame_unpredict(unpredict_mem * u, int ch, const FLOAT * energy, const FLOAT * phi,
+                       FLOAT * c)
+{
+    u->measure(u, ch, energy, phi, c);
+}
+
+
+// vim:ts=4:sw=4:nowrap:
@@ -0,0 +1,251 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2001-2004 Michael Cheng
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "twolame.h"
+#include "common.h"
+#include "mem.h"
+#include "worker.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+
+/*
+  A thread which runs the jobs of one encoder, one at a time: the
+  analysis of a frame is handed to it with twolame_worker_run(), and
+  twolame_worker_wait() returns once the job is done, so everything the
+  job wrote is visible to the caller afterwards.
+
+  Builds without POSIX threads can't start a worker, and
+  twolame_set_num_threads() only accepts a single thread there, while
+  twolame_run_threads() runs the jobs one after the other.
+*/
+#ifdef HAVE_PTHREAD_H
+
+struct twolame_worker_struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        // signalled when busy or quit change
+    worker_job job;
+    twolame_options *glopts;
+    frame_data *frame;
+    int busy;                   // a job has been handed over and is not done yet
+    int quit;
+};
+
+
+static void *worker_main(void *arg)
+{
+    twolame_worker *worker = (twolame_worker *) arg;
+
+    pthread_mutex_lock(&worker->lock);
+    for (;;) {
+        while (!worker->busy && !worker->quit)
+            pthread_cond_wait(&worker->cond, &worker->lock);
+        if (!worker->busy)
+            break;
+
+        pthread_mutex_unlock(&worker->lock);
+        worker->job(worker->glopts, worker->frame);
+        pthread_mutex_lock(&worker->lock);
+
+        worker->busy = 0;
+        pthread_cond_broadcast(&worker->cond);
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return NULL;
+}
+
+
+twolame_worker *twolame_worker_start(void)
+{
+    twolame_worker *worker = (twolame_worker *) TWOLAME_MALLOC(sizeof(twolame_worker));
+
+    if (!worker)
+        return NULL;
+
+    if (pthread_mutex_init(&worker->lock, NULL) != 0) {
+        TWOLAME_FREE(worker);
+        return NULL;
+    }
+    if (pthread_cond_init(&worker->cond, NULL) != 0) {
+        pthread_mutex_destroy(&worker->lock);
+        TWOLAME_FREE(worker);
+        return NULL;
+    }
+    if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+        pthread_cond_destroy(&worker->cond);
+        pthread_mutex_destroy(&worker->lock);
+        TWOLAME_FREE(worker);
+        return NULL;
+    }
+
+    return worker;
+}
+
+
+void twolame_worker_run(twolame_worker * worker, worker_job job, twolame_options * glopts,
+                        frame_data * frame)
+{
+    pthread_mutex_lock(&worker->lock);
+    worker->job = job;
+    worker->glopts = glopts;
+    worker->frame = frame;
+    worker->busy = 1;
+    pthread_cond_broadcast(&worker->cond);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+
+void twolame_worker_wait(twolame_worker * worker)
+{
+    pthread_mutex_lock(&worker->lock);
+    while (worker->busy)
+        pthread_cond_wait(&worker->cond, &worker->lock);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+
+/* Finish the job in progress, if any, and end the thread */
+void twolame_worker_stop(twolame_worker ** worker)
+{
+    twolame_worker *w;
+
+    if (worker == NULL || *worker == NULL)
+        return;
+    w = *worker;
+
+    pthread_mutex_lock(&w->lock);
+    w->quit = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+    TWOLAME_FREE(w);
+    *worker = NULL;
+}
+
+
+typedef struct {
+    thread_job job;
+    void *arg;
+    int index, num_threads;
+} thread_args;
+
+static void *thread_main(void *arg)
+{
+    thread_args *t = (thread_args *) arg;
+
+    t->job(t->arg, t->index, t->num_threads);
+    return NULL;
+}
+
+
+/*
+  Run job(arg, index, num_threads) for each index below num_threads
+  (at most MAX_THREADS) on as many threads, index 0 on the calling
+  thread, and return once all are done. The jobs of threads that
+  can't be started run on the calling thread.
+*/
+void twolame_run_threads(thread_job job, void *arg, int num_threads)
+{
+    pthread_t threads[MAX_THREADS];
+    thread_args args[MAX_THREADS];
+    int started[MAX_THREADS];
+    int i;
+
+    if (num_threads > MAX_THREADS)
+        num_threads = MAX_THREADS;
+
+    for (i = 1; i < num_threads; i++) {
+        args[i].job = job;
+        args[i].arg = arg;
+        args[i].index = i;
+        args[i].num_threads = num_threads;
+        started[i] = (pthread_create(&threads[i], NULL, thread_main, &args[i]) == 0);
+    }
+
+    job(arg, 0, num_threads);
+
+    for (i = 1; i < num_threads; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            job(arg, i, num_threads);
+    }
+}
+
+#else
+
+twolame_worker *twolame_worker_start(void)
+{
+    return NULL;
+}
+
+
+void twolame_worker_run(twolame_worker * worker, worker_job job, twolame_options * glopts,
+                        frame_data * frame)
+{
+    (void) worker;
+    job(glopts, frame);
+}
+
+
+void twolame_worker_wait(twolame_worker * worker)
+{
+    (void) worker;
+}
+
+
+void twolame_worker_stop(twolame_worker ** worker)
+{
+    if (worker != NULL)
+        *worker = NULL;
+}
+
+
+void twolame_run_threads(thread_job job, void *arg, int num_threads)
+{
+    int i;
+
+    if (num_threads > MAX_THREADS)
+        num_threads = MAX_THREADS;
+
+    for (i = 0; i < num_threads; i++)
+        job(arg, i, num_threads);
+}
+
+#endif
+
+
+// vim:ts=4:sw=4:nowrap:
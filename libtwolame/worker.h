@@ -0,0 +1,46 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2001-2004 Michael Cheng
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+
+
+#ifndef TWOLAME_WORKER_H
+#define TWOLAME_WORKER_H
+
+typedef void (*worker_job) (twolame_options * glopts, frame_data * frame);
+typedef void (*thread_job) (void *arg, int index, int num_threads);
+
+/* most threads twolame_run_threads() starts */
+#define MAX_THREADS     (16)
+
+twolame_worker *twolame_worker_start(void);
+void twolame_worker_run(twolame_worker * worker, worker_job job, twolame_options * glopts,
+                        frame_data * frame);
+void twolame_worker_wait(twolame_worker * worker);
+void twolame_worker_stop(twolame_worker ** worker);
+
+void twolame_run_threads(thread_job job, void *arg, int num_threads);
+
+#endif
+
+
+// vim:ts=4:sw=4:nowrap:
@@ -4,10 +4,12 @@ use warnings;
 use strict;
 
 use Digest::MD5 qw(md5_hex);
-use Test::More tests => 118;
+use File::Copy;
+use Test::More tests => 123;
 
 my $TWOLAME_CMD = $ENV{TWOLAME_CMD} || "../frontend/twolame";
 my $STWOLAME_CMD = $ENV{STWOLAME_CMD} || "../simplefrontend/stwolame";
+my $SINGLE_PRECISION = ($ENV{TWOLAME_SINGLE_PRECISION} || 'no') eq 'yes';
 die "Error: twolame command not found: $TWOLAME_CMD" unless (-e $TWOLAME_CMD);
 die "Error: stwolame command not found: $STWOLAME_CMD" unless (-e $STWOLAME_CMD);
 
@@ -183,7 +185,10 @@ foreach my $params (@$encoding_parameters) {
   is(filesize($OUTPUT_FILENAME), $params->{total_bytes}, , "[$count] file size of output file");
 
   if ($params->{output_md5sum}) {
-    is(md5_file($OUTPUT_FILENAME), $params->{output_md5sum}, "[$count] md5sum of output file");
+    SKIP: {
+      skip("output of single precision builds differs", 1) if $SINGLE_PRECISION;
+      is(md5_file($OUTPUT_FILENAME), $params->{output_md5sum}, "[$count] md5sum of output file");
+    }
   }
 
   $count++;
@@ -221,7 +226,10 @@ SKIP: {
   my $info = mpeg_audio_info($OUTPUT_FILENAME);
   is($info->{total_frames}, 22, "converting from STDIN - total number of frames");
   is($info->{total_bytes}, 13772, "converting from STDIN - total number of bytes");
-  is(md5_file($OUTPUT_FILENAME), '956f85e3647314750a1d3ed3fbf81ae3', "converting from STDIN - md5sum of output file");
+  SKIP: {
+    skip("output of single precision builds differs", 1) if $SINGLE_PRECISION;
+    is(md5_file($OUTPUT_FILENAME), '956f85e3647314750a1d3ed3fbf81ae3', "converting from STDIN - md5sum of output file");
+  }
 }
 
 
@@ -235,10 +243,37 @@ SKIP: {
   my $info = mpeg_audio_info($OUTPUT_FILENAME);
   is($info->{total_frames}, 22, "converting using simplefrontend - total number of frames");
   is($info->{total_bytes}, 13772, "converting using simplefrontend - total number of bytes");
-  is(md5_file($OUTPUT_FILENAME), '956f85e3647314750a1d3ed3fbf81ae3', "converting using simplefrontend - md5sum of output file");
+  SKIP: {
+    skip("output of single precision builds differs", 1) if $SINGLE_PRECISION;
+    is(md5_file($OUTPUT_FILENAME), '956f85e3647314750a1d3ed3fbf81ae3', "converting using simplefrontend - md5sum of output file");
+  }
 }
 
 
+# Test encoding a batch of files, named on the command line and in a list
+{
+  copy(input_filepath('testcase-44100.wav'), 'batch-44100.wav') or die "Copy failed: $!";
+  copy(input_filepath('testcase-22050.wav'), 'batch-22050.wav') or die "Copy failed: $!";
+  open(LIST, '>', 'batch.list') or die "Failed to create file: batch.list ($!)";
+  print LIST "batch-22050.wav\n";
+  close(LIST);
+
+  my $result = system("$TWOLAME_CMD --quiet --jobs 2 --file-list batch.list batch-44100.wav");
+  is($result, 0, "converting a batch - response code");
+
+  system("$TWOLAME_CMD --quiet batch-44100.wav testcase-single-44100.mp2");
+  system("$TWOLAME_CMD --quiet batch-22050.wav testcase-single-22050.mp2");
+  is(md5_file('batch-44100.mp2'), md5_file('testcase-single-44100.mp2'), "converting a batch - 44100 output same as on its own");
+  is(md5_file('batch-22050.mp2'), md5_file('testcase-single-22050.mp2'), "converting a batch - 22050 output same as on its own");
+
+  # more encoder options than arguments, grouped into one
+  $result = system("$TWOLAME_CMD --quiet -cpdEoa --file-list batch.list");
+  is($result, 0, "converting a batch with grouped options - response code");
+
+  system("$TWOLAME_CMD --quiet -cpdEoa batch-22050.wav testcase-single-22050.mp2");
+  is(md5_file('batch-22050.mp2'), md5_file('testcase-single-22050.mp2'), "converting a batch with grouped options - output same as on its own");
+}
+
 ## END OF TESTS ##
 
 sub input_filepath {
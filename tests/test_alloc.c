@@ -0,0 +1,201 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+  Check that encoding doesn't allocate any memory once
+  twolame_init_params() has returned.
+
+  The heap functions are replaced by counting wrappers around
+  the glibc allocator, so the test is skipped on other C libraries,
+  and with AddressSanitizer or ThreadSanitizer, which replace them
+  themselves.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "twolame.h"
+
+#define EXIT_SKIP       (77)
+
+#define NUM_SAMPLES     (20000)
+#define MP2_BUF_SIZE    (65536)
+
+
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define WITH_SANITIZER
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#define WITH_SANITIZER
+#endif
+#endif
+
+#if defined(__GLIBC__) && !defined(WITH_SANITIZER)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static long allocations = 0;
+
+void *malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    allocations++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+
+typedef struct {
+    const char *name;
+    int psymodel;
+    TWOLAME_MPEG_mode mode;
+    int samplerate;
+    int vbr;
+    int energy_levels;
+    int float_input;
+} test_case;
+
+static const test_case test_cases[] = {
+    {"psymodel -1", -1, TWOLAME_STEREO, 44100, FALSE, FALSE, FALSE},
+    {"psymodel 0", 0, TWOLAME_STEREO, 44100, FALSE, FALSE, FALSE},
+    {"psymodel 1", 1, TWOLAME_JOINT_STEREO, 44100, FALSE, FALSE, FALSE},
+    {"psymodel 2", 2, TWOLAME_STEREO, 48000, FALSE, FALSE, FALSE},
+    {"psymodel 3", 3, TWOLAME_STEREO, 44100, FALSE, TRUE, FALSE},
+    {"psymodel 4", 4, TWOLAME_JOINT_STEREO, 44100, FALSE, FALSE, TRUE},
+    {"psymodel 3 VBR", 3, TWOLAME_STEREO, 32000, TRUE, FALSE, FALSE},
+    {"psymodel 1 LSF mono", 1, TWOLAME_MONO, 22050, FALSE, FALSE, TRUE}
+};
+
+
+static short pcm16[NUM_SAMPLES * 2];
+static float pcm32[NUM_SAMPLES * 2];
+static unsigned char mp2buffer[MP2_BUF_SIZE];
+
+
+static long encode(const test_case * tc)
+{
+    twolame_options *opts = twolame_init();
+    long before, count;
+    int done = 0, chunk = 1;
+
+    twolame_set_num_channels(opts, 2);
+    twolame_set_in_samplerate(opts, tc->samplerate);
+    twolame_set_psymodel(opts, tc->psymodel);
+    twolame_set_mode(opts, tc->mode);
+    twolame_set_VBR(opts, tc->vbr);
+    twolame_set_energy_levels(opts, tc->energy_levels);
+    if (twolame_init_params(opts) != 0) {
+        twolame_close(&opts);
+        return -1;
+    }
+
+    before = allocations;
+    while (done < NUM_SAMPLES) {
+        int n = (chunk > NUM_SAMPLES - done) ? NUM_SAMPLES - done : chunk;
+        int bytes;
+
+        if (tc->float_input)
+            bytes = twolame_encode_buffer_float32_interleaved(opts, pcm32 + 2 * done, n,
+                                                              mp2buffer, MP2_BUF_SIZE);
+        else
+            bytes = twolame_encode_buffer_interleaved(opts, pcm16 + 2 * done, n,
+                                                      mp2buffer, MP2_BUF_SIZE);
+        if (bytes < 0) {
+            twolame_close(&opts);
+            return -1;
+        }
+        done += n;
+
+        // vary the amount of audio passed in each call
+        chunk = (chunk == 1152) ? 1 : (chunk * 7 + 5) % 1153;
+    }
+    if (twolame_encode_flush(opts, mp2buffer, MP2_BUF_SIZE) < 0) {
+        twolame_close(&opts);
+        return -1;
+    }
+    count = allocations - before;
+
+    twolame_close(&opts);
+    return count;
+}
+
+
+int main(void)
+{
+    int failed = 0;
+    unsigned int i;
+
+    for (i = 0; i < NUM_SAMPLES * 2; i++) {
+        double x = 0.5 * sin(i * 0.0123) + 0.25 * sin(i * 1.37);
+        pcm32[i] = (float) x;
+        pcm16[i] = (short) (x * 32767.0);
+    }
+
+    // make sure that the library really uses the counting allocator
+    {
+        long before = allocations;
+        twolame_options *opts = twolame_init();
+        twolame_close(&opts);
+        if (allocations == before) {
+            printf("heap allocations of libtwolame can't be counted\n");
+            return EXIT_SKIP;
+        }
+    }
+
+    for (i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+        long count = encode(&test_cases[i]);
+
+        if (count == 0) {
+            printf("ok: %s\n", test_cases[i].name);
+        } else if (count < 0) {
+            printf("FAIL: %s: encoding failed\n", test_cases[i].name);
+            failed = 1;
+        } else {
+            printf("FAIL: %s: %ld heap allocations while encoding\n", test_cases[i].name, count);
+            failed = 1;
+        }
+    }
+
+    return failed;
+}
+
+#else
+
+int main(void)
+{
+    printf("heap allocations can only be counted with glibc\n");
+    return EXIT_SKIP;
+}
+
+#endif
@@ -0,0 +1,253 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+  Check that each stream encoded a frame at a time with
+  twolame_encode_batch() is exactly the stream its encoder
+  gives on its own, on one thread and on several, also when
+  the buffer of some items was too short in one of the batches.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "twolame.h"
+
+#define NUM_FRAMES      (20)
+#define NUM_SAMPLES     (1152 * NUM_FRAMES + 700)
+#define CHUNK           (1000)
+#define MP2_BUF_SIZE    (65536)
+#define SHORT_FRAME     (5)
+
+
+typedef struct {
+    int psymodel;
+    int samplerate;
+    int channels;
+    int bitrate;                // 0 for VBR
+    int quickcount;             // 0 without quick mode
+    int num_threads;            // the encoder's own pipelining threads
+    int lead;                   // samples passed before the batches
+} stream_settings;
+
+static const stream_settings settings[] = {
+    {-1, 48000, 2, 64, 0, 1, 0},
+    {0, 32000, 1, 32, 0, 1, 0},
+    {1, 44100, 2, 128, 0, 1, 0},
+    {1, 48000, 2, 0, 0, 1, 0},
+    {2, 48000, 1, 48, 0, 1, 0},
+    {3, 24000, 2, 64, 0, 1, 0},
+    {3, 44100, 2, 96, 4, 1, 0},
+    {4, 48000, 2, 112, 0, 1, 0},
+    {4, 22050, 1, 0, 0, 1, 0},
+    {4, 48000, 2, 128, 0, 2, 0},
+    {3, 48000, 2, 64, 0, 1, 500},
+    {2, 32000, 2, 96, 0, 3, 700}
+};
+
+#define NUM_STREAMS ((int) (sizeof(settings) / sizeof(settings[0])))
+
+
+static short pcm[NUM_STREAMS][NUM_SAMPLES * 2];
+static unsigned char reference[MP2_BUF_SIZE];
+static unsigned char streams[NUM_STREAMS][MP2_BUF_SIZE];
+
+
+static twolame_options *setup(const stream_settings * s)
+{
+    twolame_options *opts = twolame_init();
+
+    if (opts == NULL)
+        return NULL;
+
+    twolame_set_num_channels(opts, s->channels);
+    twolame_set_mode(opts, s->channels == 1 ? TWOLAME_MONO : TWOLAME_STEREO);
+    twolame_set_in_samplerate(opts, s->samplerate);
+    twolame_set_psymodel(opts, s->psymodel);
+    if (s->bitrate)
+        twolame_set_bitrate(opts, s->bitrate);
+    else
+        twolame_set_VBR(opts, TRUE);
+    if (s->quickcount) {
+        twolame_set_quick_mode(opts, TRUE);
+        twolame_set_quick_count(opts, s->quickcount);
+    }
+    if (s->num_threads > 1 && twolame_set_num_threads(opts, s->num_threads) != 0)
+        twolame_set_num_threads(opts, 1);
+    twolame_set_verbosity(opts, 0);
+    if (twolame_init_params(opts) != 0) {
+        twolame_close(&opts);
+        return NULL;
+    }
+
+    return opts;
+}
+
+
+/* Encode a stream with its encoder on its own, returning the length of the stream or -1 */
+static int encode(int s)
+{
+    twolame_options *opts = setup(&settings[s]);
+    int channels = settings[s].channels;
+    int done, bytes = 0, n = 0;
+
+    if (opts == NULL)
+        return -1;
+
+    for (done = 0; done < NUM_SAMPLES && n >= 0; done += CHUNK) {
+        int chunk = (NUM_SAMPLES - done > CHUNK) ? CHUNK : NUM_SAMPLES - done;
+        n = twolame_encode_buffer_interleaved(opts, pcm[s] + channels * done, chunk,
+                                              reference + bytes, MP2_BUF_SIZE - bytes);
+        bytes += n;
+    }
+    if (n >= 0)
+        n = twolame_encode_flush(opts, reference + bytes, MP2_BUF_SIZE - bytes);
+
+    twolame_close(&opts);
+    return (n < 0) ? -1 : bytes + n;
+}
+
+
+/*
+  Encode all the streams into streams, a frame per batch, after their
+  lead samples and before the samples left over
+*/
+static int encode_batches(int num_threads, int stream_bytes[NUM_STREAMS])
+{
+    twolame_options *opts[NUM_STREAMS];
+    twolame_batch_item items[NUM_STREAMS];
+    int done[NUM_STREAMS];
+    int f, s, result = 0;
+
+    for (s = 0; s < NUM_STREAMS; s++) {
+        opts[s] = setup(&settings[s]);
+        if (opts[s] == NULL)
+            result = -1;
+        done[s] = 0;
+        stream_bytes[s] = 0;
+    }
+
+    for (s = 0; s < NUM_STREAMS && result == 0; s++) {
+        done[s] = settings[s].lead;
+        result = twolame_encode_buffer_interleaved(opts[s], pcm[s], done[s], streams[s],
+                                                   MP2_BUF_SIZE);
+        stream_bytes[s] = result;
+        if (result > 0)
+            result = 0;
+    }
+
+    for (f = 0; f < NUM_FRAMES && result == 0; f++) {
+        int n;
+
+        for (s = 0; s < NUM_STREAMS; s++) {
+            items[s].glopts = opts[s];
+            items[s].pcm = pcm[s] + settings[s].channels * done[s];
+            items[s].mp2buffer = streams[s] + stream_bytes[s];
+            items[s].mp2buffer_size = MP2_BUF_SIZE - stream_bytes[s];
+            // in one batch, give every other stream too little space for its frame
+            if (f == SHORT_FRAME && s % 2)
+                items[s].mp2buffer_size = 10;
+        }
+        n = twolame_encode_batch(items, NUM_STREAMS, num_threads);
+        if ((n < 0) != (f == SHORT_FRAME))
+            result = -1;
+
+        // the streams whose frame didn't fit pass it again in the next batch
+        for (s = 0; s < NUM_STREAMS && result == 0; s++) {
+            if (f == SHORT_FRAME && s % 2) {
+                if (items[s].mp2_bytes != TWOLAME_ERROR_BUFFER_FULL)
+                    result = -1;
+            } else if (items[s].mp2_bytes >= 0) {
+                stream_bytes[s] += items[s].mp2_bytes;
+                done[s] += 1152;
+            } else {
+                result = -1;
+            }
+        }
+    }
+
+    for (s = 0; s < NUM_STREAMS && result == 0; s++) {
+        int n = twolame_encode_buffer_interleaved(opts[s],
+                pcm[s] + settings[s].channels * done[s],
+                NUM_SAMPLES - done[s],
+                streams[s] + stream_bytes[s],
+                MP2_BUF_SIZE - stream_bytes[s]);
+        if (n >= 0) {
+            stream_bytes[s] += n;
+            n = twolame_encode_flush(opts[s], streams[s] + stream_bytes[s],
+                                     MP2_BUF_SIZE - stream_bytes[s]);
+        }
+        if (n < 0)
+            result = -1;
+        else
+            stream_bytes[s] += n;
+    }
+
+    for (s = 0; s < NUM_STREAMS; s++)
+        twolame_close(&opts[s]);
+    return result;
+}
+
+
+int main(void)
+{
+    static const int threads[] = { 1, 3, 16 };
+    int stream_bytes[NUM_STREAMS];
+    int failed = 0;
+    int t, s, i;
+
+    for (s = 0; s < NUM_STREAMS; s++) {
+        for (i = 0; i < NUM_SAMPLES * 2; i++) {
+            double x = 0.5 * sin(i * (0.0123 + 0.001 * s + 0.00001 * i)) + 0.25 * sin(i * 1.37);
+            pcm[s][i] = (short) (x * 32767.0 * (1.0 + sin(i * 0.0002 * (s + 1))) * 0.5);
+        }
+    }
+
+    // an empty batch has nothing to encode
+    if (twolame_encode_batch(NULL, 0, 4) != 0) {
+        printf("FAIL: an empty batch failed\n");
+        return 1;
+    }
+
+    for (t = 0; t < 3; t++) {
+        if (encode_batches(threads[t], stream_bytes) != 0) {
+            printf("FAIL: batches on %d threads failed\n", threads[t]);
+            return 1;
+        }
+        for (s = 0; s < NUM_STREAMS; s++) {
+            int bytes = encode(s);
+
+            if (bytes <= 0 || bytes != stream_bytes[s]
+                    || memcmp(streams[s], reference, bytes) != 0) {
+                printf("FAIL: batches on %d threads: stream %d differs\n", threads[t], s);
+                failed++;
+            }
+        }
+    }
+
+    if (failed)
+        return 1;
+
+    printf("ok: %d streams in batches\n", NUM_STREAMS);
+    return 0;
+}
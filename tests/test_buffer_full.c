@@ -0,0 +1,165 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+  Check that an output buffer too small for the frames of a call is
+  reported with TWOLAME_ERROR_BUFFER_FULL before anything is encoded:
+  passing the same samples again with a larger buffer must give
+  exactly the stream encoded without the error.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "twolame.h"
+
+#define NUM_SAMPLES     (1152 * 20 + 300)
+#define CHUNK           (1000)
+#define MP2_BUF_SIZE    (65536)
+#define SHORT_CALL      (10)    // call given a short buffer
+#define SHORT_SIZE      (100)
+
+
+typedef struct {
+    const char *name;
+    int bitrate;                // 0 for VBR
+    int padding;
+    int num_threads;
+} test_case;
+
+static const test_case test_cases[] = {
+    {"CBR", 192, FALSE, 1},
+    {"padded CBR", 128, TRUE, 1},
+    {"VBR", 0, FALSE, 1},
+    {"pipelined CBR", 192, FALSE, 2},
+    {"pipelined VBR", 0, FALSE, 3}
+};
+
+#define NUM_CASES   ((int) (sizeof(test_cases) / sizeof(test_cases[0])))
+
+
+static short pcm[NUM_SAMPLES * 2];
+static unsigned char reference[MP2_BUF_SIZE];
+static unsigned char stream[MP2_BUF_SIZE];
+
+
+static twolame_options *setup(const test_case * tc)
+{
+    twolame_options *opts = twolame_init();
+
+    if (opts == NULL)
+        return NULL;
+
+    twolame_set_num_channels(opts, 2);
+    twolame_set_in_samplerate(opts, 44100);
+    if (tc->bitrate)
+        twolame_set_bitrate(opts, tc->bitrate);
+    else
+        twolame_set_VBR(opts, TRUE);
+    if (tc->padding)
+        twolame_set_padding(opts, TWOLAME_PAD_ALL);
+    if (tc->num_threads > 1 && twolame_set_num_threads(opts, tc->num_threads) != 0)
+        twolame_set_num_threads(opts, 1);
+    twolame_set_verbosity(opts, 0);
+    if (twolame_init_params(opts) != 0) {
+        twolame_close(&opts);
+        return NULL;
+    }
+
+    return opts;
+}
+
+
+/*
+  Encode the test case into out, giving short buffers to the call
+  number short_call and to the flush when it isn't -1.
+  Returns the length of the stream or -1
+*/
+static int encode(const test_case * tc, int short_call, unsigned char *out)
+{
+    twolame_options *opts = setup(tc);
+    int call, done, bytes = 0, n = 0;
+
+    if (opts == NULL)
+        return -1;
+
+    for (call = 0, done = 0; done < NUM_SAMPLES && n >= 0; call++, done += CHUNK) {
+        int chunk = (NUM_SAMPLES - done > CHUNK) ? CHUNK : NUM_SAMPLES - done;
+
+        if (call == short_call) {
+            n = twolame_encode_buffer_interleaved(opts, pcm + 2 * done, chunk, out + bytes,
+                                                  SHORT_SIZE);
+            if (n != TWOLAME_ERROR_BUFFER_FULL) {
+                printf("FAIL: %s: short buffer gave %d\n", tc->name, n);
+                n = -1;
+                break;
+            }
+        }
+        n = twolame_encode_buffer_interleaved(opts, pcm + 2 * done, chunk, out + bytes,
+                                              MP2_BUF_SIZE - bytes);
+        bytes += n;
+    }
+    if (n >= 0 && short_call >= 0) {
+        n = twolame_encode_flush(opts, out + bytes, 1);
+        if (n != TWOLAME_ERROR_BUFFER_FULL) {
+            printf("FAIL: %s: short flush buffer gave %d\n", tc->name, n);
+            n = -1;
+        } else {
+            n = 0;
+        }
+    }
+    if (n >= 0)
+        n = twolame_encode_flush(opts, out + bytes, MP2_BUF_SIZE - bytes);
+
+    twolame_close(&opts);
+    return (n < 0) ? -1 : bytes + n;
+}
+
+
+int main(void)
+{
+    int failed = 0;
+    int c, i;
+
+    for (i = 0; i < NUM_SAMPLES * 2; i++) {
+        double x = 0.5 * sin(i * (0.0123 + 0.00001 * i)) + 0.25 * sin(i * 1.37);
+        pcm[i] = (short) (x * 32767.0 * (1.0 + sin(i * 0.0002)) * 0.5);
+    }
+
+    for (c = 0; c < NUM_CASES; c++) {
+        const test_case *tc = &test_cases[c];
+        int ref_bytes = encode(tc, -1, reference);
+        int bytes = encode(tc, SHORT_CALL, stream);
+
+        if (ref_bytes <= 0 || bytes != ref_bytes || memcmp(stream, reference, bytes) != 0) {
+            printf("FAIL: %s: stream differs after a short buffer\n", tc->name);
+            failed++;
+        }
+    }
+
+    if (failed)
+        return 1;
+
+    printf("ok: %d cases recovered from a short buffer\n", NUM_CASES);
+    return 0;
+}
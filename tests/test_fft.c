@@ -0,0 +1,224 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+  Check the real FFT of the psycho models against the Hartley
+  transform it replaces, check that batches of blocks give the same
+  results as single blocks, check the polynomial phase against atan2()
+  and compare how fast the transforms are.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "twolame.h"
+#include "common.h"
+#include "fft.h"
+
+#define NUM_BLOCKS  (50)
+#define BENCH_RUNS  (20000)
+#ifdef SINGLE_PRECISION
+#define TOLERANCE   (1e-5)
+#define PHASE_ROUNDING (1e-6)
+#else
+#define TOLERANCE   (1e-12)
+#define PHASE_ROUNDING (1e-12)
+#endif
+
+
+/* Windowed tones plus pseudo-random noise */
+static void test_block(FLOAT x[BLKSIZE], int block)
+{
+    static unsigned long seed = 1;
+    int i;
+
+    for (i = 0; i < BLKSIZE; i++) {
+        long n = (long) block * 576 + i;
+        double s = 0.5 * sin(n * 0.0123) + 0.2 * sin(n * 1.37 + block);
+
+        seed = seed * 1103515245 + 12345;
+        s += (((seed >> 16) & 0x7fff) - 16384.0) / 65536.0;
+        x[i] = s * 0.5 * (1.0 - cos(2.0 * PI * (i + 0.5) / BLKSIZE));
+    }
+}
+
+/* Transforms per second */
+static double bench(const fft_mem * fft)
+{
+    FLOAT input[BLKSIZE], x[BLKSIZE], energy[BLKSIZE];
+    clock_t start;
+    double seconds;
+    int run;
+
+    test_block(input, 0);
+    start = clock();
+    for (run = 0; run < BENCH_RUNS; run++) {
+        memcpy(x, input, sizeof(x));
+        twolame_psycho_1_fft(fft, x, energy, BLKSIZE);
+    }
+    seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    return (seconds > 0.0) ? BENCH_RUNS / seconds : 0.0;
+}
+
+/* Blocks per second, transformed FFT_BATCH at a time */
+static double bench_batch(const fft_mem * fft)
+{
+    static FLOAT input[FFT_BATCH][BLKSIZE], x[FFT_BATCH][BLKSIZE];
+    static FLOAT energy[FFT_BATCH][BLKSIZE], phi[FFT_BATCH][BLKSIZE];
+    clock_t start;
+    double seconds;
+    int run, b;
+
+    for (b = 0; b < FFT_BATCH; b++)
+        test_block(input[b], b);
+    start = clock();
+    for (run = 0; run < BENCH_RUNS / FFT_BATCH; run++) {
+        memcpy(x, input, sizeof(x));
+        twolame_psycho_2_fft_batch(fft, x, energy, phi, FFT_BATCH);
+    }
+    seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    return (seconds > 0.0) ? BENCH_RUNS / FFT_BATCH * FFT_BATCH / seconds : 0.0;
+}
+
+int main(void)
+{
+    static fft_mem hartley, fast, phase[3];
+    static const double phase_bound[3] = { 0.0, 1.4e-8, 1.2e-5 };
+    FLOAT x_hartley[BLKSIZE], x_fast[BLKSIZE];
+    FLOAT e_hartley[BLKSIZE], e_fast[BLKSIZE];
+    FLOAT phi_hartley[BLKSIZE], phi_fast[BLKSIZE];
+    static FLOAT x_batch[FFT_BATCH][BLKSIZE], x_single[BLKSIZE];
+    static FLOAT e_batch[FFT_BATCH][BLKSIZE], e_single[FFT_BATCH][BLKSIZE];
+    static FLOAT phi_batch[FFT_BATCH][BLKSIZE], phi_single[FFT_BATCH][BLKSIZE];
+    double maxdiff = 0.0, maxval = 0.0, maxphi = 0.0;
+    int batch_failed = 0, phase_failed = 0;
+    int block, i, level;
+
+    twolame_fft_init(&hartley, FALSE, 0);
+    twolame_fft_init(&fast, TRUE, 0);
+    for (level = 1; level <= 2; level++)
+        twolame_fft_init(&phase[level], FALSE, level);
+
+    for (block = 0; block < NUM_BLOCKS; block++) {
+        test_block(x_hartley, block);
+        memcpy(x_fast, x_hartley, sizeof(x_fast));
+
+        twolame_psycho_2_fft(&hartley, x_hartley, e_hartley, phi_hartley);
+        twolame_psycho_2_fft(&fast, x_fast, e_fast, phi_fast);
+
+        for (i = 0; i < BLKSIZE; i++) {
+            double diff = fabs(x_hartley[i] - x_fast[i]);
+            if (diff > maxdiff)
+                maxdiff = diff;
+            if (fabs(x_hartley[i]) > maxval)
+                maxval = fabs(x_hartley[i]);
+        }
+
+        /* only compare the phase of the components well above the rounding */
+        for (i = 1; i < 512; i++) {
+            if (e_hartley[i] > 1e-2) {
+                double diff = fabs(phi_hartley[i] - phi_fast[i]);
+                if (diff > PI)
+                    diff = fabs(diff - 2.0 * PI);
+                if (diff > maxphi)
+                    maxphi = diff;
+            }
+        }
+    }
+
+    /* transforming several blocks at once must give exactly the same results */
+    for (i = 0; i < 2 && !batch_failed; i++) {
+        const fft_mem *fft = i ? &fast : &hartley;
+        int n;
+
+        for (n = 1; n <= FFT_BATCH; n++) {
+            for (block = 0; block < n; block++) {
+                test_block(x_batch[block], block);
+                memcpy(x_single, x_batch[block], sizeof(x_single));
+                twolame_psycho_2_fft(fft, x_single, e_single[block], phi_single[block]);
+            }
+            twolame_psycho_2_fft_batch(fft, x_batch, e_batch, phi_batch, n);
+            if (memcmp(e_single, e_batch, n * sizeof(e_single[0])) != 0 ||
+                memcmp(phi_single, phi_batch, n * sizeof(phi_single[0])) != 0) {
+                printf("FAIL: batch of %d blocks differs from single blocks (%s)\n", n,
+                       i ? "real FFT" : "Hartley transform");
+                batch_failed = 1;
+                break;
+            }
+        }
+    }
+
+    /* the polynomial phase must be within its error bound of atan2() */
+    for (level = 1; level <= 2; level++) {
+        double maxerr = 0.0;
+        int energy_differs = 0;
+
+        for (block = 0; block < NUM_BLOCKS; block++) {
+            test_block(x_hartley, block);
+            memcpy(x_fast, x_hartley, sizeof(x_fast));
+            twolame_psycho_2_fft(&hartley, x_hartley, e_hartley, phi_hartley);
+            twolame_psycho_2_fft(&phase[level], x_fast, e_fast, phi_fast);
+
+            if (memcmp(e_hartley, e_fast, 513 * sizeof(FLOAT)) != 0)
+                energy_differs = 1;
+            for (i = 0; i <= 512; i++) {
+                double diff = fabs(phi_hartley[i] - phi_fast[i]);
+                if (diff > PI)
+                    diff = fabs(diff - 2.0 * PI);
+                if (diff > maxerr)
+                    maxerr = diff;
+            }
+        }
+
+        printf("phase level %d: largest error %g (bound %g)\n", level, maxerr,
+               phase_bound[level]);
+        if (energy_differs || !(maxerr <= phase_bound[level] + PHASE_ROUNDING)) {
+            printf("FAIL: phase level %d does not match atan2()\n", level);
+            phase_failed = 1;
+        }
+    }
+
+    if (!batch_failed)
+        printf("batches of 1 to %d blocks match single blocks\n", FFT_BATCH);
+    printf("largest coefficient:       %g\n", maxval);
+    printf("largest relative difference: %g (tolerance %g)\n", maxdiff / maxval, TOLERANCE);
+    printf("largest phase difference:    %g\n", maxphi);
+    printf("Hartley transform: %.0f transforms/s\n", bench(&hartley));
+    printf("real FFT:          %.0f transforms/s\n", bench(&fast));
+    printf("psycho 2 spectrum, Hartley transform: %.0f blocks/s\n", bench_batch(&hartley));
+    printf("psycho 2 spectrum, batched real FFT:  %.0f blocks/s\n", bench_batch(&fast));
+    for (level = 1; level <= 2; level++)
+        printf("psycho 2 spectrum, phase level %d:     %.0f blocks/s\n", level,
+               bench_batch(&phase[level]));
+
+    if (maxval < 1.0 || !(maxdiff <= TOLERANCE * maxval) || !(maxphi <= 1e3 * TOLERANCE)) {
+        printf("FAIL: real FFT does not match the Hartley transform\n");
+        return 1;
+    }
+    if (batch_failed || phase_failed)
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+  Check that 16-bit PCM audio widened to 32-bit and to packed 24-bit
+  samples encodes to exactly the same stream as the 16-bit samples,
+  through both the planar and the interleaved functions.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "twolame.h"
+
+#define NUM_SAMPLES     (1152 * 10 + 300)
+#define CHUNK           (1000)
+#define MP2_BUF_SIZE    (65536)
+
+
+typedef enum {
+    FORMAT_S16_INTERLEAVED,
+    FORMAT_S16,
+    FORMAT_S32,
+    FORMAT_S32_INTERLEAVED,
+    FORMAT_S24_PACKED,
+    FORMAT_S24_PACKED_INTERLEAVED,
+    NUM_FORMATS
+} input_format;
+
+static const char *format_names[NUM_FORMATS] = {
+    "s16 interleaved", "s16", "s32", "s32 interleaved", "s24 packed", "s24 packed interleaved"
+};
+
+typedef struct {
+    int channels;
+    int samplerate;
+    int bitrate;
+    int psymodel;
+} test_case;
+
+static const test_case test_cases[] = {
+    {2, 44100, 192, 3},
+    {2, 48000, 128, 4},
+    {1, 32000, 64, 1}
+};
+
+#define NUM_CASES   ((int) (sizeof(test_cases) / sizeof(test_cases[0])))
+
+
+static short pcm[NUM_SAMPLES * 2];
+static short pcm_planar[2][NUM_SAMPLES];
+static int pcm_s32[NUM_SAMPLES * 2];
+static int pcm_s32_planar[2][NUM_SAMPLES];
+static unsigned char pcm_s24[NUM_SAMPLES * 2 * 3];
+static unsigned char pcm_s24_planar[2][NUM_SAMPLES * 3];
+static unsigned char reference[MP2_BUF_SIZE];
+static unsigned char stream[MP2_BUF_SIZE];
+
+
+/* Store a sample as signed 24-bit little-endian in 3 bytes */
+static void pack_s24(unsigned char *out, long sample)
+{
+    out[0] = (unsigned char) (sample & 0xff);
+    out[1] = (unsigned char) ((sample >> 8) & 0xff);
+    out[2] = (unsigned char) ((sample >> 16) & 0xff);
+}
+
+
+/* Widen the interleaved 16-bit samples of nch channels to the other formats */
+static void widen_samples(int nch)
+{
+    int i, ch;
+
+    for (i = 0; i < NUM_SAMPLES; i++) {
+        for (ch = 0; ch < nch; ch++) {
+            int n = i * nch + ch;
+            long s24 = (long) pcm[n] * 256;
+
+            pcm_planar[ch][i] = pcm[n];
+            pcm_s32[n] = pcm_s32_planar[ch][i] = (int) ((long) pcm[n] * 65536);
+            pack_s24(&pcm_s24[3 * n], s24);
+            pack_s24(&pcm_s24_planar[ch][3 * i], s24);
+        }
+    }
+}
+
+
+/* Pass num_samples samples from offset of the audio in a format to the encoder */
+static int encode_chunk(twolame_options * opts, input_format format, int nch, int offset,
+                        int num_samples, unsigned char *mp2buffer, int mp2buffer_size)
+{
+    int right = (nch == 2) ? 1 : 0;
+
+    switch (format) {
+    case FORMAT_S16_INTERLEAVED:
+        return twolame_encode_buffer_interleaved(opts, pcm + offset * nch, num_samples,
+                                                 mp2buffer, mp2buffer_size);
+    case FORMAT_S16:
+        return twolame_encode_buffer(opts, pcm_planar[0] + offset, pcm_planar[right] + offset,
+                                     num_samples, mp2buffer, mp2buffer_size);
+    case FORMAT_S32:
+        return twolame_encode_buffer_s32(opts, pcm_s32_planar[0] + offset,
+                                         pcm_s32_planar[right] + offset, num_samples,
+                                         mp2buffer, mp2buffer_size);
+    case FORMAT_S32_INTERLEAVED:
+        return twolame_encode_buffer_s32_interleaved(opts, pcm_s32 + offset * nch, num_samples,
+                                                     mp2buffer, mp2buffer_size);
+    case FORMAT_S24_PACKED:
+        return twolame_encode_buffer_s24_packed(opts, pcm_s24_planar[0] + 3 * offset,
+                                                pcm_s24_planar[right] + 3 * offset,
+                                                num_samples, mp2buffer, mp2buffer_size);
+    case FORMAT_S24_PACKED_INTERLEAVED:
+        return twolame_encode_buffer_s24_packed_interleaved(opts, pcm_s24 + 3 * offset * nch,
+                                                            num_samples, mp2buffer,
+                                                            mp2buffer_size);
+    default:
+        return -1;
+    }
+}
+
+
+/* Encode the test case from the audio in a format, returning the length of the stream or -1 */
+static int encode(const test_case * tc, input_format format, unsigned char *out)
+{
+    twolame_options *opts = twolame_init();
+    int done, bytes = 0, n = 0;
+
+    if (opts == NULL)
+        return -1;
+
+    twolame_set_num_channels(opts, tc->channels);
+    twolame_set_mode(opts, tc->channels == 1 ? TWOLAME_MONO : TWOLAME_STEREO);
+    twolame_set_in_samplerate(opts, tc->samplerate);
+    twolame_set_bitrate(opts, tc->bitrate);
+    twolame_set_psymodel(opts, tc->psymodel);
+    twolame_set_verbosity(opts, 0);
+    if (twolame_init_params(opts) != 0) {
+        twolame_close(&opts);
+        return -1;
+    }
+
+    for (done = 0; done < NUM_SAMPLES && n >= 0; done += CHUNK) {
+        int chunk = (NUM_SAMPLES - done > CHUNK) ? CHUNK : NUM_SAMPLES - done;
+        n = encode_chunk(opts, format, tc->channels, done, chunk, out + bytes,
+                         MP2_BUF_SIZE - bytes);
+        bytes += n;
+    }
+    if (n >= 0)
+        n = twolame_encode_flush(opts, out + bytes, MP2_BUF_SIZE - bytes);
+
+    twolame_close(&opts);
+    return (n < 0) ? -1 : bytes + n;
+}
+
+
+int main(void)
+{
+    int failed = 0;
+    int c, f, i;
+
+    for (i = 0; i < NUM_SAMPLES * 2; i++) {
+        double x = 0.6 * sin(i * (0.0123 + 0.00001 * i)) + 0.5 * sin(i * 1.37);
+        if (x > 1.0)
+            pcm[i] = 32767;
+        else if (x < -1.0)
+            pcm[i] = -32768;
+        else
+            pcm[i] = (short) (x * 32767.0);
+    }
+
+    for (c = 0; c < NUM_CASES; c++) {
+        const test_case *tc = &test_cases[c];
+        int ref_bytes;
+
+        widen_samples(tc->channels);
+        ref_bytes = encode(tc, FORMAT_S16_INTERLEAVED, reference);
+        if (ref_bytes <= 0) {
+            printf("FAIL: %d channels at %d Hz: encoding failed\n", tc->channels,
+                   tc->samplerate);
+            return 1;
+        }
+
+        for (f = FORMAT_S16; f < NUM_FORMATS; f++) {
+            int bytes = encode(tc, (input_format) f, stream);
+
+            if (bytes != ref_bytes || memcmp(stream, reference, bytes) != 0) {
+                printf("FAIL: %d channels at %d Hz: %s input differs from 16-bit input\n",
+                       tc->channels, tc->samplerate, format_names[f]);
+                failed++;
+            }
+        }
+    }
+
+    if (failed)
+        return 1;
+
+    printf("ok: %d cases in %d input formats\n", NUM_CASES, NUM_FORMATS);
+    return 0;
+}
@@ -0,0 +1,637 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+  Audio quality regression test.
+
+  Encodes the test case WAV files with libtwolame, decodes the result
+  with the small Layer II decoder below, and checks that the signal to
+  noise ratio of every channel is no worse than that of the reference
+  double precision build (minus a small margin). Builds that change the
+  arithmetic of the encoder, such as --enable-float, must keep passing.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "twolame.h"
+
+/* the analysis window of the encoder, in double precision */
+#define FLOAT double
+#include "enwindow.h"
+
+
+#define MAX_DELAY       (1152)
+#define SNR_MARGIN      (0.5)
+
+#ifndef M_PI
+#define M_PI            3.14159265358979323846
+#endif
+
+
+typedef struct {
+    const char *filename;
+    int bitrate;
+    TWOLAME_MPEG_mode mode;
+    int psymodel;
+    double min_snr[2];          // SNR of each channel in the double build
+} test_case;
+
+static const char *mode_names[] = { "stereo", "joint stereo", "dual channel", "mono" };
+
+static const test_case test_cases[] = {
+    {"testcase-44100.wav", 192, TWOLAME_STEREO, 3, {19.27, 21.63}},
+    {"testcase-44100.wav", 256, TWOLAME_STEREO, 1, {25.61, 28.16}},
+    {"testcase-44100.wav", 128, TWOLAME_JOINT_STEREO, 4, {13.07, 13.15}},
+    {"testcase-44100.wav", 64, TWOLAME_MONO, 0, {19.81, 0.0}},
+    {"testcase-22050.wav", 96, TWOLAME_STEREO, 2, {14.75, 17.48}},
+    {"testcase-float32.wav", 192, TWOLAME_STEREO, 3, {19.27, 21.63}}
+};
+
+
+
+/***************************************************************************************
+ WAV input
+****************************************************************************************/
+
+typedef struct {
+    int channels;
+    int samplerate;
+    int is_float;
+    long num_samples;           // per channel
+    short *pcm16;               // interleaved input, one of these is set
+    float *pcm32;
+    double *ref[2];             // de-interleaved reference signal, full scale = 1.0
+} wav_file;
+
+static unsigned long le32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | ((unsigned long) p[2] << 16) | ((unsigned long) p[3] << 24);
+}
+
+static unsigned int le16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static int read_wav(const char *filename, wav_file * wav)
+{
+    unsigned char *data = NULL, *fmt = NULL, *pcm = NULL;
+    unsigned long size, pos, chunk_size, pcm_size = 0;
+    int bits = 0, format = 0;
+    long i;
+    int ch;
+    FILE *file;
+
+    memset(wav, 0, sizeof(wav_file));
+
+    file = fopen(filename, "rb");
+    if (file == NULL) {
+        perror(filename);
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = malloc(size);
+    if (data == NULL || fread(data, 1, size, file) != size) {
+        fprintf(stderr, "%s: failed to read file\n", filename);
+        fclose(file);
+        free(data);
+        return -1;
+    }
+    fclose(file);
+
+    if (size < 12 || memcmp(data, "RIFF", 4) || memcmp(data + 8, "WAVE", 4)) {
+        fprintf(stderr, "%s: not a WAV file\n", filename);
+        free(data);
+        return -1;
+    }
+
+    for (pos = 12; pos + 8 <= size; pos += 8 + chunk_size + (chunk_size & 1)) {
+        chunk_size = le32(data + pos + 4);
+        if (pos + 8 + chunk_size > size)
+            chunk_size = size - pos - 8;
+        if (!memcmp(data + pos, "fmt ", 4) && chunk_size >= 16) {
+            fmt = data + pos + 8;
+        } else if (!memcmp(data + pos, "data", 4)) {
+            pcm = data + pos + 8;
+            pcm_size = chunk_size;
+        }
+    }
+
+    if (fmt) {
+        format = le16(fmt);
+        wav->channels = le16(fmt + 2);
+        wav->samplerate = le32(fmt + 4);
+        bits = le16(fmt + 14);
+    }
+    if (!pcm || wav->channels < 1 || wav->channels > 2 ||
+            !((format == 1 && bits == 16) || (format == 3 && bits == 32))) {
+        fprintf(stderr, "%s: unsupported WAV format\n", filename);
+        free(data);
+        return -1;
+    }
+
+    wav->is_float = (format == 3);
+    wav->num_samples = pcm_size / (bits / 8) / wav->channels;
+    for (ch = 0; ch < wav->channels; ch++)
+        wav->ref[ch] = malloc(wav->num_samples * sizeof(double));
+    if (wav->is_float)
+        wav->pcm32 = malloc(wav->num_samples * wav->channels * sizeof(float));
+    else
+        wav->pcm16 = malloc(wav->num_samples * wav->channels * sizeof(short));
+
+    for (i = 0; i < wav->num_samples * wav->channels; i++) {
+        ch = i % wav->channels;
+        if (wav->is_float) {
+            union {
+                unsigned long u;
+                float f;
+            } v;
+            v.u = le32(pcm + 4 * i);
+            wav->pcm32[i] = v.f;
+            wav->ref[ch][i / wav->channels] = v.f;
+        } else {
+            wav->pcm16[i] = (short) le16(pcm + 2 * i);
+            wav->ref[ch][i / wav->channels] = wav->pcm16[i] / 32768.0;
+        }
+    }
+
+    free(data);
+    return 0;
+}
+
+static void free_wav(wav_file * wav)
+{
+    free(wav->pcm16);
+    free(wav->pcm32);
+    free(wav->ref[0]);
+    free(wav->ref[1]);
+}
+
+
+
+/***************************************************************************************
+ Layer II decoder (ISO 11172-3 / ISO 13818-3)
+****************************************************************************************/
+
+static const int bitrate_table[2][15] = {
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+    {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384}
+};
+
+static const int samplerate_table[2][3] = {
+    {22050, 24000, 16000},
+    {44100, 48000, 32000}
+};
+
+/* Bit allocation tables: see Annex B of the standards */
+static const int step_index[9][16] = {
+    {0, 1, 3, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 17},
+    {0, 1, 2, 3, 4, 5, 6, 17, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 2, 17, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16},
+    {0, 1, 2, 4, 5, 6, 7, 8, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {0, 1, 2, 4, 5, 6, 7, 8, 0, 0, 0, 0, 0, 0, 0, 0},
+    {0, 1, 2, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
+};
+
+static const int nbal[9] = { 4, 4, 3, 2, 4, 3, 4, 3, 2 };
+
+static const int steps[18] =
+    { 0, 3, 5, 7, 9, 15, 31, 63, 127, 255, 511, 1023, 2047, 4095, 8191, 16383, 32767, 65535 };
+static const int steps2n[18] =
+    { 0, 2, 4, 4, 8, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768 };
+static const int bits[18] = { 0, 5, 7, 3, 10, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+static const int grouped[18] = { 0, 1, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+static const double qa[18] = {
+    0, 0.750000000, 0.625000000, 0.875000000, 0.562500000, 0.937500000,
+    0.968750000, 0.984375000, 0.992187500, 0.996093750, 0.998046875,
+    0.999023438, 0.999511719, 0.999755859, 0.999877930, 0.999938965,
+    0.999969482, 0.999984741
+};
+
+static const int table_sblimit[5] = { 27, 30, 8, 12, 30 };
+
+static const int line[5][32] = {
+    {0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, -1, -1, -1,
+     -1, -1},
+    {0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, -1,
+     -1},
+    {4, 4, 5, 5, 5, 5, 5, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     -1, -1, -1, -1, -1, -1, -1},
+    {4, 4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+     -1, -1, -1, -1, -1, -1},
+    {6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8}
+};
+
+typedef struct {
+    const unsigned char *buf;
+    long size;                  // in bytes
+    long pos;                   // in bits
+} bit_reader;
+
+static unsigned int getbits(bit_reader * br, int n)
+{
+    unsigned int v = 0;
+
+    while (n--) {
+        int bit = 0;
+        if (br->pos < br->size * 8)
+            bit = (br->buf[br->pos >> 3] >> (7 - (br->pos & 7))) & 1;
+        br->pos++;
+        v = (v << 1) | bit;
+    }
+    return v;
+}
+
+typedef struct {
+    double v[2][1024];
+    double d[512];              // synthesis window
+    double n[64][32];           // synthesis matrix
+} synth_state;
+
+static void synth_init(synth_state * st)
+{
+    int i, k;
+
+    memset(st, 0, sizeof(synth_state));
+    for (i = 0; i < 64; i++)
+        for (k = 0; k < 32; k++)
+            st->n[i][k] = cos((16 + i) * (2 * k + 1) * M_PI / 64.0);
+
+    /* the synthesis window D[] of the standard is 32 times its analysis window */
+    for (i = 0; i < 512; i++)
+        st->d[i] = 32.0 * enwindow[i];
+}
+
+static void synth_block(synth_state * st, int ch, const double s[32], double *out)
+{
+    double *v = st->v[ch];
+    double u[512];
+    int i, j, k;
+
+    memmove(v + 64, v, 960 * sizeof(double));
+    for (i = 0; i < 64; i++) {
+        double t = 0.0;
+        for (k = 0; k < 32; k++)
+            t += st->n[i][k] * s[k];
+        v[i] = t;
+    }
+    for (i = 0; i < 8; i++)
+        for (j = 0; j < 32; j++) {
+            u[i * 64 + j] = v[i * 128 + j];
+            u[i * 64 + 32 + j] = v[i * 128 + 96 + j];
+        }
+    for (j = 0; j < 32; j++) {
+        double t = 0.0;
+        for (i = 0; i < 16; i++)
+            t += u[j + 32 * i] * st->d[j + 32 * i];
+        out[j] = t;
+    }
+}
+
+/* requantize a sample code, see the C and D constants in Annex B of the standards */
+static double dequantize(int code, int q)
+{
+    int n = steps2n[q];
+    int sig = (code >= n);
+    double d = (double) (sig ? code - n : code) / n - (sig ? 0.0 : 1.0);
+
+    return (d + 1.0 - (steps[q] - 1) / (2.0 * n)) / qa[q];
+}
+
+/*
+  Decode an MPEG Audio Layer II stream into pcm[ch], returning the
+  number of samples per channel or -1 if the stream is invalid.
+*/
+static long decode_mp2(const unsigned char *mp2, long mp2_size, int channels,
+                       double *pcm[2], long max_samples)
+{
+    static synth_state st;
+    long offset = 0, num_samples = 0;
+
+    synth_init(&st);
+
+    while (offset + 4 <= mp2_size) {
+        unsigned int alloc[2][32], scfsi[2][32], sf[2][32][3];
+        double sample[2][3][32];
+        bit_reader br;
+        int id, prot, bri, sfi, pad, mode, modeext, nch;
+        int bitrate, samplerate, tablenum, sblimit, jsbound;
+        int sb, ch, gr, j, k;
+        long frame_size;
+
+        br.buf = mp2 + offset;
+        br.size = mp2_size - offset;
+        br.pos = 0;
+
+        if (getbits(&br, 12) != 0xfff) {
+            fprintf(stderr, "decoder: lost sync at byte %ld\n", offset);
+            return -1;
+        }
+        id = getbits(&br, 1);
+        if (getbits(&br, 2) != 2) {
+            fprintf(stderr, "decoder: not Layer II\n");
+            return -1;
+        }
+        prot = getbits(&br, 1);
+        bri = getbits(&br, 4);
+        sfi = getbits(&br, 2);
+        pad = getbits(&br, 1);
+        getbits(&br, 1);        // private
+        mode = getbits(&br, 2);
+        modeext = getbits(&br, 2);
+        getbits(&br, 4);        // copyright, original, emphasis
+        if (!prot)
+            getbits(&br, 16);   // CRC
+
+        if (bri == 0 || bri == 15 || sfi == 3) {
+            fprintf(stderr, "decoder: invalid header\n");
+            return -1;
+        }
+        nch = (mode == TWOLAME_MONO) ? 1 : 2;
+        if (nch != channels) {
+            fprintf(stderr, "decoder: unexpected number of channels\n");
+            return -1;
+        }
+        bitrate = bitrate_table[id][bri];
+        samplerate = samplerate_table[id][sfi];
+        frame_size = 144000L * bitrate / samplerate + pad;
+
+        if (id == 1) {
+            int br_per_ch = bitrate / nch;
+            int sfrq = samplerate / 1000;
+            if ((sfrq == 48 && br_per_ch >= 56) || (br_per_ch >= 56 && br_per_ch <= 80))
+                tablenum = 0;
+            else if (sfrq != 48 && br_per_ch >= 96)
+                tablenum = 1;
+            else if (sfrq != 32 && br_per_ch <= 48)
+                tablenum = 2;
+            else
+                tablenum = 3;
+        } else {
+            tablenum = 4;
+        }
+        sblimit = table_sblimit[tablenum];
+        jsbound = (mode == TWOLAME_JOINT_STEREO) ? (modeext + 1) * 4 : sblimit;
+
+        memset(alloc, 0, sizeof(alloc));
+        for (sb = 0; sb < sblimit; sb++) {
+            int nb = nbal[line[tablenum][sb]];
+            if (sb < jsbound) {
+                for (ch = 0; ch < nch; ch++)
+                    alloc[ch][sb] = getbits(&br, nb);
+            } else {
+                alloc[0][sb] = alloc[1][sb] = getbits(&br, nb);
+            }
+        }
+
+        for (sb = 0; sb < sblimit; sb++)
+            for (ch = 0; ch < nch; ch++)
+                if (alloc[ch][sb])
+                    scfsi[ch][sb] = getbits(&br, 2);
+
+        for (sb = 0; sb < sblimit; sb++)
+            for (ch = 0; ch < nch; ch++)
+                if (alloc[ch][sb]) {
+                    switch (scfsi[ch][sb]) {
+                    case 0:
+                        sf[ch][sb][0] = getbits(&br, 6);
+                        sf[ch][sb][1] = getbits(&br, 6);
+                        sf[ch][sb][2] = getbits(&br, 6);
+                        break;
+                    case 1:
+                        sf[ch][sb][0] = sf[ch][sb][1] = getbits(&br, 6);
+                        sf[ch][sb][2] = getbits(&br, 6);
+                        break;
+                    case 2:
+                        sf[ch][sb][0] = sf[ch][sb][1] = sf[ch][sb][2] = getbits(&br, 6);
+                        break;
+                    case 3:
+                        sf[ch][sb][0] = getbits(&br, 6);
+                        sf[ch][sb][1] = sf[ch][sb][2] = getbits(&br, 6);
+                        break;
+                    }
+                }
+
+        for (gr = 0; gr < 12; gr++) {
+            memset(sample, 0, sizeof(sample));
+            for (sb = 0; sb < sblimit; sb++)
+                for (ch = 0; ch < ((sb < jsbound) ? nch : 1); ch++) {
+                    int q = step_index[line[tablenum][sb]][alloc[ch][sb]];
+                    int code[3];
+                    if (!alloc[ch][sb])
+                        continue;
+                    if (grouped[q]) {
+                        int c = getbits(&br, bits[q]);
+                        for (j = 0; j < 3; j++) {
+                            code[j] = c % steps[q];
+                            c /= steps[q];
+                        }
+                    } else {
+                        for (j = 0; j < 3; j++)
+                            code[j] = getbits(&br, bits[q]);
+                    }
+                    for (j = 0; j < 3; j++) {
+                        double x = dequantize(code[j], q);
+                        for (k = ch; k < ((sb < jsbound) ? ch + 1 : nch); k++)
+                            sample[k][j][sb] = x * 2.0 * pow(2.0, -(sf[k][sb][gr / 4] / 3.0));
+                    }
+                }
+
+            for (j = 0; j < 3; j++) {
+                if (num_samples + 32 > max_samples)
+                    return num_samples;
+                for (ch = 0; ch < nch; ch++)
+                    synth_block(&st, ch, sample[ch][j], pcm[ch] + num_samples);
+                num_samples += 32;
+            }
+        }
+
+        if (br.pos > frame_size * 8) {
+            fprintf(stderr, "decoder: frame overflow\n");
+            return -1;
+        }
+        offset += frame_size;
+    }
+
+    return num_samples;
+}
+
+
+
+/***************************************************************************************
+ Encoding and measurement
+****************************************************************************************/
+
+static long encode(const test_case * tc, const wav_file * wav, unsigned char **mp2)
+{
+    twolame_options *opts = twolame_init();
+    long size = 0, capacity = wav->num_samples + 65536;
+    long done = 0;
+    int bytes;
+
+    *mp2 = malloc(capacity);
+
+    twolame_set_num_channels(opts, wav->channels);
+    twolame_set_in_samplerate(opts, wav->samplerate);
+    twolame_set_out_samplerate(opts, wav->samplerate);
+    twolame_set_bitrate(opts, tc->bitrate);
+    twolame_set_mode(opts, tc->mode);
+    twolame_set_psymodel(opts, tc->psymodel);
+    if (twolame_init_params(opts) != 0) {
+        twolame_close(&opts);
+        return -1;
+    }
+
+    while (done < wav->num_samples) {
+        int n = 1152;
+        if (n > wav->num_samples - done)
+            n = wav->num_samples - done;
+        if (wav->is_float)
+            bytes = twolame_encode_buffer_float32_interleaved(opts,
+                                                              wav->pcm32 + done * wav->channels,
+                                                              n, *mp2 + size, capacity - size);
+        else
+            bytes = twolame_encode_buffer_interleaved(opts, wav->pcm16 + done * wav->channels,
+                                                      n, *mp2 + size, capacity - size);
+        if (bytes < 0) {
+            twolame_close(&opts);
+            return -1;
+        }
+        size += bytes;
+        done += n;
+    }
+    bytes = twolame_encode_flush(opts, *mp2 + size, capacity - size);
+    twolame_close(&opts);
+    if (bytes < 0)
+        return -1;
+
+    return size + bytes;
+}
+
+/* SNR in dB of the decoded signal, at the delay that fits it best */
+static double measure_snr(const double *ref, long ref_len, const double *dec, long dec_len)
+{
+    double best = -1000.0;
+    long delay, i;
+
+    for (delay = 0; delay < MAX_DELAY; delay++) {
+        double sig = 0.0, noise = 0.0;
+        for (i = MAX_DELAY; i < ref_len - MAX_DELAY && i + delay < dec_len; i++) {
+            double e = dec[i + delay] - ref[i];
+            sig += ref[i] * ref[i];
+            noise += e * e;
+        }
+        if (sig > 0.0 && noise > 0.0 && 10.0 * log10(sig / noise) > best)
+            best = 10.0 * log10(sig / noise);
+    }
+
+    return best;
+}
+
+static int run_test(const char *srcdir, const test_case * tc)
+{
+    char filename[4096];
+    wav_file wav;
+    unsigned char *mp2 = NULL;
+    double *pcm[2] = { NULL, NULL };
+    long mp2_size, max_samples, num_samples;
+    int channels, ch, failed = 0;
+
+    snprintf(filename, sizeof(filename), "%s/%s", srcdir, tc->filename);
+    if (read_wav(filename, &wav) != 0)
+        return 1;
+
+    mp2_size = encode(tc, &wav, &mp2);
+    if (mp2_size <= 0) {
+        printf("FAIL: %s: encoding failed\n", tc->filename);
+        free(mp2);
+        free_wav(&wav);
+        return 1;
+    }
+
+    channels = (tc->mode == TWOLAME_MONO) ? 1 : 2;
+    max_samples = wav.num_samples + 2 * MAX_DELAY;
+    for (ch = 0; ch < channels; ch++)
+        pcm[ch] = calloc(max_samples, sizeof(double));
+
+    num_samples = decode_mp2(mp2, mp2_size, channels, pcm, max_samples);
+    if (num_samples < wav.num_samples) {
+        printf("FAIL: %s: decoding failed\n", tc->filename);
+        failed = 1;
+        channels = 0;
+    }
+
+    for (ch = 0; ch < channels; ch++) {
+        const double *ref = wav.ref[ch];
+        double snr;
+
+        /* a mono encoding is a downmix of both channels */
+        if (channels == 1 && wav.channels == 2) {
+            long i;
+            double *mix = malloc(wav.num_samples * sizeof(double));
+            for (i = 0; i < wav.num_samples; i++)
+                mix[i] = (wav.ref[0][i] + wav.ref[1][i]) / 2.0;
+            snr = measure_snr(mix, wav.num_samples, pcm[ch], num_samples);
+            free(mix);
+        } else {
+            snr = measure_snr(ref, wav.num_samples, pcm[ch], num_samples);
+        }
+
+        printf("%s, %d kbps, %s, psymodel %d, channel %d: SNR %.2f dB (reference %.2f dB)\n",
+               tc->filename, tc->bitrate, mode_names[tc->mode],
+               tc->psymodel, ch, snr, tc->min_snr[ch]);
+        if (!(snr >= tc->min_snr[ch] - SNR_MARGIN)) {
+            printf("FAIL: SNR is more than %.1f dB below the reference\n", SNR_MARGIN);
+            failed = 1;
+        }
+    }
+
+    free(pcm[0]);
+    free(pcm[1]);
+    free(mp2);
+    free_wav(&wav);
+    return failed;
+}
+
+
+int main(void)
+{
+    const char *srcdir = getenv("srcdir");
+    int failed = 0;
+    unsigned int i;
+
+    if (srcdir == NULL)
+        srcdir = ".";
+
+    for (i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++)
+        failed |= run_test(srcdir, &test_cases[i]);
+
+    return failed;
+}
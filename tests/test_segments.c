@@ -0,0 +1,177 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+  Check that a stream encoded in segments with
+  twolame_encode_segments_interleaved() is exactly the stream
+  encoded in one go, at the boundaries of the segments too.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "twolame.h"
+
+#define NUM_SAMPLES     (1152 * 40 + 700)
+#define MP2_BUF_SIZE    (65536 * 2)
+
+
+typedef struct {
+    const char *name;
+    int psymodel;
+    TWOLAME_MPEG_mode mode;
+    int samplerate;
+    int bitrate;                // 0 for VBR
+    int padding;
+    int quickcount;             // 0 without quick mode
+    int extras;                 // non-default header, ancillary and model settings
+} test_case;
+
+static const test_case test_cases[] = {
+    {"psymodel -1", -1, TWOLAME_STEREO, 48000, 192, FALSE, 0, FALSE},
+    {"psymodel 0", 0, TWOLAME_STEREO, 48000, 192, FALSE, 0, FALSE},
+    {"psymodel 1 padding", 1, TWOLAME_JOINT_STEREO, 44100, 128, TRUE, 0, FALSE},
+    {"psymodel 2", 2, TWOLAME_STEREO, 32000, 256, FALSE, 0, FALSE},
+    {"psymodel 3 quick", 3, TWOLAME_STEREO, 44100, 192, TRUE, 4, FALSE},
+    {"psymodel 4", 4, TWOLAME_JOINT_STEREO, 48000, 384, FALSE, 0, FALSE},
+    {"psymodel 4 LSF", 4, TWOLAME_STEREO, 22050, 96, FALSE, 0, FALSE},
+    {"psymodel 4 mono", 4, TWOLAME_MONO, 16000, 64, FALSE, 0, FALSE},
+    {"psymodel 4 VBR", 4, TWOLAME_STEREO, 48000, 0, FALSE, 0, FALSE},
+    {"psymodel 3 extras", 3, TWOLAME_JOINT_STEREO, 44100, 224, FALSE, 0, TRUE}
+};
+
+#define NUM_CASES   ((int) (sizeof(test_cases) / sizeof(test_cases[0])))
+
+
+static short pcm[NUM_SAMPLES * 2];
+static unsigned char reference[MP2_BUF_SIZE];
+static unsigned char segmented[MP2_BUF_SIZE];
+
+
+static twolame_options *setup(const test_case * tc)
+{
+    twolame_options *opts = twolame_init();
+
+    if (opts == NULL)
+        return NULL;
+
+    twolame_set_num_channels(opts, 2);
+    twolame_set_in_samplerate(opts, tc->samplerate);
+    twolame_set_psymodel(opts, tc->psymodel);
+    twolame_set_mode(opts, tc->mode);
+    if (tc->bitrate)
+        twolame_set_bitrate(opts, tc->bitrate);
+    else
+        twolame_set_VBR(opts, TRUE);
+    if (tc->padding)
+        twolame_set_padding(opts, TWOLAME_PAD_ALL);
+    if (tc->quickcount) {
+        twolame_set_quick_mode(opts, TRUE);
+        twolame_set_quick_count(opts, tc->quickcount);
+    }
+    if (tc->extras) {
+        twolame_set_error_protection(opts, TRUE);
+        twolame_set_copyright(opts, TRUE);
+        twolame_set_original(opts, FALSE);
+        twolame_set_emphasis(opts, TWOLAME_EMPHASIS_5);
+        twolame_set_energy_levels(opts, TRUE);
+        twolame_set_scale(opts, 0.8f);
+        twolame_set_scale_right(opts, 0.6f);
+        twolame_set_ATH_level(opts, 3.0f);
+        twolame_set_fast_db(opts, TRUE);
+    }
+    twolame_set_verbosity(opts, 0);
+    if (twolame_init_params(opts) != 0) {
+        twolame_close(&opts);
+        return NULL;
+    }
+
+    return opts;
+}
+
+
+/* Encode the test case in one go, returning the length of the stream or -1 */
+static int encode(const test_case * tc)
+{
+    twolame_options *opts = setup(tc);
+    int bytes, n;
+
+    if (opts == NULL)
+        return -1;
+
+    bytes = twolame_encode_buffer_interleaved(opts, pcm, NUM_SAMPLES, reference, MP2_BUF_SIZE);
+    n = (bytes < 0) ? -1 : twolame_encode_flush(opts, reference + bytes, MP2_BUF_SIZE - bytes);
+
+    twolame_close(&opts);
+    return (n < 0) ? -1 : bytes + n;
+}
+
+
+int main(void)
+{
+    static const int num_segments[] = { 1, 2, 3, 7, 40, 100 };
+    int failed = 0;
+    int c, i, s;
+
+    for (i = 0; i < NUM_SAMPLES * 2; i++) {
+        double x = 0.5 * sin(i * (0.0123 + 0.00001 * i)) + 0.25 * sin(i * 1.37);
+        pcm[i] = (short) (x * 32767.0 * (1.0 + sin(i * 0.0002)) * 0.5);
+    }
+
+    for (c = 0; c < NUM_CASES; c++) {
+        const test_case *tc = &test_cases[c];
+        int bytes = encode(tc);
+        twolame_options *opts = setup(tc);
+
+        if (bytes <= 0 || opts == NULL) {
+            printf("FAIL: %s: encoding failed\n", tc->name);
+            return 1;
+        }
+
+        // the options are not changed, so they encode all the streams
+        for (s = 0; s < (int) (sizeof(num_segments) / sizeof(num_segments[0])); s++) {
+            int n = twolame_encode_segments_interleaved(opts, pcm, NUM_SAMPLES, num_segments[s],
+                                                        segmented, MP2_BUF_SIZE);
+
+            if (n != bytes || memcmp(segmented, reference, bytes) != 0) {
+                printf("FAIL: %s: %d segments gave a different stream\n", tc->name,
+                       num_segments[s]);
+                failed++;
+            }
+        }
+
+        if (twolame_encode_segments_interleaved(opts, pcm, NUM_SAMPLES, 4, segmented, bytes - 1)
+                != TWOLAME_ERROR_BUFFER_FULL) {
+            printf("FAIL: %s: a stream larger than the buffer was not reported\n", tc->name);
+            failed++;
+        }
+
+        twolame_close(&opts);
+    }
+
+    if (failed)
+        return 1;
+
+    printf("ok: %d streams encoded in segments\n", NUM_CASES);
+    return 0;
+}
@@ -0,0 +1,256 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+  Check that each stream of a simulcast encoded with
+  twolame_encode_simulcast_interleaved() is exactly the stream
+  its encoder gives on its own, also after calls which failed as
+  one of the buffers was too short.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "twolame.h"
+
+#define NUM_SAMPLES     (1152 * 20 + 300)
+#define CHUNK           (1000)
+#define MP2_BUF_SIZE    (65536)
+#define NUM_ENCODERS    (5)
+
+
+typedef struct {
+    int bitrate;                // 0 for VBR
+    TWOLAME_MPEG_mode mode;
+    int padding;
+} output_settings;
+
+/* a ladder of bitrates, with different numbers of subbands */
+static const output_settings ladder[NUM_ENCODERS] = {
+    {64, TWOLAME_STEREO, FALSE},
+    {128, TWOLAME_JOINT_STEREO, FALSE},
+    {192, TWOLAME_STEREO, TRUE},
+    {256, TWOLAME_DUAL_CHANNEL, FALSE},
+    {0, TWOLAME_STEREO, FALSE}
+};
+
+typedef struct {
+    int psymodel;
+    int samplerate;
+    int quickcount;             // 0 without quick mode
+} test_case;
+
+static const test_case test_cases[] = {
+    {-1, 48000, 0},
+    {0, 48000, 0},
+    {1, 44100, 0},
+    {2, 48000, 0},
+    {3, 32000, 0},
+    {3, 44100, 5},
+    {4, 48000, 0},
+    {4, 44100, 3}
+};
+
+#define NUM_CASES   ((int) (sizeof(test_cases) / sizeof(test_cases[0])))
+
+
+static short pcm[NUM_SAMPLES * 2];
+static unsigned char reference[MP2_BUF_SIZE];
+static unsigned char streams[NUM_ENCODERS][MP2_BUF_SIZE];
+
+
+static twolame_options *setup(const test_case * tc, const output_settings * out)
+{
+    twolame_options *opts = twolame_init();
+
+    if (opts == NULL)
+        return NULL;
+
+    twolame_set_num_channels(opts, 2);
+    twolame_set_in_samplerate(opts, tc->samplerate);
+    twolame_set_psymodel(opts, tc->psymodel);
+    if (tc->quickcount) {
+        twolame_set_quick_mode(opts, TRUE);
+        twolame_set_quick_count(opts, tc->quickcount);
+    }
+    twolame_set_mode(opts, out->mode);
+    if (out->bitrate)
+        twolame_set_bitrate(opts, out->bitrate);
+    else
+        twolame_set_VBR(opts, TRUE);
+    if (out->padding)
+        twolame_set_padding(opts, TWOLAME_PAD_ALL);
+    twolame_set_verbosity(opts, 0);
+    if (twolame_init_params(opts) != 0) {
+        twolame_close(&opts);
+        return NULL;
+    }
+
+    return opts;
+}
+
+
+/* Encode the test case with one encoder on its own, returning the length of the stream or -1 */
+static int encode(const test_case * tc, const output_settings * out)
+{
+    twolame_options *opts = setup(tc, out);
+    int done, bytes = 0, n = 0;
+
+    if (opts == NULL)
+        return -1;
+
+    for (done = 0; done < NUM_SAMPLES && n >= 0; done += CHUNK) {
+        int chunk = (NUM_SAMPLES - done > CHUNK) ? CHUNK : NUM_SAMPLES - done;
+        n = twolame_encode_buffer_interleaved(opts, pcm + 2 * done, chunk, reference + bytes,
+                                              MP2_BUF_SIZE - bytes);
+        bytes += n;
+    }
+    if (n >= 0)
+        n = twolame_encode_flush(opts, reference + bytes, MP2_BUF_SIZE - bytes);
+
+    twolame_close(&opts);
+    return (n < 0) ? -1 : bytes + n;
+}
+
+
+/*
+  Encode the samples, or flush the encoders if pcm is NULL, with too
+  little space for a frame in the buffer of the last encoder. This must
+  fail without encoding anything, so that the streams are unchanged.
+  Returns 0 if it did.
+*/
+static int short_buffer(twolame_options * opts[], const short *pcm, int num_samples,
+                        unsigned char *mp2[], int mp2_size[])
+{
+    int sizes[NUM_ENCODERS], mp2_bytes[NUM_ENCODERS];
+    int e, result;
+
+    for (e = 0; e < NUM_ENCODERS; e++)
+        sizes[e] = mp2_size[e];
+    sizes[NUM_ENCODERS - 1] = 10;
+
+    if (pcm != NULL)
+        result = twolame_encode_simulcast_interleaved(opts, NUM_ENCODERS, pcm, num_samples,
+                                                      mp2, sizes, mp2_bytes);
+    else
+        result = twolame_encode_simulcast_flush(opts, NUM_ENCODERS, mp2, sizes, mp2_bytes);
+    if (result != TWOLAME_ERROR_BUFFER_FULL) {
+        printf("FAIL: a short buffer was not reported\n");
+        return -1;
+    }
+    for (e = 0; e < NUM_ENCODERS; e++) {
+        if (mp2_bytes[e] != 0) {
+            printf("FAIL: encoder %d wrote %d bytes into its buffer\n", e, mp2_bytes[e]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Encode the test case with all the encoders of the ladder at once into streams */
+static int encode_simulcast(const test_case * tc, int stream_bytes[NUM_ENCODERS])
+{
+    twolame_options *opts[NUM_ENCODERS];
+    unsigned char *mp2[NUM_ENCODERS];
+    int mp2_size[NUM_ENCODERS], mp2_bytes[NUM_ENCODERS];
+    int done, e, result = 0;
+
+    for (e = 0; e < NUM_ENCODERS; e++) {
+        opts[e] = setup(tc, &ladder[e]);
+        if (opts[e] == NULL)
+            result = -1;
+        stream_bytes[e] = 0;
+    }
+
+    for (done = 0; done < NUM_SAMPLES && result == 0; done += CHUNK) {
+        int chunk = (NUM_SAMPLES - done > CHUNK) ? CHUNK : NUM_SAMPLES - done;
+
+        for (e = 0; e < NUM_ENCODERS; e++) {
+            mp2[e] = streams[e] + stream_bytes[e];
+            mp2_size[e] = MP2_BUF_SIZE - stream_bytes[e];
+        }
+        if (done == 5 * CHUNK)
+            result = short_buffer(opts, pcm + 2 * done, chunk, mp2, mp2_size);
+        if (result == 0)
+            result = twolame_encode_simulcast_interleaved(opts, NUM_ENCODERS, pcm + 2 * done,
+                                                          chunk, mp2, mp2_size, mp2_bytes);
+        for (e = 0; e < NUM_ENCODERS && result == 0; e++)
+            stream_bytes[e] += mp2_bytes[e];
+    }
+    if (result == 0) {
+        for (e = 0; e < NUM_ENCODERS; e++) {
+            mp2[e] = streams[e] + stream_bytes[e];
+            mp2_size[e] = MP2_BUF_SIZE - stream_bytes[e];
+        }
+        result = short_buffer(opts, NULL, 0, mp2, mp2_size);
+        if (result == 0)
+            result = twolame_encode_simulcast_flush(opts, NUM_ENCODERS, mp2, mp2_size, mp2_bytes);
+        for (e = 0; e < NUM_ENCODERS && result == 0; e++)
+            stream_bytes[e] += mp2_bytes[e];
+    }
+
+    for (e = 0; e < NUM_ENCODERS; e++)
+        twolame_close(&opts[e]);
+    return result;
+}
+
+
+int main(void)
+{
+    int stream_bytes[NUM_ENCODERS];
+    int failed = 0;
+    int c, e, i;
+
+    for (i = 0; i < NUM_SAMPLES * 2; i++) {
+        double x = 0.5 * sin(i * (0.0123 + 0.00001 * i)) + 0.25 * sin(i * 1.37);
+        pcm[i] = (short) (x * 32767.0 * (1.0 + sin(i * 0.0002)) * 0.5);
+    }
+
+    for (c = 0; c < NUM_CASES; c++) {
+        const test_case *tc = &test_cases[c];
+
+        if (encode_simulcast(tc, stream_bytes) != 0) {
+            printf("FAIL: psymodel %d at %d Hz: simulcast failed\n", tc->psymodel,
+                   tc->samplerate);
+            return 1;
+        }
+        for (e = 0; e < NUM_ENCODERS; e++) {
+            int bytes = encode(tc, &ladder[e]);
+
+            if (bytes <= 0 || bytes != stream_bytes[e]
+                    || memcmp(streams[e], reference, bytes) != 0) {
+                printf("FAIL: psymodel %d at %d Hz: stream %d differs\n", tc->psymodel,
+                       tc->samplerate, e);
+                failed++;
+            }
+        }
+    }
+
+    if (failed)
+        return 1;
+
+    printf("ok: %d simulcasts of %d streams\n", NUM_CASES, NUM_ENCODERS);
+    return 0;
+}
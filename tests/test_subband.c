@@ -0,0 +1,100 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+  Check the fast DCT of the analysis filterbank against the
+  16x32 cosine matrix it replaces.
+*/
+
+#include <stdio.h>
+#include <math.h>
+
+#include "twolame.h"
+#include "common.h"
+#include "subband.h"
+
+#define NUM_FRAMES  (20)
+#ifdef SINGLE_PRECISION
+#define TOLERANCE   (1e-5)
+#else
+#define TOLERANCE   (1e-7)
+#endif
+
+
+/* Two tones plus pseudo-random noise, sometimes clipping */
+static short test_sample(long n)
+{
+    static unsigned long seed = 1;
+    double x;
+
+    seed = seed * 1103515245 + 12345;
+    x = 20000.0 * sin(n * 0.0123) + 9000.0 * sin(n * 1.37);
+    x += (double) ((seed >> 16) & 0x7fff) - 16384.0;
+
+    if (x > 32767.0)
+        return 32767;
+    if (x < -32768.0)
+        return -32768;
+    return (short) x;
+}
+
+
+int main(void)
+{
+    static subband_mem matrix, fast;
+    static FLOAT out_matrix[3][SCALE_BLOCK][SBLIMIT];
+    static FLOAT out_fast[3][SCALE_BLOCK][SBLIMIT];
+    FLOAT buffer[TWOLAME_SAMPLES_PER_FRAME];
+    FLOAT maxdiff = 0.0, maxval = 0.0;
+    long n = 0;
+    int frame, gr, bl, sb, i;
+
+    twolame_init_subband(&matrix, FALSE);
+    twolame_init_subband(&fast, TRUE);
+
+    for (frame = 0; frame < NUM_FRAMES; frame++) {
+        for (i = 0; i < TWOLAME_SAMPLES_PER_FRAME; i++)
+            buffer[i] = test_sample(n++);
+
+        twolame_window_filter_frame(&matrix, buffer, 0, out_matrix);
+        twolame_window_filter_frame(&fast, buffer, 0, out_fast);
+
+        for (gr = 0; gr < 3; gr++)
+            for (bl = 0; bl < SCALE_BLOCK; bl++)
+                for (sb = 0; sb < SBLIMIT; sb++) {
+                    FLOAT diff = fabs(out_matrix[gr][bl][sb] - out_fast[gr][bl][sb]);
+                    if (diff > maxdiff)
+                        maxdiff = diff;
+                    if (fabs(out_matrix[gr][bl][sb]) > maxval)
+                        maxval = fabs(out_matrix[gr][bl][sb]);
+                }
+    }
+
+    printf("largest subband sample: %g\n", (double) maxval);
+    printf("largest difference:     %g (tolerance %g)\n", (double) maxdiff, TOLERANCE);
+
+    if (maxval < 0.1 || !(maxdiff <= TOLERANCE)) {
+        printf("FAIL: fast DCT does not match the cosine matrix\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,233 @@
+/*
+ *  TwoLAME: an optimized MPEG Audio Layer Two encoder
+ *
+ *  Copyright (C) 2004-2018 The TwoLAME Project
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+  Check that encoders running at the same time in several threads
+  produce exactly the same streams as when they run one at a time,
+  also when each encoder pipelines its frames with
+  twolame_set_num_threads().
+
+  Each thread sets up, runs and closes encoders for all the test
+  cases, in a different order, so that the shared tables are built
+  and freed while other threads use them. The threads start before
+  anything else is encoded, so that the first use of any state of the
+  library is also concurrent. Configure with
+  CFLAGS=-fsanitize=thread LDFLAGS=-fsanitize=thread to also have
+  ThreadSanitizer look for data races.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "twolame.h"
+#include "config.h"
+
+#define EXIT_SKIP       (77)
+
+#define NUM_SAMPLES     (1152 * 12 + 500)
+#define MP2_BUF_SIZE    (16384)
+#define NUM_THREADS     (8)
+#define NUM_ROUNDS      (2)
+
+
+#ifdef HAVE_PTHREAD_H
+
+#include <pthread.h>
+
+typedef struct {
+    const char *name;
+    int psymodel;
+    TWOLAME_MPEG_mode mode;
+    int samplerate;
+    int bitrate;
+    int fast;                   // all the inexact fast paths
+    float spread_tolerance;
+    int vbr;
+} test_case;
+
+static const test_case test_cases[] = {
+    {"psymodel -1", -1, TWOLAME_STEREO, 44100, 192, FALSE, 0.0, FALSE},
+    {"psymodel 0", 0, TWOLAME_STEREO, 48000, 192, FALSE, 0.0, FALSE},
+    {"psymodel 1", 1, TWOLAME_JOINT_STEREO, 44100, 128, FALSE, 0.0, FALSE},
+    {"psymodel 1 LSF", 1, TWOLAME_STEREO, 22050, 96, FALSE, 0.0, FALSE},
+    {"psymodel 1 fast", 1, TWOLAME_STEREO, 44100, 160, TRUE, 0.0, FALSE},
+    {"psymodel 2", 2, TWOLAME_STEREO, 48000, 256, FALSE, 0.0, FALSE},
+    {"psymodel 2 fast", 2, TWOLAME_STEREO, 48000, 256, TRUE, 1e-3, FALSE},
+    {"psymodel 3", 3, TWOLAME_STEREO, 44100, 192, FALSE, 0.0, FALSE},
+    {"psymodel 3 fast", 3, TWOLAME_JOINT_STEREO, 32000, 160, TRUE, 0.0, FALSE},
+    {"psymodel 4", 4, TWOLAME_JOINT_STEREO, 44100, 128, FALSE, 0.0, FALSE},
+    {"psymodel 4 fast", 4, TWOLAME_STEREO, 24000, 96, TRUE, 1e-6, FALSE},
+    {"psymodel 4 mono", 4, TWOLAME_MONO, 16000, 64, FALSE, 0.0, FALSE},
+    {"psymodel 3 VBR", 3, TWOLAME_STEREO, 48000, 192, FALSE, 0.0, TRUE},
+    {"psymodel 4 VBR", 4, TWOLAME_STEREO, 44100, 192, FALSE, 0.0, TRUE}
+};
+
+#define NUM_CASES   ((int) (sizeof(test_cases) / sizeof(test_cases[0])))
+
+
+static short pcm[NUM_CASES][NUM_SAMPLES * 2];
+static unsigned char streams[NUM_THREADS][NUM_CASES][MP2_BUF_SIZE];
+static int stream_bytes[NUM_THREADS][NUM_CASES];
+static int failures[NUM_THREADS];
+
+
+/* Encode the audio of a test case into mp2 with num_threads threads,
+   returning its length or -1 */
+static int encode(int c, int num_threads, unsigned char *mp2)
+{
+    const test_case *tc = &test_cases[c];
+    twolame_options *opts = twolame_init();
+    int done = 0, bytes = 0, n;
+
+    if (opts == NULL)
+        return -1;
+
+    twolame_set_num_channels(opts, 2);
+    twolame_set_in_samplerate(opts, tc->samplerate);
+    twolame_set_psymodel(opts, tc->psymodel);
+    twolame_set_mode(opts, tc->mode);
+    twolame_set_bitrate(opts, tc->bitrate);
+    twolame_set_verbosity(opts, 0);
+    twolame_set_VBR(opts, tc->vbr);
+    twolame_set_num_threads(opts, num_threads);
+    if (tc->fast) {
+        twolame_set_fast_dct(opts, TRUE);
+        twolame_set_fast_fft(opts, TRUE);
+        twolame_set_fast_phase(opts, 2);
+        twolame_set_fast_db(opts, TRUE);
+    }
+    twolame_set_spreading_tolerance(opts, tc->spread_tolerance);
+    if (twolame_init_params(opts) != 0) {
+        twolame_close(&opts);
+        return -1;
+    }
+
+    while (done < NUM_SAMPLES) {
+        int chunk = (NUM_SAMPLES - done > 1000) ? 1000 : NUM_SAMPLES - done;
+
+        n = twolame_encode_buffer_interleaved(opts, pcm[c] + 2 * done, chunk,
+                                              mp2 + bytes, MP2_BUF_SIZE - bytes);
+        if (n < 0)
+            break;
+        bytes += n;
+        done += chunk;
+    }
+    n = (done == NUM_SAMPLES) ? twolame_encode_flush(opts, mp2 + bytes, MP2_BUF_SIZE - bytes) : -1;
+
+    twolame_close(&opts);
+    return (n < 0) ? -1 : bytes + n;
+}
+
+
+/* Encode all the cases NUM_ROUNDS times, keeping the streams of the first round.
+   The encoders of thread t run with 1 + t % 3 threads of their own. */
+static void *encode_thread(void *arg)
+{
+    int t = (int) (size_t) arg;
+    int num_threads = 1 + t % 3;
+    unsigned char *mp2 = (unsigned char *) malloc(MP2_BUF_SIZE);
+    int round, i;
+
+    if (mp2 == NULL) {
+        failures[t]++;
+        return NULL;
+    }
+
+    for (round = 0; round < NUM_ROUNDS; round++)
+        for (i = 0; i < NUM_CASES; i++) {
+            // each thread starts with a different case
+            int c = (i + t * 3 + round) % NUM_CASES;
+
+            if (round == 0) {
+                stream_bytes[t][c] = encode(c, num_threads, streams[t][c]);
+            } else {
+                int bytes = encode(c, num_threads, mp2);
+
+                if (bytes != stream_bytes[t][c] || memcmp(mp2, streams[t][c], bytes) != 0) {
+                    printf("FAIL: %s: thread %d gave different streams\n", test_cases[c].name, t);
+                    failures[t]++;
+                }
+            }
+        }
+
+    free(mp2);
+    return NULL;
+}
+
+
+int main(void)
+{
+    static unsigned char reference[MP2_BUF_SIZE];
+    pthread_t threads[NUM_THREADS];
+    int failed = 0;
+    int c, i, t;
+
+    for (c = 0; c < NUM_CASES; c++)
+        for (i = 0; i < NUM_SAMPLES * 2; i++) {
+            double x = 0.5 * sin(i * (0.0123 + 0.001 * c)) + 0.25 * sin(i * 1.37);
+            pcm[c][i] = (short) (x * 32767.0);
+        }
+
+    for (t = 0; t < NUM_THREADS; t++) {
+        if (pthread_create(&threads[t], NULL, encode_thread, (void *) (size_t) t) != 0) {
+            printf("FAIL: can't start thread %d\n", t);
+            return 1;
+        }
+    }
+    for (t = 0; t < NUM_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        failed += failures[t];
+    }
+
+    // compare with the streams of each case encoded one at a time
+    for (c = 0; c < NUM_CASES; c++) {
+        int bytes = encode(c, 1, reference);
+
+        if (bytes <= 0) {
+            printf("FAIL: %s: encoding failed\n", test_cases[c].name);
+            return 1;
+        }
+        for (t = 0; t < NUM_THREADS; t++) {
+            if (stream_bytes[t][c] != bytes || memcmp(streams[t][c], reference, bytes) != 0) {
+                printf("FAIL: %s: thread %d gave a different stream\n", test_cases[c].name, t);
+                failed++;
+            }
+        }
+    }
+
+    if (failed)
+        return 1;
+
+    printf("ok: %d threads encoded %d streams each\n", NUM_THREADS, NUM_ROUNDS * NUM_CASES);
+    return 0;
+}
+
+#else
+
+int main(void)
+{
+    printf("threads need pthreads\n");
+    return EXIT_SKIP;
+}
+
+#endif